@@ -108,59 +108,201 @@ void HAPClient::init(){
     LOG0("\nAccessory configuration number: %d\n",homeSpan.hapConfig.configNumber);
   }
 
+  if(homeSpan.cryptoTaskStack && !cryptoQueue){                                     // start crypto worker task
+    int core=homeSpan.cryptoTaskCore;
+    if(core<0)
+      core=(portNUM_PROCESSORS>1)?!xPortGetCoreID():0;                            // default to core not running poll task
+    cryptoQueue=xQueueCreate(CONFIG_LWIP_MAX_SOCKETS,sizeof(HAPClient *));        // each connection has at most one request pending
+    if(homeSpan.curveKeyDepth){                                                   // pool must be ready before worker starts, since worker begins filling it immediately
+      curveKeyPool=(curveKey_t *)HS_MALLOC(homeSpan.curveKeyDepth*sizeof(curveKey_t));
+      if(!curveKeyPool){
+        Serial.printf("\n\n*** FATAL ERROR: Requested allocation of %d bytes failed.  Program Halting.\n\n",homeSpan.curveKeyDepth*sizeof(curveKey_t));
+        while(1);
+      }
+      curveKeyMax=homeSpan.curveKeyDepth;
+    }
+    if(xTaskCreateUniversal(cryptoTask,"cryptoTask",homeSpan.cryptoTaskStack,NULL,homeSpan.cryptoTaskPriority,&cryptoTaskHandle,core)!=pdPASS){
+      LOG0("\n*** WARNING: Unable to start crypto worker task.  Pair-Setup and Pair-Verify will be performed on poll task.\n");
+      vQueueDelete(cryptoQueue);
+      cryptoQueue=NULL;
+      free(curveKeyPool);                                                         // pool is only filled by worker task
+      curveKeyPool=NULL;
+      curveKeyMax=0;
+    } else {
+      LOG0("\nCrypto worker task started on Core-%d with priority=%d\n",xTaskGetCoreID(cryptoTaskHandle),uxTaskPriorityGet(cryptoTaskHandle));
+    }
+  }
+
   LOG0("\n");
 
 }
 
 //////////////////////////////////////
 
-void HAPClient::processRequest(){
+void HAPClient::receive(){
 
-  int nBytes, messageSize;
+  cryptoStatus_t status=cryptoStatus.load(std::memory_order_acquire);
 
-  messageSize=client.available();        
+  if(status==CRYPTO_PENDING)                              // crypto worker is still processing prior pair-setup/pair-verify request - leave any further data unread until done
+    return;
 
-  if(messageSize>MAX_HTTP){                         // exceeded maximum number of bytes allowed
-    badRequestError();
-    LOG0("\n*** ERROR:  HTTP message of %d bytes exceeds maximum allowed (%d)\n\n",messageSize,MAX_HTTP);
+  boolean resumed=false;
+
+  if(status==CRYPTO_DONE){                                // crypto worker has finished prior request (acquire load above makes all of its results visible)
+    homeSpan.lastClientIP=client.remoteIP();
+    cryptoComplete();                                     // send response and apply results
+    homeSpan.lastClientIP=IPAddress();
+    if(!client.connected()){
+      rxReset();
+      return;
+    }
+    resumed=true;                                         // process any further messages that were already received
+  }
+
+  int avail=client.available();
+  boolean pending=(rxLen || rxAADLen || rxFrameLen);      // a partially-received message is already in progress
+
+  if(avail<=0 && !resumed){                               // no new data available
+    if(pending && millis()-rxTime>RX_TIMEOUT){            // partially-received message has stalled
+      LOG0("\n*** ERROR:  Timed out waiting for remainder of HTTP message (%d bytes received)\n\n",rxLen+rxAADLen+rxFrameLen);
+      rxReset();
+      badRequestError();
+    }
     return;
   }
- 
-  TempBuffer<uint8_t> httpBuf(messageSize+1);      // leave room for null character added below
-  
-  if(cPair){                                       // expecting encrypted message
-    LOG2("<<<< #### ");
-    LOG2(client.remoteIP());
-    LOG2(" #### <<<<\n");
 
-    nBytes=receiveEncrypted(httpBuf,messageSize);  // decrypt and return number of bytes read      
-        
-    if(!nBytes){                                   // decryption failed (error message already printed in function)
-      badRequestError();              
-      return;          
+  if(avail>0){
+
+    if(!pending)                                          // start of a new message
+      rxTime=millis();
+
+    if(cPair){                                            // expecting encrypted message
+      if(!receiveEncrypted(avail)){                       // decryption failed (error message already printed in function)
+        rxReset();
+        badRequestError();
+        return;
+      }
+    } else {                                              // expecting plaintext message
+      if(avail>MAX_HTTP-rxLen){                           // exceeded maximum number of bytes allowed
+        LOG0("\n*** ERROR:  HTTP message of %d bytes exceeds maximum allowed (%d)\n\n",rxLen+avail,MAX_HTTP);
+        rxReset();
+        badRequestError();
+        return;
+      }
+      rxGrow(rxLen+avail);
+      int n=client.read(rxBuf+rxLen,avail);
+      if(n>0){
+        rxLen+=n;
+        homeSpan.metrics.count(SpanMetrics::BYTES_RECEIVED,n);
+      }
     }
-        
-  } else {                                         // expecting plaintext message  
-    LOG2("<<<<<<<<< ");
-    LOG2(client.remoteIP());
-    LOG2(" <<<<<<<<<\n");
-    
-    nBytes=client.read(httpBuf,messageSize);       // read expected number of bytes
+  }
+
+  while(rxLen>0){                                         // process every complete HTTP message received so far
+
+    char *p=(char *)memmem(rxBuf,rxLen,"\r\n\r\n",4);
+    if(!p)                                                // blank line indicating end of HTTP header not yet received
+      return;
+
+    int hLen=p+4-(char *)rxBuf;                           // length of HTTP header, including blank line
+    int cLen=0;                                           // length of optional HTTP Content
 
-    if(nBytes!=messageSize || client.available()!=0){
+    *p='\0';                                              // temporarily null-terminate header so Content-Length search does not extend into Content
+    char *q=strstr((char *)rxBuf,"Content-Length: ");
+    boolean badLength=(q && (sscanf(q+16,"%d",&cLen)!=1 || cLen<0 || cLen>MAX_HTTP-hLen));
+    *p='\r';
+
+    if(badLength){
+      LOG0("\n*** ERROR: Invalid Content-Length\n\n");
+      rxReset();
       badRequestError();
-      LOG0("\n*** ERROR:  HTTP message not read correctly.  Expected %d bytes, read %d bytes, %d bytes remaining\n\n",messageSize,nBytes,client.available());
       return;
     }
-               
-  } // encrypted/plaintext
-      
+
+    int nBytes=hLen+cLen;                                 // total length of HTTP message
+    if(rxLen<nBytes)                                      // HTTP Content not yet fully received
+      return;
+
+    if(cPair){
+      LOG2("<<<< #### ");
+      LOG2(client.remoteIP());
+      LOG2(" #### <<<<\n");
+    } else {
+      LOG2("<<<<<<<<< ");
+      LOG2(client.remoteIP());
+      LOG2(" <<<<<<<<<\n");
+    }
+
+    uint8_t next=rxBuf[nBytes];                           // save first byte of any following data, since processRequest() adds a null terminator at this location
+
+    homeSpan.lastClientIP=client.remoteIP();              // store IP Address for web logging
+    reqMetric=SpanMetrics::REQ_ERROR;                     // changed by processRequest() if request is routed to a URL handler
+    int64_t startTime=esp_timer_get_time();
+    processRequest(rxBuf,nBytes);                         // PROCESS HAP REQUEST
+    uint32_t elapsed=esp_timer_get_time()-startTime;
+    homeSpan.metrics.record(reqMetric,elapsed);
+    homeSpan.lastClientIP=IPAddress();                    // reset stored IP address to show "0.0.0.0" if homeSpan.getClientIP() is used in any other context 
+
+    nRequests++;
+    requestTime+=elapsed;
+    if(elapsed>maxRequestTime)
+      maxRequestTime=elapsed;
+
+    if(!client.connected()){                              // connection was closed while processing request
+      rxReset();
+      return;
+    }
+
+    rxBuf[nBytes]=next;
+    rxLen-=nBytes;
+    memmove(rxBuf,rxBuf+nBytes,rxLen+rxFrameLen);         // shift any following data (including a partially-received encrypted frame) to start of buffer
+    rxTime=millis();
+
+    if(cryptoStatus.load(std::memory_order_relaxed)!=CRYPTO_IDLE)     // request was handed to crypto worker (which may already be done) - wait for it to be completed before processing any following messages
+      break;
+  }
+
+  if(!rxLen && !rxAADLen && !rxFrameLen)                  // nothing left pending
+    rxReset();
+}
+
+//////////////////////////////////////
+
+void HAPClient::rxGrow(int nBytes){
+
+  if(nBytes+1<=rxSize)                                    // include room for null terminator added by processRequest()
+    return;
+
+  rxBuf=(uint8_t *)HS_REALLOC(rxBuf,nBytes+1);
+  if(rxBuf==NULL){
+    Serial.printf("\n\n*** FATAL ERROR: Requested allocation of %d bytes failed.  Program Halting.\n\n",nBytes+1);
+    while(1);
+  }
+  rxSize=nBytes+1;
+}
+
+//////////////////////////////////////
+
+void HAPClient::rxReset(){
+
+  free(rxBuf);
+  rxBuf=NULL;
+  rxSize=0;
+  rxLen=0;
+  rxAADLen=0;
+  rxFrameLen=0;
+}
+
+//////////////////////////////////////
+
+void HAPClient::processRequest(uint8_t *httpBuf, int nBytes){
+
   httpBuf[nBytes]='\0';   // add null character to enable string functions
       
-  char *body=(char *)httpBuf.get();   // char pointer to start of HTTP Body
+  char *body=(char *)httpBuf;         // char pointer to start of HTTP Body
   char *p;                            // char pointer used for searches
      
-  if(!(p=strstr((char *)httpBuf.get(),"\r\n\r\n"))){
+  if(!(p=strstr(body,"\r\n\r\n"))){
     badRequestError();
     LOG0("\n*** ERROR:  Malformed HTTP request (can't find blank line indicating end of BODY)\n\n");
     return;      
@@ -194,14 +336,20 @@ void HAPClient::processRequest(){
       LOG0("\n*** ERROR:  HTTP POST request contains no Content\n\n");
     }
            
-    else if(!strncmp(body,"POST /pair-setup ",17) && strstr(body,"Content-Type: application/pairing+tlv8"))            // POST PAIR-SETUP               
+    else if(!strncmp(body,"POST /pair-setup ",17) && strstr(body,"Content-Type: application/pairing+tlv8")){           // POST PAIR-SETUP               
+      reqMetric=SpanMetrics::REQ_PAIR_SETUP;
       postPairSetupURL(content,cLen);
+    }
 
-    else if(!strncmp(body,"POST /pair-verify ",18) && strstr(body,"Content-Type: application/pairing+tlv8"))           // POST PAIR-VERIFY 
+    else if(!strncmp(body,"POST /pair-verify ",18) && strstr(body,"Content-Type: application/pairing+tlv8")){          // POST PAIR-VERIFY 
+      reqMetric=SpanMetrics::REQ_PAIR_VERIFY;
       postPairVerifyURL(content,cLen);
+    }
             
-    else if(!strncmp(body,"POST /pairings ",15) && strstr(body,"Content-Type: application/pairing+tlv8"))              // POST PAIRINGS                
+    else if(!strncmp(body,"POST /pairings ",15) && strstr(body,"Content-Type: application/pairing+tlv8")){             // POST PAIRINGS                
+      reqMetric=SpanMetrics::REQ_PAIRINGS;
       postPairingsURL(content,cLen);
+    }
 
     else {
       notFoundError();
@@ -222,11 +370,15 @@ void HAPClient::processRequest(){
     LOG2((char *)content);
     LOG2("\n------------ END JSON! ------------\n");    
            
-    if(!strncmp(body,"PUT /characteristics ",21) && strstr(body,"Content-Type: application/hap+json"))                 // PUT CHARACTERISTICS              
+    if(!strncmp(body,"PUT /characteristics ",21) && strstr(body,"Content-Type: application/hap+json")){                // PUT CHARACTERISTICS              
+      reqMetric=SpanMetrics::REQ_PUT_CHARS;
       putCharacteristicsURL((char *)content);
+    }
 
-    else if(!strncmp(body,"PUT /prepare ",13) && strstr(body,"Content-Type: application/hap+json"))                    // PUT PREPARE
+    else if(!strncmp(body,"PUT /prepare ",13) && strstr(body,"Content-Type: application/hap+json")){                   // PUT PREPARE
+      reqMetric=SpanMetrics::REQ_PUT_PREPARE;
       putPrepareURL((char *)content);
+    }
 
     else {
       notFoundError();
@@ -240,15 +392,29 @@ void HAPClient::processRequest(){
   if(!strncmp(body,"GET ",4)){                                                                                         // this is a GET request
 
     int refreshTime;
+    int dataFormat;
+    uint32_t since;
+    boolean statsOnly;
                     
-    if(!strncmp(body,"GET /accessories ",17))                                                                          // GET ACCESSORIES
+    if(!strncmp(body,"GET /accessories ",17)){                                                                         // GET ACCESSORIES
+      reqMetric=SpanMetrics::REQ_ACCESSORIES;
       getAccessoriesURL();
+    }
 
-    else if(!strncmp(body,"GET /characteristics?",21))                                                                 // GET CHARACTERISTICS
+    else if(!strncmp(body,"GET /characteristics?",21)){                                                                // GET CHARACTERISTICS
+      reqMetric=SpanMetrics::REQ_GET_CHARS;
       getCharacteristicsURL(body+21);
+    }
 
-    else if(homeSpan.webLog.isEnabled && (refreshTime=homeSpan.webLog.check(body+4))>=0)                               // OPTIONAL (NON-HAP) STATUS REQUEST
+    else if(homeSpan.webLog.isEnabled && (refreshTime=homeSpan.webLog.check(body+4))>=0){                              // OPTIONAL (NON-HAP) STATUS REQUEST
+      reqMetric=SpanMetrics::REQ_STATUS;
       getStatusURL(this,NULL,NULL,refreshTime);
+    }
+
+    else if(homeSpan.webLog.isEnabled && (dataFormat=homeSpan.webLog.checkData(body+4,since,statsOnly))>=0){         // OPTIONAL (NON-HAP) WEB LOG DATA REQUEST
+      reqMetric=SpanMetrics::REQ_STATUS_DATA;
+      getStatusData(dataFormat,since,statsOnly);
+    }
 
     else {
       notFoundError();
@@ -322,11 +488,8 @@ int HAPClient::unauthorizedError(){
 
 int HAPClient::postPairSetupURL(uint8_t *content, size_t len){
 
-  static SRP6A *srp=NULL;   // must persist across multiple calls to postPairSetupURL
-
   HAPTLV iosTLV;
   HAPTLV responseTLV;
-  HAPTLV subTLV;
 
   iosTLV.unpack(content,len);
   if(homeSpan.getLogLevel()>1)
@@ -334,12 +497,12 @@ int HAPClient::postPairSetupURL(uint8_t *content, size_t len){
   LOG2("------------ END TLVS! ------------\n");
 
   LOG1("In Pair Setup #%d (%s)...",clientNumber,client.remoteIP().toString().c_str());
-  
+
   auto itState=iosTLV.find(kTLVType_State);
 
   if(iosTLV.len(itState)!=1){                                   // missing STATE TLV
     LOG0("\n*** ERROR: Missing or invalid 'State' TLV\n\n");
-    badRequestError();                                          // return with 400 error, which closes connection      
+    badRequestError();                                          // return with 400 error, which closes connection
     return(0);
   }
 
@@ -353,6 +516,14 @@ int HAPClient::postPairSetupURL(uint8_t *content, size_t len){
     return(0);
   };
 
+  if(srpBusy){                                              // error: crypto worker is still processing a prior Pair-Setup step
+    LOG0("\n*** ERROR: Pair-Setup already in progress!\n\n");
+    responseTLV.add(kTLVType_State,tlvState+1);             // set response STATE to requested state+1 (which should match the state that was expected by the controller)
+    responseTLV.add(kTLVType_Error,tagError_Busy);          // set Error=Busy
+    tlvRespond(responseTLV);                                // send response to client
+    return(0);
+  };
+
   LOG1("Found <M%d>.  Expected <M%d>.\n",tlvState,pairStatus);
 
   if(tlvState!=pairStatus){                                         // error: Device is not yet paired, but out-of-sequence pair-setup STATE was received
@@ -363,212 +534,265 @@ int HAPClient::postPairSetupURL(uint8_t *content, size_t len){
     pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired accessory (M1)
     return(0);
   };
-   
+
   switch(tlvState){                                         // valid and in-sequence Pair-Setup STATE received -- process request!  (HAP Section 5.6)
 
     case pairState_M1:{                                     // 'SRP Start Request'
 
-      responseTLV.add(kTLVType_State,pairState_M2);                             // set State=<M2>
-
       auto itMethod=iosTLV.find(kTLVType_Method);
 
       if(iosTLV.len(itMethod)!=1 || itMethod->getVal()!=0){                     // error: "Pair Setup" method must always be 0 to indicate setup without MiFi Authentification (HAP Table 5-3)
         LOG0("\n*** ERROR: Pair 'Method' missing or not set to 0\n\n");
+        responseTLV.add(kTLVType_State,pairState_M2);                           // set State=<M2>
         responseTLV.add(kTLVType_Error,tagError_Unavailable);                   // set Error=Unavailable
         tlvRespond(responseTLV);                                                // send response to client
         return(0);
       };
 
-      auto itPublicKey=responseTLV.add(kTLVType_PublicKey,384,NULL);                // create blank PublicKey TLV with space for 384 bytes
-
-      if(srp==NULL)                                                                 // create instance of SRP (if not already created) to persist until Pairing-Setup M5 completes
+      if(srp==NULL)                                                             // create instance of SRP (if not already created) to persist until Pairing-Setup M5 completes
         srp=new SRP6A;
-        
-      TempBuffer<Verification> verifyData;                                          // retrieve verification data (should already be stored in NVS)
-      size_t len=verifyData.len();
-      nvs_get_blob(homeSpan.srpNVS,"VERIFYDATA",verifyData,&len);
 
-      responseTLV.add(kTLVType_Salt,16,verifyData.get()->salt);                     // write Salt from verification data into TLV
-      
-      srp->createPublicKey(verifyData,*itPublicKey);                                // create accessory Public Key from stored verification data and write result into PublicKey TLV
-      
-      tlvRespond(responseTLV);                                                      // send response to client
-      pairStatus=pairState_M3;                                                      // set next expected pair-state request from client
+      srpBusy=true;
+      cryptoSubmit(iosTLV,&HAPClient::srpStartCrypto,&HAPClient::setupComplete);
       return(1);
-    } 
+    }
     break;
 
     case pairState_M3:{                                     // 'SRP Verify Request'
 
-      responseTLV.add(kTLVType_State,pairState_M4);                     // set State=<M4>
-
       auto itPublicKey=iosTLV.find(kTLVType_PublicKey);
       auto itClientProof=iosTLV.find(kTLVType_Proof);
 
       if(iosTLV.len(itPublicKey)<=0 || iosTLV.len(itClientProof)!=64){
         LOG0("\n*** ERROR: One or both of the required 'PublicKey' and 'Proof' TLV records for this step is bad or missing\n\n");
+        responseTLV.add(kTLVType_State,pairState_M4);                   // set State=<M4>
         responseTLV.add(kTLVType_Error,tagError_Unknown);               // set Error=Unknown (there is no specific error type for missing/bad TLV data)
         tlvRespond(responseTLV);                                        // send response to client
         pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired
         return(0);
       };
 
-      srp->createSessionKey(*itPublicKey,itPublicKey->getLen());              // create session key, K, from client Public Key, A
-
-      if(!srp->verifyClientProof(*itClientProof)){                            // verify client Proof, M1
-        LOG0("\n*** ERROR: SRP Proof Verification Failed\n\n");
-        responseTLV.add(kTLVType_Error,tagError_Authentication);              // set Error=Authentication
-        tlvRespond(responseTLV);                                              // send response to client
-        pairStatus=pairState_M1;                                              // reset pairStatus to first step of unpaired
-        return(0);        
-      };
-
-      auto itAccProof=responseTLV.add(kTLVType_Proof,64,NULL);                // create blank accessory Proof TLV with space for 64 bytes
-
-      srp->createAccProof(*itAccProof);                                       // M1 has been successully verified; now create accessory Proof M2
-
-      tlvRespond(responseTLV);                                                // send response to client
-      pairStatus=pairState_M5;                                                // set next expected pair-state request from client
-     
-      return(1);        
+      srpBusy=true;
+      cryptoSubmit(iosTLV,&HAPClient::srpVerifyCrypto,&HAPClient::setupComplete);
+      return(1);
     }
     break;
-    
-    case pairState_M5:{                                     // 'Exchange Request'
 
-      responseTLV.add(kTLVType_State,pairState_M6);                     // set State=<M6>
+    case pairState_M5:{                                     // 'Exchange Request'
 
       auto itEncryptedData=iosTLV.find(kTLVType_EncryptedData);
 
-      if(iosTLV.len(itEncryptedData)<=0){            
+      if(iosTLV.len(itEncryptedData)<=crypto_aead_chacha20poly1305_IETF_ABYTES){
         LOG0("\n*** ERROR: Required 'EncryptedData' TLV record for this step is bad or missing\n\n");
+        responseTLV.add(kTLVType_State,pairState_M6);                   // set State=<M6>
         responseTLV.add(kTLVType_Error,tagError_Unknown);               // set Error=Unknown (there is no specific error type for missing/bad TLV data)
         tlvRespond(responseTLV);                                        // send response to client
         pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired
         return(0);
       };
 
-      // THIS NEXT STEP IS MISSING FROM HAP DOCUMENTATION!
-      //
-      // Must FIRST use HKDF to create a Session Key from the SRP Shared Secret for use in subsequent ChaCha20-Poly1305 decryption
-      // of the encrypted data TLV (HAP Sections 5.6.5.2 and 5.6.6.1).
-      //
-      // Note the SALT and INFO text fields used by HKDF to create this Session Key are NOT the same as those for creating iosDeviceX.
-      // The iosDeviceX HKDF calculations are separate and will be performed further below with the SALT and INFO as specified in the HAP docs.
+      srpBusy=true;
+      cryptoSubmit(iosTLV,&HAPClient::exchangeCrypto,&HAPClient::exchangeComplete);
+      return(1);
+    }
+    break;
 
-      HKDF::create(temp.sessionKey,srp->K,64,"Pair-Setup-Encrypt-Salt","Pair-Setup-Encrypt-Info");               // create SessionKey
+  } // switch
 
-      LOG2("------- DECRYPTING SUB-TLVS -------\n");
-      
-      // use SessionKey to decrypt encryptedData TLV with padded nonce="PS-Msg05"
-                                  
-      TempBuffer<uint8_t> decrypted(itEncryptedData->getLen()-crypto_aead_chacha20poly1305_IETF_ABYTES);  // temporary storage for decrypted data
-       
-      if(crypto_aead_chacha20poly1305_ietf_decrypt(decrypted, NULL, NULL, *itEncryptedData, itEncryptedData->getLen(), NULL, 0, (unsigned char *)"\x00\x00\x00\x00PS-Msg05", temp.sessionKey)==-1){          
-        LOG0("\n*** ERROR: Exchange-Request Authentication Failed\n\n");
-        responseTLV.add(kTLVType_Error,tagError_Authentication);        // set Error=Authentication
-        tlvRespond(responseTLV);                                        // send response to client
-        pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired
-        return(0);        
-      }
+  return(1);
 
-      subTLV.unpack(decrypted,decrypted.len());                         // unpack TLV      
-      if(homeSpan.getLogLevel()>1)
-        subTLV.print();                                                 // print decrypted TLV data
-      
-      LOG2("---------- END SUB-TLVS! ----------\n");
+} // postPairSetup
 
-      auto itIdentifier=subTLV.find(kTLVType_Identifier);
-      auto itSignature=subTLV.find(kTLVType_Signature);
-      auto itPublicKey=subTLV.find(kTLVType_PublicKey);
+//////////////////////////////////////
 
-      if(subTLV.len(itIdentifier)!=hap_controller_IDBYTES || subTLV.len(itSignature)!=crypto_sign_BYTES || subTLV.len(itPublicKey)!=crypto_sign_PUBLICKEYBYTES){ 
-        LOG0("\n*** ERROR: One or more of required 'Identifier,' 'PublicKey,' and 'Signature' TLV records for this step is bad or missing\n\n");
-        responseTLV.add(kTLVType_Error,tagError_Unknown);               // set Error=Unknown (there is no specific error type for missing/bad TLV data)
-        tlvRespond(responseTLV);                                        // send response to client
-        pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired
-        return(0);
-      };
+int HAPClient::srpStartCrypto(){
 
-      // Next, verify the authenticity of the TLV Records using the Signature provided by the Client.
-      // But the Client does not send the entire message that was used to generate the Signature.
-      // Rather, it purposely does not transmit "iosDeviceX", which is derived from the SRP Shared Secret that only the Client and this Server know.
-      // Note that the SALT and INFO text fields now match those in HAP Section 5.6.6.1
+  cryptoRsp.add(kTLVType_State,pairState_M2);                                   // set State=<M2>
 
-      TempBuffer<uint8_t> iosDeviceX(32);
-      HKDF::create(iosDeviceX,srp->K,64,"Pair-Setup-Controller-Sign-Salt","Pair-Setup-Controller-Sign-Info");     // derive iosDeviceX (32 bytes) from SRP Shared Secret using HKDF 
+  auto itPublicKey=cryptoRsp.add(kTLVType_PublicKey,384,NULL);                  // create blank PublicKey TLV with space for 384 bytes
 
-      // Concatenate iosDeviceX, IOS ID, and IOS PublicKey into iosDeviceInfo
-      
-      TempBuffer<uint8_t> iosDeviceInfo(iosDeviceX,iosDeviceX.len(),(uint8_t *)(*itIdentifier),itIdentifier->getLen(),(uint8_t *)(*itPublicKey),itPublicKey->getLen(),NULL);
+  TempBuffer<Verification> verifyData;                                          // retrieve verification data (should already be stored in NVS)
+  size_t len=verifyData.len();
+  nvs_get_blob(homeSpan.srpNVS,"VERIFYDATA",verifyData,&len);
 
-      if(crypto_sign_verify_detached(*itSignature, iosDeviceInfo, iosDeviceInfo.len(), *itPublicKey) != 0){      // verify signature of iosDeviceInfo using iosDeviceLTPK   
-        LOG0("\n*** ERROR: LPTK Signature Verification Failed\n\n");
-        responseTLV.add(kTLVType_Error,tagError_Authentication);        // set Error=Authentication
-        tlvRespond(responseTLV);                                        // send response to client
-        pairStatus=pairState_M1;                                        // reset pairStatus to first step of unpaired
-        return(0);                
-      }
+  cryptoRsp.add(kTLVType_Salt,16,verifyData.get()->salt);                       // write Salt from verification data into TLV
 
-      addController(*itIdentifier,*itPublicKey,true);                   // save Pairing ID and LTPK for this Controller with admin privileges
+  srp->createPublicKey(verifyData,*itPublicKey);                                // create accessory Public Key from stored verification data and write result into PublicKey TLV
 
-      // Now perform the above steps in reverse to securely transmit the AccessoryLTPK to the Controller (HAP Section 5.6.6.2)
+  return(1);
+}
 
-      TempBuffer<uint8_t> accessoryX(32);
-      HKDF::create(accessoryX,srp->K,64,"Pair-Setup-Accessory-Sign-Salt","Pair-Setup-Accessory-Sign-Info");       // derive accessoryX from SRP Shared Secret using HKDF 
-      
-      // Concatenate accessoryX, Accessory ID, and Accessory PublicKey into accessoryInfo
+//////////////////////////////////////
 
-      TempBuffer<uint8_t> accessoryInfo(accessoryX,accessoryX.len(),accessory.ID,hap_accessory_IDBYTES,accessory.LTPK,crypto_sign_PUBLICKEYBYTES,NULL);
+int HAPClient::srpVerifyCrypto(){
 
-      subTLV.clear();                                                                            // clear existing SUBTLV records
+  cryptoRsp.add(kTLVType_State,pairState_M4);                             // set State=<M4>
 
-      itSignature=subTLV.add(kTLVType_Signature,64,NULL);                                        // create blank Signature TLV with space for 64 bytes
+  auto itPublicKey=cryptoReq.find(kTLVType_PublicKey);
+  auto itClientProof=cryptoReq.find(kTLVType_Proof);
 
-      crypto_sign_detached(*itSignature,NULL,accessoryInfo,accessoryInfo.len(),accessory.LTSK);  // produce signature of accessoryInfo using AccessoryLTSK (Ed25519 long-term secret key)
+  srp->createSessionKey(*itPublicKey,itPublicKey->getLen());              // create session key, K, from client Public Key, A
 
-      subTLV.add(kTLVType_Identifier,hap_accessory_IDBYTES,accessory.ID);                        // set Identifier TLV record as accessoryPairingID
-      subTLV.add(kTLVType_PublicKey,crypto_sign_PUBLICKEYBYTES,accessory.LTPK);                  // set PublicKey TLV record as accessoryLTPK
+  if(!srp->verifyClientProof(*itClientProof)){                            // verify client Proof, M1
+    LOG0("\n*** ERROR: SRP Proof Verification Failed\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Authentication);                // set Error=Authentication
+    return(0);
+  };
 
-      LOG2("------- ENCRYPTING SUB-TLVS -------\n");
+  auto itAccProof=cryptoRsp.add(kTLVType_Proof,64,NULL);                  // create blank accessory Proof TLV with space for 64 bytes
 
-      if(homeSpan.getLogLevel()>1)
-        subTLV.print();
+  srp->createAccProof(*itAccProof);                                       // M1 has been successully verified; now create accessory Proof M2
 
-      TempBuffer<uint8_t> subPack(subTLV.pack_size());                                           // create sub-TLV by packing Identifier, PublicKey and Signature TLV records together
-      subTLV.pack(subPack);      
+  return(1);
+}
 
-      // Encrypt the subTLV data using the same SRP Session Key as above with ChaCha20-Poly1305
+//////////////////////////////////////
 
-      itEncryptedData=responseTLV.add(kTLVType_EncryptedData,subPack.len()+crypto_aead_chacha20poly1305_IETF_ABYTES,NULL);     //create blank EncryptedData TLV with space for subTLV + Authentication Tag
+int HAPClient::exchangeCrypto(){
 
-      crypto_aead_chacha20poly1305_ietf_encrypt(*itEncryptedData,NULL,subPack,subPack.len(),NULL,0,NULL,(unsigned char *)"\x00\x00\x00\x00PS-Msg06",temp.sessionKey);
-                                                   
-      LOG2("---------- END SUB-TLVS! ----------\n");
-      
-      tlvRespond(responseTLV);                              // send response to client
+  HAPTLV subTLV;
 
-      delete srp;                                           // delete SRP - no longer needed once pairing is completed
-      srp=NULL;                                             // reset to NULL
+  cryptoRsp.add(kTLVType_State,pairState_M6);                             // set State=<M6>
 
-      mdns_service_txt_item_set("_hap","_tcp","sf","0");    // broadcast new status
-      
-      LOG1("\n*** ACCESSORY PAIRED! ***\n");
+  auto itEncryptedData=cryptoReq.find(kTLVType_EncryptedData);
 
-      STATUS_UPDATE(on(),HS_PAIRED)      
-            
-      if(homeSpan.pairCallback)                             // if set, invoke user-defined Pairing Callback to indicate device has been paired
-        homeSpan.pairCallback(true);
-      
-      return(1);        
-    }       
-    break;
+  // THIS NEXT STEP IS MISSING FROM HAP DOCUMENTATION!
+  //
+  // Must FIRST use HKDF to create a Session Key from the SRP Shared Secret for use in subsequent ChaCha20-Poly1305 decryption
+  // of the encrypted data TLV (HAP Sections 5.6.5.2 and 5.6.6.1).
+  //
+  // Note the SALT and INFO text fields used by HKDF to create this Session Key are NOT the same as those for creating iosDeviceX.
+  // The iosDeviceX HKDF calculations are separate and will be performed further below with the SALT and INFO as specified in the HAP docs.
 
-  } // switch
+  HKDF::create(temp.sessionKey,srp->K,64,"Pair-Setup-Encrypt-Salt","Pair-Setup-Encrypt-Info");               // create SessionKey
+
+  LOG2("------- DECRYPTING SUB-TLVS -------\n");
+
+  // use SessionKey to decrypt encryptedData TLV with padded nonce="PS-Msg05"
+
+  TempBuffer<uint8_t> decrypted(itEncryptedData->getLen()-crypto_aead_chacha20poly1305_IETF_ABYTES);  // temporary storage for decrypted data
+
+  if(crypto_aead_chacha20poly1305_ietf_decrypt(decrypted, NULL, NULL, *itEncryptedData, itEncryptedData->getLen(), NULL, 0, (unsigned char *)"\x00\x00\x00\x00PS-Msg05", temp.sessionKey)==-1){
+    LOG0("\n*** ERROR: Exchange-Request Authentication Failed\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Authentication);          // set Error=Authentication
+    return(0);
+  }
+
+  subTLV.unpackView(decrypted,decrypted.len());                     // unpack TLV (records are views into decrypted, which remains valid while they are used)
+  if(homeSpan.getLogLevel()>1)
+    subTLV.print();                                                 // print decrypted TLV data
+
+  LOG2("---------- END SUB-TLVS! ----------\n");
+
+  auto itIdentifier=subTLV.find(kTLVType_Identifier);
+  auto itSignature=subTLV.find(kTLVType_Signature);
+  auto itPublicKey=subTLV.find(kTLVType_PublicKey);
+
+  if(subTLV.len(itIdentifier)!=hap_controller_IDBYTES || subTLV.len(itSignature)!=crypto_sign_BYTES || subTLV.len(itPublicKey)!=crypto_sign_PUBLICKEYBYTES){
+    LOG0("\n*** ERROR: One or more of required 'Identifier,' 'PublicKey,' and 'Signature' TLV records for this step is bad or missing\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Unknown);                 // set Error=Unknown (there is no specific error type for missing/bad TLV data)
+    return(0);
+  };
+
+  // Next, verify the authenticity of the TLV Records using the Signature provided by the Client.
+  // But the Client does not send the entire message that was used to generate the Signature.
+  // Rather, it purposely does not transmit "iosDeviceX", which is derived from the SRP Shared Secret that only the Client and this Server know.
+  // Note that the SALT and INFO text fields now match those in HAP Section 5.6.6.1
+
+  TempBuffer<uint8_t> iosDeviceX(32);
+  HKDF::create(iosDeviceX,srp->K,64,"Pair-Setup-Controller-Sign-Salt","Pair-Setup-Controller-Sign-Info");     // derive iosDeviceX (32 bytes) from SRP Shared Secret using HKDF
+
+  // Concatenate iosDeviceX, IOS ID, and IOS PublicKey into iosDeviceInfo
+
+  TempBuffer<uint8_t> iosDeviceInfo(iosDeviceX,iosDeviceX.len(),(uint8_t *)(*itIdentifier),itIdentifier->getLen(),(uint8_t *)(*itPublicKey),itPublicKey->getLen(),NULL);
+
+  if(crypto_sign_verify_detached(*itSignature, iosDeviceInfo, iosDeviceInfo.len(), *itPublicKey) != 0){      // verify signature of iosDeviceInfo using iosDeviceLTPK
+    LOG0("\n*** ERROR: LPTK Signature Verification Failed\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Authentication);          // set Error=Authentication
+    return(0);
+  }
+
+  memcpy(temp.iosID,*itIdentifier,hap_controller_IDBYTES);                  // save Pairing ID and LTPK for this Controller (added by exchangeComplete() on the poll task)
+  memcpy(temp.iosLTPK,*itPublicKey,crypto_sign_PUBLICKEYBYTES);
+
+  // Now perform the above steps in reverse to securely transmit the AccessoryLTPK to the Controller (HAP Section 5.6.6.2)
+
+  TempBuffer<uint8_t> accessoryX(32);
+  HKDF::create(accessoryX,srp->K,64,"Pair-Setup-Accessory-Sign-Salt","Pair-Setup-Accessory-Sign-Info");       // derive accessoryX from SRP Shared Secret using HKDF
+
+  // Concatenate accessoryX, Accessory ID, and Accessory PublicKey into accessoryInfo
+
+  TempBuffer<uint8_t> accessoryInfo(accessoryX,accessoryX.len(),accessory.ID,hap_accessory_IDBYTES,accessory.LTPK,crypto_sign_PUBLICKEYBYTES,NULL);
+
+  subTLV.clear();                                                                            // clear existing SUBTLV records
+
+  itSignature=subTLV.add(kTLVType_Signature,64,NULL);                                        // create blank Signature TLV with space for 64 bytes
+
+  crypto_sign_detached(*itSignature,NULL,accessoryInfo,accessoryInfo.len(),accessory.LTSK);  // produce signature of accessoryInfo using AccessoryLTSK (Ed25519 long-term secret key)
+
+  subTLV.add(kTLVType_Identifier,hap_accessory_IDBYTES,accessory.ID);                        // set Identifier TLV record as accessoryPairingID
+  subTLV.add(kTLVType_PublicKey,crypto_sign_PUBLICKEYBYTES,accessory.LTPK);                  // set PublicKey TLV record as accessoryLTPK
+
+  LOG2("------- ENCRYPTING SUB-TLVS -------\n");
+
+  if(homeSpan.getLogLevel()>1)
+    subTLV.print();
+
+  TempBuffer<uint8_t> subPack(subTLV.pack_size());                                           // create sub-TLV by packing Identifier, PublicKey and Signature TLV records together
+  subTLV.pack(subPack);
+
+  // Encrypt the subTLV data using the same SRP Session Key as above with ChaCha20-Poly1305
+
+  itEncryptedData=cryptoRsp.add(kTLVType_EncryptedData,subPack.len()+crypto_aead_chacha20poly1305_IETF_ABYTES,NULL);     //create blank EncryptedData TLV with space for subTLV + Authentication Tag
+
+  crypto_aead_chacha20poly1305_ietf_encrypt(*itEncryptedData,NULL,subPack,subPack.len(),NULL,0,NULL,(unsigned char *)"\x00\x00\x00\x00PS-Msg06",temp.sessionKey);
+
+  LOG2("---------- END SUB-TLVS! ----------\n");
 
   return(1);
+}
 
-} // postPairSetup
+//////////////////////////////////////
+
+void HAPClient::setupComplete(int success){
+
+  srpBusy=false;
+  tlvRespond(cryptoRsp);                                                        // send response to client
+
+  if(success)
+    pairStatus=(pairState)(cryptoRsp.find(kTLVType_State)->getVal()+1);        // set next expected pair-state request from client
+  else
+    pairStatus=pairState_M1;                                                    // reset pairStatus to first step of unpaired
+}
+
+//////////////////////////////////////
+
+void HAPClient::exchangeComplete(int success){
+
+  srpBusy=false;
+
+  if(!success){
+    tlvRespond(cryptoRsp);                  // send response to client
+    pairStatus=pairState_M1;                // reset pairStatus to first step of unpaired
+    return;
+  }
+
+  addController(temp.iosID,temp.iosLTPK,true);          // save Pairing ID and LTPK for this Controller with admin privileges
+
+  tlvRespond(cryptoRsp);                                // send response to client
+
+  delete srp;                                           // delete SRP - no longer needed once pairing is completed
+  srp=NULL;                                             // reset to NULL
+
+  mdns_service_txt_item_set("_hap","_tcp","sf","0");    // broadcast new status
+
+  LOG1("\n*** ACCESSORY PAIRED! ***\n");
+
+  STATUS_UPDATE(on(),HS_PAIRED)
+
+  if(homeSpan.pairCallback)                             // if set, invoke user-defined Pairing Callback to indicate device has been paired
+    homeSpan.pairCallback(true);
+}
 
 //////////////////////////////////////
 
@@ -584,12 +808,12 @@ int HAPClient::postPairVerifyURL(uint8_t *content, size_t len){
   LOG2("------------ END TLVS! ------------\n");
 
   LOG1("In Pair Verify #%d (%s)...",clientNumber,client.remoteIP().toString().c_str());
-  
+
   auto itState=iosTLV.find(kTLVType_State);
 
   if(iosTLV.len(itState)!=1){                                   // missing STATE TLV
     LOG0("\n*** ERROR: Missing or invalid 'State' TLV\n\n");
-    badRequestError();                                          // return with 400 error, which closes connection      
+    badRequestError();                                          // return with 400 error, which closes connection
     return(0);
   }
 
@@ -611,56 +835,25 @@ int HAPClient::postPairVerifyURL(uint8_t *content, size_t len){
 
       auto itPublicKey=iosTLV.find(kTLVType_PublicKey);
 
-      if(iosTLV.len(itPublicKey)!=crypto_box_PUBLICKEYBYTES){            
+      if(iosTLV.len(itPublicKey)!=crypto_box_PUBLICKEYBYTES){
         LOG0("\n*** ERROR: Required 'PublicKey' TLV record for this step is bad or missing\n\n");
         responseTLV.add(kTLVType_State,pairState_M2);        // set State=<M2>
         responseTLV.add(kTLVType_Error,tagError_Unknown);    // set Error=Unknown (there is no specific error type for missing/bad TLV data)
         tlvRespond(responseTLV);                             // send response to client
-        return(0);        
+        return(0);
       }
 
-      TempBuffer<uint8_t> secretCurveKey(crypto_box_SECRETKEYBYTES);                // temporary space - used only in this block     
-      crypto_box_keypair(temp.publicCurveKey,secretCurveKey);                       // generate Accessory's random Curve25519 Public/Secret Key Pair
-
       memcpy(temp.iosCurveKey,*itPublicKey,crypto_box_PUBLICKEYBYTES);              // save Controller's Curve25519 Public Key
-            
-      // concatenate Accessory's Curve25519 Public Key, Accessory's Pairing ID, and Controller's Curve25519 Public Key into accessoryInfo
-      
-      TempBuffer<uint8_t> accessoryInfo(temp.publicCurveKey,crypto_box_PUBLICKEYBYTES,accessory.ID,hap_accessory_IDBYTES,temp.iosCurveKey,crypto_box_PUBLICKEYBYTES,NULL);
-
-      subTLV.add(kTLVType_Identifier,hap_accessory_IDBYTES,accessory.ID);                         // set Identifier subTLV record as Accessory's Pairing ID
-      auto itSignature=subTLV.add(kTLVType_Signature,crypto_sign_BYTES,NULL);                     // create blank Signature subTLV
-      crypto_sign_detached(*itSignature,NULL,accessoryInfo,accessoryInfo.len(),accessory.LTSK);   // produce Signature of accessoryInfo using Accessory's LTSK
 
-      LOG2("------- ENCRYPTING SUB-TLVS -------\n");
-
-      if(homeSpan.getLogLevel()>1)
-        subTLV.print();
-
-      TempBuffer<uint8_t> subPack(subTLV.pack_size());                                                    // create sub-TLV by packing Identifier and Signature TLV records together
-      subTLV.pack(subPack);                                
-
-      crypto_scalarmult_curve25519(temp.sharedCurveKey,secretCurveKey,temp.iosCurveKey);                  // generate Shared-Secret Curve25519 Key from Accessory's Curve25519 Secret Key and Controller's Curve25519 Public Key
-
-      HKDF::create(temp.sessionKey,temp.sharedCurveKey,crypto_box_PUBLICKEYBYTES,"Pair-Verify-Encrypt-Salt","Pair-Verify-Encrypt-Info");   // create Session Curve25519 Key from Shared-Secret Curve25519 Key using HKDF-SHA-512  
-
-      auto itEncryptedData=responseTLV.add(kTLVType_EncryptedData,subPack.len()+crypto_aead_chacha20poly1305_IETF_ABYTES,NULL);                                         // create blank EncryptedData subTLV
-      crypto_aead_chacha20poly1305_ietf_encrypt(*itEncryptedData,NULL,subPack,subPack.len(),NULL,0,NULL,(unsigned char *)"\x00\x00\x00\x00PV-Msg02",temp.sessionKey);   // encrypt data with Session Curve25519 Key and padded nonce="PV-Msg02"
-                                            
-      LOG2("---------- END SUB-TLVS! ----------\n");
-      
-      responseTLV.add(kTLVType_State,pairState_M2);                                        // set State=<M2>
-      responseTLV.add(kTLVType_PublicKey,crypto_box_PUBLICKEYBYTES,temp.publicCurveKey);        // set PublicKey to Accessory's Curve25519 Public Key
-    
-      tlvRespond(responseTLV);                                      // send response to client  
+      cryptoSubmit(iosTLV,&HAPClient::verifyStartCrypto,&HAPClient::respondComplete);
     }
-    break;  
-   
+    break;
+
     case pairState_M3:{                     // 'Verify Finish Request'
 
       auto itEncryptedData=iosTLV.find(kTLVType_EncryptedData);
 
-      if(iosTLV.len(itEncryptedData)<=0){            
+      if(iosTLV.len(itEncryptedData)<=crypto_aead_chacha20poly1305_IETF_ABYTES){
         LOG0("\n*** ERROR: Required 'EncryptedData' TLV record for this step is bad or missing\n\n");
         responseTLV.add(kTLVType_State,pairState_M4);               // set State=<M4>
         responseTLV.add(kTLVType_Error,tagError_Unknown);           // set Error=Unknown (there is no specific error type for missing/bad TLV data)
@@ -673,25 +866,25 @@ int HAPClient::postPairVerifyURL(uint8_t *content, size_t len){
       // use Session Curve25519 Key (from previous step) to decrypt encrypytedData TLV with padded nonce="PV-Msg03"
 
       TempBuffer<uint8_t> decrypted((*itEncryptedData).getLen()-crypto_aead_chacha20poly1305_IETF_ABYTES);        // temporary storage for decrypted data
-      
-      if(crypto_aead_chacha20poly1305_ietf_decrypt(decrypted, NULL, NULL, *itEncryptedData, itEncryptedData->getLen(), NULL, 0, (unsigned char *)"\x00\x00\x00\x00PV-Msg03", temp.sessionKey)==-1){          
+
+      if(crypto_aead_chacha20poly1305_ietf_decrypt(decrypted, NULL, NULL, *itEncryptedData, itEncryptedData->getLen(), NULL, 0, (unsigned char *)"\x00\x00\x00\x00PV-Msg03", temp.sessionKey)==-1){
         LOG0("\n*** ERROR: Verify Authentication Failed\n\n");
         responseTLV.add(kTLVType_State,pairState_M4);               // set State=<M4>
         responseTLV.add(kTLVType_Error,tagError_Authentication);    // set Error=Authentication
         tlvRespond(responseTLV);                                    // send response to client
-        return(0);        
+        return(0);
       }
 
-      subTLV.unpack(decrypted,decrypted.len());                     // unpack TLV     
+      subTLV.unpack(decrypted,decrypted.len());                     // unpack TLV
       if(homeSpan.getLogLevel()>1)
         subTLV.print();                                             // print decrypted TLV data
-      
+
       LOG2("---------- END SUB-TLVS! ----------\n");
 
       auto itIdentifier=subTLV.find(kTLVType_Identifier);
       auto itSignature=subTLV.find(kTLVType_Signature);
 
-      if(subTLV.len(itIdentifier)!=hap_controller_IDBYTES || subTLV.len(itSignature)!=crypto_sign_BYTES){ 
+      if(subTLV.len(itIdentifier)!=hap_controller_IDBYTES || subTLV.len(itSignature)!=crypto_sign_BYTES){
         LOG0("\n*** ERROR: One or more of required 'Identifier,' and 'Signature' TLV records for this step is bad or missing\n\n");
         responseTLV.add(kTLVType_State,pairState_M4);               // set State=<M4>
         responseTLV.add(kTLVType_Error,tagError_Unknown);           // set Error=Unknown (there is no specific error type for missing/bad TLV data)
@@ -700,7 +893,7 @@ int HAPClient::postPairVerifyURL(uint8_t *content, size_t len){
       }
 
       Controller *tPair;                                            // temporary pointer to Controller
-      
+
       if(!(tPair=findController(*itIdentifier))){
         LOG1("\n*** WARNING: Unrecognized Controller ID: ");
         charPrintRow(*itIdentifier,hap_controller_IDBYTES,1);
@@ -715,41 +908,193 @@ int HAPClient::postPairVerifyURL(uint8_t *content, size_t len){
       charPrintRow(tPair->ID,hap_controller_IDBYTES,2);
       LOG2("...\n");
 
-      // concatenate Controller's Curve25519 Public Key (from previous step), Controller's Pairing ID, and Accessory's Curve25519 Public Key (from previous step) into iosDeviceInfo     
-
-      TempBuffer<uint8_t> iosDeviceInfo(temp.iosCurveKey,crypto_box_PUBLICKEYBYTES,tPair->ID,hap_controller_IDBYTES,temp.publicCurveKey,crypto_box_PUBLICKEYBYTES,NULL);
-      
-      if(crypto_sign_verify_detached(*itSignature, iosDeviceInfo, iosDeviceInfo.len(), tPair->LTPK) != 0){         // verify signature of iosDeviceInfo using Controller's LTPK   
-        LOG0("\n*** ERROR: LPTK Signature Verification Failed\n\n");
-        responseTLV.add(kTLVType_State,pairState_M4);               // set State=<M4>
-        responseTLV.add(kTLVType_Error,tagError_Authentication);    // set Error=Authentication
-        tlvRespond(responseTLV);                                    // send response to client
-        return(0);                
-      }
-
-      responseTLV.add(kTLVType_State,pairState_M4);                 // set State=<M4>
-      tlvRespond(responseTLV);                                      // send response to client (unencrypted since cPair=NULL)
+      memcpy(temp.iosID,tPair->ID,hap_controller_IDBYTES);          // copy Controller's ID and LTPK, since Controller list may change while signature is being verified
+      memcpy(temp.iosLTPK,tPair->LTPK,crypto_sign_PUBLICKEYBYTES);
 
-      cPair=tPair;        // save Controller for this connection slot - connection is now verified and should be encrypted going forward
-
-      HKDF::create(a2cKey,temp.sharedCurveKey,32,"Control-Salt","Control-Read-Encryption-Key");        // create AccessoryToControllerKey from (previously-saved) Shared-Secret Curve25519 Key (HAP Section 6.5.2)
-      HKDF::create(c2aKey,temp.sharedCurveKey,32,"Control-Salt","Control-Write-Encryption-Key");       // create ControllerToAccessoryKey from (previously-saved) Shared-Secret Curve25519 Key (HAP Section 6.5.2)
-      
-      a2cNonce.zero();         // reset Nonces for this session to zero
-      c2aNonce.zero();
-
-      LOG2("\n*** SESSION VERIFICATION COMPLETE *** \n");
+      cryptoSubmit(subTLV,&HAPClient::verifyFinishCrypto,&HAPClient::verifyComplete);
     }
     break;
-  
+
   } // switch
 
   return(1);
-  
+
 } // postPairVerify
 
 //////////////////////////////////////
 
+int HAPClient::verifyStartCrypto(){
+
+  HAPTLV subTLV;
+
+  TempBuffer<uint8_t> secretCurveKey(crypto_box_SECRETKEYBYTES);                // temporary space - used only in this block
+  getCurveKey(temp.publicCurveKey,secretCurveKey);                              // get Accessory's random Curve25519 Public/Secret Key Pair (pre-generated if available)
+
+  // concatenate Accessory's Curve25519 Public Key, Accessory's Pairing ID, and Controller's Curve25519 Public Key into accessoryInfo
+
+  TempBuffer<uint8_t> accessoryInfo(temp.publicCurveKey,crypto_box_PUBLICKEYBYTES,accessory.ID,hap_accessory_IDBYTES,temp.iosCurveKey,crypto_box_PUBLICKEYBYTES,NULL);
+
+  subTLV.add(kTLVType_Identifier,hap_accessory_IDBYTES,accessory.ID);                         // set Identifier subTLV record as Accessory's Pairing ID
+  auto itSignature=subTLV.add(kTLVType_Signature,crypto_sign_BYTES,NULL);                     // create blank Signature subTLV
+  crypto_sign_detached(*itSignature,NULL,accessoryInfo,accessoryInfo.len(),accessory.LTSK);   // produce Signature of accessoryInfo using Accessory's LTSK
+
+  LOG2("------- ENCRYPTING SUB-TLVS -------\n");
+
+  if(homeSpan.getLogLevel()>1)
+    subTLV.print();
+
+  TempBuffer<uint8_t> subPack(subTLV.pack_size());                                                    // create sub-TLV by packing Identifier and Signature TLV records together
+  subTLV.pack(subPack);
+
+  crypto_scalarmult_curve25519(temp.sharedCurveKey,secretCurveKey,temp.iosCurveKey);                  // generate Shared-Secret Curve25519 Key from Accessory's Curve25519 Secret Key and Controller's Curve25519 Public Key
+
+  HKDF::create(temp.sessionKey,temp.sharedCurveKey,crypto_box_PUBLICKEYBYTES,"Pair-Verify-Encrypt-Salt","Pair-Verify-Encrypt-Info");   // create Session Curve25519 Key from Shared-Secret Curve25519 Key using HKDF-SHA-512
+
+  auto itEncryptedData=cryptoRsp.add(kTLVType_EncryptedData,subPack.len()+crypto_aead_chacha20poly1305_IETF_ABYTES,NULL);                                           // create blank EncryptedData subTLV
+  crypto_aead_chacha20poly1305_ietf_encrypt(*itEncryptedData,NULL,subPack,subPack.len(),NULL,0,NULL,(unsigned char *)"\x00\x00\x00\x00PV-Msg02",temp.sessionKey);   // encrypt data with Session Curve25519 Key and padded nonce="PV-Msg02"
+
+  LOG2("---------- END SUB-TLVS! ----------\n");
+
+  cryptoRsp.add(kTLVType_State,pairState_M2);                                          // set State=<M2>
+  cryptoRsp.add(kTLVType_PublicKey,crypto_box_PUBLICKEYBYTES,temp.publicCurveKey);     // set PublicKey to Accessory's Curve25519 Public Key
+
+  return(1);
+}
+
+//////////////////////////////////////
+
+int HAPClient::verifyFinishCrypto(){
+
+  cryptoRsp.add(kTLVType_State,pairState_M4);                   // set State=<M4>
+
+  auto itSignature=cryptoReq.find(kTLVType_Signature);
+
+  // concatenate Controller's Curve25519 Public Key (from previous step), Controller's Pairing ID, and Accessory's Curve25519 Public Key (from previous step) into iosDeviceInfo
+
+  TempBuffer<uint8_t> iosDeviceInfo(temp.iosCurveKey,crypto_box_PUBLICKEYBYTES,temp.iosID,hap_controller_IDBYTES,temp.publicCurveKey,crypto_box_PUBLICKEYBYTES,NULL);
+
+  if(crypto_sign_verify_detached(*itSignature, iosDeviceInfo, iosDeviceInfo.len(), temp.iosLTPK) != 0){         // verify signature of iosDeviceInfo using Controller's LTPK
+    LOG0("\n*** ERROR: LPTK Signature Verification Failed\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Authentication);      // set Error=Authentication
+    return(0);
+  }
+
+  return(1);
+}
+
+//////////////////////////////////////
+
+void HAPClient::respondComplete(int success){
+
+  tlvRespond(cryptoRsp);                    // send response to client
+}
+
+//////////////////////////////////////
+
+void HAPClient::verifyComplete(int success){
+
+  Controller *tPair=NULL;
+
+  if(success && !(tPair=findController(temp.iosID))){               // Controller was removed while its signature was being verified
+    LOG0("\n*** ERROR: Controller removed during Pair-Verify\n\n");
+    cryptoRsp.add(kTLVType_Error,tagError_Authentication);          // set Error=Authentication
+  }
+
+  tlvRespond(cryptoRsp);                                            // send response to client (unencrypted since cPair=NULL)
+
+  if(!tPair)
+    return;
+
+  cPair=tPair;        // save Controller for this connection slot - connection is now verified and should be encrypted going forward
+
+  HKDF::create(a2cKey,temp.sharedCurveKey,32,"Control-Salt","Control-Read-Encryption-Key");        // create AccessoryToControllerKey from (previously-saved) Shared-Secret Curve25519 Key (HAP Section 6.5.2)
+  HKDF::create(c2aKey,temp.sharedCurveKey,32,"Control-Salt","Control-Write-Encryption-Key");       // create ControllerToAccessoryKey from (previously-saved) Shared-Secret Curve25519 Key (HAP Section 6.5.2)
+
+  a2cNonce.zero();         // reset Nonces for this session to zero
+  c2aNonce.zero();
+
+  LOG2("\n*** SESSION VERIFICATION COMPLETE *** \n");
+}
+
+//////////////////////////////////////
+
+void HAPClient::cryptoSubmit(HAPTLV &req, int (HAPClient::*work)(), void (HAPClient::*finish)(int)){
+
+  cryptoReq=std::move(req);                   // hand over request TLV records (and the arena holding their values) without copying
+  cryptoWork=work;
+  cryptoFinish=finish;
+
+  if(!cryptoQueue){                           // crypto worker is not running - perform all steps immediately on poll task
+    int64_t startTime=esp_timer_get_time();
+    cryptoResult=(this->*cryptoWork)();
+    cryptoElapsed=esp_timer_get_time()-startTime;
+    cryptoComplete();
+    return;
+  }
+
+  HAPClient *hc=this;
+  cryptoStatus.store(CRYPTO_PENDING,std::memory_order_relaxed);     // park connection until crypto worker is done (queue send orders this and the request data before the worker runs)
+  xQueueSend(cryptoQueue,&hc,portMAX_DELAY);
+}
+
+//////////////////////////////////////
+
+void HAPClient::cryptoComplete(){
+
+  homeSpan.metrics.record(isVerifyWork(cryptoWork)?SpanMetrics::VERIFY_CRYPTO:SpanMetrics::SETUP_CRYPTO,cryptoElapsed);     // statistics are only updated on poll task
+  cryptoJobs++;
+  cryptoTime+=cryptoElapsed;
+  if(cryptoElapsed>maxCryptoTime)
+    maxCryptoTime=cryptoElapsed;
+
+  (this->*cryptoFinish)(cryptoResult);
+  cryptoReq.wipe();
+  cryptoRsp.wipe();
+  cryptoStatus.store(CRYPTO_IDLE,std::memory_order_relaxed);
+}
+
+//////////////////////////////////////
+
+void HAPClient::cryptoTask(void *args){
+
+  HAPClient *hc;
+
+  for(;;){
+
+    boolean refill=(curveKeyCount<curveKeyMax);                                  // pool of ephemeral Curve25519 keys needs refilling
+
+    if(xQueueReceive(cryptoQueue,&hc,refill?0:portMAX_DELAY)!=pdTRUE){           // no requests are pending
+      crypto_box_keypair(curveKeyPool[curveKeyCount].publicKey,curveKeyPool[curveKeyCount].secretKey);      // add one key pair to pool (then check for requests again)
+      curveKeyCount++;
+      continue;
+    }
+
+    int64_t startTime=esp_timer_get_time();
+    hc->cryptoResult=(hc->*hc->cryptoWork)();
+    hc->cryptoElapsed=esp_timer_get_time()-startTime;
+    hc->cryptoStatus.store(CRYPTO_DONE,std::memory_order_release);     // signal poll task to complete request (release publishes cryptoResult, cryptoRsp, temp, etc. written above)
+  }
+}
+
+//////////////////////////////////////
+
+void HAPClient::getCurveKey(uint8_t *publicKey, uint8_t *secretKey){
+
+  if(!curveKeyCount){                                           // pool is empty (or not enabled)
+    curveKeyMisses++;
+    crypto_box_keypair(publicKey,secretKey);                    // generate new key pair
+    return;
+  }
+
+  curveKeyCount--;
+  curveKeyHits++;
+  memcpy(publicKey,curveKeyPool[curveKeyCount].publicKey,crypto_box_PUBLICKEYBYTES);
+  memcpy(secretKey,curveKeyPool[curveKeyCount].secretKey,crypto_box_SECRETKEYBYTES);
+  sodium_memzero(curveKeyPool+curveKeyCount,sizeof(curveKey_t));   // each key pair is used only once
+}
+
+//////////////////////////////////////
+
 int HAPClient::postPairingsURL(uint8_t *content, size_t len){
 
   if(!cPair){                       // unverified, unencrypted session
@@ -760,7 +1105,7 @@ int HAPClient::postPairingsURL(uint8_t *content, size_t len){
   HAPTLV iosTLV;
   HAPTLV responseTLV;
 
-  iosTLV.unpack(content,len);
+  iosTLV.unpackView(content,len);             // records are views into content, which remains valid until request is processed
   if(homeSpan.getLogLevel()>1)
     iosTLV.print();
   LOG2("------------ END TLVS! ------------\n");
@@ -893,15 +1238,15 @@ int HAPClient::getAccessoriesURL(){
 
   LOG1("In Get Accessories #%d (%s)...\n",clientNumber,client.remoteIP().toString().c_str());
 
+  hapOut.beginCapture();
   homeSpan.printfAttributes();
-  size_t nBytes=hapOut.getSize();
-  hapOut.flush();
+  size_t nBytes=hapOut.endCapture();
 
   LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",client.remoteIP().toString().c_str());
 
   hapOut.setLogLevel(2).setHapClient(this);    
   hapOut << "HTTP/1.1 200 OK\r\nContent-Type: application/hap+json\r\nContent-Length: " << nBytes << "\r\n\r\n";
-  homeSpan.printfAttributes();
+  hapOut.replay();
   hapOut.flush();
 
   LOG2("\n-------- SENT ENCRYPTED! --------\n");
@@ -969,13 +1314,13 @@ int HAPClient::getCharacteristicsURL(char *urlBuf){
 
   LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",client.remoteIP().toString().c_str());
 
+  hapOut.beginCapture();
   boolean statusFlag=homeSpan.printfAttributes(ids,numIDs,flags);     // get statusFlag returned to use below
-  size_t nBytes=hapOut.getSize();
-  hapOut.flush();
+  size_t nBytes=hapOut.endCapture();
 
   hapOut.setLogLevel(2).setHapClient(this);
   hapOut << "HTTP/1.1 " << (!statusFlag?"200 OK":"207 Multi-Status") << "\r\nContent-Type: application/hap+json\r\nContent-Length: " << nBytes << "\r\n\r\n";
-  homeSpan.printfAttributes(ids,numIDs,flags);
+  hapOut.replay();
   hapOut.flush();
 
   LOG2("\n-------- SENT ENCRYPTED! --------\n");
@@ -996,7 +1341,11 @@ int HAPClient::putCharacteristicsURL(char *json){
 
   SpanBufVec pVec;
    
-  if(!homeSpan.updateCharacteristics(json, pVec))         // perform update and check for success
+  int64_t startTime=esp_timer_get_time();
+  boolean success=homeSpan.updateCharacteristics(json, pVec);
+  homeSpan.metrics.record(SpanMetrics::UPDATE_CHARS,esp_timer_get_time()-startTime);
+
+  if(!success)                                            // check for successful update
     return(0);                                            // return if failed to update (error message will have been printed in update)
 
   boolean multiCast=false;
@@ -1014,13 +1363,13 @@ int HAPClient::putCharacteristicsURL(char *json){
         
   } else {                                                // multicast response is required
 
+    hapOut.beginCapture();
     homeSpan.printfAttributes(pVec);
-    size_t nBytes=hapOut.getSize();
-    hapOut.flush();
+    size_t nBytes=hapOut.endCapture();
   
     hapOut.setLogLevel(2).setHapClient(this);
     hapOut << "HTTP/1.1 207 Multi-Status\r\nContent-Type: application/hap+json\r\nContent-Length: " << nBytes << "\r\n\r\n";
-    homeSpan.printfAttributes(pVec);
+    hapOut.replay();
     hapOut.flush(); 
   }
 
@@ -1067,13 +1416,13 @@ int HAPClient::putPrepareURL(char *json){
 
   LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",client.remoteIP().toString().c_str());
 
+  hapOut.beginCapture();
   hapOut << "{\"status\":" << (int)status << "}";
-  size_t nBytes=hapOut.getSize();
-  hapOut.flush();
+  size_t nBytes=hapOut.endCapture();
 
   hapOut.setLogLevel(2).setHapClient(this);    
   hapOut << "HTTP/1.1 200 OK\r\nContent-Type: application/hap+json\r\nContent-Length: " << nBytes << "\r\n\r\n";
-  hapOut << "{\"status\":" << (int)status << "}";
+  hapOut.replay();
   hapOut.flush();
 
   LOG2("\n-------- SENT ENCRYPTED! --------\n");
@@ -1085,8 +1434,6 @@ int HAPClient::putPrepareURL(char *json){
 
 void HAPClient::getStatusURL(HAPClient *hapClient, void (*callBack)(const char *, void *), void *user_data, int refreshTime){
 
-  std::shared_lock readLock(homeSpan.webLog.mux);        // wait for mux to be unlocked, or already locked non-exclusively, and then lock *non-exclusively* to prevent writing in vLog
-
   char clocktime[33];
 
   if(homeSpan.webLog.timeInit){
@@ -1165,6 +1512,7 @@ void HAPClient::getStatusURL(HAPClient *hapClient, void (*callBack)(const char *
   
   hapOut << "<tr><td>HomeKit Status:</td><td>" << (HAPClient::nAdminControllers()?"PAIRED":"NOT PAIRED") << "</td></tr>\n";   
   hapOut << "<tr><td>Max Log Entries:</td><td>" << homeSpan.webLog.maxEntries << "</td></tr>\n"; 
+  hapOut << "<tr><td>Event Renders Saved:</td><td>" << homeSpan.eventRendersSaved << " in " << homeSpan.eventBatches << " batches (last batch: " << homeSpan.lastRendersSaved << ")</td></tr>\n";
 
   if(homeSpan.weblogCallback){
     String usrString;
@@ -1177,25 +1525,28 @@ void HAPClient::getStatusURL(HAPClient *hapClient, void (*callBack)(const char *
   
   if(homeSpan.webLog.maxEntries>0){
     hapOut << "<table class=tab2><tr><th>Entry</th><th>Up Time</th><th>Log Time</th><th>Client</th><th>Message</th></tr>\n";
-    int lastIndex=homeSpan.webLog.nEntries-homeSpan.webLog.maxEntries;
-    if(lastIndex<0)
-      lastIndex=0;
+    uint32_t nEntries=homeSpan.webLog.nEntries;                 // entries appended while page is being sent will appear on next refresh
+    uint32_t lastIndex=nEntries>homeSpan.webLog.maxEntries?nEntries-homeSpan.webLog.maxEntries:0;
+    SpanWebLog::entry_t entry;
+    TempBuffer<char> message(homeSpan.webLog.msgSize);        // storage for message text of each entry
+    entry.message=message;
     
-    for(int i=homeSpan.webLog.nEntries-1;i>=lastIndex;i--){
-      int index=i%homeSpan.webLog.maxEntries;
-      seconds=homeSpan.webLog.log[index].upTime/1e6;
+    for(uint32_t i=nEntries;i>lastIndex;i--){
+      if(!homeSpan.webLog.getEntry(i-1,entry))                   // skip entry if it was overwritten by a new entry (or is still being written)
+        continue;
+      seconds=entry.upTime/1e6;
       secs=seconds%60;
       mins=(seconds/=60)%60;
       hours=(seconds/=60)%24;
       days=(seconds/=24);   
       sprintf(uptime,"%d:%02d:%02d:%02d",days,hours,mins,secs);
 
-      if(homeSpan.webLog.log[index].clockTime.tm_year>0)
-        strftime(clocktime,sizeof(clocktime),"%c",&homeSpan.webLog.log[index].clockTime);
+      if(entry.clockTime.tm_year>0)
+        strftime(clocktime,sizeof(clocktime),"%c",&entry.clockTime);
       else
         sprintf(clocktime,"Unknown");        
       
-      hapOut << "<tr><td>" << i+1 << "</td><td>" << uptime << "</td><td>" << clocktime << "</td><td>" << homeSpan.webLog.log[index].clientIP.c_str() << "</td><td>" << homeSpan.webLog.log[index].message << "</td></tr>\n";
+      hapOut << "<tr><td>" << i << "</td><td>" << uptime << "</td><td>" << clocktime << "</td><td>" << entry.clientIP.toString().c_str() << "</td><td>" << entry.message << "</td></tr>\n";
     }
     hapOut << "</table>\n";
   }
@@ -1212,12 +1563,161 @@ void HAPClient::getStatusURL(HAPClient *hapClient, void (*callBack)(const char *
 
 //////////////////////////////////////
 
+void HAPClient::getStatusData(int format, uint32_t since, boolean statsOnly){
+
+  SpanWebLog &webLog=homeSpan.webLog;
+  uint32_t nEntries=webLog.nEntries;
+  uint32_t first=nEntries>webLog.maxEntries?nEntries-webLog.maxEntries:0;     // oldest entry still retained
+  if(since>first)                                                             // only send entries numbered above since (entries are numbered from 1)
+    first=since<nEntries?since:nEntries;
+
+  uint32_t upTime=esp_timer_get_time()/1000000;
+  time_t clockTime=webLog.timeInit?time(NULL):0;
+  SpanWebLog::entry_t entry;
+  TempBuffer<char> message(webLog.msgSize);                  // storage for message text of each entry
+  entry.message=message;
+
+  LOG1("In Get Status Data #%d (%s)...\n",clientNumber,client.remoteIP().toString().c_str());
+
+  hapOut.beginCapture();
+
+  if(format==SpanWebLog::DATA_METRICS){
+    SpanMetrics &metrics=homeSpan.metrics;
+    hapOut << "{\"upTime\":" << upTime << ",\"bucketLimits\":[";
+    for(int b=0;b<SpanMetrics::N_BUCKETS-1;b++)
+      hapOut << (b?",":"") << SpanMetrics::bucketLimit(b);
+    hapOut << "],\"latency\":{";
+    for(int h=0;h<SpanMetrics::N_HISTOGRAMS;h++){
+      hapOut << (h?",\"":"\"") << SpanMetrics::histNames[h] << "\":{\"count\":" << metrics.hist[h].count << ",\"total\":" << metrics.hist[h].total << ",\"max\":" << metrics.hist[h].max << ",\"buckets\":[";
+      for(int b=0;b<SpanMetrics::N_BUCKETS;b++)
+        hapOut << (b?",":"") << metrics.hist[h].bucket[b];
+      hapOut << "]}";
+    }
+    hapOut << "},\"counters\":{";
+    for(int c=0;c<SpanMetrics::N_COUNTERS;c++)
+      hapOut << (c?",\"":"\"") << SpanMetrics::counterNames[c] << "\":" << metrics.counter[c];
+    hapOut << "}}";
+  } else if(format==SpanWebLog::DATA_JSON){
+    hapOut << "{\"nEntries\":" << nEntries << ",\"maxEntries\":" << webLog.maxEntries << ",\"upTime\":" << upTime << ",\"clockTime\":" << clockTime;
+    if(!statsOnly){
+      hapOut << ",\"entries\":[";
+      boolean comma=false;
+      for(uint32_t i=first;i<nEntries;i++){
+        if(!webLog.getEntry(i,entry))                                         // skip entry if it was overwritten by a new entry (or is still being written)
+          continue;
+        hapOut << (comma?",[":"[") << i+1 << "," << (uint32_t)(entry.upTime/1000000) << "," << (entry.clockTime.tm_year>0?mktime(&entry.clockTime):0) << ",\"" << entry.clientIP.toString().c_str() << "\",\"";
+        for(const char *c=entry.message;*c;c++){
+          if(*c=='"' || *c=='\\'){
+            hapOut << '\\' << *c;
+          } else if((uint8_t)*c<0x20){
+            char u[7];
+            sprintf(u,"\\u%04x",*c);
+            hapOut << u;
+          } else {
+            hapOut << *c;
+          }
+        }
+        hapOut << "\"]";
+        comma=true;
+      }
+      hapOut << "]";
+    }
+    hapOut << "}";
+  } else {
+    if(statsOnly){
+      hapOut << "nEntries,maxEntries,upTime,clockTime\r\n" << nEntries << "," << webLog.maxEntries << "," << upTime << "," << clockTime << "\r\n";
+    } else {
+      hapOut << "entry,upTime,clockTime,client,message\r\n";
+      for(uint32_t i=first;i<nEntries;i++){
+        if(!webLog.getEntry(i,entry))
+          continue;
+        hapOut << i+1 << "," << (uint32_t)(entry.upTime/1000000) << "," << (entry.clockTime.tm_year>0?mktime(&entry.clockTime):0) << "," << entry.clientIP.toString().c_str() << ",\"";
+        for(const char *c=entry.message;*c;c++){
+          if(*c=='"')                                                         // quotes are escaped by doubling
+            hapOut << '"';
+          hapOut << *c;
+        }
+        hapOut << "\"\r\n";
+      }
+    }
+  }
+
+  size_t nBytes=hapOut.endCapture();
+
+  LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",client.remoteIP().toString().c_str());
+
+  hapOut.setLogLevel(2).setHapClient(this);
+  hapOut << "HTTP/1.1 200 OK\r\nContent-Type: " << (format==SpanWebLog::DATA_CSV?"text/csv":"application/json") << "\r\nContent-Length: " << nBytes << "\r\n\r\n";
+  hapOut.replay();
+  hapOut.flush();
+
+  LOG2("\n-------- SENT! --------\n");
+}
+
+//////////////////////////////////////
+
+void HAPClient::allocSlot(){
+
+  uint32_t freeSlots=~(slotsInUse|slotsStale);
+
+  if(!freeSlots && slotsStale){           // only stale slots are free - clear all of them from every Characteristic in a single pass
+    homeSpan.clearNotify(slotsStale);
+    slotsStale=0;
+    freeSlots=~slotsInUse;
+  }
+
+  if(!freeSlots){
+    LOG0("\n*** WARNING:  No subscription slots available for Client #%d.  Event Notifications will not be sent to this connection.\n\n",clientNumber);
+    return;
+  }
+
+  slot=__builtin_ctz(freeSlots);        // lowest free slot
+  slotsInUse|=(1UL<<slot);
+}
+
+//////////////////////////////////////
+
+void HAPClient::freeSlot(){
+
+  if(slot>=0){
+    slotsInUse&=~(1UL<<slot);
+    if(nSubscriptions)                  // slot is still set in the bitmask of each Characteristic this connection subscribed to
+      slotsStale|=(1UL<<slot);
+  }
+  slot=-1;
+  nSubscriptions=0;
+}
+
+//////////////////////////////////////
+
 void HAPClient::checkNotifications(){
 
-  if(!homeSpan.Notifications.empty()){       // if there are Notifications to process    
-    eventNotify(homeSpan.Notifications);     // transmit EVENT Notifications
-    homeSpan.Notifications.clear();          // clear Notifications vector
+  if(homeSpan.Notifications.empty())          // no Notifications to process
+    return;
+
+  unsigned long cTime=millis();
+  boolean ready=false;
+
+  for(auto &sb : homeSpan.Notifications){                                         // Notifications still within their Characteristic's minimum event interval are held (status TBD) so printfNotify() skips them
+    SpanCharacteristic *chr=sb.characteristic;
+    if(chr->minEventInterval && cTime-chr->eventTime<chr->minEventInterval){
+      sb.status=StatusCode::TBD;
+    } else {
+      sb.status=StatusCode::OK;
+      chr->eventTime=cTime;
+      chr->notifyPending=false;
+      homeSpan.eventsSent++;
+      ready=true;
+    }
   }
+
+  if(!ready)
+    return;
+
+  eventNotify(homeSpan.Notifications);       // transmit EVENT Notifications
+
+  auto &nv=homeSpan.Notifications;           // remove sent Notifications, keeping any that are held for a later poll (trailing-edge delivery of latest value)
+  nv.erase(std::remove_if(nv.begin(),nv.end(),[](const SpanBuf &sb){return(sb.status==StatusCode::OK);}),nv.end());
 }
 
 //////////////////////////////////////
@@ -1241,26 +1741,68 @@ void HAPClient::checkTimedWrites(){
 
 void HAPClient::eventNotify(SpanBufVec &pVec, HAPClient *ignore){
 
+  auto sameEvents=[&pVec](HAPClient *a, HAPClient *b){          // returns true if clients a and b are subscribed to exactly the same updated characteristics in pVec (and will therefore receive identical JSON)
+    for(auto const &sb : pVec)
+      if(sb.status==StatusCode::OK && sb.val && sb.characteristic->evList.has(a)!=sb.characteristic->evList.has(b))
+        return(false);
+    return(true);
+  };
+
+  int64_t startTime=esp_timer_get_time();
+
+  unsigned long queueTime=0;                            // earliest time any update in pVec was queued by setVal() (0 if none)
+  for(auto const &sb : pVec)
+    if(sb.status==StatusCode::OK && sb.queueTime && (!queueTime || sb.queueTime<queueTime))
+      queueTime=sb.queueTime;
+
+  uint32_t done=0;                                      // bitmask of subscription slots that have already been processed
+  int nClients=0;                                       // number of clients with subscriptions (each would otherwise require its own render)
+  int nRenders=0;                                       // number of distinct JSON bodies actually rendered
+
   for(auto it=homeSpan.hapList.begin(); it!=homeSpan.hapList.end(); ++it){          // loop over all connection slots
-    if(&(*it)!=ignore){                                                             // if NOT flagged to be ignored (in cases where it is the client making a PUT request)
+    if(&(*it)==ignore || !it->nSubscriptions || (done&(1UL<<it->slot)))            // skip client if flagged to be ignored (in cases where it is the client making a PUT request), if it has no subscriptions, or if already processed
+      continue;
+
+    hapOut.beginCapture();
+    homeSpan.printfNotify(pVec,&(*it));              // create JSON (which may be of zero length if there are no applicable notifications for this client)
+    size_t nBytes=hapOut.endCapture();
+    nRenders++;
 
-      homeSpan.printfNotify(pVec,&(*it));              // create JSON (which may be of zero length if there are no applicable notifications for this cNum)
-      size_t nBytes=hapOut.getSize();
-      hapOut.flush();
+    for(auto jt=it; jt!=homeSpan.hapList.end(); ++jt){                              // send same JSON to this client and all remaining clients with identical subscriptions
+      if(&(*jt)==ignore || !jt->nSubscriptions || (done&(1UL<<jt->slot)) || !sameEvents(&(*it),&(*jt)))
+        continue;
 
-      if(nBytes>0){                                    // if there ARE notifications to send to client cNum
+      done|=(1UL<<jt->slot);
+      nClients++;
+      
+      if(nBytes>0){                                    // if there ARE notifications to send to client
         
-        LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",it->client.remoteIP().toString().c_str());
+        LOG2("\n>>>>>>>>>> %s >>>>>>>>>>\n",jt->client.remoteIP().toString().c_str());
 
-        hapOut.setLogLevel(2).setHapClient(&(*it));    
+        uint64_t writeErrors=homeSpan.metrics.counter[SpanMetrics::WRITE_ERRORS];
+        hapOut.setLogLevel(2).setHapClient(&(*jt));    
         hapOut << "EVENT/1.0 200 OK\r\nContent-Type: application/hap+json\r\nContent-Length: " << nBytes << "\r\n\r\n";
-        homeSpan.printfNotify(pVec,&(*it));
+        hapOut.replay(true);                           // retain captured JSON for re-use with the next client in this group (each client is still encrypted with its own session key)
         hapOut.flush();
+        homeSpan.metrics.count(homeSpan.metrics.counter[SpanMetrics::WRITE_ERRORS]==writeErrors?SpanMetrics::EVENTS_SENT:SpanMetrics::EVENTS_DROPPED);
+
+        jt->nEvents++;
+        if(queueTime && millis()-queueTime>jt->maxEventLag)
+          jt->maxEventLag=millis()-queueTime;
 
         LOG2("\n-------- SENT ENCRYPTED! --------\n");
       }
     }
-  }         
+
+    hapOut.clearCapture();
+  }
+
+  if(nClients){                                         // only passes that notified at least one client are timed
+    homeSpan.metrics.record(SpanMetrics::EVENT_NOTIFY,esp_timer_get_time()-startTime);
+    homeSpan.eventBatches++;
+    homeSpan.eventRendersSaved+=nClients-nRenders;
+    homeSpan.lastRendersSaved=nClients-nRenders;
+  }
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -1268,9 +1810,9 @@ void HAPClient::eventNotify(SpanBufVec &pVec, HAPClient *ignore){
 
 void HAPClient::tlvRespond(TLV8 &tlv8){
 
+  hapOut.beginCapture();
   tlv8.osprint(hapOut);
-  size_t nBytes=hapOut.getSize();
-  hapOut.flush();
+  size_t nBytes=hapOut.endCapture();
   
   char *body;
   asprintf(&body,"HTTP/1.1 200 OK\r\nContent-Type: application/pairing+tlv8\r\nContent-Length: %d\r\n\r\n",nBytes);      // create Body with Content Length = size of TLV data
@@ -1282,7 +1824,7 @@ void HAPClient::tlvRespond(TLV8 &tlv8){
 
   hapOut.setHapClient(this);
   hapOut << body;
-  tlv8.osprint(hapOut);
+  hapOut.replay();
   hapOut.flush();
 
   if(!cPair)
@@ -1296,39 +1838,56 @@ void HAPClient::tlvRespond(TLV8 &tlv8){
 
 //////////////////////////////////////
 
-int HAPClient::receiveEncrypted(uint8_t *httpBuf, int messageSize){
-
-  uint8_t aad[2];
-  int nBytes=0;
+boolean HAPClient::receiveEncrypted(int nBytes){
 
-  while(client.read(aad,2)==2){    // read initial 2-byte AAD record
+  while(nBytes>0){
 
-    int n=aad[0]+aad[1]*256;                // compute number of bytes expected in message after decoding
-
-    if(n>messageSize-nBytes){      // exceeded maximum number of bytes allowed in plaintext message
-      LOG0("\n\n*** ERROR:  Decrypted message of %d + %d bytes exceeded maximum expected message length of %d bytes\n\n",nBytes,n,messageSize);
-      return(0);
+    if(rxAADLen<2){                                       // read initial 2-byte AAD record
+      int n=client.read(rxAAD+rxAADLen,2-rxAADLen);
+      if(n<=0)
+        break;
+      homeSpan.metrics.count(SpanMetrics::BYTES_RECEIVED,n);
+      rxAADLen+=n;
+      nBytes-=n;
+
+      int len=rxAAD[0]+rxAAD[1]*256;                      // compute number of bytes expected in frame after decoding
+      if(rxAADLen==2 && len>MAX_HTTP-rxLen){              // exceeded maximum number of bytes allowed in plaintext message
+        LOG0("\n\n*** ERROR:  Decrypted message of %d + %d bytes exceeded maximum allowed message length of %d bytes\n\n",rxLen,len,MAX_HTTP);
+        return(false);
       }
+      continue;
+    }
 
-    TempBuffer<uint8_t> tBuf(n+16);      // expected number of total bytes = n bytes in encoded message + 16 bytes for appended authentication tag      
+    int frameSize=rxAAD[0]+rxAAD[1]*256+16;              // expected number of total bytes = n bytes in encoded message + 16 bytes for appended authentication tag
+    rxGrow(rxLen+frameSize);                              // encrypted frame is stored directly after existing plaintext, and decrypted in place
 
-    if(client.read(tBuf,tBuf.len())!=tBuf.len()){      
-      LOG0("\n\n*** ERROR: Malformed encrypted message frame\n\n");
-      return(0);      
-    }                
+    int n=frameSize-rxFrameLen;                          // number of bytes remaining in frame
+    n=client.read(rxBuf+rxLen+rxFrameLen,nBytes<n?nBytes:n);
+    if(n<=0)
+      break;
+    homeSpan.metrics.count(SpanMetrics::BYTES_RECEIVED,n);
+    rxFrameLen+=n;
+    nBytes-=n;
 
-    if(crypto_aead_chacha20poly1305_ietf_decrypt(httpBuf+nBytes, NULL, NULL, tBuf, tBuf.len(), aad, 2, c2aNonce.get(), c2aKey)==-1){
+    if(rxFrameLen<frameSize)                              // wait for remainder of frame
+      continue;
+
+    int64_t startTime=esp_timer_get_time();
+    if(crypto_aead_chacha20poly1305_ietf_decrypt(rxBuf+rxLen, NULL, NULL, rxBuf+rxLen, frameSize, rxAAD, 2, c2aNonce.get(), c2aKey)==-1){
       LOG0("\n\n*** ERROR: Can't Decrypt Message\n\n");
-      return(0);        
+      return(false);        
     }
+    homeSpan.metrics.record(SpanMetrics::DECRYPT,esp_timer_get_time()-startTime);
 
     c2aNonce.inc();
 
-    nBytes+=n;          // increment total number of bytes in plaintext message
+    rxLen+=frameSize-16;        // increment total number of bytes in plaintext message
+    rxAADLen=0;
+    rxFrameLen=0;
     
   } // while
 
-  return(nBytes);
+  return(true);
     
 } // receiveEncrypted
 
@@ -1505,7 +2064,9 @@ void HAPClient::saveControllers(){
   std::copy(controllerList.begin(),controllerList.end(),tBuf.get());     // copy data from linked list to buffer
   
   nvs_set_blob(homeSpan.hapNVS,"CONTROLLERS",tBuf,tBuf.len());           // update data
+  int64_t startTime=esp_timer_get_time();
   nvs_commit(homeSpan.hapNVS);                                           // commit to NVS  
+  homeSpan.metrics.record(SpanMetrics::NVS_COMMIT,esp_timer_get_time()-startTime);
 }
 
 
@@ -1547,7 +2108,6 @@ HapOut::HapStreamBuffer::HapStreamBuffer(){
   const uint32_t caps=MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL;
 
   buffer=(char *)heap_caps_malloc(bufSize+1,caps);                                          // add 1 for adding null terminator when printing text
-  encBuf=(uint8_t *)heap_caps_malloc(bufSize+18,caps);                                      // 2-byte AAD + encrypted data + 16-byte authentication tag 
   hash=(uint8_t *)heap_caps_malloc(48,caps);                                                // space for SHA-384 hash output
   ctx = (mbedtls_sha512_context *)heap_caps_malloc(sizeof(mbedtls_sha512_context),caps);    // space for hash context
   
@@ -1555,6 +2115,8 @@ HapOut::HapStreamBuffer::HapStreamBuffer(){
   mbedtls_sha512_starts(ctx,1);             // start SHA-384 hash (note second argument=1)
   
   setp(buffer, buffer+bufSize-1);           // assign buffer pointers
+
+  setTxSize(DEFAULT_TX_BUFFER_SIZE);        // allocate staging buffer
 }
 
 //////////////////////////////////////
@@ -1563,14 +2125,19 @@ HapOut::HapStreamBuffer::~HapStreamBuffer(){
 
   sync();
   free(buffer);
-  free(encBuf);
+  free(txBuf);
   free(hash);
   free(ctx);
+  for(auto chunk : chunks)
+    free(chunk);
 }
 
 //////////////////////////////////////
 
 void HapOut::HapStreamBuffer::flushBuffer(){
+
+  if(capturing)                                   // captured data stays in chunk chain until replayed
+    return;
   
   int num=pptr()-pbase();
 
@@ -1588,23 +2155,34 @@ void HapOut::HapStreamBuffer::flushBuffer(){
     Serial.print(buffer);         
   }
   
-  if(hapClient!=NULL){
+  if(hapClient!=NULL && num>0){
+
+    size_t frameSize=hapClient->cPair?num+18:num;   // 2-byte AAD + encrypted data + 16-byte authentication tag if encrypted
+    
+    if(txLen+frameSize>txSize)                    // not enough room left in staging buffer for this frame
+      drainTx();
+    
+    uint8_t *frame=txBuf+txLen;
+    
     if(!hapClient->cPair){                        // if not encrypted 
-      hapClient->client.write(buffer,num);        // transmit data buffer
+      memcpy(frame,buffer,num);                   // stage data buffer
       
     } else {                                      // if encrypted
       
-      encBuf[0]=num%256;                          // store number of bytes that encrypts this frame (AAD bytes)
-      encBuf[1]=num/256;
-      crypto_aead_chacha20poly1305_ietf_encrypt(encBuf+2,NULL,(uint8_t *)buffer,num,encBuf,2,NULL,hapClient->a2cNonce.get(),hapClient->a2cKey);   // encrypt buffer with AAD prepended and authentication tag appended
-      
-      hapClient->client.write(encBuf,num+18);     // transmit encrypted frame
+      frame[0]=num%256;                           // store number of bytes that encrypts this frame (AAD bytes)
+      frame[1]=num/256;
+      int64_t startTime=esp_timer_get_time();
+      crypto_aead_chacha20poly1305_ietf_encrypt(frame+2,NULL,(uint8_t *)buffer,num,frame,2,NULL,hapClient->a2cNonce.get(),hapClient->a2cKey);   // encrypt buffer with AAD prepended and authentication tag appended
+      homeSpan.metrics.record(SpanMetrics::ENCRYPT,esp_timer_get_time()-startTime);
       hapClient->a2cNonce.inc();                  // increment nonce
     }
-    delay(1);
+    
+    txLen+=frameSize;
+    frameCount++;
   }
 
-  mbedtls_sha512_update(ctx,(uint8_t *)buffer,num);       // update hash
+  if(hashEnabled)
+    mbedtls_sha512_update(ctx,(uint8_t *)buffer,num);     // update hash
 
   pbump(-num);                                            // reset buffer pointers
 }
@@ -1612,6 +2190,18 @@ void HapOut::HapStreamBuffer::flushBuffer(){
 //////////////////////////////////////
         
 std::streambuf::int_type HapOut::HapStreamBuffer::overflow(std::streambuf::int_type c){
+
+  if(capturing){
+    if(pptr()==epptr()){                          // current chunk is full
+      byteCount+=bufSize;
+      nextChunk();
+    }
+    if(c!=EOF){
+      *pptr() = c;
+      pbump(1);
+    }
+    return(c);
+  }
   
   if(c!=EOF){
     *pptr() = c;
@@ -1627,6 +2217,7 @@ std::streambuf::int_type HapOut::HapStreamBuffer::overflow(std::streambuf::int_t
 int HapOut::HapStreamBuffer::sync(){
 
   flushBuffer();
+  drainTx();
   
   logLevel=255;
   hapClient=NULL;
@@ -1640,14 +2231,121 @@ int HapOut::HapStreamBuffer::sync(){
     callBackUserData=NULL;
   }
 
-  mbedtls_sha512_finish(ctx,hash);    // finish SHA-384 and store hash
-  mbedtls_sha512_starts(ctx,1);       // re-start hash for next time
+  if(hashEnabled){
+    mbedtls_sha512_finish(ctx,hash);    // finish SHA-384 and store hash
+    mbedtls_sha512_starts(ctx,1);       // re-start hash for next time
+    hashEnabled=false;
+  }
 
   return(0);
 }
 
 //////////////////////////////////////
 
+void HapOut::HapStreamBuffer::drainTx(){
+
+  if(hapClient!=NULL && txLen>0){
+    size_t nSent=hapClient->client.write(txBuf,txLen);    // transmit all staged frames in a single write
+    writeCount++;
+    homeSpan.metrics.count(SpanMetrics::BYTES_SENT,nSent);
+    if(nSent<txLen)
+      homeSpan.metrics.count(SpanMetrics::WRITE_ERRORS);
+  }
+  
+  txLen=0;
+}
+
+//////////////////////////////////////
+
+void HapOut::HapStreamBuffer::setTxSize(size_t nBytes){
+
+  if(nBytes<bufSize+18)                           // staging buffer must be able to hold at least one full encrypted frame
+    nBytes=bufSize+18;
+
+  drainTx();                                      // transmit any frames already staged before the buffer is replaced
+  free(txBuf);
+  txBuf=(uint8_t *)heap_caps_malloc(nBytes,MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL);     // note - must pull from INTERNAL heap only
+  if(txBuf==NULL){
+    Serial.printf("\n\n*** FATAL ERROR: Requested allocation of %d bytes failed.  Program Halting.\n\n",nBytes);
+    while(1);
+  }
+  txSize=nBytes;
+}
+
+//////////////////////////////////////
+
+void HapOut::HapStreamBuffer::nextChunk(){
+
+  if(nChunks==chunks.size()){                                   // no unused chunks remain in chain - add a new one
+    char *chunk=(char *)HS_MALLOC(bufSize);                     // captured data does not need to be in INTERNAL heap since it is copied into buffer before encryption
+    if(chunk==NULL){
+      Serial.printf("\n\n*** FATAL ERROR: Requested allocation of %d bytes failed.  Program Halting.\n\n",bufSize);
+      while(1);
+    }
+    chunks.push_back(chunk);
+  }
+
+  setp(chunks[nChunks],chunks[nChunks]+bufSize);               // use entire chunk (no null terminator needed)
+  nChunks++;
+}
+
+//////////////////////////////////////
+
+void HapOut::HapStreamBuffer::beginCapture(){
+
+  flushBuffer();                  // send any pending output before switching to chunk chain
+  capturing=true;
+  byteCount=0;
+  nChunks=0;
+  nextChunk();
+}
+
+//////////////////////////////////////
+
+size_t HapOut::HapStreamBuffer::endCapture(){
+
+  captureSize=byteCount+pptr()-pbase();
+  capturing=false;
+  byteCount=0;
+  setp(buffer, buffer+bufSize-1);           // re-assign normal buffer pointers
+
+  renderCount++;
+  renderBytes+=captureSize;
+  
+  return(captureSize);
+}
+
+//////////////////////////////////////
+
+void HapOut::HapStreamBuffer::replay(boolean retain){
+
+  size_t nBytes=captureSize;
+
+  for(int i=0;i<nChunks && nBytes>0;i++){
+    size_t n=nBytes>bufSize?bufSize:nBytes;
+    sputn(chunks[i],n);                     // stream chunk through normal buffer so it is printed, encrypted, transmitted, and hashed as usual
+    nBytes-=n;
+  }
+
+  if(!retain)
+    clearCapture();
+}
+
+//////////////////////////////////////
+
+void HapOut::HapStreamBuffer::clearCapture(){
+
+  while(chunks.size()>maxChunks){           // release any chunks beyond the number retained for re-use
+    free(chunks.back());
+    chunks.pop_back();
+  }
+
+  nChunks=0;
+  captureSize=0;
+}
+
+//////////////////////////////////////
+
 void HapOut::HapStreamBuffer::printFormatted(char *buf, size_t nChars, size_t nsp){
   
   for(int i=0;i<nChars;i++){
@@ -1690,4 +2388,18 @@ void HapOut::HapStreamBuffer::printFormatted(char *buf, size_t nChars, size_t ns
 pairState HAPClient::pairStatus;                        
 Accessory HAPClient::accessory;                         
 list<Controller, Mallocator<Controller>> HAPClient::controllerList;
+uint32_t HAPClient::slotsInUse=0;
+uint32_t HAPClient::slotsStale=0;
+SRP6A *HAPClient::srp=NULL;
+boolean HAPClient::srpBusy=false;
+QueueHandle_t HAPClient::cryptoQueue=NULL;
+TaskHandle_t HAPClient::cryptoTaskHandle=NULL;
+uint32_t HAPClient::cryptoJobs=0;
+uint64_t HAPClient::cryptoTime=0;
+uint32_t HAPClient::maxCryptoTime=0;
+HAPClient::curveKey_t *HAPClient::curveKeyPool=NULL;
+int HAPClient::curveKeyMax=0;
+int HAPClient::curveKeyCount=0;
+uint32_t HAPClient::curveKeyHits=0;
+uint32_t HAPClient::curveKeyMisses=0;
  
@@ -78,20 +78,71 @@ struct Accessory {
 
 struct HAPClient {
 
+  class HAPTLV : public TLV8 {   // dedicated class for HAP TLV8 records
+    public:
+      HAPTLV() : TLV8(HAP_Names,11){}
+  };
+
+  enum cryptoStatus_t : uint8_t {CRYPTO_IDLE, CRYPTO_PENDING, CRYPTO_DONE};
+
   // common structures and data shared across all HAP Clients
 
   static const int MAX_HTTP=8096;                     // max number of bytes allowed for HTTP message
+  static const uint32_t RX_TIMEOUT=10000;             // max time (in millis) allowed to receive the remainder of a partially-received HTTP message
   static const int MAX_CONTROLLERS=16;                // maximum number of paired controllers (HAP requires at least 16)
   static const int MAX_ACCESSORIES=150;               // maximum number of allowed Accessories (HAP limit=150)
   
   static pairState pairStatus;                                      // tracks pair-setup status
   static Accessory accessory;                                       // Accessory ID and Ed25519 public and secret keys - permanently stored
   static list<Controller, Mallocator<Controller>> controllerList;   // linked-list of Paired Controller IDs and ED25519 long-term public keys - permanently stored
+  static uint32_t slotsInUse;                                       // bitmask of subscription slots currently assigned to connections (limits EV subscriptions to 32 simultaneous connections)
+  static uint32_t slotsStale;                                       // bitmask of free slots that may still be set in Characteristic subscription bitmasks (cleared in bulk by allocSlot() before re-use)
+  static SRP6A *srp;                                                // SRP-6A structure used for Pair-Setup (must persist across multiple calls to postPairSetupURL)
+  static boolean srpBusy;                                           // true while a Pair-Setup step is being processed by the crypto worker
+
+  static QueueHandle_t cryptoQueue;                                 // queue of HAPClients with pending Pair-Setup/Pair-Verify cryptography (NULL if crypto worker task is not running)
+  static TaskHandle_t cryptoTaskHandle;                             // crypto worker task
+  static uint32_t cryptoJobs;                                       // number of Pair-Setup/Pair-Verify cryptography steps performed
+  static uint64_t cryptoTime;                                       // total time (in micros) spent performing those steps
+  static uint32_t maxCryptoTime;                                    // longest time (in micros) spent performing a single step
+
+  struct curveKey_t {
+    uint8_t publicKey[crypto_box_PUBLICKEYBYTES];                   // ephemeral Curve25519 Public Key
+    uint8_t secretKey[crypto_box_SECRETKEYBYTES];                   // ephemeral Curve25519 Secret Key
+  };
+
+  static curveKey_t *curveKeyPool;                                  // pool of ephemeral Curve25519 key pairs pre-generated by crypto worker task while idle (only accessed by crypto worker task)
+  static int curveKeyMax;                                           // capacity of pool (set when crypto worker task is started)
+  static int curveKeyCount;                                         // number of key pairs currently ready in pool
+  static uint32_t curveKeyHits;                                     // number of Pair-Verify requests that used a pre-generated key pair
+  static uint32_t curveKeyMisses;                                   // number of Pair-Verify requests that had to generate a key pair
 
   // individual structures and data defined for each Hap Client connection
   
   NetworkClient client;           // handle to client
   int clientNumber;               // client number
+  int slot=-1;                    // subscription slot (bit position in each Characteristic's subscription bitmask), or -1 if none available
+  uint16_t nSubscriptions=0;      // number of Characteristics for which this connection has subscribed to EV notifications
+
+  // Incoming HTTP messages are reassembled incrementally across polls, so requests split across TCP segments (or encrypted frames) are handled without blocking other clients
+
+  uint8_t *rxBuf=NULL;            // reassembly buffer for incoming HTTP message (allocated only while a message is being received)
+  int rxSize=0;                   // allocated size of rxBuf
+  int rxLen=0;                    // number of plaintext bytes currently in rxBuf
+  uint8_t rxAAD[2];               // 2-byte AAD (frame length) of encrypted frame currently being received
+  int rxAADLen=0;                 // number of AAD bytes received for current frame
+  int rxFrameLen=0;               // number of encrypted bytes (including 16-byte authentication tag) received for current frame, stored in rxBuf following the plaintext
+  unsigned long rxTime=0;         // time (in millis) that first byte of current HTTP message was received
+
+  // Per-connection performance statistics (reported by the 's' serial command).  These are the device-side measurements for load and soak tests;
+  // client-side latency, throughput, and EVENT lag for simulated Controllers are measured on the host by tests/host/sim.cpp.
+
+  uint32_t nRequests=0;           // number of HTTP requests processed
+  int reqMetric;                  // metrics histogram used to record processing time of current HTTP request
+  uint64_t requestTime=0;         // total time (in micros) spent processing requests
+  uint32_t maxRequestTime=0;      // longest time (in micros) spent processing a single request
+  uint32_t nEvents=0;             // number of EVENT messages sent
+  uint32_t maxEventLag=0;         // longest delay (in millis) between a Characteristic update being queued by setVal() and its EVENT being sent
   Controller *cPair=NULL;         // pointer to info on current, session-verified Paired Controller (NULL=un-verified, and therefore un-encrypted, connection)
    
   // These temporary Curve25519 keys are generated in the first call to pair-verify and used in the second call to pair-verify so must persist for a short period
@@ -101,7 +152,20 @@ struct HAPClient {
     uint8_t sharedCurveKey[crypto_box_PUBLICKEYBYTES];     // Shared-Secret Curve25519 Key derived from Accessory's Secret Key and Controller's Public Key
     uint8_t sessionKey[crypto_box_PUBLICKEYBYTES];         // Session Key Curve25519 (derived with various HKDF calls)
     uint8_t iosCurveKey[crypto_box_PUBLICKEYBYTES];        // Controller's Curve25519 Public Key    
+    uint8_t iosID[hap_controller_IDBYTES];                 // Controller's Pairing ID (being verified in pair-verify, or added in pair-setup)
+    uint8_t iosLTPK[crypto_sign_PUBLICKEYBYTES];           // Controller's Long Term Ed25519 Public Key (being verified in pair-verify, or added in pair-setup)
   } temp;
+
+  // Pair-Setup and Pair-Verify cryptography is performed on a separate crypto worker task (when enabled) so the poll task can continue serving other connections.
+  // While the worker is busy the connection is parked: no further data is read from it until the poll task completes the request and sends the response.
+
+  std::atomic<cryptoStatus_t> cryptoStatus{CRYPTO_IDLE};  // status of crypto step for this connection (CRYPTO_DONE is stored with release semantics so all results are visible once loaded with acquire)
+  int (HAPClient::*cryptoWork)();                       // crypto step to perform on worker task (may only use this connection's data, the SRP structure, and the Accessory keys); returns 1 on success, 0 on failure
+  void (HAPClient::*cryptoFinish)(int success);         // completion step to perform on poll task (sends response and updates any shared data)
+  int cryptoResult=0;                                   // return value of cryptoWork
+  uint32_t cryptoElapsed=0;                             // time (in micros) spent performing cryptoWork (recorded in metrics by poll task when request is completed)
+  HAPTLV cryptoReq;                                     // request TLV records handed to the crypto step
+  HAPTLV cryptoRsp;                                     // response TLV records produced by the crypto step
   
   // CurveKey and CurveKey Nonces are created once each new session is verified in /pair-verify.  Keys persist for as long as connection is open
   
@@ -112,9 +176,26 @@ struct HAPClient {
 
   // define member methods
 
-  void processRequest();                                      // process HAP request  
+  void receive();                                             // reads (and decrypts) all bytes currently available from client, and processes HTTP message once complete
+  void processRequest(uint8_t *httpBuf, int nBytes);          // process HAP request contained in httpBuf (must have room for null terminator at httpBuf[nBytes])
+  void rxGrow(int nBytes);                                    // ensures rxBuf can hold nBytes plus a null terminator
+  void rxReset();                                             // discards any partially-received HTTP message and frees rxBuf
+  void allocSlot();                                           // assigns a free subscription slot to this connection (if available)
+  void freeSlot();                                            // releases subscription slot of this connection (without clearing its subscriptions - see allocSlot())
   int postPairSetupURL(uint8_t *content, size_t len);         // POST /pair-setup (HAP Section 5.6)
   int postPairVerifyURL(uint8_t *content, size_t len);        // POST /pair-verify (HAP Section 5.7)
+  int srpStartCrypto();                                       // pair-setup M1->M2 crypto step (SRP public key)
+  int srpVerifyCrypto();                                      // pair-setup M3->M4 crypto step (SRP session key and proofs)
+  int exchangeCrypto();                                       // pair-setup M5->M6 crypto step (Controller signature verification and Accessory signature)
+  int verifyStartCrypto();                                    // pair-verify M1->M2 crypto step (Curve25519 key exchange and Accessory signature)
+  int verifyFinishCrypto();                                   // pair-verify M3->M4 crypto step (Controller signature verification)
+  void setupComplete(int success);                            // completes pair-setup M1 and M3 on poll task
+  void exchangeComplete(int success);                         // completes pair-setup M5 on poll task
+  void respondComplete(int success);                          // completes pair-verify M1 on poll task
+  void verifyComplete(int success);                           // completes pair-verify M3 on poll task
+  void cryptoSubmit(HAPTLV &req, int (HAPClient::*work)(), void (HAPClient::*finish)(int));    // hands req to crypto step and queues it for the crypto worker (or performs all steps immediately if worker is not running)
+  static boolean isVerifyWork(int (HAPClient::*work)()){return(work==&HAPClient::verifyStartCrypto || work==&HAPClient::verifyFinishCrypto);}    // true if work is a pair-verify (rather than pair-setup) crypto step
+  void cryptoComplete();                                      // performs completion step once crypto worker is done
   int postPairingsURL(uint8_t *content, size_t len);          // POST /pairings (HAP Sections 5.10-5.12)  
   int getAccessoriesURL();                                    // GET /accessories (HAP Section 6.6)
   int getCharacteristicsURL(char *urlBuf);                    // GET /characteristics (HAP Section 6.7.4)  
@@ -122,7 +203,7 @@ struct HAPClient {
   int putPrepareURL(char *json);                              // PUT /prepare (HAP Section 6.7.2.4)
 
   void tlvRespond(TLV8 &tlv8);                                // respond to client with HTTP OK header and all defined TLV data records
-  int receiveEncrypted(uint8_t *httpBuf, int messageSize);    // decrypt HTTP request (HAP Section 6.5)
+  boolean receiveEncrypted(int nBytes);                       // reads up to nBytes of encrypted frame data into rxBuf, decrypting each frame once complete (HAP Section 6.5); returns false on error
 
   int notFoundError();           // return 404 error
   int badRequestError();         // return 400 error
@@ -131,6 +212,8 @@ struct HAPClient {
   // define static methods
     
   static void init();            // initialize HAP after start-up
+  static void cryptoTask(void *args);     // crypto worker task
+  static void getCurveKey(uint8_t *publicKey, uint8_t *secretKey);     // retrieves ephemeral Curve25519 key pair from pool if available, else generates a new one
     
   static void hexPrintColumn(const uint8_t *buf, int n, int minLogLevel=0);            // prints 'n' bytes of *buf as HEX, one byte per row, subject to specified minimum log level
   static void hexPrintRow(const uint8_t *buf, int n, int minLogLevel=0);               // prints 'n' bytes of *buf as HEX, all on one row, subject to specified minimum log level
@@ -148,12 +231,8 @@ struct HAPClient {
   static void eventNotify(SpanBufVec &pVec, HAPClient *ignore=NULL);                   // transmits EVENT Notifications for SpanBuf objects with optional flag to ignore a specific client
 
   static void getStatusURL(HAPClient *, void (*)(const char *, void *), void *, int refreshTime=0);       // GET / status (an optional, non-HAP feature)
+  void getStatusData(int format, uint32_t since, boolean statsOnly);                                      // GET / status.json, status.csv, or status.metrics (an optional, non-HAP feature)
 
-  class HAPTLV : public TLV8 {   // dedicated class for HAP TLV8 records
-    public:
-      HAPTLV() : TLV8(HAP_Names,11){}
-  };
-  
 };
 
 /////////////////////////////////////////////////
@@ -166,8 +245,11 @@ class HapOut : public std::ostream {
   struct HapStreamBuffer : public std::streambuf {
 
     const size_t bufSize=1024;            // max allowed for HAP encrypted records
+    const size_t maxChunks=8;             // max number of capture chunks retained for re-use after a response is sent
     char *buffer;
-    uint8_t *encBuf;
+    uint8_t *txBuf=NULL;                  // staging buffer used to pack one or more (encrypted) HAP frames into a single client write
+    size_t txSize=0;                      // size of staging buffer
+    size_t txLen=0;                       // number of bytes currently in staging buffer
     HAPClient *hapClient=NULL;
     int logLevel=255;                     // default is NOT to print anything
     boolean enablePrettyPrint=false;
@@ -175,14 +257,31 @@ class HapOut : public std::ostream {
     size_t indent=0;
     uint8_t *hash;
     mbedtls_sha512_context *ctx;
+    boolean hashEnabled=false;            // default is NOT to hash output (only needed when computing configuration hash)
     void (*callBack)(const char *, void *)=NULL;
     void *callBackUserData = NULL;
+
+    vector<char *, Mallocator<char *>> chunks;   // reusable chain of bufSize-byte chunks used to capture a response body so it only needs to be rendered once
+    size_t nChunks=0;                     // number of chunks used by current capture
+    size_t captureSize=0;                 // total number of bytes in current capture
+    boolean capturing=false;              // true if output is being captured into chunks instead of being transmitted
+    uint32_t renderCount=0;               // number of response bodies rendered
+    uint64_t renderBytes=0;               // total bytes in response bodies rendered
+    uint32_t frameCount=0;                // number of HAP frames transmitted
+    uint32_t writeCount=0;                // number of client writes used to transmit those frames
   
     void flushBuffer();
     int_type overflow(int_type c) override;
     int sync() override; 
     size_t getSize(){return(byteCount+pptr()-pbase());}
     void printFormatted(char *buf, size_t nChars, size_t nsp);
+    void drainTx();
+    void setTxSize(size_t nBytes);
+    void nextChunk();
+    void beginCapture();
+    size_t endCapture();
+    void replay(boolean retain);
+    void clearCapture();
         
     HapStreamBuffer();
     ~HapStreamBuffer();
@@ -200,9 +299,20 @@ class HapOut : public std::ostream {
   HapOut& prettyPrint(){hapBuffer.enablePrettyPrint=true;hapBuffer.logLevel=0;return(*this);}
   HapOut& setCallback(void(*f)(const char *, void *)){hapBuffer.callBack=f;return(*this);}
   HapOut& setCallbackUserData(void *userData){hapBuffer.callBackUserData=userData;return(*this);}
+  HapOut& enableHash(){hapBuffer.hashEnabled=true;return(*this);}     // hash output until next flush, after which SHA-384 is available from getHash()
+  
+  HapOut& beginCapture(){hapBuffer.beginCapture();return(*this);}    // start capturing output into chunk chain (nothing is printed, transmitted, or hashed)
+  size_t endCapture(){return(hapBuffer.endCapture());}                // stop capturing and return number of bytes captured (use for Content-Length)
+  HapOut& replay(boolean retain=false){hapBuffer.replay(retain);return(*this);}    // stream captured bytes through to the current HAP Client/Serial Monitor without re-rendering (set retain=true to replay again later)
+  HapOut& clearCapture(){hapBuffer.clearCapture();return(*this);}                  // discard captured bytes retained by replay(true)
+  HapOut& setTxSize(size_t nBytes){hapBuffer.setTxSize(nBytes);return(*this);}    // sets size of staging buffer used to batch HAP frames into a single client write
   
   uint8_t *getHash(){return(hapBuffer.hash);}
   size_t getSize(){return(hapBuffer.getSize());}
+  uint32_t getRenderCount(){return(hapBuffer.renderCount);}
+  uint64_t getRenderBytes(){return(hapBuffer.renderBytes);}
+  uint32_t getFrameCount(){return(hapBuffer.frameCount);}
+  uint32_t getWriteCount(){return(hapBuffer.writeCount);}
 };
 
 /////////////////////////////////////////////////
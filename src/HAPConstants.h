@@ -83,6 +83,7 @@ enum class StatusCode {
   ReadOnly=-70404,
   WriteOnly=-70405,
   NotifyNotAllowed=-70406,
+  OutOfResources=-70407,
   UnknownResource=-70409,
   InvalidValue=-70410,  
   TBD=-1                       // status To-Be-Determined (TBD) once service.update() called - internal use only
@@ -250,11 +250,14 @@ void Span::pollTask() {
     processSerialCommand(cBuf);
   }
 
+  int64_t clientTime=esp_timer_get_time();              // start timing HAP client servicing (reported as poll stall)
+
   if(hapServer->hasClient()){  
  
     auto it=hapList.emplace(hapList.begin());                                // create new HAPClient connection
     it->client=hapServer->accept();
     it->clientNumber=it->client.fd()-LWIP_SOCKET_OFFSET;
+    it->allocSlot();                                                         // assign subscription slot used for EV notifications
             
     HAPClient::pairStatus=pairState_M1;                                      // reset starting PAIR STATE (which may be needed if Accessory failed in middle of pair-setup)    
 
@@ -267,18 +270,23 @@ void Span::pollTask() {
   while(currentClient!=hapList.end()){
 
     if(currentClient->client.connected()){                                   // if the client is connected
-      if(currentClient->client.available()){                                 // if client has data available
-        homeSpan.lastClientIP=currentClient->client.remoteIP().toString();   // store IP Address for web logging
-        currentClient->processRequest();                                     // PROCESS HAP REQUEST
-        homeSpan.lastClientIP="0.0.0.0";                                     // reset stored IP address to show "0.0.0.0" if homeSpan.getClientIP() is used in any other context 
-      }
+      currentClient->receive();                                              // read any available data, and process HAP request once complete (never waits for data that has not yet arrived)
+      currentClient++;
+    } else if(currentClient->cryptoStatus.load(std::memory_order_acquire)==HAPClient::CRYPTO_PENDING){       // crypto worker is still using this connection - remove once it is done
       currentClient++;
     } else {
       LOG1("** Client #%d DISCONNECTED (%lu sec)\n",currentClient->clientNumber,millis()/1000);
-      clearNotify(&*currentClient);                                          // clear all notification requests for this connection
+      if(currentClient->cryptoStatus.load(std::memory_order_acquire)==HAPClient::CRYPTO_DONE)               // complete request finished by crypto worker after connection closed (so shared pairing state is updated)
+        currentClient->cryptoComplete();
+      currentClient->freeSlot();                                             // release subscription slot for re-use (its notification requests are cleared lazily when the slot is next assigned)
+      currentClient->rxReset();                                              // discard any partially-received message
       currentClient=hapList.erase(currentClient);                            // remove HAPClient connection
     }
   }
+
+  uint32_t clientElapsed=esp_timer_get_time()-clientTime;
+  if(isInitialized && clientElapsed>maxPollStall)
+    maxPollStall=clientElapsed;
       
   snapTime=millis();                                     // snap the current time for use in ALL loop routines
   
@@ -290,6 +298,7 @@ void Span::pollTask() {
     
   HAPClient::checkNotifications();  
   HAPClient::checkTimedWrites();
+  checkNVS();
 
   if(spanOTA.enabled)
     ArduinoOTA.handle();
@@ -813,7 +822,8 @@ void Span::processSerialCommand(const char *c){
       LOG0("\n");
 
       for(auto it=hapList.begin(); it!=hapList.end(); ++it){
-        LOG0("Client #%d: %s",(*it).clientNumber,(*it).client.remoteIP().toString().c_str());
+        LOG0("Client #%d: %s  Subscriptions=%d  Requests=%lu (avg %llu us, max %lu us)  Events=%lu (max lag %lu ms)",(*it).clientNumber,(*it).client.remoteIP().toString().c_str(),(*it).nSubscriptions,
+          (*it).nRequests,(*it).nRequests?(*it).requestTime/(*it).nRequests:0ULL,(*it).maxRequestTime,(*it).nEvents,(*it).maxEventLag);
         if((*it).cPair){
           LOG0("  ID=");
           HAPClient::charPrintRow((*it).cPair->getID(),36);
@@ -825,11 +835,28 @@ void Span::processSerialCommand(const char *c){
 
       if(hapList.empty())
         LOG0("No Client Connections!\n");
+
+      LOG0("\nHAP Responses:     %lu rendered, %llu bytes\n",hapOut.getRenderCount(),hapOut.getRenderBytes());
+      LOG0("HAP Transmit:      %lu frames in %lu writes\n",hapOut.getFrameCount(),hapOut.getWriteCount());
+      LOG0("HAP Events:        %lu sent, %lu suppressed\n",eventsSent,eventsSuppressed);
+      LOG0("NVS Write-Behind:  %lu updates, %lu commits, %lu commits avoided, %d pending\n",nvsUpdates,nvsCommits,nvsUpdates>nvsCommits?nvsUpdates-nvsCommits:0,NVSDirty.size());
+      if(HAPClient::cryptoQueue)
+        LOG0("Pairing Crypto:    worker task on Core-%d",xTaskGetCoreID(HAPClient::cryptoTaskHandle));
+      else
+        LOG0("Pairing Crypto:    performed on poll task");
+      LOG0(", %lu steps (avg %llu us, max %lu us), max poll stall %lu us\n",HAPClient::cryptoJobs,HAPClient::cryptoJobs?HAPClient::cryptoTime/HAPClient::cryptoJobs:0ULL,HAPClient::maxCryptoTime,maxPollStall);
+      LOG0("Curve Key Pool:    %d of %d ready, %lu hits, %lu misses\n",HAPClient::curveKeyCount,HAPClient::curveKeyMax,HAPClient::curveKeyHits,HAPClient::curveKeyMisses);
         
       LOG0("\n*** End Status ***\n\n");
     } 
     break;
 
+    case 'M': {
+
+      metrics.print();
+    }
+    break;
+
     case 'd': {            
 
       LOG0("\n*** Attributes Database ***\n\n");
@@ -973,6 +1000,7 @@ void Span::processSerialCommand(const char *c){
 
     case 'V': {
       
+      discardNVS();
       nvs_erase_all(charNVS);
       nvs_commit(charNVS);      
       LOG0("\n*** Values for all saved Characteristics erased!\n\n");
@@ -996,6 +1024,7 @@ void Span::processSerialCommand(const char *c){
 
     case 'F': {
       
+      discardNVS();
       nvs_erase_all(hapNVS);
       nvs_commit(hapNVS);      
       nvs_erase_all(wifiNVS);
@@ -1012,6 +1041,7 @@ void Span::processSerialCommand(const char *c){
 
     case 'E': {
       
+      discardNVS();
       nvs_flash_erase();
       LOG0("\n*** ALL DATA ERASED!  Restarting...\n\n");
       reboot();
@@ -1033,6 +1063,101 @@ void Span::processSerialCommand(const char *c){
     }
     break;
 
+    case 'b': {
+
+      const int nIter=20;                                  // number of times each response is rendered (rendering is read-only, so no Characteristic values or update() callbacks are affected)
+      int nChars=0;
+
+      for(auto const &acc : Accessories)
+        for(auto const &svc : acc->Services)
+          nChars+=svc->Characteristics.size();
+
+      auto renderChars=[this](int flags){                  // renders the same JSON as a GET /characteristics or EVENT response covering every Characteristic
+        boolean addComma=false;
+        hapOut.beginCapture();
+        hapOut << "{\"characteristics\":[";
+        for(auto const &acc : Accessories){
+          for(auto const &svc : acc->Services){
+            for(auto const &chr : svc->Characteristics){
+              if(addComma)
+                hapOut << ",";
+              chr->printfAttributes(flags);
+              addComma=true;
+            }
+          }
+        }
+        hapOut << "]}";
+        size_t nBytes=hapOut.endCapture();
+        hapOut.clearCapture();
+        return(nBytes);
+      };
+
+      auto bench=[nIter](const char *label, auto render){
+        size_t nBytes=0;
+        int64_t t0=esp_timer_get_time();
+        for(int i=0;i<nIter;i++)
+          nBytes=render();
+        int64_t dt=esp_timer_get_time()-t0;
+        LOG0("%-20s %8d %10.1f %10.1f\n",label,nBytes,(double)dt/nIter,dt>0?1.0e6*nIter/dt:0.0);
+      };
+
+      LOG0("\n*** HAP Benchmark: %d Accessories, %d Characteristics, %d iterations ***\n\n",Accessories.size(),nChars,nIter);
+      LOG0("%-20s %8s %10s %10s\n","Response","Bytes","usec/req","req/sec");
+      LOG0("%-20s %8s %10s %10s\n","--------------------","--------","----------","----------");
+
+      bench("GET /accessories",[this](){
+        hapOut.beginCapture();
+        printfAttributes();
+        size_t nBytes=hapOut.endCapture();
+        hapOut.clearCapture();
+        return(nBytes);
+      });
+
+      bench("GET /characteristics",[&renderChars](){return(renderChars(GET_VALUE|GET_AID));});
+
+      bench("EVENT",[&renderChars](){return(renderChars(GET_VALUE|GET_AID|GET_NV));});
+
+      vector<uint64_t, Mallocator<uint64_t>> ids;          // aid/iid (as a charKey) of every Characteristic
+      for(auto const &acc : Accessories)
+        for(auto const &svc : acc->Services)
+          for(auto const &chr : svc->Characteristics)
+            ids.push_back(charKey(acc->aid,chr->iid));
+
+      auto scan=[this](uint32_t aid, uint32_t iid)->SpanCharacteristic* {         // linear search used by find() before Characteristics were indexed in CharIndex
+        for(auto const &acc : Accessories){
+          if(acc->aid==aid){
+            for(auto const &svc : acc->Services)
+              for(auto const &chr : svc->Characteristics)
+                if(chr->iid==iid)
+                  return(chr);
+            return(NULL);
+          }
+        }
+        return(NULL);
+      };
+
+      auto lookup=[&ids](const char *label, auto f){
+        int nRounds=ids.size()?20000/ids.size()+1:1;        // repeat enough lookups to be measurable even for a small database
+        int nFound=0;
+        int64_t t0=esp_timer_get_time();
+        for(int i=0;i<nRounds;i++)
+          for(auto id : ids)
+            nFound+=(f(id>>32,id&0xFFFFFFFF)!=NULL);
+        int64_t dt=esp_timer_get_time()-t0;
+        double nLookups=(double)nRounds*ids.size();
+        LOG0("%-20s %8d %10.3f %10.0f\n",label,nFound/nRounds,nLookups?dt/nLookups:0.0,dt>0?1.0e6*nLookups/dt:0.0);
+      };
+
+      LOG0("\n%-20s %8s %10s %10s\n","Lookup","Found","usec/find","find/sec");
+      LOG0("%-20s %8s %10s %10s\n","--------------------","--------","----------","----------");
+
+      lookup("find() (index)",[this](uint32_t aid, uint32_t iid){return(find(aid,iid));});
+      lookup("find() (scan)",scan);
+
+      LOG0("\n*** End Benchmark ***\n\n");
+    }
+    break;
+
     case 'm': {
       multi_heap_info_t heapAll;
       multi_heap_info_t heapInternal;
@@ -1121,9 +1246,11 @@ void Span::processSerialCommand(const char *c){
             if(((*chr)->perms)&EV){
               LOG0(", EV=(");
               boolean addComma=false;
-              for(auto const &hc : (*chr)->evList){
-                LOG0("%s%d",addComma?",":"",hc->clientNumber);
-                addComma=true;
+              for(auto &hc : hapList){
+                if((*chr)->evList.has(&hc)){
+                  LOG0("%s%d",addComma?",":"",hc.clientNumber);
+                  addComma=true;
+                }
               }
               LOG0(")");              
             }
@@ -1330,7 +1457,9 @@ void Span::processSerialCommand(const char *c){
       LOG0("  s - print connection status\n");
       LOG0("  i - print summary information about the HAP Database\n");
       LOG0("  d - print the full HAP Accessory Attributes Database in JSON format\n");
+      LOG0("  b - benchmark rendering of HAP responses and Characteristic lookups for the current Accessory Attributes Database\n");
       LOG0("  m - print free heap memory\n");
+      LOG0("  M - print runtime metrics (request latencies and counters)\n");
       LOG0("  p - print flash partition table\n");
       LOG0("\n");      
       LOG0("  W - configure WiFi Credentials and restart\n");      
@@ -1412,6 +1541,7 @@ void Span::resetStatus(){
 ///////////////////////////////
 
 void Span::reboot(){
+  flushNVS();
   STATUS_UPDATE(off(),HS_REBOOTING)
   delay(1000);
   ESP.restart();  
@@ -1506,6 +1636,49 @@ Span& Span::setWifiCredentials(const char *ssid, const char *pwd){
 
 ///////////////////////////////
 
+Span& Span::setTxBufferSize(uint32_t nBytes){
+  hapOut.setTxSize(nBytes);
+  return(*this);
+}
+
+///////////////////////////////
+
+Span& Span::flushNVS(){
+
+  if(NVSDirty.empty())
+    return(*this);
+
+  for(auto chr : NVSDirty)
+    chr->writeNVS();
+
+  NVSDirty.clear();
+  int64_t startTime=esp_timer_get_time();
+  nvs_commit(charNVS);                // single commit for all pending values
+  metrics.record(SpanMetrics::NVS_COMMIT,esp_timer_get_time()-startTime);
+  nvsCommits++;
+  return(*this);
+}
+
+///////////////////////////////
+
+void Span::checkNVS(){
+
+  if(!NVSDirty.empty() && (millis()-nvsChangeTime>=nvsQuietTime || millis()-nvsDirtyTime>=nvsMaxDelay))
+    flushNVS();
+}
+
+///////////////////////////////
+
+void Span::discardNVS(){
+
+  for(auto chr : NVSDirty)
+    chr->nvsDirty=false;
+
+  NVSDirty.clear();
+}
+
+///////////////////////////////
+
 void Span::printfAttributes(int flags){
 
   hapOut << "{\"accessories\":[";
@@ -1537,188 +1710,334 @@ boolean Span::deleteAccessory(uint32_t n){
 
 SpanCharacteristic *Span::find(uint32_t aid, uint32_t iid){
 
-  int index=-1;
-  for(int i=0;i<Accessories.size();i++){   // loop over all Accessories to find aid
-    if(Accessories[i]->aid==aid){          // if match, save index into Accessories array
-      index=i;
-      break;
-    }
-  }
-
-  if(index<0)                  // fail if no match on aid
+  auto it=CharIndex.find(charKey(aid,iid));
+  
+  if(it==CharIndex.end())      // fail if no match on aid/iid
     return(NULL);
-    
-  for(int i=0;i<Accessories[index]->Services.size();i++){                           // loop over all Services in this Accessory
-    for(int j=0;j<Accessories[index]->Services[i]->Characteristics.size();j++){     // loop over all Characteristics in this Service
-      
-      if(iid == Accessories[index]->Services[i]->Characteristics[j]->iid)           // if matching iid
-        return(Accessories[index]->Services[i]->Characteristics[j]);                // return pointer to Characteristic
-    }
+
+  return(it->second);          // return pointer to Characteristic
+}
+
+///////////////////////////////
+
+char SpanJSON::peek(){
+
+  while(*p==' ' || *p=='\t' || *p=='\r' || *p=='\n')
+    p++;
+  return(*p);
+}
+
+///////////////////////////////
+
+boolean SpanJSON::accept(char c){
+
+  if(peek()!=c || c=='\0')
+    return(false);
+  p++;
+  return(true);
+}
+
+///////////////////////////////
+
+boolean SpanJSON::string(const char *&s, size_t &len){
+
+  if(!accept('"'))
+    return(false);
+
+  const char *q;
+  for(q=p;*q!='"';q++){
+    if(*q=='\0')                            // unterminated string
+      return(false);
+    if(*q=='\\' && *++q=='\0')              // skip over escaped character (which may be a quote)
+      return(false);
   }
 
-  return(NULL);                // fail if no match on iid
+  s=p;
+  len=q-p;
+  p=q+1;
+  return(true);
 }
 
 ///////////////////////////////
 
-char *Span::escapeJSON(char *jObj){
- 
-  boolean quoting=false;
-  char *p;
-  
-  for(int i=0,k=0;;i++){
-    
-    if(jObj[i]=='\0'){
-      jObj[k]='\0';
-      break;
-    }
+boolean SpanJSON::scalar(const char *&s, size_t &len){
 
-    if(!quoting){
-      if(strchr(" \t\n\r",jObj[i]))
-        continue;
-    if(jObj[i]=='"')
-      quoting=true;
-    } else {
-      if(jObj[i]=='"' && i>0 && jObj[i-1]!='\\')
-        quoting=false;
-      else if((p=strchr(delims,jObj[i])))
-        jObj[i]=DELIM+p-delims;
-    }
-          
-    jObj[k++]=jObj[i];
-  }    
+  if(peek()=='"')
+    return(string(s,len));
+
+  const char *q;
+  for(q=p;*q!='\0' && !strchr(" \t\r\n,:{}[]\"",*q);q++);
 
-  return(jObj);
+  if(q==p)                                  // no number or literal found
+    return(false);
+
+  s=p;
+  len=q-p;
+  p=q;
+  return(true);
 }
 
 ///////////////////////////////
 
-char *Span::unEscapeJSON(char *jObj){
+boolean SpanJSON::skip(int depth){
 
-  for(int i=0;;i++){
-    
-    if(jObj[i]=='\0')
+  const char *s;
+  size_t len;
+  char close;
+
+  if(accept('{'))
+    close='}';
+  else if(accept('['))
+    close=']';
+  else
+    return(scalar(s,len));
+
+  if(depth>=8)                              // limit nesting to protect the stack
+    return(false);
+
+  if(accept(close))                         // empty object or array
+    return(true);
+
+  do {
+    if(close=='}' && !(string(s,len) && accept(':')))
+      return(false);
+    if(!skip(depth+1))
+      return(false);
+  } while(accept(','));
+
+  return(accept(close));
+}
+
+///////////////////////////////
+
+int SpanJSON::flag(const char *s, size_t len){
+
+  if(match(s,len,"0") || match(s,len,"false"))
+    return(0);
+  if(match(s,len,"1") || match(s,len,"true"))
+    return(1);
+  return(-1);
+}
+
+///////////////////////////////
+
+size_t SpanJSON::unescape(char *dest, const char *s, size_t len){
+
+  char *d=dest;
+  const char *end=s+len;
+
+  while(s<end){
+    if(*s!='\\' || s+1==end){
+      *d++=*s++;
+      continue;
+    }
+
+    s++;
+    switch(*s++){
+      case 'b': *d++='\b'; break;
+      case 'f': *d++='\f'; break;
+      case 'n': *d++='\n'; break;
+      case 'r': *d++='\r'; break;
+      case 't': *d++='\t'; break;
+
+      case 'u': {
+        auto hex4=[end](const char *h)->int32_t {            // returns value of 4 hex digits starting at h, or -1 if malformed
+          int32_t v=0;
+          for(int i=0;i<4;i++,h++){
+            if(h>=end || !isxdigit(*h))
+              return(-1);
+            v=(v<<4) | (isdigit(*h)?(*h-'0'):((*h|0x20)-'a'+10));
+          }
+          return(v);
+        };
+
+        int32_t cp=hex4(s);
+        if(cp<0){                                                   // malformed escape - copy as-is
+          *d++='u';
+          break;
+        }
+        s+=4;
+        if(cp>=0xD800 && cp<0xDC00 && end-s>=6 && s[0]=='\\' && s[1]=='u'){     // high surrogate may be followed by low surrogate
+          int32_t lo=hex4(s+2);
+          if(lo>=0xDC00 && lo<0xE000){
+            cp=0x10000+((cp-0xD800)<<10)+(lo-0xDC00);
+            s+=6;
+          }
+        }
+        if(cp<0x80){
+          *d++=cp;
+        } else if(cp<0x800){
+          *d++=0xC0|(cp>>6);
+          *d++=0x80|(cp&0x3F);
+        } else if(cp<0x10000){
+          *d++=0xE0|(cp>>12);
+          *d++=0x80|((cp>>6)&0x3F);
+          *d++=0x80|(cp&0x3F);
+        } else {
+          *d++=0xF0|(cp>>18);
+          *d++=0x80|((cp>>12)&0x3F);
+          *d++=0x80|((cp>>6)&0x3F);
+          *d++=0x80|(cp&0x3F);
+        }
+      }
       break;
 
-    if(jObj[i]>=DELIM && jObj[i]<=END_DELIM)
-      jObj[i]=delims[jObj[i]-DELIM];
+      default:                              // includes \" \\ and \/ (which Apple uses unnecessarily)
+        *d++=s[-1];
+      break;
+    }
   }
-    
-  return(jObj);
+
+  *d='\0';
+  return(d-dest);
 }
 
 ///////////////////////////////
 
-char *Span::strstr_r(const char *haystack, const char *needle){
-  char *s=strstr(haystack,needle);
-  if(s)
-    s+=strlen(needle);
-  return(s);  
+boolean SpanJSON::number(char *dest, const char *s, size_t len){
+
+  if(len>=MAX_NUMBER)
+    return(false);
+
+  memcpy(dest,s,len);
+  dest[len]='\0';
+  return(true);
 }
 
 ///////////////////////////////
 
 boolean Span::updateCharacteristics(char *buf, SpanBufVec &pVec){
 
+  SpanJSON json(buf);
+  const char *pidStr=NULL;
+  size_t len;
+  size_t pidLen=0;
+  boolean foundChars=false;
   boolean twFail=false;
-  char *jObj=escapeJSON(buf);
-  size_t end=0;
-
-  char *pidObj=strstr_r(jObj,"\"pid\":");
-  if(pidObj){
-    uint64_t pid=strtoull(pidObj,NULL,0);
-    if(!TimedWrites.count(pid)){
-      LOG0("\n*** ERROR:  Timed Write PID not found\n\n");
-      twFail=true;
-    } else        
-    if(millis()>TimedWrites[pid]){
-      LOG0("\n*** ERROR:  Timed Write Expired\n\n");
-      twFail=true;
-    }        
-  }
-
-  jObj=strstr_r(jObj,"\"characteristics\":");
+  char num[SpanJSON::MAX_NUMBER];
 
-  if(!jObj || !sscanf(jObj,"[%[^]]]%n",jObj,&end) || !end){
-    LOG0("\n*** ERROR: Cannot extract properly-formatted \"characteristics\" array from JSON text\n\n");
+  if(!json.accept('{')){
+    LOG0("\n*** ERROR: Cannot extract properly-formatted JSON object\n\n");
     return(false);
   }
 
-  for(;;){                // loop over objects in characteristics array
-    int okay=0;
-    end=0;
-    if(!sscanf(jObj,"{%[^}]}%n",jObj,&end) || end==0){
-      LOG0("\n*** ERROR: Cannot extract properly-formatted object from \"characteristics\" array\n\n");
+  do {                                                                // loop over top-level name-value pairs
+    const char *name;
+    size_t nameLen;
+
+    if(!json.string(name,nameLen) || !json.accept(':')){
+      LOG0("\n*** ERROR: Cannot extract name from top-level JSON object\n\n");
       return(false);
     }
 
-    SpanBuf sBuf;
-    
-    for(;;){              // loop over all name-value pairs in the object 
-      end=0;
-      char *name=jObj;
-      if(sscanf(name,"\"%[^\"]\"%n",name,&end)!=1  || end==0){
-        LOG0("\n*** ERROR: Cannot extract name from \"characteristics\" object\n\n");
+    if(SpanJSON::match(name,nameLen,"pid")){
+      if(!json.scalar(pidStr,pidLen)){
+        LOG0("\n*** ERROR: Cannot extract value of \"pid\"\n\n");
         return(false);
       }
-      char *value=name+end;
-      if(sscanf(value,":%[^,]%n",value,&end)!=1){
-        LOG0("\n*** ERROR: Cannot extract value from \"characteristics\" object\n\n");
-        return(false);        
-      }
+      continue;
+    }
 
-      if(*value=='\"'){
-        value++;
-        end--;
-        if(value[end-2]=='\"'){
-          value[end-2]='\0';
-          unEscapeJSON(value);
-        }          
-      }
-      
-      if(!strcmp(name,"aid")){
-        sscanf(value,"%lu",&sBuf.aid);
-        okay|=1;
-      } else 
-      if(!strcmp(name,"iid")){
-        sscanf(value,"%lu",&sBuf.iid);
-        okay|=2;
-      } else 
-      if(!strcmp(name,"value")){
-        sBuf.val=value;
-        okay|=4;
-      } else 
-      if(!strcmp(name,"ev")){
-        sBuf.ev=value;
-        okay|=8;
-      } else 
-      if(!strcmp(name,"r")){
-        sBuf.wr=(!strcmp(value,"1") || !strcmp(value,"true"));
-      } else {
-        LOG0("\n*** ERROR:  Problems parsing JSON characteristics object - unexpected property \"%s\"\n\n",name);
+    if(!SpanJSON::match(name,nameLen,"characteristics")){             // ignore any other top-level properties
+      if(!json.skip()){
+        LOG0("\n*** ERROR: Cannot parse top-level JSON object\n\n");
         return(false);
       }
-      
-      jObj=value+end;
-      if(*jObj++=='\0')
-        break;
+      continue;
     }
 
-    if(okay==7 || okay==11  || okay==15){                             // all required properties found
-      if(!sBuf.val)                                                   // if value is NOT being updated
-        sBuf.wr=false;                                                // ignore any request for write-response
-      pVec.push_back(sBuf);                                           // add sBuf to pVec vector
-    } else {
-      LOG0("\n*** ERROR:  Problems parsing JSON characteristics object - missing required properties\n\n");
+    if(!json.accept('[') || json.peek()==']'){
+      LOG0("\n*** ERROR: Cannot extract properly-formatted \"characteristics\" array from JSON text\n\n");
       return(false);
     }
-    
-    if(*++jObj=='\0')
-      break;
-    else if(*jObj++!=','){
+
+    do {                                                              // loop over objects in characteristics array
+      int okay=0;
+      SpanBuf sBuf;
+
+      if(!json.accept('{')){
+        LOG0("\n*** ERROR: Cannot extract properly-formatted object from \"characteristics\" array\n\n");
+        return(false);
+      }
+
+      do {                                                            // loop over all name-value pairs in the object
+        const char *value;
+
+        if(!json.string(name,nameLen) || !json.accept(':')){
+          LOG0("\n*** ERROR: Cannot extract name from \"characteristics\" object\n\n");
+          return(false);
+        }
+
+        if(!json.scalar(value,len)){
+          LOG0("\n*** ERROR: Cannot extract value from \"characteristics\" object\n\n");
+          return(false);
+        }
+
+        if(SpanJSON::match(name,nameLen,"aid")){
+          sBuf.aid=SpanJSON::number(num,value,len)?strtoul(num,NULL,10):0;
+          okay|=1;
+        } else
+        if(SpanJSON::match(name,nameLen,"iid")){
+          sBuf.iid=SpanJSON::number(num,value,len)?strtoul(num,NULL,10):0;
+          okay|=2;
+        } else
+        if(SpanJSON::match(name,nameLen,"value")){
+          sBuf.val=value;
+          sBuf.valLen=len;
+          okay|=4;
+        } else
+        if(SpanJSON::match(name,nameLen,"ev")){
+          int ev=SpanJSON::flag(value,len);
+          sBuf.ev=ev<0?2:ev;
+          okay|=8;
+        } else
+        if(SpanJSON::match(name,nameLen,"r")){
+          sBuf.wr=(SpanJSON::flag(value,len)==1);
+        } else {
+          LOG0("\n*** ERROR:  Problems parsing JSON characteristics object - unexpected property \"%.*s\"\n\n",nameLen,name);
+          return(false);
+        }
+      } while(json.accept(','));
+
+      if(!json.accept('}')){
+        LOG0("\n*** ERROR: Cannot extract properly-formatted object from \"characteristics\" array\n\n");
+        return(false);
+      }
+
+      if(okay==7 || okay==11  || okay==15){                           // all required properties found
+        if(!sBuf.val)                                                 // if value is NOT being updated
+          sBuf.wr=false;                                              // ignore any request for write-response
+        pVec.push_back(sBuf);                                         // add sBuf to pVec vector
+      } else {
+        LOG0("\n*** ERROR:  Problems parsing JSON characteristics object - missing required properties\n\n");
+        return(false);
+      }
+    } while(json.accept(','));
+
+    if(!json.accept(']')){
       LOG0("\n*** ERROR: Unexpected characters trailing last object in \"characteristics\" array\n\n");
       return(false);
     }
+
+    foundChars=true;
+
+  } while(json.accept(','));
+
+  if(!json.accept('}') || !foundChars){
+    LOG0("\n*** ERROR: Cannot extract properly-formatted \"characteristics\" array from JSON text\n\n");
+    return(false);
+  }
+
+  if(pidStr){
+    uint64_t pid=SpanJSON::number(num,pidStr,pidLen)?strtoull(num,NULL,0):0;
+    if(!TimedWrites.count(pid)){
+      LOG0("\n*** ERROR:  Timed Write PID not found\n\n");
+      twFail=true;
+    } else        
+    if(millis()>TimedWrites[pid]){
+      LOG0("\n*** ERROR:  Timed Write Expired\n\n");
+      twFail=true;
+    }        
   }
 
   snapTime=millis();                                           // timestamp for this series of updates, assigned to each characteristic in loadUpdate()
@@ -1732,7 +2051,7 @@ boolean Span::updateCharacteristics(char *buf, SpanBufVec &pVec){
       (*it).characteristic = find((*it).aid,(*it).iid);        // find characteristic with matching aid/iid and store pointer          
 
       if((*it).characteristic)                                                           // if found, initialize characteristic update with new val/ev
-        (*it).status=(*it).characteristic->loadUpdate((*it).val,(*it).ev,(*it).wr);      // save status code, which is either an error, or TBD (in which case updateFlag for the characteristic has been set to either 1 or 2) 
+        (*it).status=(*it).characteristic->loadUpdate((*it).val,(*it).valLen,(*it).ev,(*it).wr);      // save status code, which is either an error, or TBD (in which case updateFlag for the characteristic has been set to either 1 or 2) 
       else
         (*it).status=StatusCode::UnknownResource;                                        // if not found, set HAP error            
     }
@@ -1746,18 +2065,13 @@ boolean Span::updateCharacteristics(char *buf, SpanBufVec &pVec){
 
       for(auto jt=it;jt!=pVec.end();jt++){                                                                  // loop over this object plus any remaining objects to update values and save status for any other characteristics in this service
         
-        if((*jt).characteristic->service==(*it).characteristic->service){                                   // if service of this characteristic matches service that was updated
+        if((*jt).characteristic && (*jt).characteristic->service==(*it).characteristic->service){           // if service of this characteristic matches service that was updated
           (*jt).status=status;                                                                              // save statusCode for this object
           LOG1("Updating aid=%lu iid=%lu",(*jt).characteristic->aid,(*jt).characteristic->iid);
           if(status==StatusCode::OK){                                                                       // if status is okay
             (*jt).characteristic->uvSet((*jt).characteristic->value,(*jt).characteristic->newValue);        // update characteristic value with new value
-            if((*jt).characteristic->nvsKey){                                                               // if storage key found
-              if((*jt).characteristic->format<FORMAT::STRING)
-                nvs_set_u64(charNVS,(*jt).characteristic->nvsKey,(*jt).characteristic->value.UINT64);       // store data as uint64_t regardless of actual type (it will be read correctly when access through uvGet())         
-              else
-                nvs_set_str(charNVS,(*jt).characteristic->nvsKey,(*jt).characteristic->value.STRING);       // store data
-              nvs_commit(charNVS);
-            }
+            if((*jt).characteristic->nvsKey)                                                                // if storage key found
+              (*jt).characteristic->saveNVS();                                                              // schedule write-behind storage of value
             LOG1(" (okay)\n");
           } else {                                                                                          // if status not okay
             (*jt).characteristic->uvSet((*jt).characteristic->newValue,(*jt).characteristic->value);        // replace characteristic new value with original value
@@ -1775,12 +2089,12 @@ boolean Span::updateCharacteristics(char *buf, SpanBufVec &pVec){
 
 ///////////////////////////////
 
-void Span::clearNotify(HAPClient *hc){
+void Span::clearNotify(uint32_t slots){
 
   for(auto const &acc : Accessories)
     for(auto const &svc : acc->Services)
       for(auto const &chr : svc->Characteristics)
-        chr->evList.remove(hc);  
+        chr->evList.clear(slots);
 } 
 
 ///////////////////////////////
@@ -1819,8 +2133,10 @@ void Span::printfAttributes(SpanBufVec &pVec){
     if(it!=pVec.begin())
       hapOut << ",";
     hapOut << "{\"aid\":" << (*it).aid << ",\"iid\":" << (*it).iid << ",\"status\":" << (int)(*it).status;
-    if((*it).status==StatusCode::OK && (*it).wr && (*it).characteristic)
-      hapOut << ",\"value\":" << (*it).characteristic->uvPrint((*it).characteristic->value).c_str();
+    if((*it).status==StatusCode::OK && (*it).wr && (*it).characteristic){
+      hapOut << ",\"value\":";
+      (*it).characteristic->printfValue((*it).characteristic->value);
+    }
     hapOut << "}";
   }
 
@@ -1899,13 +2215,29 @@ Span& Span::resetIID(uint32_t newIID){
 
 boolean Span::updateDatabase(boolean updateMDNS){
 
-  printfAttributes(GET_META|GET_PERMS|GET_TYPE|GET_DESC);   // stream attributes database, which automtically produces a SHA-384 hash
-  hapOut.flush();  
+  uint8_t hashCode[48];
+  mbedtls_sha512_context ctx;
+  mbedtls_sha512_init(&ctx);
+  mbedtls_sha512_starts(&ctx,1);                                      // start SHA-384 hash (note second argument=1)
+
+  for(auto acc=Accessories.begin(); acc!=Accessories.end(); acc++){
+    if(!(*acc)->hashValid){                                           // only re-stream attributes of Accessories that changed since last update
+      hapOut.enableHash();
+      (*acc)->printfAttributes(GET_META|GET_PERMS|GET_TYPE|GET_DESC);
+      hapOut.flush();
+      memcpy((*acc)->hashCode,hapOut.getHash(),48);
+      (*acc)->hashValid=true;
+    }
+    mbedtls_sha512_update(&ctx,(*acc)->hashCode,48);                  // hash of database is the hash of all the individual Accessory hashes
+  }
+
+  mbedtls_sha512_finish(&ctx,hashCode);
+  mbedtls_sha512_free(&ctx);
 
   boolean changed=false;
 
-  if(forceConfigIncrement || memcmp(hapOut.getHash(),hapConfig.hashCode,48)){       // if hash code of current HAP database does not match stored hash code, or force-increment is requested
-    memcpy(hapConfig.hashCode,hapOut.getHash(),48);                                 // update stored hash code
+  if(forceConfigIncrement || memcmp(hashCode,hapConfig.hashCode,48)){       // if hash code of current HAP database does not match stored hash code, or force-increment is requested
+    memcpy(hapConfig.hashCode,hashCode,48);                                 // update stored hash code
     hapConfig.configNumber++;                                                       // increment configuration number
     if(hapConfig.configNumber==65536)                                               // reached max value
       hapConfig.configNumber=1;                                                     // reset to 1
@@ -1927,11 +2259,14 @@ boolean Span::updateDatabase(boolean updateMDNS){
     LOG0("\n*** WARNING: NVS is running low on space.  Try erasing with 'E'.  If that fails, increase size of NVS partition or reduce NVS usage.\n\n");
 
   Loops.clear();
+  CharIndex.clear();
 
   for(auto acc=Accessories.begin(); acc!=Accessories.end(); acc++){                        // identify all services with over-ridden loop() methods
     for(auto svc=(*acc)->Services.begin(); svc!=(*acc)->Services.end(); svc++){
       if((void(*)())((*svc)->*(&SpanService::loop)) != (void(*)())(&SpanService::loop))    // save pointers to services in Loops vector
         homeSpan.Loops.push_back((*svc));
+      for(auto chr=(*svc)->Characteristics.begin(); chr!=(*svc)->Characteristics.end(); chr++)     // re-build Characteristic index (first match wins if aid/iid is duplicated)
+        CharIndex.emplace(charKey((*acc)->aid,(*chr)->iid),(*chr));
     }
   }    
 
@@ -2024,6 +2359,7 @@ SpanService::SpanService(const char *type, const char *hapName, boolean isCustom
 
   homeSpan.Accessories.back()->Services.push_back(this);  
   accessory=homeSpan.Accessories.back();
+  accessory->hashValid=false;
   iid=++(homeSpan.Accessories.back()->iidCount);
 }
 
@@ -2038,6 +2374,7 @@ SpanService::~SpanService(){
   while((*svc)!=this)
     svc++;
   accessory->Services.erase(svc);
+  accessory->hashValid=false;
 
   for(svc=homeSpan.Loops.begin(); svc!=homeSpan.Loops.end() && (*svc)!=this; svc++);    // search for entry in Loop vector...
   if(svc!=homeSpan.Loops.end()){                                                        // ...if it exists, erase it
@@ -2063,6 +2400,7 @@ SpanService::~SpanService(){
 
 SpanService *SpanService::setPrimary(){
   primary=true;
+  accessory->hashValid=false;
   return(this);
 }
 
@@ -2070,6 +2408,7 @@ SpanService *SpanService::setPrimary(){
 
 SpanService *SpanService::setHidden(){
   hidden=true;
+  accessory->hashValid=false;
   return(this);
 }
 
@@ -2077,6 +2416,7 @@ SpanService *SpanService::setHidden(){
 
 SpanService *SpanService::addLink(SpanService *svc){
   linkedServices.push_back(svc);
+  accessory->hashValid=false;
   return(this);
 }
 
@@ -2137,6 +2477,9 @@ SpanCharacteristic::SpanCharacteristic(HapChar *hapChar, boolean isCustom){
   iid=++(homeSpan.Accessories.back()->iidCount);
   service=homeSpan.Accessories.back()->Services.back();
   aid=homeSpan.Accessories.back()->aid;
+  service->accessory->hashValid=false;
+
+  homeSpan.CharIndex.emplace(Span::charKey(aid,iid),this);
 }
 
 ///////////////////////////////
@@ -2147,6 +2490,24 @@ SpanCharacteristic::~SpanCharacteristic(){
   while((*chr)!=this)
     chr++;
   service->Characteristics.erase(chr);
+  service->accessory->hashValid=false;
+
+  auto idx=homeSpan.CharIndex.find(Span::charKey(aid,iid));    // remove Characteristic from index
+  if(idx!=homeSpan.CharIndex.end() && idx->second==this)
+    homeSpan.CharIndex.erase(idx);
+
+  for(auto &hc : homeSpan.hapList)                             // remove any subscriptions so per-connection subscription counts remain accurate
+    evList.remove(&hc);
+
+  if(nvsDirty){                                                // remove from list of values pending storage in NVS
+    auto &nd=homeSpan.NVSDirty;
+    nd.erase(std::remove(nd.begin(),nd.end(),this),nd.end());
+  }
+
+  if(notifyPending){                                           // remove any queued Notification for this Characteristic
+    auto &nv=homeSpan.Notifications;
+    nv.erase(std::remove_if(nv.begin(),nv.end(),[this](const SpanBuf &sb){return(sb.characteristic==this);}),nv.end());
+  }
 
   free(desc);
   free(unit);
@@ -2177,10 +2538,10 @@ String SpanCharacteristic::uvPrint(UVal &u){
     case FORMAT::UINT32:
       return(String(u.UINT32));        
     case FORMAT::UINT64:
-      sprintf(c,"%llu",u.UINT64);
+      c[Utils::uintToChar(u.UINT64,c)]='\0';
       return(String(c));        
     case FORMAT::FLOAT:
-      sprintf(c,"%g",u.FLOAT);
+      c[Utils::floatToChar(u.FLOAT,c)]='\0';
       return(String(c));        
     case FORMAT::STRING:
     case FORMAT::DATA:
@@ -2192,6 +2553,42 @@ String SpanCharacteristic::uvPrint(UVal &u){
 
 ///////////////////////////////
 
+void SpanCharacteristic::printfValue(UVal &u){
+  char c[32];
+  size_t n=0;
+  switch(format){
+    case FORMAT::BOOL:
+      n=Utils::uintToChar(u.BOOL,c);
+      break;
+    case FORMAT::INT:
+      n=Utils::intToChar(u.INT,c);
+      break;
+    case FORMAT::UINT8:
+      n=Utils::uintToChar(u.UINT8,c);
+      break;
+    case FORMAT::UINT16:
+      n=Utils::uintToChar(u.UINT16,c);
+      break;
+    case FORMAT::UINT32:
+      n=Utils::uintToChar(u.UINT32,c);
+      break;
+    case FORMAT::UINT64:
+      n=Utils::uintToChar(u.UINT64,c);
+      break;
+    case FORMAT::FLOAT:
+      n=Utils::floatToChar(u.FLOAT,c);
+      break;
+    case FORMAT::STRING:
+    case FORMAT::DATA:
+    case FORMAT::TLV_ENC:
+      hapOut << "\"" << u.STRING << "\"";
+      return;
+  } // switch
+  hapOut.write(c,n);
+}
+
+///////////////////////////////
+
 void SpanCharacteristic::uvSet(UVal &dest, UVal &src){
   if(format>=FORMAT::STRING)
     uvSet(dest,(const char *)src.STRING);
@@ -2225,22 +2622,15 @@ void SpanCharacteristic::uvSet(UVal &u, DATA_t data){
 
 void SpanCharacteristic::uvSet(UVal &u, TLV_ENC_t tlv){
 
-  const size_t bufSize=36;                                  // maximum size of buffer to store packed TLV bytes before encoding directly into value; must be multiple of 3
   size_t nBytes=tlv.pack_size();                            // total size of packed TLV in bytes
 
   if(nBytes>0){
     size_t nChars;
     mbedtls_base64_encode(NULL,0,&nChars,NULL,nBytes);      // get length of string buffer needed (mbedtls includes the trailing null in this size)
     u.STRING = (char *)HS_REALLOC(u.STRING,nChars);         // allocate sufficient size for storing value
-    TempBuffer<uint8_t> tBuf(bufSize);                      // create fixed-size buffer to store packed TLV bytes
-    tlv.pack_init();                                        // initialize TLV packing
-    uint8_t *p=(uint8_t *)u.STRING;                         // set pointer to beginning of value
-    while((nBytes=tlv.pack(tBuf,bufSize))>0){               // pack the next set of TLV bytes, up to a maximum of bufSize, into tBuf
-      size_t olen;                                          // number of characters written (excludes null character)
-      mbedtls_base64_encode(p,nChars,&olen,tBuf,nBytes);    // encode data directly into value
-      p+=olen;                                              // advance pointer to null character
-      nChars-=olen;                                         // subtract number of characters remaining
-    }
+    TempBuffer<uint8_t> tBuf(nBytes);                       // create buffer to store all packed TLV bytes
+    tlv.pack(tBuf);                                         // pack TLV in a single pass
+    mbedtls_base64_encode((uint8_t *)u.STRING,nChars,&nChars,tBuf,nBytes);    // encode data directly into value
   } else {
     u.STRING = (char *)HS_REALLOC(u.STRING,1);              // allocate sufficient size for just trailing null character
     *u.STRING ='\0';
@@ -2301,35 +2691,32 @@ size_t SpanCharacteristic::getTLVGeneric(TLV8 &tlv, UVal &val){
   if(format<FORMAT::TLV_ENC)
     return(0);
 
-  const size_t bufSize=36;                    // maximum size of buffer to store decoded bytes before unpacking into TLV; must be multiple of 3
-  TempBuffer<uint8_t> tBuf(bufSize);          // create fixed-size buffer to store decoded bytes
   tlv.wipe();                                 // clear TLV completely
 
-  size_t nChars=strlen(val.STRING);         // total characters to decode
-  uint8_t *p=(uint8_t *)val.STRING;         // set pointer to beginning of value
-  const size_t decodeSize=bufSize/3*4;      // number of characters to decode in each pass
-  int status=0;
-  
-  while(nChars>0){
-    size_t olen;
-    size_t n=nChars<decodeSize?nChars:decodeSize;
-    
-    int ret=mbedtls_base64_decode(tBuf,tBuf.len(),&olen,p,n);
-    if(ret==MBEDTLS_ERR_BASE64_INVALID_CHARACTER){
-      LOG0("\n*** WARNING:  Can't decode Characteristic::%s with getTLV().  Data is not in base-64 format!\n\n",hapName);
-      tlv.wipe();
-      return(0);
-    }
-    status=tlv.unpack(tBuf,olen);
-    p+=n;
-    nChars-=n;
+  size_t nChars=strlen(val.STRING);           // total characters to decode
+  size_t nBytes;
+
+  if(nChars==0)
+    return(0);
+
+  if(mbedtls_base64_decode(NULL,0,&nBytes,(uint8_t *)val.STRING,nChars)==MBEDTLS_ERR_BASE64_INVALID_CHARACTER){     // get number of bytes needed to decode value
+    LOG0("\n*** WARNING:  Can't decode Characteristic::%s with getTLV().  Data is not in base-64 format!\n\n",hapName);
+    return(0);
   }
-  if(status>0){
+
+  if(nBytes==0)
+    return(0);
+
+  TempBuffer<uint8_t> tBuf(nBytes);                                       // create buffer to store all decoded bytes
+  mbedtls_base64_decode(tBuf,tBuf.len(),&nBytes,(uint8_t *)val.STRING,nChars);
+
+  if(tlv.unpack(tBuf,nBytes)!=0){             // unpack all records at once (values are copied into a single arena owned by tlv)
     LOG0("\n*** WARNING:  Can't unpack Characteristic::%s with getTLV().  TLV record is incomplete or corrupted!\n\n",hapName);
     tlv.wipe();
     return(0);      
   }
-return(tlv.pack_size());
+
+  return(tlv.pack_size());
 }
 
 ///////////////////////////////
@@ -2356,24 +2743,63 @@ void SpanCharacteristic::setValFinish(boolean notify){
   updateTime=homeSpan.snapTime;
 
   if(notify){
-    if((perms&EV) && (updateFlag!=2)){        // only broadcast notification if EV permission is set AND update is NOT being done in context of write-response    
-      SpanBuf sb;                             // create SpanBuf object
-      sb.characteristic=this;                 // set characteristic          
-      sb.status=StatusCode::OK;               // set status
-      char dummy[]="";
-      sb.val=dummy;                           // set dummy "val" so that printfNotify knows to consider this "update"
-      homeSpan.Notifications.push_back(sb);   // store SpanBuf in Notifications vector
-    }
+    if((perms&EV) && (updateFlag!=2))         // only broadcast notification if EV permission is set AND update is NOT being done in context of write-response    
+      queueNotify();
 
-    if(nvsKey){
-      nvs_set_str(homeSpan.charNVS,nvsKey,value.STRING);    // store data
-      nvs_commit(homeSpan.charNVS);
-    }
+    if(nvsKey)
+      saveNVS();                              // schedule write-behind storage of value
   }      
 }
 
 ///////////////////////////////
 
+void SpanCharacteristic::saveNVS(){
+
+  homeSpan.nvsUpdates++;
+  homeSpan.nvsChangeTime=millis();
+
+  if(nvsDirty)                                // already scheduled - latest value will be written when flushed
+    return;
+
+  if(homeSpan.NVSDirty.empty())               // first dirty value since last commit
+    homeSpan.nvsDirtyTime=homeSpan.nvsChangeTime;
+
+  nvsDirty=true;
+  homeSpan.NVSDirty.push_back(this);
+}
+
+///////////////////////////////
+
+void SpanCharacteristic::writeNVS(){
+
+  if(format<FORMAT::STRING)
+    nvs_set_u64(homeSpan.charNVS,nvsKey,value.UINT64);       // store data as uint64_t regardless of actual type (it will be read correctly when access through uvGet())         
+  else
+    nvs_set_str(homeSpan.charNVS,nvsKey,value.STRING);       // store data
+
+  nvsDirty=false;
+}
+
+///////////////////////////////
+
+void SpanCharacteristic::queueNotify(){
+
+  if(notifyPending){                          // a Notification is already queued - since values are rendered when sent, it will report this latest value
+    homeSpan.eventsSuppressed++;
+    return;
+  }
+
+  SpanBuf sb;                                 // create SpanBuf object
+  sb.characteristic=this;                     // set characteristic          
+  sb.status=StatusCode::OK;                   // set status
+  sb.val="";                                  // set dummy "val" so that printfNotify knows to consider this "update"
+  sb.queueTime=millis();                      // used to measure EVENT delivery lag
+  homeSpan.Notifications.push_back(sb);       // store SpanBuf in Notifications vector
+  notifyPending=true;
+}
+
+///////////////////////////////
+
 void SpanCharacteristic::printfAttributes(int flags){
 
   const char permCodes[][7]={"pr","pw","ev","aa","tw","hd","wr"};
@@ -2387,18 +2813,25 @@ void SpanCharacteristic::printfAttributes(int flags){
   if((perms&PR) && (flags&GET_VALUE)){    
     if(perms&NV && !(flags&GET_NV))
       hapOut << ",\"value\":null";
-    else
-      hapOut << ",\"value\":" << uvPrint(value).c_str();
+    else {
+      hapOut << ",\"value\":";
+      printfValue(value);
+    }
   }
 
   if(flags&GET_META){
     hapOut << ",\"format\":\"" << formatCodes[format] << "\"";
     
     if(customRange && (flags&GET_META)){
-      hapOut << ",\"minValue\":" << uvPrint(minValue).c_str() << ",\"maxValue\":" << uvPrint(maxValue).c_str();
+      hapOut << ",\"minValue\":";
+      printfValue(minValue);
+      hapOut << ",\"maxValue\":";
+      printfValue(maxValue);
         
-      if(uvGet<float>(stepValue)>0)
-        hapOut << ",\"minStep\":" << uvPrint(stepValue).c_str();
+      if(uvGet<float>(stepValue)>0){
+        hapOut << ",\"minStep\":";
+        printfValue(stepValue);
+      }
     }
 
     if(unit){
@@ -2449,28 +2882,24 @@ void SpanCharacteristic::printfAttributes(int flags){
 
 ///////////////////////////////
 
-StatusCode SpanCharacteristic::loadUpdate(char *val, char *ev, boolean wr){
+StatusCode SpanCharacteristic::loadUpdate(const char *val, size_t valLen, int ev, boolean wr){
 
-  if(ev){                // request for notification
-    boolean evFlag;
-    
-    if(!strcmp(ev,"0") || !strcmp(ev,"false"))
-      evFlag=false;
-    else if(!strcmp(ev,"1") || !strcmp(ev,"true"))
-      evFlag=true;
-    else
+  if(ev>=0){             // request for notification
+    if(ev>1)
       return(StatusCode::InvalidValue);
     
-    if(evFlag && !(perms&EV))         // notification is not supported for characteristic
+    if(ev && !(perms&EV))             // notification is not supported for characteristic
       return(StatusCode::NotifyNotAllowed);
       
-    LOG1("Notification Request for aid=%lu iid=%lu: %s\n",aid,iid,evFlag?"true":"false");
+    LOG1("Notification Request for aid=%lu iid=%lu: %s\n",aid,iid,ev?"true":"false");
     HAPClient *hc=&(*(homeSpan.currentClient));
     
-    if(evFlag)
-      evList.add(hc);
-    else
+    if(!ev)
       evList.remove(hc);
+    else if(!evList.add(hc)){         // connection has no subscription slot available
+      homeSpan.metrics.count(SpanMetrics::SUBSCRIBE_REJECTED);
+      return(StatusCode::OutOfResources);
+    }
   }
 
   if(!val)                // no request to update value
@@ -2479,74 +2908,52 @@ StatusCode SpanCharacteristic::loadUpdate(char *val, char *ev, boolean wr){
   if(!(perms&PW))         // cannot write to read only characteristic
     return(StatusCode::ReadOnly);
 
+  int flag=SpanJSON::flag(val,valLen);      // 0 or 1 if val is "0"/"false" or "1"/"true", else -1
+  char num[SpanJSON::MAX_NUMBER];           // numeric values are copied here so the conversions below are bounded by valLen
+  char *end=NULL;
+
+  if(format!=BOOL && format<STRING && !SpanJSON::number(num,val,valLen))
+    return(StatusCode::InvalidValue);
+
+  uint64_t prior=newValue.UINT64;           // saved in case the numeric conversion below fails
+
   switch(format){
     
     case BOOL:
-      if(!strcmp(val,"0") || !strcmp(val,"false"))
-        newValue.BOOL=false;
-      else if(!strcmp(val,"1") || !strcmp(val,"true"))
-        newValue.BOOL=true;
-      else
+      if(flag<0)
         return(StatusCode::InvalidValue);
+      newValue.BOOL=flag;
       break;
 
     case INT:
-      if(!strcmp(val,"false"))
-        newValue.INT=0;
-      else if(!strcmp(val,"true"))
-        newValue.INT=1;
-      else if(!sscanf(val,"%ld",&newValue.INT))
-        return(StatusCode::InvalidValue);
+      newValue.INT=flag>=0?flag:strtol(num,&end,10);
       break;
 
     case UINT8:
-      if(!strcmp(val,"false"))
-        newValue.UINT8=0;
-      else if(!strcmp(val,"true"))
-        newValue.UINT8=1;
-      else if(!sscanf(val,"%hhu",&newValue.UINT8))
-        return(StatusCode::InvalidValue);
+      newValue.UINT8=flag>=0?flag:strtoul(num,&end,10);
       break;
             
     case UINT16:
-      if(!strcmp(val,"false"))
-        newValue.UINT16=0;
-      else if(!strcmp(val,"true"))
-        newValue.UINT16=1;
-      else if(!sscanf(val,"%hu",&newValue.UINT16))
-        return(StatusCode::InvalidValue);
+      newValue.UINT16=flag>=0?flag:strtoul(num,&end,10);
       break;
       
     case UINT32:
-      if(!strcmp(val,"false"))
-        newValue.UINT32=0;
-      else if(!strcmp(val,"true"))
-        newValue.UINT32=1;
-      else if(!sscanf(val,"%lu",&newValue.UINT32))
-        return(StatusCode::InvalidValue);
+      newValue.UINT32=flag>=0?flag:strtoul(num,&end,10);
       break;
       
     case UINT64:
-      if(!strcmp(val,"false"))
-        newValue.UINT64=0;
-      else if(!strcmp(val,"true"))
-        newValue.UINT64=1;
-      else if(!sscanf(val,"%llu",&newValue.UINT64))
-        return(StatusCode::InvalidValue);
+      newValue.UINT64=flag>=0?flag:strtoull(num,&end,10);
       break;
 
     case FLOAT:
-      if(!sscanf(val,"%lg",&newValue.FLOAT))
-        return(StatusCode::InvalidValue);
+      newValue.FLOAT=strtod(num,&end);
       break;
 
     case STRING:
-      uvSet(newValue,(const char *)val);
-      break;
-      
     case DATA:
     case TLV_ENC:
-      uvSet(newValue,(const char *)stripBackslash(val));
+      newValue.STRING = (char *)HS_REALLOC(newValue.STRING, valLen + 1);
+      SpanJSON::unescape(newValue.STRING,val,valLen);
       break;
 
     default:
@@ -2554,6 +2961,11 @@ StatusCode SpanCharacteristic::loadUpdate(char *val, char *ev, boolean wr){
 
   } // switch
 
+  if(end==num){           // no digits could be converted
+    newValue.UINT64=prior;              // leave newValue as it was (it may already hold a value from an earlier object in the same request)
+    return(StatusCode::InvalidValue);
+  }
+
   updateFlag=1+wr;                // set flag to 1 if successful update or 2 if successful AND write-response flag is set
   updateTime=homeSpan.snapTime;
   return(StatusCode::TBD);
@@ -2605,6 +3017,7 @@ SpanCharacteristic *SpanCharacteristic::setPerms(uint8_t perms){
   perms&=0x7F;
   if(perms>0)
     this->perms=perms;
+  service->accessory->hashValid=false;
   return(this);
 }
 
@@ -2625,6 +3038,7 @@ SpanCharacteristic *SpanCharacteristic::removePerms(uint8_t dPerms){
 SpanCharacteristic *SpanCharacteristic::setDescription(const char *c){
   desc = (char *)HS_REALLOC(desc, strlen(c) + 1);
   strcpy(desc, c);
+  service->accessory->hashValid=false;
   return(this);
 }  
 
@@ -2633,6 +3047,7 @@ SpanCharacteristic *SpanCharacteristic::setDescription(const char *c){
 SpanCharacteristic *SpanCharacteristic::setUnit(const char *c){
   unit = (char *)HS_REALLOC(unit, strlen(c) + 1);
   strcpy(unit, c);
+  service->accessory->hashValid=false;
   return(this);
 }  
 
@@ -2641,6 +3056,15 @@ SpanCharacteristic *SpanCharacteristic::setUnit(const char *c){
 SpanCharacteristic *SpanCharacteristic::setMaxStringLength(uint8_t n){
   if(format==FORMAT::STRING)
     maxLen=n;
+  service->accessory->hashValid=false;
+  return(this);
+}
+
+///////////////////////////////
+
+SpanCharacteristic *SpanCharacteristic::setMinEventInterval(uint32_t ms){
+  minEventInterval=ms;
+  eventTime=millis()-ms;                  // allows first Event Notification to be sent without delay
   return(this);
 }
 
@@ -2677,6 +3101,7 @@ SpanCharacteristic *SpanCharacteristic::setValidValues(int n, ...){
 
   validValues=(char *)HS_REALLOC(validValues, strlen(s.c_str()) + 1);
   strcpy(validValues,s.c_str());
+  service->accessory->hashValid=false;
 
   return(this);
 }
@@ -2684,21 +3109,28 @@ SpanCharacteristic *SpanCharacteristic::setValidValues(int n, ...){
 ///////////////////////////////
 
 boolean SpanCharacteristic::EVLIST::has(HAPClient *hc){
-  return(find_if(begin(), end(), [hc](const HAPClient *hcTemp){return(hc==hcTemp);}) != end());  
+  return(hc->slot>=0 && (mask&(1UL<<hc->slot)));
 }
 
 ///////////////////////////////
 
-void SpanCharacteristic::EVLIST::add(HAPClient *hc){
-  if(!has(hc))
-    push_back(hc);
+boolean SpanCharacteristic::EVLIST::add(HAPClient *hc){
+  if(hc->slot<0)
+    return(false);
+  if(!has(hc)){
+    mask|=(1UL<<hc->slot);
+    hc->nSubscriptions++;
+  }
+  return(true);
 }
 
 ///////////////////////////////
 
 void SpanCharacteristic::EVLIST::remove(HAPClient *hc){
-  auto it=remove_if(begin(), end(), [hc](const HAPClient *hcTemp){return(hc==hcTemp);});
-  erase(it,end());
+  if(has(hc)){
+    mask&=~(1UL<<hc->slot);
+    hc->nSubscriptions--;
+  }
 }
 
 ///////////////////////////////
@@ -2767,7 +3199,28 @@ void SpanWebLog::init(uint16_t maxEntries, const char *serv, const char *tz, con
     asprintf(&statusURL,"/%s",url);
     isEnabled=true;
   }
-  log = (log_t *)HS_CALLOC(maxEntries,sizeof(log_t));
+  log = (log_t *)HS_CALLOC(maxEntries,sizeof(log_t));     // pre-allocate all log slots so that vLog() never needs to allocate memory
+  msgBuf = (char *)HS_CALLOC(maxEntries,msgSize);         // pre-allocate message storage for all log slots
+  if(maxEntries && (!log || !msgBuf)){
+    Serial.printf("\n\n*** FATAL ERROR: Can't allocate %d bytes for Web Log.  Program Halting.\n\n",(int)(maxEntries*(sizeof(log_t)+msgSize)));
+    while(1);
+  }
+  for(int i=0;i<maxEntries;i++){
+    new(log+i) log_t();
+    log[i].message=msgBuf+i*msgSize;
+  }
+}
+
+///////////////////////////////
+
+void SpanWebLog::setMsgSize(uint16_t size){
+
+  if(log){                               // message storage is shared with lock-free writers and readers once Web Log is running, so it cannot be resized
+    LOG0("\n*** WARNING!  Call to setWebLogMessageSize(%d) ignored: must be called before enableWebLog()\n\n",size);
+    return;
+  }
+
+  msgSize=size<4?4:size;                 // leave room for at least the "..." truncation marker
 }
 
 ///////////////////////////////
@@ -2810,35 +3263,171 @@ int SpanWebLog::check(const char *uri){
 
 ///////////////////////////////
 
+int SpanWebLog::checkData(const char *uri, uint32_t &since, boolean &statsOnly){
+
+  size_t n=strlen(statusURL);
+  int format;
+
+  if(strncasecmp(uri,statusURL,n)!=0)        // no partial match of statusURL
+    return(-1);
+
+  uri+=n;
+  if(!strncasecmp(uri,".json",5)){
+    format=DATA_JSON;
+    uri+=5;
+  } else if(!strncasecmp(uri,".csv",4)){
+    format=DATA_CSV;
+    uri+=4;
+  } else if(!strncasecmp(uri,".metrics",8)){
+    format=DATA_METRICS;
+    uri+=8;
+  } else {
+    return(-1);
+  }
+
+  since=0;
+  statsOnly=false;
+
+  if(*uri==' ')                              // match without query string
+    return(format);
+  if(*uri!='?')                              // no match
+    return(-1);
+
+  char query[48];                            // copy query string so that search for parameters does not extend into HTTP headers
+  size_t len=strcspn(++uri," ");
+  if(len>=sizeof(query))
+    len=sizeof(query)-1;
+  memcpy(query,uri,len);
+  query[len]='\0';
+
+  char *save;
+  for(char *param=strtok_r(query,"&",&save);param;param=strtok_r(NULL,"&",&save)){     // each parameter is either "key" or "key=value" (unknown keys are ignored)
+    char *val=strchr(param,'=');
+    size_t keyLen=val?val-param:strlen(param);
+
+    if(keyLen==5 && !strncasecmp(param,"since",5))
+      since=val?strtoul(val+1,NULL,10):0;
+    else if(keyLen==5 && !strncasecmp(param,"stats",5))
+      statsOnly=(!val || strcmp(val+1,"0"));        // "stats" or "stats=1" (but not "stats=0")
+  }
+
+  return(format);
+}
+
+///////////////////////////////
+
 void SpanWebLog::vLog(boolean sysMsg, const char *fmt, va_list ap){
 
-  std::unique_lock writeLock(mux);        // wait for mux to be unlocked and then lock *exclusively* so write can proceed uninterrupted
-  
-  char *buf;
-  vasprintf(&buf,fmt,ap);
+  if(homeSpan.getLogLevel()>=(sysMsg?0:1)){       // print full message to Serial Monitor directly from fmt (no buffer needed)
+    va_list ap2;
+    va_copy(ap2,ap);
+    if(!sysMsg)
+      printf("WEBLOG: ");
+    vprintf(fmt,ap2);
+    printf("\n");                                // stdout is line-buffered, so the message is flushed as a whole
+    va_end(ap2);
+  }
+
+  if(maxEntries>0)
+    addEntry(fmt,ap);
+}
+
+///////////////////////////////
+
+void SpanWebLog::addEntry(const char *fmt, va_list ap){
 
-  if(sysMsg)
-    LOG0("%s\n",buf);
+  uint32_t n=nEntries.fetch_add(1);       // reserve next entry number - never waits, so logging cannot block behind a reader of the Web Log
+  log_t *slot=log+n%maxEntries;
+
+  slot->stamp.store(2*n+1,std::memory_order_relaxed);     // odd stamp marks slot as being written
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->upTime=esp_timer_get_time();
+  if(timeInit)
+    getLocalTime(&slot->clockTime,10);
   else
-    LOG1("WEBLOG: %s\n",buf);
-  
-  if(maxEntries>0){
-    int index=nEntries%maxEntries;
-  
-    log[index].upTime=esp_timer_get_time();
-    if(timeInit)
-      getLocalTime(&log[index].clockTime,10);
-    else
-      log[index].clockTime.tm_year=0;
-  
-    log[index].message=(char *)HS_REALLOC(log[index].message, strlen(buf) + 1);
-    strcpy(log[index].message, buf);
-    
-    log[index].clientIP=homeSpan.lastClientIP;  
-    nEntries++;
+    slot->clockTime.tm_year=0;
+  slot->clientIP=homeSpan.lastClientIP;
+  if(vsnprintf(slot->message,msgSize,fmt,ap)>=msgSize)   // format message directly into its pre-allocated slot (no buffer needed)
+    strcpy(slot->message+msgSize-4,"...");                // mark message as truncated
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->stamp.store(2*n+2,std::memory_order_relaxed);     // slot now holds complete entry n
+}
+
+///////////////////////////////
+
+boolean SpanWebLog::getEntry(uint32_t n, entry_t &entry){
+
+  log_t *slot=log+n%maxEntries;
+  uint32_t stamp=slot->stamp.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);     // entry contents cannot be read before stamp
+
+  if(stamp!=2*n+2)                        // entry n is still being written, or slot has already been re-used for a later entry
+    return(false);
+
+  char *message=entry.message;            // retain caller's message buffer
+  entry=*slot;                            // take snapshot of entry
+  entry.message=message;
+  memcpy(message,slot->message,msgSize);
+  std::atomic_thread_fence(std::memory_order_acquire);     // entry contents cannot be read after stamp is re-checked
+  return(slot->stamp.load(std::memory_order_relaxed)==stamp);     // snapshot is only valid if slot was not re-used while being copied
+}
+
+///////////////////////////////
+//       SpanMetrics         //
+///////////////////////////////
+
+const char * const SpanMetrics::histNames[N_HISTOGRAMS]={
+  "pair-setup", "pair-verify", "pairings", "accessories", "get-characteristics", "put-characteristics", "put-prepare", "status", "status-data", "error",
+  "decrypt", "encrypt", "event-notify", "update-characteristics", "nvs-commit", "setup-crypto", "verify-crypto"
+};
+
+const char * const SpanMetrics::counterNames[N_COUNTERS]={
+  "bytes-received", "bytes-sent", "write-errors", "events-sent", "events-dropped", "subscribe-rejected"
+};
+
+///////////////////////////////
+
+void SpanMetrics::record(int h, uint32_t elapsed){
+
+  int b=elapsed<64?0:(31-__builtin_clz(elapsed))/2-2;       // bucket limits increase by factors of 4 starting at 64us
+  if(b>=N_BUCKETS)
+    b=N_BUCKETS-1;
+
+  hist[h].count++;
+  hist[h].total+=elapsed;
+  if(elapsed>hist[h].max)
+    hist[h].max=elapsed;
+  hist[h].bucket[b]++;
+}
+
+///////////////////////////////
+
+void SpanMetrics::print(){
+
+  char label[16];
+
+  LOG0("\n*** HomeSpan Metrics ***\n\n");
+
+  LOG0("%-24s%10s%10s%10s ","Latency (us)","Count","Avg","Max");
+  for(int b=0;b<N_BUCKETS-1;b++){
+    sprintf(label,"<%lu",bucketLimit(b));
+    LOG0("%9s",label);
   }
+  sprintf(label,">=%lu",bucketLimit(N_BUCKETS-2));
+  LOG0("%10s\n",label);
+
+  for(int h=0;h<N_HISTOGRAMS;h++){
+    LOG0("%-24s%10lu%10llu%10lu ",histNames[h],hist[h].count,hist[h].count?hist[h].total/hist[h].count:0ULL,hist[h].max);
+    for(int b=0;b<N_BUCKETS;b++)
+      LOG0(b<N_BUCKETS-1?"%9lu":"%10lu",hist[h].bucket[b]);
+    LOG0("\n");
+  }
+
+  LOG0("\n%-24s%10s\n","Counter","Total");
+  for(int c=0;c<N_COUNTERS;c++)
+    LOG0("%-24s%10llu\n",counterNames[c],counter[c]);
 
-  free(buf);
+  LOG0("\n*** End Metrics ***\n\n");
 }
 
 ///////////////////////////////
@@ -2894,6 +3483,7 @@ int SpanOTA::setPassword(const char *pwd){
 ///////////////////////////////
 
 void SpanOTA::start(){
+  homeSpan.flushNVS();                  // commit any pending Characteristic values before OTA update begins
   LOG0("\n*** Current Partition: %s\n*** New Partition: %s\n*** OTA Starting..",
     esp_ota_get_running_partition()->label,esp_ota_get_next_update_partition(NULL)->label);
   otaPercent=0;
@@ -36,6 +36,7 @@
 #include <unordered_map>
 #include <vector>
 #include <list>
+#include <atomic>
 #include <shared_mutex>
 #include <nvs.h>
 #include <ArduinoOTA.h>
@@ -195,20 +196,44 @@ struct SpanBuf{                               // temporary storage buffer for us
   uint32_t aid=0;                             // updated aid 
   uint32_t iid=0;                             // updated iid
   boolean wr=false;                           // flag to indicate write-response has been requested
-  char *val=NULL;                             // updated value (optional, though either at least 'val' or 'ev' must be specified)
-  char *ev=NULL;                              // updated event notification flag (optional, though either at least 'val' or 'ev' must be specified)
+  const char *val=NULL;                       // updated value, pointing into JSON text and NOT null-terminated (optional, though either at least 'val' or 'ev' must be specified)
+  size_t valLen=0;                            // length of updated value
+  int8_t ev=-1;                               // updated event notification flag: -1=not specified, 0=false, 1=true, 2=invalid (optional, though either at least 'val' or 'ev' must be specified)
   StatusCode status;                          // return status (HAP Table 6-11)
   SpanCharacteristic *characteristic=NULL;    // Characteristic to update (NULL if not found)
+  unsigned long queueTime=0;                  // time (in millis) an Event Notification was queued by setVal() (0 if not applicable)
 };
 
 typedef vector<SpanBuf, Mallocator<SpanBuf>> SpanBufVec;
+
+///////////////////////////////
+
+struct SpanJSON{                              // single-pass tokenizer for PUT /characteristics JSON text - never modifies the underlying text
+  const char *p;                              // current position in JSON text
+
+  SpanJSON(const char *buf) : p{buf} {}
+
+  char peek();                                                      // skips whitespace and returns next character without consuming it
+  boolean accept(char c);                                           // skips whitespace and consumes next character if it matches c; returns true if consumed, else false
+  boolean string(const char *&s, size_t &len);                      // consumes a quoted string and sets s/len to its (still-escaped) contents; returns false on error
+  boolean scalar(const char *&s, size_t &len);                      // consumes a string, number, or literal (true/false/null) and sets s/len to its contents; returns false on error
+  boolean skip(int depth=0);                                        // consumes and discards any value, including nested objects and arrays; returns false on error
+
+  static boolean match(const char *s, size_t len, const char *token){return(strlen(token)==len && !strncmp(s,token,len));}    // returns true if s/len exactly matches token
+  static int flag(const char *s, size_t len);                       // returns 0 if s/len is "0" or "false", 1 if "1" or "true", else -1
+  static size_t unescape(char *dest, const char *s, size_t len);    // copies JSON string contents s/len into dest (must hold len+1 bytes) resolving all escape sequences; returns length of null-terminated dest
+  static boolean number(char *dest, const char *s, size_t len);     // copies number s/len into dest (must hold MAX_NUMBER bytes) as a null-terminated string for strtol() etc.; returns false if it does not fit
+
+  static const size_t MAX_NUMBER=64;                                // size of buffer used with number()
+};
   
 ///////////////////////////////
 
 struct SpanWebLog{                            // optional web status/log data
   boolean isEnabled=false;                    // flag to inidicate WebLog has been enabled
   uint16_t maxEntries=0;                      // max number of log entries;
-  int nEntries=0;                             // total cumulative number of log entries
+  uint16_t msgSize=DEFAULT_WEBLOG_MSG_SIZE;   // size (in bytes, including terminating null) of each message slot; longer messages are truncated
+  std::atomic<uint32_t> nEntries=0;           // total cumulative number of log entries (incremented atomically to reserve a slot)
   const char *timeServer=NULL;                // optional time server to use for acquiring clock time
   const char *timeZone;                       // optional time-zone specification
   boolean timeInit=false;                     // flag to indicate time has been initialized
@@ -217,19 +242,64 @@ struct SpanWebLog{                            // optional web status/log data
   char *faviconURL=NULL;                      // optional URL for favicon PNG image
   uint32_t waitTime=120000;                   // number of milliseconds to wait for initial connection to time server
   String css="";                              // optional user-defined style sheet for web log
-  std::shared_mutex mux;                      // shared read/write lock
     
-  struct log_t {                              // log entry type
+  struct entry_t {                            // log entry type
     uint64_t upTime;                          // number of seconds since booting
     struct tm clockTime;                      // clock time
-    char *message;                            // pointers to log entries of arbitrary size
-    String clientIP;                          // IP address of client making request (or "0.0.0.0" if not applicable)
-  } *log=NULL;                                // array of log entries 
+    IPAddress clientIP;                       // IP address of client making request (or 0.0.0.0 if not applicable)
+    char *message=NULL;                       // log message (truncated to fit msgSize)
+  };
+
+  struct log_t : entry_t {                    // log slot type
+    std::atomic<uint32_t> stamp=0;            // sequence stamp: odd while entry is being written, 2*(entry number)+2 when complete
+  } *log=NULL;                                // array of log slots, pre-allocated in init()
+
+  char *msgBuf=NULL;                          // message storage for all log slots (maxEntries x msgSize bytes), pre-allocated in init()
 
   void init(uint16_t maxEntries, const char *serv, const char *tz, const char *url);
+  void setMsgSize(uint16_t size);
   static void initTime(void *args);  
   void vLog(boolean sysMsg, const char *fmr, va_list ap);
+  void addEntry(const char *fmt, va_list ap);    // formats message into next log slot, truncating to fit msgSize
+  boolean getEntry(uint32_t n, entry_t &entry);  // copies log entry n into entry (with message copied into entry.message, which must point to msgSize bytes); returns false if entry has been overwritten or is being written
   int check(const char *uri);
+  int checkData(const char *uri, uint32_t &since, boolean &statsOnly);     // returns DATA_JSON, DATA_CSV, or DATA_METRICS if uri requests Web Log data or metrics (setting since and statsOnly from query string), else -1
+
+  enum {DATA_JSON, DATA_CSV, DATA_METRICS};   // formats for Web Log data requests
+};
+
+///////////////////////////////
+
+struct SpanMetrics{                           // runtime metrics - fixed-bucket latency histograms and monotonic counters, updated without locks since each metric is only written by a single task
+
+  enum {                                      // latency histograms (all times in microseconds)
+    REQ_PAIR_SETUP, REQ_PAIR_VERIFY, REQ_PAIRINGS, REQ_ACCESSORIES, REQ_GET_CHARS, REQ_PUT_CHARS, REQ_PUT_PREPARE, REQ_STATUS, REQ_STATUS_DATA, REQ_ERROR,
+    DECRYPT, ENCRYPT, EVENT_NOTIFY, UPDATE_CHARS, NVS_COMMIT, SETUP_CRYPTO, VERIFY_CRYPTO,
+    N_HISTOGRAMS
+  };
+
+  enum {                                      // counters
+    BYTES_RECEIVED, BYTES_SENT, WRITE_ERRORS, EVENTS_SENT, EVENTS_DROPPED, SUBSCRIBE_REJECTED,
+    N_COUNTERS
+  };
+
+  static const int N_BUCKETS=8;               // bucket b holds times below 64*4^b microseconds (from <64us up to <256ms), except last bucket holds all remaining times
+  static const char * const histNames[N_HISTOGRAMS];
+  static const char * const counterNames[N_COUNTERS];
+
+  struct hist_t {
+    uint32_t count=0;                         // number of times recorded
+    uint32_t max=0;                           // maximum time recorded
+    uint64_t total=0;                         // sum of all times recorded (for computing average)
+    uint32_t bucket[N_BUCKETS]={0};           // number of times recorded in each bucket
+  } hist[N_HISTOGRAMS];
+
+  uint64_t counter[N_COUNTERS]={0};
+
+  void record(int h, uint32_t elapsed);                               // records elapsed time (in microseconds) in histogram h
+  void count(int c, uint32_t n=1){counter[c]+=n;}                     // adds n to counter c
+  static uint32_t bucketLimit(int b){return(64UL<<(2*b));}            // upper limit (in microseconds) of bucket b
+  void print();                                                       // prints all metrics to Serial
 };
 
 ///////////////////////////////
@@ -265,6 +335,7 @@ class Span{
   friend class SpanWebLog;
   friend class SpanOTA;
   friend class Network_HS;
+  friend class HapOut;
   friend class HAPClient;
   friend void init();
   
@@ -280,7 +351,7 @@ class Span{
   HapQR qrCode;                                 // optional QR Code to use for pairing
   const char *sketchVersion="n/a";              // version of the sketch
   char pairingCodeCommand[12]="";               // user-specified Pairing Code - only needed if Pairing Setup Code is specified in sketch using setPairingCode()
-  String lastClientIP="0.0.0.0";                // IP address of last client accessing device through encrypted channel
+  IPAddress lastClientIP;                       // IP address of last client accessing device through encrypted channel
   boolean newCode;                              // flag indicating new application code has been loaded (based on keeping track of app SHA256)
   boolean serialInputDisabled=false;            // flag indiating that serial input is disabled
   uint8_t rebootCount=0;                        // counts number of times device was rebooted (used in optional Reboot callback)
@@ -300,10 +371,6 @@ class Span{
   HS_ExpCounter wifiTimeCounter;                // exponentially-increasing wait time counter between WiFi connection attempts
   unsigned long alarmConnect=0;                 // time after which WiFi connection attempt should be tried again
 
-  static constexpr char delims[]="\"{[:,]}"; 
-  static const uint8_t DELIM = 0xF5;
-  static const uint8_t END_DELIM = DELIM+strlen(delims)-1;  
-  
   void (*wifiBegin)(const char *s, const char *p)=[](const char *s, const char *p){WiFi.begin(s,p);};     // default call to WiFi.begin()
  
   uint32_t rescanInitialTime=0;
@@ -337,6 +404,7 @@ class Span{
   PushButton *controlButton = NULL;                 // controls HomeSpan configuration and resets
   Network_HS network;                               // configures WiFi and Setup Code via either serial monitor or temporary Access Point
   SpanWebLog webLog;                                // optional web status/log
+  SpanMetrics metrics;                              // runtime metrics
   TaskHandle_t pollTaskHandle = NULL;               // optional task handle to use for poll() function
   TaskHandle_t loopTaskHandle;                      // Arduino Loop Task handle
   boolean verboseWifiReconnect = true;              // set to false to not print WiFi reconnect attempts messages
@@ -351,26 +419,47 @@ class Span{
   vector<SpanAccessory *, Mallocator<SpanAccessory *>> Accessories;      // vector of pointers to all Accessories
   vector<SpanService *, Mallocator<SpanService *>> Loops;                // vector of pointer to all Services that have over-ridden loop() methods
   SpanBufVec Notifications;                                              // vector of SpanBuf objects that store info for Characteristics that are updated with setVal() and require a Notification Event
+  uint32_t eventsSent=0;                                                 // number of Characteristic Event Notifications released for transmission
+  uint32_t eventsSuppressed=0;                                           // number of Characteristic updates coalesced into an Event Notification that was already queued
+  uint32_t eventBatches=0;                                               // number of Event Notification batches sent to at least one subscribed client
+  uint32_t eventRendersSaved=0;                                          // number of Event Notification JSON renders avoided by sharing a body across clients with identical subscriptions
+  uint16_t lastRendersSaved=0;                                           // number of renders avoided in the most recent batch
   vector<SpanButton *,  Mallocator<SpanButton *>> PushButtons;           // vector of pointer to all PushButtons
   unordered_map<uint64_t, uint32_t> TimedWrites;                         // map of timed-write PIDs and Alarm Times (based on TTLs)  
   unordered_map<char, SpanUserCommand *> UserCommands;                   // map of pointers to all UserCommands
+  unordered_map<uint64_t, SpanCharacteristic *> CharIndex;               // map of pointers to all Characteristics, keyed on aid and iid (see charKey), used by find()
+  vector<SpanCharacteristic *, Mallocator<SpanCharacteristic *>> NVSDirty;   // vector of pointers to Characteristics with values changed in RAM but not yet written to NVS
+
+  uint32_t nvsQuietTime=DEFAULT_NVS_QUIET_TIME;     // time (in millis) without further changes before dirty Characteristic values are committed to NVS
+  uint32_t nvsMaxDelay=DEFAULT_NVS_MAX_DELAY;       // maximum time (in millis) a dirty Characteristic value may wait before being committed to NVS
+  unsigned long nvsDirtyTime=0;                     // time (in millis) the first Characteristic became dirty since the last commit
+  unsigned long nvsChangeTime=0;                    // time (in millis) of most recent change to any dirty Characteristic
+  uint32_t nvsUpdates=0;                            // number of Characteristic value changes scheduled for storage in NVS (each previously required its own commit)
+  uint32_t nvsCommits=0;                            // number of NVS commits actually performed for Characteristic values
+
+  uint32_t cryptoTaskStack=DEFAULT_CRYPTO_TASK_STACK;   // stack size of crypto worker task (0 = perform Pair-Setup and Pair-Verify cryptography directly on poll task)
+  uint32_t cryptoTaskPriority=1;                        // priority of crypto worker task
+  int cryptoTaskCore=-1;                                // core for crypto worker task (-1 = core not running poll task, if available)
+  uint8_t curveKeyDepth=DEFAULT_CURVE_KEY_POOL;         // number of ephemeral Curve25519 key pairs the crypto worker task keeps ready for Pair-Verify
+  uint32_t maxPollStall=0;                              // longest time (in micros) a single pass of the poll task spent servicing HAP client connections
+
+  static uint64_t charKey(uint32_t aid, uint32_t iid){return(((uint64_t)aid<<32)|iid);}   // returns key used to index Characteristics in CharIndex
 
   void pollTask();                                                       // poll HAP Clients and process any new HAP requests
   void configureNetwork();                                               // configure Network services (MDNS, WebLog,  OTA, etc.) and start HAP Server
   void commandMode();                                                    // allows user to control and reset HomeSpan settings with the control button
   void resetStatus();                                                    // resets statusLED and calls statusCallback based on current HomeSpan status
-  void reboot();                                                         // reboots device
+  void reboot();                                                         // reboots device (after first committing any pending Characteristic values to NVS)
+  void checkNVS();                                                       // commits pending Characteristic values to NVS once quiet period or maximum delay has elapsed
+  void discardNVS();                                                     // discards pending Characteristic values without writing them (used before erasing NVS)
 
   void printfAttributes(int flags=GET_VALUE|GET_META|GET_PERMS|GET_TYPE|GET_DESC);   // writes Attributes JSON database to hapOut stream
   
   SpanCharacteristic *find(uint32_t aid, uint32_t iid);             // return Characteristic with matching aid and iid (else NULL if not found)
   void printfAttributes(SpanBufVec &pVec);                          // writes SpanBuf objects to hapOut stream
   boolean printfAttributes(char **ids, int numIDs, int flags);      // writes accessory requested characteristic ids to hapOut stream - returns true if all characteristics are found and readable, else returns false
-  void clearNotify(HAPClient *hc);                                  // clear all notifications related to specific client connection
+  void clearNotify(uint32_t slots);                                 // clear all notifications for the subscription slots in bitmask slots
   void printfNotify(SpanBufVec &pVec, HAPClient *hc);               // writes notification JSON to hapOut stream based on SpanBuf objects and specified connection
-  char *escapeJSON(char *jObj);                                     // remove all whitespace not within double-quotes, and converts special characters to unused UTF-8 bytes as a placeholder
-  char *unEscapeJSON(char *jObj);                                   // converts UTF-8 placeholder bytes back to original special characters
-  char *strstr_r(const char *haystack, const char *needle);         // same as standard-C strstr(), but returns pointer to character AFTER end of matched string (or NULL if no match)
   boolean updateCharacteristics(char *buf, SpanBufVec &pVec);       // parses PUT /characteristics JSON request and updates referenced characteristics; returns true on success, false on fail
 
   static boolean invalidUUID(const char *uuid){
@@ -470,6 +559,7 @@ class Span{
     va_end(ap);    
   }
 
+  Span& setWebLogMessageSize(uint16_t size){webLog.setMsgSize(size);return(*this);}       // sets size (in bytes, including terminating null) of each Web Log message slot (default=DEFAULT_WEBLOG_MSG_SIZE) - must be called before enableWebLog()
   Span& setWebLogCSS(const char *css){webLog.css="\n" + String(css) + "\n";return(*this);}
   Span& setWebLogCallback(void (*f)(String &)){weblogCallback=f;return(*this);}
   Span& setWebLogFavicon(const char *favicon=DEFAULT_FAVICON){asprintf(&webLog.faviconURL,"%s",favicon);return(*this);}
@@ -480,6 +570,12 @@ class Span{
 
   Span& setRebootCallback(void (*f)(uint8_t),uint32_t t=DEFAULT_REBOOT_CALLBACK_TIME){rebootCallback=f;rebootCallbackTime=t;return(*this);}
 
+  Span& setTxBufferSize(uint32_t nBytes);                   // sets size (in bytes) of buffer used to batch HAP frames into a single write (minimum is one full encrypted frame of 1042 bytes)
+  Span& setNVSWriteDelay(uint32_t quietTime, uint32_t maxDelay=DEFAULT_NVS_MAX_DELAY){nvsQuietTime=quietTime;nvsMaxDelay=maxDelay;return(*this);}     // sets quiet period and maximum delay (in millis) before changed Characteristic values are committed to NVS (0,0 = commit on next poll)
+  Span& flushNVS();                                         // immediately writes and commits any pending Characteristic values to NVS
+  Span& setCryptoTask(uint32_t stackSize, uint32_t priority=1, int core=-1){cryptoTaskStack=stackSize;cryptoTaskPriority=priority;cryptoTaskCore=core;return(*this);}    // configures worker task for Pair-Setup/Pair-Verify cryptography (stackSize=0 performs cryptography on poll task instead)
+  Span& setCurveKeyPool(uint8_t depth){curveKeyDepth=depth;return(*this);}     // sets number of ephemeral Curve25519 key pairs pre-generated by crypto worker task for Pair-Verify (0 = generate during each Pair-Verify)
+
   std::shared_mutex& getMutex(){return(pollMutex);}
 
   void autoPoll(uint32_t stackSize=8192, uint32_t priority=1, uint32_t core=0){
@@ -528,6 +624,8 @@ class SpanAccessory{
   uint32_t aid=0;                                               // Accessory Instance ID (HAP Table 6-1)
   uint32_t iidCount=0;                                          // running count of iid to use for Services and Characteristics associated with this Accessory                                 
   vector<SpanService *, Mallocator<SpanService*>> Services;     // vector of pointers to all Services in this Accessory  
+  uint8_t hashCode[48];                                         // cached SHA-384 hash of this Accessory's attributes database (excluding values)
+  boolean hashValid=false;                                      // flag indicating whether hashCode is current (cleared upon any structural change to this Accessory)
 
   void printfAttributes(int flags);                             // writes Accessory JSON to hapOut stream
 
@@ -603,6 +701,7 @@ class SpanCharacteristic{
 
   friend class Span;
   friend class SpanService;
+  friend class HAPClient;
 
   union UVal {                                  
     boolean BOOL;
@@ -615,11 +714,13 @@ class SpanCharacteristic{
     char * STRING = NULL;
   };
 
-  class EVLIST : public vector<HAPClient *, Mallocator<HAPClient *>>{      // vector of current connections that have subscribed to EV notifications for this Characteristic
+  class EVLIST {                                                    // bitmask of connection slots (see HAPClient::slot) that have subscribed to EV notifications for this Characteristic
+    uint32_t mask=0;
     public:
-    boolean has(HAPClient *hc);                                     // returns true if pointer to connection hc is subscribed, else returns false
-    void add(HAPClient *hc);                                        // adds connection hc as new subscriber, IF not already a subscriber
+    boolean has(HAPClient *hc);                                     // returns true if connection hc is subscribed, else returns false
+    boolean add(HAPClient *hc);                                     // adds connection hc as new subscriber, IF not already a subscriber; returns false if hc has no subscription slot
     void remove(HAPClient *hc);                                     // removes connection hc as a subscriber; okay to remove even if hc was not already a subscriber
+    void clear(uint32_t slots){mask&=~slots;}                       // removes all subscribers in bitmask slots (no longer assigned to any connection)
   };
 
   uint32_t iid=0;                          // Instance ID (HAP Table 6-3)
@@ -648,11 +749,16 @@ class SpanCharacteristic{
   unsigned long updateTime=0;              // last time value was updated (in millis) either by PUT /characteristic OR by setVal()
   UVal newValue;                           // the updated value requested by PUT /characteristic
   SpanService *service=NULL;               // pointer to Service containing this Characteristic
-  EVLIST evList;                           // vector of current connections that have subscribed to EV notifications for this Characteristic 
+  EVLIST evList;                           // bitmask of current connections that have subscribed to EV notifications for this Characteristic 
+  boolean notifyPending=false;             // flag to indicate an Event Notification for this Characteristic is already queued in Notifications
+  uint32_t minEventInterval=0;             // minimum time (in millis) between Event Notifications for this Characteristic (0=no minimum)
+  unsigned long eventTime=0;               // last time (in millis) an Event Notification for this Characteristic was released for transmission
+  boolean nvsDirty=false;                  // flag to indicate value has changed but has not yet been written to NVS
     
   void printfAttributes(int flags);                           // writes Characteristic JSON to hapOut stream
-  StatusCode loadUpdate(char *val, char *ev, boolean wr);     // load updated val/ev from PUT /characteristic JSON request.  Return intitial HAP status code (checks to see if characteristic is found, is writable, etc.)  
+  StatusCode loadUpdate(const char *val, size_t valLen, int ev, boolean wr);     // load updated val/ev from PUT /characteristic JSON request.  Return intitial HAP status code (checks to see if characteristic is found, is writable, etc.)  
   String uvPrint(UVal &u);                                    // returns "printable" String for any type of Characteristic  
+  void printfValue(UVal &u);                                  // writes "printable" value for any type of Characteristic directly to hapOut stream
   
   void uvSet(UVal &dest, UVal &src);                          // copies UVal src into UVal dest
   void uvSet(UVal &u, STRING_t val);                          // copies string val into UVal u
@@ -716,6 +822,9 @@ class SpanCharacteristic{
 
   void setValCheck();                                                     // initial check before setting value of any Characteristic
   void setValFinish(boolean notify);                                      // final processing after setting value of any Characteristic
+  void queueNotify();                                                     // queues an Event Notification for this Characteristic, unless one is already queued
+  void saveNVS();                                                         // schedules current value for write-behind storage in NVS
+  void writeNVS();                                                        // writes current value to NVS (without committing)
    
   protected:
 
@@ -794,19 +903,11 @@ class SpanCharacteristic{
     updateTime=homeSpan.snapTime;
 
     if(notify){
-      if(updateFlag!=2){                        // do not broadcast EV if update is being done in context of write-response
-        SpanBuf sb;                             // create SpanBuf object
-        sb.characteristic=this;                 // set characteristic          
-        sb.status=StatusCode::OK;               // set status
-        char dummy[]="";
-        sb.val=dummy;                           // set dummy "val" so that printfNotify knows to consider this "update"
-        homeSpan.Notifications.push_back(sb);   // store SpanBuf in Notifications vector  
-      }
+      if(updateFlag!=2)                         // do not broadcast EV if update is being done in context of write-response
+        queueNotify();
     
-      if(nvsKey){
-        nvs_set_u64(homeSpan.charNVS,nvsKey,value.UINT64);            // store data as uint64_t regardless of actual type (it will be read correctly when access through uvGet())         
-        nvs_commit(homeSpan.charNVS);
-      }
+      if(nvsKey)
+        saveNVS();                              // schedule write-behind storage of value
     }
     
   } // setVal()  
@@ -824,6 +925,7 @@ class SpanCharacteristic{
   SpanCharacteristic *setUnit(const char *c);         // set unit of a Characteristic  
   SpanCharacteristic *setValidValues(int n, ...);     // sets a list of 'n' valid values allowed for a Characteristic - only applicable if format=INT, UINT8, UINT16, or UINT32
   SpanCharacteristic *setMaxStringLength(uint8_t n);  // sets maximum length of STRING Characteristics
+  SpanCharacteristic *setMinEventInterval(uint32_t ms);   // sets minimum time (in millis) between Event Notifications - intermediate updates are coalesced and the latest value is sent once the interval expires
 
   template <typename A, typename B, typename S=int> SpanCharacteristic *setRange(A min, B max, S step=0){     // sets the allowed range of a Characteristic
 
@@ -832,6 +934,7 @@ class SpanCharacteristic{
       uvSet(maxValue,max);
       uvSet(stepValue,step);  
       customRange=true; 
+      service->accessory->hashValid=false;
     } else
       setRangeError=true;
       
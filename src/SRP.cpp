@@ -35,10 +35,10 @@
 
 SRP6A::SRP6A(){
 
+  initGroup();              // initialize shared N, g, k, and _rr (only performed once)
+
   // initialize MPI structures
   
-  mbedtls_mpi_init(&N);     
-  mbedtls_mpi_init(&g);
   mbedtls_mpi_init(&s);
   mbedtls_mpi_init(&x);
   mbedtls_mpi_init(&v);
@@ -46,17 +46,10 @@ SRP6A::SRP6A(){
   mbedtls_mpi_init(&b);
   mbedtls_mpi_init(&B);
   mbedtls_mpi_init(&S);
-  mbedtls_mpi_init(&k);
   mbedtls_mpi_init(&u);
-  mbedtls_mpi_init(&_rr);
   mbedtls_mpi_init(&t1);
   mbedtls_mpi_init(&t2);
   mbedtls_mpi_init(&t3);
-
-  // load N and g into MPI structures
-  
-  mbedtls_mpi_read_string(&N,16,N3072);
-  mbedtls_mpi_lset(&g,g3072);
     
 }
 
@@ -64,8 +57,6 @@ SRP6A::SRP6A(){
 
 SRP6A::~SRP6A(){
 
-  mbedtls_mpi_free(&N);     
-  mbedtls_mpi_free(&g);
   mbedtls_mpi_free(&s);
   mbedtls_mpi_free(&x);
   mbedtls_mpi_free(&v);
@@ -73,9 +64,7 @@ SRP6A::~SRP6A(){
   mbedtls_mpi_free(&b);
   mbedtls_mpi_free(&B);
   mbedtls_mpi_free(&S);
-  mbedtls_mpi_free(&k);
   mbedtls_mpi_free(&u);
-  mbedtls_mpi_free(&_rr);
   mbedtls_mpi_free(&t1);
   mbedtls_mpi_free(&t2);
   mbedtls_mpi_free(&t3);
@@ -84,6 +73,46 @@ SRP6A::~SRP6A(){
 
 //////////////////////////////////////
 
+void SRP6A::initGroup(){
+
+  if(groupInit)
+    return;
+
+  TempBuffer<uint8_t> tBuf(768);                  // temporary buffer for staging
+  TempBuffer<uint8_t> tHash(64);                  // temporary buffer for storing SHA-512 results
+
+  mbedtls_mpi_init(&N);     
+  mbedtls_mpi_init(&g);
+  mbedtls_mpi_init(&k);
+  mbedtls_mpi_init(&_rr);                         // _rr is populated by mbedtls on first call to mbedtls_mpi_exp_mod() and re-used thereafter
+
+  // load N and g into MPI structures
+  
+  mbedtls_mpi_read_string(&N,16,N3072);
+  mbedtls_mpi_lset(&g,g3072);
+
+  // compute k = SHA512( N | PAD(g) )
+  
+  mbedtls_mpi_write_binary(&N,tBuf,384);          // write N into first half of staging buffer
+  mbedtls_mpi_write_binary(&g,tBuf+384,384);      // write g into second half of staging buffer (fully padded with leading zeros)
+  mbedtls_sha512(tBuf,768,tHash,0);               // create hash of data
+  mbedtls_mpi_read_binary(&k,tHash,64);           // load hash result into k  
+
+  // populate _rr now (with a trivial exponentiation) so it is never modified afterwards, since SRP6A may be used by the crypto worker task and the poll task at the same time
+
+  mbedtls_mpi X, E;
+  mbedtls_mpi_init(&X);
+  mbedtls_mpi_init(&E);
+  mbedtls_mpi_lset(&E,1);
+  mbedtls_mpi_exp_mod(&X,&g,&E,&N,&_rr);
+  mbedtls_mpi_free(&X);
+  mbedtls_mpi_free(&E);
+
+  groupInit=true;
+}
+
+//////////////////////////////////////
+
 void SRP6A::createVerifyCode(const char *setupCode, Verification *vData){
 
   TempBuffer<uint8_t> tBuf(80);             // temporary buffer for staging 
@@ -118,8 +147,6 @@ void SRP6A::createVerifyCode(const char *setupCode, Verification *vData){
 
 void SRP6A::createPublicKey(const Verification *vData, uint8_t *publicKey){
 
-  TempBuffer<uint8_t> tBuf(768);                  // temporary buffer for staging
-  TempBuffer<uint8_t> tHash(64);                  // temporary buffer for storing SHA-512 results
   TempBuffer<uint8_t> privateKey(32);             // temporary buffer for generating private key random numbers
 
   // load stored salt, s, and verification code, v
@@ -132,14 +159,7 @@ void SRP6A::createPublicKey(const Verification *vData, uint8_t *publicKey){
   randombytes_buf(privateKey,32);                 // generate 32 random bytes for private key                     
   mbedtls_mpi_read_binary(&b,privateKey,32);      // load private key into b
     
-  // compute k = SHA512( N | PAD(g) )
-  
-  mbedtls_mpi_write_binary(&N,tBuf,384);          // write N into first half of staging buffer
-  mbedtls_mpi_write_binary(&g,tBuf+384,384);      // write g into second half of staging buffer (fully padded with leading zeros)
-  mbedtls_sha512(tBuf,768,tHash,0);               // create hash of data
-  mbedtls_mpi_read_binary(&k,tHash,64);           // load hash result into k  
-
-  // compute B = (k*v + g^b) %N
+  // compute B = (k*v + g^b) %N  (k was computed once in initGroup())
   
   mbedtls_mpi_mul_mpi(&t1,&k,&v);                 // t1 = k*v
   mbedtls_mpi_exp_mod(&t2,&g,&b,&N,&_rr);         // t2 = g^b %N
@@ -258,3 +278,9 @@ void SRP6A::print(mbedtls_mpi *mpi){
 constexpr char SRP6A::N3072[];
 constexpr char SRP6A::I[];
 const uint8_t SRP6A::g3072;
+
+mbedtls_mpi SRP6A::N;
+mbedtls_mpi SRP6A::g;
+mbedtls_mpi SRP6A::k;
+mbedtls_mpi SRP6A::_rr;
+boolean SRP6A::groupInit=false;
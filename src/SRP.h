@@ -67,9 +67,9 @@ struct SRP6A {
   static const uint8_t g3072=5;
   static constexpr char I[]="Pair-Setup";
 
-  mbedtls_mpi N;          // N                            - 3072-bit Group pre-defined prime used for all SRP-6A calculations (384 bytes)
-  mbedtls_mpi g;          // g                            - pre-defined generator for the specified 3072-bit Group (g=5)
-  mbedtls_mpi k;          // k = H(N | PAD(g))            - SRP-6A multiplier (which is different from versions SRP-6 or SRP-3) 
+  static mbedtls_mpi N;   // N                            - 3072-bit Group pre-defined prime used for all SRP-6A calculations (384 bytes) - shared and parsed only once
+  static mbedtls_mpi g;   // g                            - pre-defined generator for the specified 3072-bit Group (g=5) - shared
+  static mbedtls_mpi k;   // k = H(N | PAD(g))            - SRP-6A multiplier (which is different from versions SRP-6 or SRP-3) - shared and computed only once
   mbedtls_mpi s;          // s                            - randomly-generated salt (16 bytes)
   mbedtls_mpi x;          // x = H(s | H(I | ":" | P))    - salted, double-hash of username and password (64 bytes)
   mbedtls_mpi v;          // v = g^x %N                   - SRP-6A verifier (max 384 bytes)  
@@ -83,12 +83,15 @@ struct SRP6A {
   mbedtls_mpi t1;         // temp1                        - temporary mpi structures for intermediate results
   mbedtls_mpi t2;         // temp2                        - temporary mpi structures for intermediate results
   mbedtls_mpi t3;         // temp3                        - temporary mpi structures for intermediate results
-  mbedtls_mpi _rr;        // _rr                          - temporary "helper" for large exponential modulus calculations
+  static mbedtls_mpi _rr; // _rr                          - "helper" for large exponential modulus calculations (depends only on N, so is retained across pairing attempts)
 
+  static boolean groupInit;     // flag indicating N, g, k, and _rr have been initialized
 
-  SRP6A();                                         // initializes N, G, and computes k
+  SRP6A();                                         // initializes all MPI structures (and N, g, and k on first use)
   ~SRP6A();
 
+  static void initGroup();                         // loads N and g, and computes k (once)
+
   void *operator new(size_t size){return(HS_MALLOC(size));}     // override new operator to use PSRAM when available
   void operator delete(void *p){free(p);}
   
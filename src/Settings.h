@@ -51,6 +51,7 @@
 #define     DEFAULT_TCP_PORT          80                  // change with homeSpan.setPort(port);
 
 #define     DEFAULT_WEBLOG_URL        "status"            // change with optional fourth argument in homeSpan.enableWebLog()
+#define     DEFAULT_WEBLOG_MSG_SIZE   128                 // change with homeSpan.setWebLogMessageSize(size); size (in bytes, including terminating null) of each Web Log message slot
 
 #define     DEFAULT_FAVICON           "https://raw.githubusercontent.com/HomeSpan/HomeSpan/refs/heads/master/docs/images/HomeSpanLogo.png"
 
@@ -58,6 +59,14 @@
 
 #define     DEFAULT_REBOOT_CALLBACK_TIME  5000            // default time (in milliseconds) to check for reboot callback
 
+#define     DEFAULT_TX_BUFFER_SIZE        4168            // default size (in bytes) of buffer used to batch HAP frames into a single write (room for four full encrypted frames); change with homeSpan.setTxBufferSize(nBytes)
+
+#define     DEFAULT_NVS_QUIET_TIME        1000            // default time (in milliseconds) without further changes before saved Characteristic values are committed to NVS; change with homeSpan.setNVSWriteDelay(quietTime, maxDelay)
+#define     DEFAULT_NVS_MAX_DELAY         5000            // default maximum time (in milliseconds) a changed Characteristic value may wait before being committed to NVS; change with homeSpan.setNVSWriteDelay(quietTime, maxDelay)
+
+#define     DEFAULT_CRYPTO_TASK_STACK     8192            // default stack size (in bytes) of the worker task that performs Pair-Setup and Pair-Verify cryptography; change with homeSpan.setCryptoTask(stackSize, priority, core)
+#define     DEFAULT_CURVE_KEY_POOL        4               // default number of ephemeral Curve25519 key pairs pre-generated by the crypto worker task for Pair-Verify; change with homeSpan.setCurveKeyPool(depth)
+
 
 /////////////////////////////////////////////////////
 //              OTA PARTITION INFO                 //
@@ -31,9 +31,10 @@
 
 tlv8_t::tlv8_t(uint8_t tag, size_t len, const uint8_t* val) : tag{tag}, len{len} {       
   if(len>0){
-    this->val=std::unique_ptr<uint8_t>((uint8_t *)HS_MALLOC(len));
+    this->val=(uint8_t *)HS_MALLOC(len);
+    owned=true;
     if(val!=NULL)
-      memcpy((this->val).get(),val,len);      
+      memcpy(this->val,val,len);      
   }
 }
 
@@ -41,9 +42,16 @@ tlv8_t::tlv8_t(uint8_t tag, size_t len, const uint8_t* val) : tag{tag}, len{len}
 
 void tlv8_t::update(size_t addLen, const uint8_t *addVal){
   if(addLen>0){
-    uint8_t *p=val.release();
-    p=(uint8_t *)HS_REALLOC(p,len+addLen);
-    val=std::unique_ptr<uint8_t>(p);
+    uint8_t *p;
+    if(owned){
+      p=(uint8_t *)HS_REALLOC(val,len+addLen);
+    } else {                                  // record is a view - copy into newly-allocated storage before extending
+      p=(uint8_t *)HS_MALLOC(len+addLen);
+      if(len>0)
+        memcpy(p,val,len);
+      owned=true;
+    }
+    val=p;
     if(addVal!=NULL)
       memcpy(p+len,addVal,addLen);
     len+=addLen;        
@@ -54,7 +62,7 @@ void tlv8_t::update(size_t addLen, const uint8_t *addVal){
 
 void tlv8_t::osprint(std::ostream& os) const {
 
-  uint8_t *p=val.get();       // starting pointer
+  uint8_t *p=val;             // starting pointer
   uint8_t *pend=p+len;        // ending pointer (may equal starting if len=0)
 
   do{
@@ -189,8 +197,11 @@ int TLV8::unpack(uint8_t *buf, size_t bufSize){
   if(bufSize==0)
     return(-1);
 
-  if(empty())
+  if(empty()){
     unpackPhase=0;
+    if(unpackAll(buf,bufSize,false)==0)         // buf holds complete TLV records - unpacked into a single arena
+      return(0);
+  }
 
   while(bufSize>0){
     switch(unpackPhase){
@@ -237,6 +248,124 @@ int TLV8::unpack(TLV8_itc it){
 
 /////////////////////////////////////
 
+int TLV8::unpackView(uint8_t *buf, size_t bufSize){
+
+  if(empty() && bufSize>0 && unpackAll(buf,bufSize,true)==0)
+    return(0);
+
+  return(unpack(buf,bufSize));                  // records are incomplete or TLV8 is not empty - fall back to incremental unpacking
+}
+
+/////////////////////////////////////
+
+int TLV8::unpackAll(uint8_t *buf, size_t bufSize, boolean view){
+
+  // Unpacks buf in a single pass, provided it contains only complete TLV records (else returns -1 without changing anything).
+  // Consecutive records with the same tag (i.e. fragments) are coalesced into one record, as with add().
+  //
+  // view=false: buf is first copied into a single arena block, fragments are coalesced in place within the arena, and all records are views into the arena
+  // view=true:  unfragmented records are views directly into buf; each fragmented record is coalesced into a single allocation
+
+  uint8_t *p=buf;
+  uint8_t *pend=buf+bufSize;
+
+  while(p<pend){                                // verify buf contains only complete records
+    if(pend-p<2 || pend-p-2<p[1])
+      return(-1);
+    p+=2+p[1];
+  }
+
+  if(!view){
+    uint8_t *a=arenaAlloc(bufSize);
+    memcpy(a,buf,bufSize);
+    buf=a;
+    pend=buf+bufSize;
+  }
+
+  p=buf;
+
+  while(p<pend){
+
+    uint8_t tag=p[0];
+    uint8_t *val=p+2;
+    size_t len=p[1];
+    int nFrags=1;
+
+    for(p=val+len;p<pend && p[0]==tag;p+=2+p[1])     // find total length of any following fragments
+      nFrags++;
+
+    if(nFrags==1){
+      emplace_back(tag,len,val,false);
+      continue;
+    }
+
+    uint8_t *q=val+len;                         // start of next fragment header
+    uint8_t *dest;
+
+    if(view){                                   // coalesce fragments into a single allocation
+      size_t total=len;
+      for(uint8_t *r=q;r<p;r+=2+r[1])
+        total+=r[1];
+      dest=(uint8_t *)HS_MALLOC(total);
+      memcpy(dest,val,len);
+    } else {                                    // coalesce fragments in place (each fragment moves down by 2 bytes per preceding fragment header)
+      dest=val;
+    }
+
+    while(q<p){
+      size_t fragLen=q[1];                      // save length first, since in-place move may overwrite this header
+      memmove(dest+len,q+2,fragLen);
+      len+=fragLen;
+      q+=2+fragLen;
+    }
+
+    emplace_back(tag,len,dest,view);
+  }
+
+  return(0);
+}
+
+/////////////////////////////////////
+
+uint8_t *TLV8::arenaAlloc(size_t len){
+
+  uint8_t *p=(uint8_t *)HS_MALLOC(sizeof(uint8_t *)+len);
+  if(p==NULL){
+    Serial.printf("\n\n*** FATAL ERROR: Requested allocation of %d bytes failed.  Program Halting.\n\n",sizeof(uint8_t *)+len);
+    while(1);
+  }
+  *(uint8_t **)p=arena;                         // link to previous block
+  arena=p;
+  return(p+sizeof(uint8_t *));
+}
+
+/////////////////////////////////////
+
+void TLV8::arenaFree(){
+
+  while(arena){
+    uint8_t *prev=*(uint8_t **)arena;
+    free(arena);
+    arena=prev;
+  }
+}
+
+/////////////////////////////////////
+
+TLV8& TLV8::operator=(TLV8 &&tlv){
+
+  clear();
+  arenaFree();
+  std::list<tlv8_t, Mallocator<tlv8_t>>::operator=(std::move(tlv));
+  names=tlv.names;
+  nNames=tlv.nNames;
+  arena=tlv.arena;
+  tlv.arena=NULL;
+  return(*this);
+}
+
+/////////////////////////////////////
+
 const char *TLV8::getName(uint8_t tag) const {
 
   if(names==NULL)
@@ -282,7 +411,7 @@ void TLV8::printAll_r(String label) const{
     Serial.printf("%s",label.c_str());
     print(it);
     TLV8 tlv;
-    if(tlv.unpack(*it,(*it).getLen())==0)
+    if(tlv.unpackView(*it,(*it).getLen())==0)
       tlv.printAll_r(label+String((*it).getTag())+"-");
   }
   Serial.printf("%sDONE\n",label.c_str());
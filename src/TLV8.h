@@ -40,24 +40,30 @@ class tlv8_t {
   
   uint8_t tag;
   size_t len;
-  std::unique_ptr<uint8_t> val;
+  uint8_t *val=NULL;
+  boolean owned=false;      // true if val was allocated by this record; false if val is a view into a TLV8 arena or an external buffer
 
   public:
  
   tlv8_t(uint8_t tag, size_t len, const uint8_t* val);
+  tlv8_t(uint8_t tag, size_t len, uint8_t *view, boolean owned) : tag{tag}, len{len}, val{view}, owned{owned} {}     // creates record from existing storage (takes ownership if owned=true)
+  tlv8_t(const tlv8_t &)=delete;
+  tlv8_t& operator=(const tlv8_t &)=delete;
+  ~tlv8_t(){if(owned)free(val);}
+
   void update(size_t addLen, const uint8_t *addVal);
   void osprint(std::ostream& os) const;
   
   operator uint8_t*() const {
-    return(val.get());
+    return(val);
   }
 
   uint8_t & operator[](int index) const {
-    return(val.get()[index]);
+    return(val[index]);
   }
 
   uint8_t *get() const {
-    return(val.get());
+    return(val);
   }
 
   size_t getLen() const {
@@ -71,7 +77,7 @@ class tlv8_t {
   template<class T=uint32_t> T getVal() const {
     T iVal=0;
     for(int i=0;i<len;i++)
-      iVal|=static_cast<T>(val.get()[i])<<(i*8);
+      iVal|=static_cast<T>(val[i])<<(i*8);
     return(iVal);
   }
   
@@ -100,12 +106,21 @@ class TLV8 : public std::list<tlv8_t, Mallocator<tlv8_t>> {
   const TLV8_names *names=NULL;
   int nNames=0;
 
+  uint8_t *arena=NULL;          // chain of contiguous blocks holding the values of records created by unpack() (each block starts with a pointer to the previous block)
+
   void printAll_r(String label) const;
+  uint8_t *arenaAlloc(size_t len);
+  void arenaFree();
+  int unpackAll(uint8_t *buf, size_t bufSize, boolean view);
 
   public:
 
   TLV8(){};
   TLV8(const TLV8_names *names, int nNames) : names{names}, nNames{nNames} {};
+  TLV8(const TLV8 &)=delete;
+  TLV8(TLV8 &&tlv) : std::list<tlv8_t, Mallocator<tlv8_t>>(std::move(tlv)), names{tlv.names}, nNames{tlv.nNames}, arena{tlv.arena} {tlv.arena=NULL;}
+  TLV8& operator=(TLV8 &&tlv);
+  ~TLV8(){clear();arenaFree();}
 
   TLV8_itc add(uint8_t tag, size_t len, const uint8_t *val);
   TLV8_itc add(uint8_t tag, uint64_t val);
@@ -142,6 +157,7 @@ class TLV8 : public std::list<tlv8_t, Mallocator<tlv8_t>> {
 
   int unpack(uint8_t *buf, size_t bufSize);
   int unpack(TLV8_itc it);
+  int unpackView(uint8_t *buf, size_t bufSize);         // same as unpack(), but unfragmented records are views into buf (which must therefore outlive this TLV8 and remain unchanged)
   
-  void wipe() {std::list<tlv8_t, Mallocator<tlv8_t>>().swap(*this);}
+  void wipe() {std::list<tlv8_t, Mallocator<tlv8_t>>().swap(*this);arenaFree();}
 };
@@ -35,6 +35,9 @@
 //  Utils::readSerial       - reads all characters from Serial port and saves only up to max specified
 //  Utils::mask             - masks a string with asterisks (good for displaying passwords)
 //  Utils::resetReason      - returns literal string description of esp_reset_reason()
+//  Utils::uintToChar       - fast, allocation-free conversion of unsigned integers to decimal characters
+//  Utils::intToChar        - fast, allocation-free conversion of signed integers to decimal characters
+//  Utils::floatToChar      - fast, allocation-free conversion of floating-point numbers to shortest decimal characters
 //
 //  class PushButton        - tracks Single, Double, and Long Presses of a pushbutton that connects a specified pin to ground
 //  class hsWatchdogTimer   - a generic watchdog timer that reboots the ESP32 device if not reset periodically
@@ -130,6 +133,103 @@ const char *Utils::resetReason(){
   return "Unknown Reset Code";    
 }
 
+//////////////////////////////////////
+
+size_t Utils::uintToChar(uint64_t val, char *buf){
+
+  static const char digits[]=
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+  char tmp[20];
+  char *p=tmp+sizeof(tmp);
+
+  while(val>0xFFFFFFFF){                 // only use (slower) 64-bit division while needed
+    uint64_t q=val/100;
+    p-=2;
+    memcpy(p,digits+(val-q*100)*2,2);
+    val=q;
+  }
+
+  uint32_t v=val;
+  
+  while(v>=100){                         // convert two digits at a time
+    uint32_t q=v/100;
+    p-=2;
+    memcpy(p,digits+(v-q*100)*2,2);
+    v=q;
+  }
+
+  if(v>=10){
+    p-=2;
+    memcpy(p,digits+v*2,2);
+  } else {
+    *--p='0'+v;
+  }
+
+  size_t n=tmp+sizeof(tmp)-p;
+  memcpy(buf,p,n);
+  return(n);
+}
+
+//////////////////////////////////////
+
+size_t Utils::intToChar(int64_t val, char *buf){
+
+  if(val<0){
+    buf[0]='-';
+    return(1+uintToChar(0-(uint64_t)val,buf+1));
+  }
+  
+  return(uintToChar(val,buf));
+}
+
+//////////////////////////////////////
+
+size_t Utils::floatToChar(double val, char *buf){
+
+  static const double p10[]={1,10,100,1000,10000,100000,1000000};
+  const int maxDecimals=6;
+
+  if(!isfinite(val) || fabs(val)>=1e15)            // outside range of fixed-point conversion
+    return(sprintf(buf,"%g",val));
+
+  auto roundTrip=[](double v, int d)->boolean{     // returns true if v can be represented with d decimals without loss of (single) floating-point precision
+    return((float)(llround(v*p10[d])/p10[d])==(float)v);
+  };
+
+  int d;
+  for(d=0;d<=maxDecimals && !roundTrip(val,d);d++);   // find shortest number of decimals needed to represent val
+
+  if(d>maxDecimals)                                   // val cannot be represented with maxDecimals
+    return(sprintf(buf,"%g",val));                    // fall back to %g
+
+  int64_t n=llround(val*p10[d]);
+  size_t len=0;
+
+  if(n<0){
+    buf[len++]='-';
+    n=-n;
+  }
+
+  uint64_t intPart=n/(uint64_t)p10[d];
+  uint32_t fracPart=n-intPart*(uint64_t)p10[d];
+  
+  len+=uintToChar(intPart,buf+len);
+
+  if(fracPart>0){
+    buf[len++]='.';
+    for(int i=d-1;i>=0;i--,fracPart/=10)           // write fractional digits, including any leading zeros
+      buf[len+i]='0'+fracPart%10;
+    len+=d;
+    while(buf[len-1]=='0')                         // strip trailing zeros
+      len--;
+  }
+  
+  return(len);
+}
+
 ////////////////////////////////
 //         PushButton         //
 ////////////////////////////////
@@ -40,6 +40,9 @@ char *readSerial(char *c, int max);   // read serial port into 'c' until <newlin
 String mask(char *c, int n);          // simply utility that creates a String from 'c' with all except the first and last 'n' characters replaced by '*'
 char *stripBackslash(char *c);        // strips backslashes out of c (Apple unecessesarily "escapes" forward slashes in JSON)
 const char *resetReason();            // returns literal string description of esp_reset_reason()
+size_t uintToChar(uint64_t val, char *buf);                 // writes val as decimal characters into buf (must hold at least 20); returns number of characters written (no null terminator)
+size_t intToChar(int64_t val, char *buf);                   // writes val as decimal characters into buf (must hold at least 21); returns number of characters written (no null terminator)
+size_t floatToChar(double val, char *buf);                  // writes shortest representation of val that preserves its (single) floating-point precision into buf (must hold at least 32); returns number of characters written
 }
 
 /////////////////////////////////////////////////
@@ -35,7 +35,7 @@
 //     Single-Wire RGB/RGBW NeoPixels     //
 ////////////////////////////////////////////
 
-IRAM_ATTR size_t Pixel::pixelEncodeCallback(const void *colors, size_t symbolsTotal,
+IRAM_ATTR size_t Pixel::pixelEncodeCallback(const void *data, size_t symbolsTotal,
                      size_t symbolsWritten, size_t symbolsFree,
                      rmt_symbol_word_t *symbols, bool *done, void *arg) {
 
@@ -46,24 +46,63 @@ IRAM_ATTR size_t Pixel::pixelEncodeCallback(const void *colors, size_t symbolsTo
     *done=false;
   }
 
-  callbackArgs_t *callbackArgs=(callbackArgs_t *)arg;
+  Pixel *pixel=(Pixel *)arg;
+  const frame_t *frame=(const frame_t *)data;
+  size_t dataSymbols=symbolsTotal-pixel->resetSymbols;               // number of symbols encoding color bytes (remainder are reset symbols)
+
+  if(symbolsWritten>=dataSymbols){                                    // all color bytes written - append reset symbols
+    size_t nSymbols=symbolsTotal-symbolsWritten;
+    if(nSymbols>symbolsFree)
+      nSymbols=symbolsFree;
+    for(size_t i=0;i<nSymbols;i++)
+      symbols[i]=pixel->resetSymbol;
+    return(nSymbols);
+  }
   
-  if(symbolsFree < callbackArgs->pixel->symbolsPerPixel)         // not enough space to write an entire pixel
-    return(0);
-
-  Color *color = (Color *)colors + (callbackArgs->multiColor ? (symbolsWritten / callbackArgs->pixel->symbolsPerPixel) : 0);
-
-  for(auto i=0; i<callbackArgs->pixel->bytesPerPixel; i++){
-    uint8_t colorByte = color->col[callbackArgs->pixel->map[i]];
-    for(auto j = 7; j >= 0; j--)
-      *symbols++ = (colorByte & (1 << j)) ? callbackArgs->pixel->bit1 : callbackArgs->pixel->bit0;
+  size_t nBytes=symbolsFree/8;                                        // fill as many whole color bytes as will fit in free space...
+  if(nBytes>(dataSymbols-symbolsWritten)/8)                           // ...but not more than remain to be written
+    nBytes=(dataSymbols-symbolsWritten)/8;
+
+  size_t byteIndex=symbolsWritten/8;                                  // color bytes are never split across callbacks, so resume at a byte boundary
+  size_t pixelIndex=byteIndex/pixel->bytesPerPixel;
+  int k=byteIndex-pixelIndex*pixel->bytesPerPixel;                    // position of next byte within current pixel
+  const uint8_t *col=frame->data+pixelIndex*frame->stride;           // color bytes of current pixel
+
+  for(size_t i=0;i<nBytes;i++){
+    const rmt_symbol_word_t *block=pixel->symbolTable[col[frame->order[k]]];
+    for(int j=0;j<8;j++)
+      symbols[j]=block[j];
+    symbols+=8;
+    if(++k==pixel->bytesPerPixel){
+      k=0;
+      col+=frame->stride;
+    }
   }
   
-  return(callbackArgs->pixel->symbolsPerPixel);
+  return(nBytes*8);
 };
 
 ///////////////////
 
+IRAM_ATTR bool Pixel::transDoneCallback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *arg){
+
+  Pixel *pixel=(Pixel *)arg;
+  txBuffer_t *tx=pixel->txBuffer+pixel->doneBuffer;
+
+  if(!tx->inUse)                            // completed frame was sent by set(), not send()
+    return(false);
+
+  tx->inUse=false;                          // frames complete in the order queued, so release buffers in that order
+  pixel->doneBuffer^=1;
+  
+  if(pixel->doneCallback)
+    pixel->doneCallback(pixel,pixel->doneArg);
+
+  return(false);
+}
+
+///////////////////
+
 Pixel::Pixel(int pin, const char *pixelType){
     
   this->pin=pin;
@@ -75,7 +114,7 @@ Pixel::Pixel(int pin, const char *pixelType){
   tx_chan_config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;   // set number of symbols to match those in a single channel block
   tx_chan_config.resolution_hz = 80 * 1000 * 1000;                    // set to 80MHz
   tx_chan_config.intr_priority = 3;                                   // medium interrupt priority
-  tx_chan_config.trans_queue_depth = 1;                               // set the number of transactions that can pend in the background
+  tx_chan_config.trans_queue_depth = 2;                               // set the number of transactions that can pend in the background (one for each txBuffer)
   tx_chan_config.flags.invert_out = false;                            // do not invert output signal
   tx_chan_config.flags.with_dma = false;                              // use RMT channel memory, not DMA (most chips do not support use of DMA anyway)
   tx_chan_config.flags.io_loop_back = false;                          // do not use loop-back mode
@@ -111,16 +150,17 @@ Pixel::Pixel(int pin, const char *pixelType){
   symbolsPerPixel=bytesPerPixel*8;                        // pre-compute and store to save time in callback
   sscanf(pixelType,"%ms",&pType);                         // save pixelType for later use with hasColor()
   
+  rmt_tx_event_callbacks_t cbs={.on_trans_done=transDoneCallback};
+  rmt_tx_register_event_callbacks(tx_chan, &cbs, this);   // register completion callback (must be done before channel is enabled)
   rmt_enable(tx_chan);                                    // enable channel
   channel=((int *)tx_chan)[0];                            // get channel number
   
   rmt_simple_encoder_config_t simple_config;              // create simple_encoder configuration  
   simple_config.callback = pixelEncodeCallback;           // set callback function to encode data
-  simple_config.min_chunk_size=symbolsPerPixel;           // set minimum size to handle a full pixel
-  simple_config.arg = &callbackArgs;                      // set callback args  
+  simple_config.min_chunk_size=8;                         // set minimum size to handle a single color byte
+  simple_config.arg = this;                               // set callback arg to point back to this pixel instance
   rmt_new_simple_encoder(&simple_config, &encoder);       // create simple_encoder using above configuration
 
-  callbackArgs.pixel=this;                                // set callback arg to point back to this pixel instance   
   setTiming(0.32, 0.88, 0.64, 0.56, 80.0);                // set default timing parameters (suitable for most SK68 and WS28 RGB pixels)
   onColor.HSV(0,100,100,0);                               // set onColor
 }
@@ -131,6 +171,8 @@ Pixel *Pixel::setTiming(float high0, float low0, float high1, float low1, uint32
 
   if(channel<0)
     return(this);
+
+  rmt_tx_wait_all_done(tx_chan,-1);                       // symbols below must not change while a frame is being encoded
   
   bit0.level0=1;
   bit0.duration0=high0*80+0.5;
@@ -143,24 +185,317 @@ Pixel *Pixel::setTiming(float high0, float low0, float high1, float low1, uint32
   bit1.duration1=low1*80+0.5;
 
   resetTime=lowReset;
+
+  uint32_t resetTicks=resetTime*80;                       // reset gap is transmitted as trailing low symbols, each holding up to 2 x 32767 ticks
+  resetSymbols=resetTicks/65534+1;
+  resetSymbol.level0=0;
+  resetSymbol.duration0=resetTicks/resetSymbols/2+1;      // durations must be non-zero, since a zero duration marks the end of transmission
+  resetSymbol.level1=0;
+  resetSymbol.duration1=resetTicks/resetSymbols/2+1;
+
+  if(!symbolTable){                                       // table is read by encoder callback at interrupt time, so must be in internal RAM
+    symbolTable=(symbolBlock_t *)heap_caps_malloc(256*sizeof(symbolBlock_t),MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+    if(!symbolTable){
+      ESP_LOGE(PIXEL_TAG,"Can't create Pixel(%d) - insufficient memory for symbol table",pin);
+      rmt_del_encoder(encoder);                           // release encoder and channel so they can be used by another Pixel
+      rmt_disable(tx_chan);
+      rmt_del_channel(tx_chan);
+      encoder=NULL;
+      tx_chan=NULL;
+      channel=-1;
+      return(this);
+    }
+  }
+
+  buildSymbolTable();
+  return(this);
+}
+
+///////////////////
+
+Pixel *Pixel::setBrightness(uint8_t level, float gamma){
+
+  if(channel<0)
+    return(this);
+
+  rmt_tx_wait_all_done(tx_chan,-1);                       // table must not change while a frame is being encoded
+
+  brightness=level;
+  this->gamma=gamma;
+  buildSymbolTable();
   return(this);
 }
 
 ///////////////////
 
+void Pixel::buildSymbolTable(){
+
+  for(int i=0;i<256;i++){                                 // pre-compute symbols for every possible color byte
+    uint8_t val=i;
+    if(gamma!=1.0)
+      val=pow(i/255.0,gamma)*255.0+0.5;
+    val=(val*brightness+127)/255;
+    for(int j=0;j<8;j++)
+      symbolTable[i][j]=(val&(0x80>>j))?bit1:bit0;
+  }
+}
+
+///////////////////
+
 void Pixel::transmit(const Color *c, size_t nPixels, boolean multiColor){
 
   if(channel<0 || nPixels==0)
     return;
 
+  frame_t frame;
+
+  if(multiColor){
+    frame.data=c->col;                                                        // encode directly from Colors (no copy needed since transmission completes before returning)
+    frame.stride=sizeof(Color);
+    for(int i=0;i<bytesPerPixel;i++)
+      frame.order[i]=map[i];
+  } else {
+    for(int i=0;i<bytesPerPixel;i++){
+      frame.color[i]=c->col[map[i]];                                          // pre-permute single Color into transmit order
+      frame.order[i]=i;
+    }
+    frame.data=frame.color;
+    frame.stride=0;
+  }
+
+  rmt_tx_wait_all_done(tx_chan,-1);                                           // wait for any frames queued by send() to complete
+  startFrame(&frame,nPixels);
+  rmt_tx_wait_all_done(tx_chan,-1);                                           // wait until final data, and the reset gap that follows, is transmitted
+}
+
+///////////////////
+
+boolean Pixel::queue(const Color *c, size_t nPixels, boolean multiColor){
+
+  if(channel<0 || nPixels==0)
+    return(true);
+
+  txBuffer_t *tx=txBuffer+nextBuffer;
+
+  if(tx->inUse)                                                               // both buffers are busy
+    return(false);
+
+  size_t nBytes=(multiColor?nPixels:1)*bytesPerPixel;
+
+  if(nBytes>tx->size){                                                        // buffer is read by encoder callback at interrupt time, so must be in internal RAM
+    uint8_t *buf=(uint8_t *)heap_caps_realloc(tx->buf,nBytes,MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+    if(!buf){
+      ESP_LOGE(PIXEL_TAG,"Can't send %d pixels to Pixel(%d) - insufficient memory",nPixels,pin);
+      return(false);
+    }
+    tx->buf=buf;
+    tx->size=nBytes;
+  }
+
+  uint8_t *p=tx->buf;
+  for(size_t n=0;n<nBytes;n+=bytesPerPixel,c++)                               // single copy of Colors, with bytes permuted into transmit order
+    for(int i=0;i<bytesPerPixel;i++)
+      *p++=c->col[map[i]];
+
+  tx->frame.data=tx->buf;
+  tx->frame.stride=multiColor?bytesPerPixel:0;
+  for(int i=0;i<bytesPerPixel;i++)
+    tx->frame.order[i]=i;
+
+  tx->inUse=true;
+  nextBuffer^=1;
+  startFrame(&tx->frame,nPixels);
+  return(true);
+}
+
+///////////////////
+
+void Pixel::startFrame(const frame_t *frame, size_t nPixels){
+
   rmt_ll_set_group_clock_src(&RMT, channel, RMT_CLK_SRC_DEFAULT, 1, 0, 0);    // ensure use of DEFAULT CLOCK, which is always 80 MHz, without any scaling
 
-  callbackArgs.multiColor = multiColor;
   rmt_transmit_config_t tx_config{};
+  rmt_transmit(tx_chan, encoder, frame, nPixels*symbolsPerPixel+resetSymbols, &tx_config);     // transmit data (size parameter set to total number of symbols to be written, including reset symbols)
+}
+
+////////////////////////////////////////////
+//              Pixel Frames              //
+////////////////////////////////////////////
+
+// Color kernels below treat the frame buffer as a flat array of bytes, with no aliasing between source and destination,
+// so each loop is a simple element-wise operation the compiler can vectorize (or unroll on chips without SIMD support)
+
+static_assert(sizeof(Pixel::Color)==5, "Pixel::Color must be packed as 5 bytes");
+
+PixelFrame::PixelFrame(Pixel *pixel, size_t nPixels){
+
+  this->pixel=pixel;
+  colors=(Pixel::Color *)calloc(nPixels,sizeof(Pixel::Color));      // frame buffer may be in PSRAM since send() copies it into internal RAM for encoding
+
+  if(!colors){
+    ESP_LOGE(PIXEL_TAG,"Can't create PixelFrame of %d pixels - insufficient memory",nPixels);
+    return;
+  }
+
+  this->nPixels=nPixels;
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::fill(Pixel::Color c){
+
+  for(size_t i=0;i<nPixels;i++)
+    colors[i]=c;
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::fillRainbow(uint8_t startHue, uint8_t deltaHue, uint8_t s, uint8_t v){
+
+  uint8_t hue=startHue;
+  for(size_t i=0;i<nPixels;i++,hue+=deltaHue)
+    colors[i].HSV8(hue,s,v);
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::fillPalette(const Pixel::Color *palette, size_t nColors, uint8_t start, uint8_t delta){
+
+  if(nColors==0)
+    return(this);
+
+  uint8_t index=start;
+  for(size_t i=0;i<nPixels;i++,index+=delta){
+    uint32_t pos=index*nColors;                         // position within palette in units of 1/256 of an entry
+    const uint8_t *a=palette[pos>>8].col;
+    const uint8_t *b=palette[((pos>>8)+1)%nColors].col;
+    uint16_t w=pos&0xFF;
+    for(int j=0;j<5;j++)
+      colors[i].col[j]=(a[j]*(256-w)+b[j]*w)>>8;
+  }
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::add(const Pixel::Color *src){
+
+  uint8_t * __restrict d=colors->col;
+  const uint8_t * __restrict s=src->col;
+
+  for(size_t i=0;i<nPixels*5;i++){
+    uint16_t t=d[i]+s[i];
+    d[i]=t>255?255:t;
+  }
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::blend(const Pixel::Color *src, uint8_t amount){
+
+  uint8_t * __restrict d=colors->col;
+  const uint8_t * __restrict s=src->col;
+  uint16_t w=amount+(amount>>7);                        // maps [0,255] to [0,256] so that 255 selects all of src
+
+  for(size_t i=0;i<nPixels*5;i++)
+    d[i]=(d[i]*(256-w)+s[i]*w)>>8;
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::crossfade(const Pixel::Color *from, const Pixel::Color *to, uint8_t amount){
+
+  uint8_t *d=colors->col;                               // from or to may be the frame buffer itself
+  const uint8_t *a=from->col;
+  const uint8_t *b=to->col;
+  uint16_t w=amount+(amount>>7);
+
+  for(size_t i=0;i<nPixels*5;i++)
+    d[i]=(a[i]*(256-w)+b[i]*w)>>8;
+  return(this);
+}
+
+///////////////////
+
+PixelFrame *PixelFrame::fade(uint8_t amount){
+
+  uint8_t *d=colors->col;
+  uint16_t w=256-(amount+(amount>>7));
+
+  for(size_t i=0;i<nPixels*5;i++)
+    d[i]=(d[i]*w)>>8;
+  return(this);
+}
+
+///////////////////
+
+boolean PixelFrame::poll(){
+
+  uint64_t now=esp_timer_get_time();
+
+  if(now<nextFrame)                                     // frame not yet due
+    return(false);
+
+  if(animation && !rendered)                            // render frame only once, even if it has to wait for a free transmit buffer
+    animation(*this,frameCount);
+
+  rendered=true;
 
-  rmt_transmit(tx_chan, encoder, c, nPixels*symbolsPerPixel, &tx_config);     // transmit data (size parameter set to total number of symbols to be written)
-  rmt_tx_wait_all_done(tx_chan,-1);                                           // wait until final data is transmitted
-  delayMicroseconds(resetTime);                                               // end-of-marker delay
+  if(!show())                                           // both transmit buffers are still in use - keep rendered frame and try again on next poll
+    return(false);
+
+  rendered=false;
+  frameCount++;
+  nextFrame+=period;
+  if(nextFrame<now)                                     // fell more than one frame behind - resynchronize rather than sending a burst of frames
+    nextFrame=now+period;
+  return(true);
+}
+
+////////////////////////////////////////////
+//              Pixel Groups              //
+////////////////////////////////////////////
+
+boolean PixelGroup::send(const Pixel::Color * const colors[], const size_t nPixels[]){
+
+  boolean success=true;
+
+  for(int i=0;i<pixels.size();i++)          // each pixel copies its Colors into its own sequential transmit buffer and starts its RMT channel without waiting
+    success&=pixels[i]->send(colors[i],nPixels[i]);
+
+  return(success);
+}
+
+///////////////////
+
+void PixelGroup::set(const Pixel::Color * const colors[], const size_t nPixels[]){
+
+  wait();                                   // ensure a transmit buffer is free on every pixel
+  send(colors,nPixels);
+  wait();
+}
+
+///////////////////
+
+boolean PixelGroup::isBusy(){
+
+  for(auto pixel : pixels)
+    if(pixel->isBusy())
+      return(true);
+
+  return(false);
+}
+
+///////////////////
+
+void PixelGroup::wait(){
+
+  for(auto pixel : pixels)                  // total wait is set by the longest strip, since all channels are transmitting concurrently
+    pixel->wait();
 }
 
 ////////////////////////////////////////////
@@ -169,6 +504,13 @@ void Pixel::transmit(const Color *c, size_t nPixels, boolean multiColor){
 
 Dot::Dot(uint8_t dataPin, uint8_t clockPin){
 
+  initGPIO(dataPin,clockPin);
+}
+
+///////////////////
+
+void Dot::initGPIO(uint8_t dataPin, uint8_t clockPin){
+
   pinMode(dataPin,OUTPUT);
   pinMode(clockPin,OUTPUT);
   digitalWrite(dataPin,LOW);
@@ -202,10 +544,198 @@ Dot::Dot(uint8_t dataPin, uint8_t clockPin){
 
 ///////////////////
 
+Dot::Dot(uint8_t dataPin, uint8_t clockPin, spi_host_device_t host, uint32_t freq){
+
+  if(host==SPI1_HOST)
+    #if defined(CONFIG_IDF_TARGET_ESP32)
+      spiHost=SPI2_HOST;
+    #elif defined(CONFIG_IDF_TARGET_ESP32S2) || defined(CONFIG_IDF_TARGET_ESP32S3)
+      spiHost=SPI3_HOST;
+    #else
+      spiHost=SPI2_HOST;
+  #endif
+  else
+    spiHost=host;
+
+  spi_bus_config_t buscfg = {};
+  buscfg.mosi_io_num=dataPin;
+  buscfg.sclk_io_num=clockPin;
+  buscfg.miso_io_num = -1;
+  buscfg.data2_io_num = -1;
+  buscfg.data3_io_num = -1;
+  buscfg.data4_io_num = -1;
+  buscfg.data5_io_num = -1;
+  buscfg.data6_io_num = -1;
+  buscfg.data7_io_num = -1;
+  buscfg.max_transfer_sz = DOT_SPI_MAX_BYTES;
+
+  devcfg.clock_speed_hz = freq;
+  devcfg.mode = 0;                                        // APA102/SK9822 sample data on rising edge of clock
+  devcfg.spics_io_num = -1;
+  devcfg.queue_size = 2;                                  // one transaction for each txBuffer
+  devcfg.flags|=SPI_DEVICE_HALFDUPLEX;
+
+  this->dataPin=dataPin;
+  this->clockPin=clockPin;
+
+  const spi_bus_attr_t *busAttr=spi_bus_get_attr(spiHost);
+
+  if(busAttr!=NULL){                                      // SPI host is already in use (e.g. by a WS2801_LED) - it can only be shared if it drives the same pins
+    if(busAttr->bus_cfg.mosi_io_num!=dataPin || busAttr->bus_cfg.sclk_io_num!=clockPin){
+      ESP_LOGE(PIXEL_TAG,"Can't use SPI host %d for Dot(%d,%d) - host is already initialized on pins (%d,%d); using bit-banged GPIO instead",spiHost,dataPin,clockPin,busAttr->bus_cfg.mosi_io_num,busAttr->bus_cfg.sclk_io_num);
+      initGPIO(dataPin,clockPin);
+      return;
+    }
+    maxBytes=busAttr->max_transfer_sz;
+  } else if(spi_bus_initialize(spiHost, &buscfg, SPI_DMA_CH_AUTO)!=ESP_OK){
+    ESP_LOGE(PIXEL_TAG,"Can't initialize SPI host %d for Dot(%d,%d) - using bit-banged GPIO instead",spiHost,dataPin,clockPin);
+    initGPIO(dataPin,clockPin);
+    return;
+  }
+
+  if(spi_bus_add_device(spiHost, &devcfg, &spi)!=ESP_OK){
+    ESP_LOGE(PIXEL_TAG,"Can't add Dot(%d,%d) to SPI host %d - using bit-banged GPIO instead",dataPin,clockPin,spiHost);
+    spi=NULL;
+    initGPIO(dataPin,clockPin);
+  }
+}
+
+///////////////////
+
+Dot *Dot::setTiming(uint32_t freq){
+
+  if(!spi)
+    return(this);
+
+  wait();
+  devcfg.clock_speed_hz=freq;
+  spi_bus_remove_device(spi);
+  if(spi_bus_add_device(spiHost, &devcfg, &spi)!=ESP_OK){
+    ESP_LOGE(PIXEL_TAG,"Can't change Dot clock frequency to %lu Hz - unable to re-add device to SPI host %d; using bit-banged GPIO instead",freq,spiHost);
+    spi=NULL;
+    initGPIO(dataPin,clockPin);
+  }
+  return(this);
+}
+
+///////////////////
+
+size_t Dot::buildFrame(uint8_t *buf, const Color *c, size_t nPixels, boolean multiColor){
+
+  if(nPixels==0)
+    return(0);
+
+  uint8_t *p=buf;
+
+  for(int j=0;j<4;j++)              // start frame: 0x00000000
+    *p++=0;
+
+  for(int i=0;i<nPixels;i++){       // pixel frames: 32 bits of Color sent MSB first (flags, drive, blue, green, red)
+    *p++=c->val>>24;
+    *p++=c->val>>16;
+    *p++=c->val>>8;
+    *p++=c->val;
+    c+=multiColor;
+  }
+
+  int nEndBlocks=(nPixels-1)/64+1;  // need an end block of 32 bits for every 64 pixels in strand (i.e. 128 pixels requires 2 end blocks)
+
+  for(int i=0;i<nEndBlocks;i++){    // end frames: 0xE0000000 (i.e. a valid blank pixel - needed if nPixels is set to less than total number in strand)
+    *p++=0xE0;
+    *p++=0;
+    *p++=0;
+    *p++=0;
+  }
+
+  return(p-buf);
+}
+
+///////////////////
+
+boolean Dot::queue(const Color *c, size_t nPixels, boolean multiColor){
+
+  if(!spi){                                               // bit-banged GPIO cannot run in the background
+    transmit(c,nPixels,multiColor);
+    return(true);
+  }
+
+  if(nPixels==0)
+    return(true);
+
+  release(false);
+  txBuffer_t *tx=txBuffer+nextBuffer;
+
+  if(tx->inUse)                                           // both buffers are busy
+    return(false);
+
+  size_t nBytes=frameSize(nPixels);
+
+  if(nBytes>maxBytes){
+    ESP_LOGE(PIXEL_TAG,"Can't send %d pixels to Dot - exceeds maximum SPI transfer size of %d bytes",nPixels,maxBytes);
+    return(false);
+  }
+
+  if(nBytes>tx->size){
+    free(tx->buf);
+    tx->buf=(uint8_t *)heap_caps_malloc(nBytes,MALLOC_CAP_DMA);
+    tx->size=tx->buf?nBytes:0;
+    if(!tx->buf){
+      ESP_LOGE(PIXEL_TAG,"Can't send %d pixels to Dot - insufficient DMA-capable memory",nPixels);
+      return(false);
+    }
+  }
+
+  buildFrame(tx->buf,c,nPixels,multiColor);
+
+  tx->trans.length=nBytes*8;
+  tx->trans.tx_buffer=tx->buf;
+  tx->trans.user=tx;
+  tx->inUse=true;
+
+  if(spi_device_queue_trans(spi,&tx->trans,portMAX_DELAY)!=ESP_OK){
+    ESP_LOGE(PIXEL_TAG,"Can't send %d pixels to Dot - unable to queue SPI transaction on host %d",nPixels,spiHost);
+    tx->inUse=false;
+    return(false);
+  }
+
+  nextBuffer^=1;                                          // advance to next buffer only once frame is actually queued
+  return(true);
+}
+
+///////////////////
+
+void Dot::release(boolean block){
+
+  spi_transaction_t *trans;
+
+  while((txBuffer[0].inUse || txBuffer[1].inUse) && spi_device_get_trans_result(spi,&trans,block?portMAX_DELAY:0)==ESP_OK)
+    ((txBuffer_t *)trans->user)->inUse=false;
+}
+
+///////////////////
+
+boolean Dot::isBusy(){
+
+  if(!spi)
+    return(false);
+
+  release(false);
+  return(txBuffer[0].inUse || txBuffer[1].inUse);
+}
+
+///////////////////
+
 void Dot::transmit(const Color *c, size_t nPixels, boolean multiColor){
   
   if(nPixels==0)
     return;
+
+  if(spi){                          // hardware SPI: queue frame and wait for it to complete
+    wait();
+    queue(c,nPixels,multiColor);
+    wait();
+    return;
+  }
   
   *dataClearReg=dataMask;           // send 0x0000
   *clockClearReg=clockMask;    
@@ -40,12 +40,17 @@
 #include <soc/rmt_struct.h>     // where RMT register structure is defined
 #include <hal/rmt_ll.h>         // where low-level RMT calls are defined
 
+#include <vector>
+
 #include <soc/gpio_struct.h>
 #include "driver/spi_master.h"
 #include "esp_private/spi_common_internal.h"
 
 [[maybe_unused]] static const char* PIXEL_TAG = "Pixel";
 
+#define DOT_SPI_FREQ        4000000       // default SPI clock frequency (in Hz) for Dot in SPI mode; change with optional fourth argument to Dot() or with setTiming()
+#define DOT_SPI_MAX_BYTES   16384         // maximum size (in bytes) of a single SPI transfer for Dot in SPI mode (about 4000 pixels)
+
 //////////////////////////////////////////////////
 //     Single-Wire RGB/RGBW/RGBWC NeoPixels     //
 //////////////////////////////////////////////////
@@ -93,6 +98,25 @@ class Pixel : public Blinkable {
         return(*this);
       }
 
+      Color HSV8(uint8_t h, uint8_t s, uint8_t v, uint8_t w=0, uint8_t c=0){     // returns Color based on provided HSV(WC) values using integer math only, where h=[0,255] spans the full color wheel and s/v/w/c=[0,255]
+        uint8_t region=h/43;
+        uint8_t rem=(h-region*43)*6;
+        uint8_t p=(v*(255-s))>>8;
+        uint8_t q=(v*(255-((s*rem)>>8)))>>8;
+        uint8_t t=(v*(255-((s*(255-rem))>>8)))>>8;
+        switch(region){
+          case 0: col[0]=v; col[1]=t; col[2]=p; break;
+          case 1: col[0]=q; col[1]=v; col[2]=p; break;
+          case 2: col[0]=p; col[1]=v; col[2]=t; break;
+          case 3: col[0]=p; col[1]=q; col[2]=v; break;
+          case 4: col[0]=t; col[1]=p; col[2]=v; break;
+          default: col[0]=v; col[1]=p; col[2]=q; break;
+        }
+        col[3]=w;
+        col[4]=c;
+        return(*this);
+      }
+
       Color CCT(float temp, float v, float wTemp, float cTemp){
         col[0]=0;
         col[1]=0;
@@ -135,40 +159,73 @@ class Pixel : public Blinkable {
   
   private:
     typedef struct {
-      Pixel* pixel;
-      bool multiColor;
-    } callbackArgs_t;
+      const uint8_t *data;         // first color byte of first pixel
+      size_t stride;               // number of bytes between successive pixels in data (0 if the same pixel is repeated)
+      uint8_t order[5];            // order in which to read the color bytes of each pixel
+      uint8_t color[5];            // storage for a single Color pre-permuted into transmit order
+    } frame_t;                     // describes one frame of pixel data to the encoder callback
+
+    typedef struct {
+      uint8_t *buf=NULL;           // owned copy of frame, with color bytes stored in transmit order
+      size_t size=0;               // allocated size (in bytes) of buf
+      frame_t frame;               // frame descriptor passed to encoder
+      volatile boolean inUse=false;    // true from when frame is queued until its transmission (including reset gap) has completed
+    } txBuffer_t;
+
+    typedef rmt_symbol_word_t symbolBlock_t[8];    // the 8 RMT symbols that encode one color byte (MSB first)
     
-    static IRAM_ATTR size_t pixelEncodeCallback(const void *colors, size_t symbolsTotal,
+    static IRAM_ATTR size_t pixelEncodeCallback(const void *data, size_t symbolsTotal,
                      size_t symbolsWritten, size_t symbolsFree,
                      rmt_symbol_word_t *symbols, bool *done, void *arg);
 
+    static IRAM_ATTR bool transDoneCallback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *arg);
+
     uint8_t pin;
     int channel=-1;
     char *pType=NULL;
     rmt_channel_handle_t tx_chan = NULL;
     rmt_encoder_handle_t encoder;
-    callbackArgs_t callbackArgs;
 
     rmt_symbol_word_t bit0;        // timing symbol for bit0
     rmt_symbol_word_t bit1;        // timing symbol for bit1
+    rmt_symbol_word_t resetSymbol; // all-low symbol appended (resetSymbols times) to each frame to enforce reset gap
     uint32_t resetTime;            // minimum time (in usec) between pulse trains
+    uint8_t resetSymbols;          // number of reset symbols needed to cover resetTime
     uint8_t bytesPerPixel;         // WC=2, RGB=3, RGBW=4, RGBWC=5
     uint8_t symbolsPerPixel;       // will be set to bytesPerPixel * 8
     float warmTemp=2000;           // default temperature (in Kelvin) of warm-white LED
     float coolTemp=7000;           // defult temperature (in Kelvin) of cool-white LED
     uint8_t map[5];                // color map representing order in which color bytes are transmitted
+    symbolBlock_t *symbolTable=NULL;   // 256-entry table of symbol blocks for every possible color byte (rebuilt by setTiming() and stored in internal RAM for use by encoder callback)
+    uint8_t brightness=255;        // global brightness level applied through symbolTable
+    float gamma=1.0;               // gamma correction applied through symbolTable
     Color onColor;                 // color used for on() command
 
+    txBuffer_t txBuffer[2];        // double-buffered frames used by send()
+    int nextBuffer=0;              // index of buffer to use for next call to send()
+    int doneBuffer=0;              // index of buffer to be released when next queued frame completes
+    void (*doneCallback)(Pixel *, void *)=NULL;    // optional function called (from interrupt) when a frame queued by send() has been fully transmitted
+    void *doneArg=NULL;            // user-provided argument for doneCallback
+
+    void buildSymbolTable();                                              // fills symbolTable from bit0/bit1 with brightness and gamma folded in
+    void startFrame(const frame_t *frame, size_t nPixels);                // hands frame to RMT driver (returns immediately)
+    boolean queue(const Color *c, size_t nPixels, boolean multiColor);    // copies Colors into a free txBuffer and starts transmission; setting multiColor to false repeats Color in c[0] for all nPixels
     void transmit(const Color *c, size_t nPixels, boolean multiColor);    // transmits Colors to the LED strand; setting multiColor to false repeats Color in c[0] for all nPixels
 
   public:
     Pixel(int pin, const char *pixelType="GRB");                          // creates addressable single-wire LED of pixelType connected to pin (such as the SK68 or WS28)   
     void set(const Color *c, size_t nPixels){transmit(c,nPixels,true);}   // sets colors of nPixels based on array of Colors c
     void set(Color c, size_t nPixels=1){transmit(&c,nPixels,false);}      // sets color of nPixels to be equal to specific Color c
+
+    boolean send(const Color *c, size_t nPixels){return(queue(c,nPixels,true));}     // same as set(), but copies Colors and transmits them in the background, returning immediately; returns false (and does nothing) if two frames are already pending
+    boolean send(Color c, size_t nPixels=1){return(queue(&c,nPixels,false));}        // same as set(), but transmits in the background, returning immediately; returns false (and does nothing) if two frames are already pending
+    boolean isBusy(){return(txBuffer[0].inUse || txBuffer[1].inUse);}                // returns true if any frame queued by send() has not yet been fully transmitted
+    void wait(){if(channel>=0) rmt_tx_wait_all_done(tx_chan,-1);}                   // waits until all frames queued by send() have been fully transmitted
+    Pixel *setDoneCallback(void (*f)(Pixel *, void *), void *arg=NULL){doneCallback=f;doneArg=arg;return(this);}   // sets function called from INTERRUPT context each time a frame queued by send() completes - must be brief and non-blocking
     
     static Color RGB(uint8_t r, uint8_t g, uint8_t b, uint8_t w=0, uint8_t c=0){return(Color().RGB(r,g,b,w,c));}   // a static method for returning an RGB(WC) Color
     static Color HSV(float h, float s, float v, double w=0, double c=0){return(Color().HSV(h,s,v,w,c));}           // a static method for returning an HSV(WC) Color
+    static Color HSV8(uint8_t h, uint8_t s, uint8_t v, uint8_t w=0, uint8_t c=0){return(Color().HSV8(h,s,v,w,c));} // a static method for returning an HSV(WC) Color using integer math (all parameters [0,255])
     static Color WC(uint8_t w, uint8_t c=0){return(Color().WC(w,c));}                                              // a static method for returning an Warm-White/Cold-White (WC) Color
     static Color CCT(float temp, float v, float wTemp, float cTemp){return(Color().CCT(temp,v,wTemp,cTemp));}      // a static method for returning a CCT Color    
     Color CCT(float temp, float v){return(Color().CCT(temp,v,warmTemp,coolTemp));}                                 // a member function for returning a CCT Color using pixel-specific temperatures
@@ -176,6 +233,7 @@ class Pixel : public Blinkable {
     int getPin(){return(channel>=0?pin:-1);}                                                        // returns pixel pin (=-1 if channel is not valid)
     Pixel *setTiming(float high0, float low0, float high1, float low1, uint32_t lowReset);          // changes default timings for bit pulse - note parameters are in MICROSECONDS
     Pixel *setTemperatures(float wTemp, float cTemp){warmTemp=wTemp;coolTemp=cTemp;return(this);}   // changes default warm-white and cool-white LED temperatures (in Kelvin)
+    Pixel *setBrightness(uint8_t level, float gamma=1.0);                                          // scales all color bytes by level/255 after applying gamma correction; applied while encoding at no extra cost
         
     boolean hasColor(char c){return(strchr(pType,toupper(c))!=NULL || strchr(pType,tolower(c))!=NULL);}   // returns true if pixelType includes c (case-insensitive)
 
@@ -188,6 +246,65 @@ class Pixel : public Blinkable {
     Pixel *setOnColor(Color c){onColor=c;return(this);}
 };
 
+////////////////////////////////////////////
+//              Pixel Frames              //
+////////////////////////////////////////////
+
+class PixelFrame {
+
+  private:
+    Pixel *pixel;
+    Pixel::Color *colors=NULL;     // frame buffer
+    size_t nPixels=0;              // number of Colors in frame buffer
+    uint32_t period=0;             // time (in usec) between frames sent by poll()
+    uint64_t nextFrame=0;          // time (in usec) at which poll() should send next frame
+    uint32_t frameCount=0;         // number of frames sent by poll()
+    boolean rendered=false;        // true if poll() has rendered the next frame but pixel had no free transmit buffer to send it
+    void (*animation)(PixelFrame &, uint32_t)=NULL;      // optional function called by poll() to render each frame
+
+  public:
+    PixelFrame(Pixel *pixel, size_t nPixels);                                      // creates frame buffer of nPixels Colors for pixel
+    ~PixelFrame(){free(colors);}
+    PixelFrame(const PixelFrame &)=delete;                                         // frame buffer is owned by this PixelFrame, so copying is not allowed
+    PixelFrame &operator=(const PixelFrame &)=delete;
+
+    Pixel::Color *getColors(){return(colors);}                                     // returns pointer to frame buffer
+    size_t size(){return(nPixels);}                                                // returns number of Colors in frame buffer
+    Pixel::Color &operator[](size_t i){return(colors[i]);}                         // returns reference to i-th Color in frame buffer
+
+    PixelFrame *fill(Pixel::Color c);                                              // sets every Color in frame to c
+    PixelFrame *fillRainbow(uint8_t startHue, uint8_t deltaHue, uint8_t s=255, uint8_t v=255);       // sets Colors to successive hues (using integer HSV8) starting at startHue and increasing by deltaHue
+    PixelFrame *fillPalette(const Pixel::Color *palette, size_t nColors, uint8_t start=0, uint8_t delta=1);   // sets Colors from a palette of nColors spread evenly (and blended) across palette index [0,255], starting at index start and increasing by delta
+    PixelFrame *add(const Pixel::Color *src);                                      // adds nPixels Colors in src to frame, saturating at 255
+    PixelFrame *blend(const Pixel::Color *src, uint8_t amount);                    // blends nPixels Colors in src into frame, where amount=[0,255] ranges from none to all of src
+    PixelFrame *crossfade(const Pixel::Color *from, const Pixel::Color *to, uint8_t amount);         // sets frame to a blend of nPixels Colors from "from" and "to", where amount=[0,255] ranges from all of "from" to all of "to"
+    PixelFrame *fade(uint8_t amount);                                              // dims every Color in frame, where amount=[0,255] ranges from no change to black
+
+    boolean show(){return(pixel->send(colors,nPixels));}                           // sends frame to pixel in the background; returns false if pixel already has two frames pending
+    PixelFrame *setFrameRate(float fps){period=fps>0?1.0e6/fps:0;return(this);}    // sets target rate (in frames per second) at which poll() sends frames
+    PixelFrame *setAnimation(void (*f)(PixelFrame &frame, uint32_t frameCount)){animation=f;return(this);}   // sets function called by poll() to render each frame before it is sent
+    boolean poll();                                                                // call from loop() - renders and sends next frame if due and pixel has a free transmit buffer, and returns true if a frame was sent
+};
+
+////////////////////////////////////////////
+//              Pixel Groups              //
+////////////////////////////////////////////
+
+class PixelGroup {
+
+  private:
+    std::vector<Pixel *> pixels;
+
+  public:
+    PixelGroup *add(Pixel *pixel){pixels.push_back(pixel);return(this);}          // adds pixel (on its own pin/RMT channel) to group
+    size_t size(){return(pixels.size());}                                          // returns number of pixels in group
+
+    boolean send(const Pixel::Color * const colors[], const size_t nPixels[]);    // starts background transmission of nPixels[i] Colors from colors[i] on the i-th pixel of group, for all pixels at once, and returns immediately; returns false if any pixel still had two frames pending (that pixel is skipped)
+    void set(const Pixel::Color * const colors[], const size_t nPixels[]);        // same as send(), but waits until all pixels have completed, so total time is that of the longest strip rather than the sum of all strips
+    boolean isBusy();                                                              // returns true if any pixel in group has not yet completed its transmission
+    void wait();                                                                   // waits until all pixels in group have completed their transmissions
+};
+
 ////////////////////////////////////////////
 //          Two-Wire RGB DotStars         //
 ////////////////////////////////////////////
@@ -276,18 +393,48 @@ class Dot {
     };
 
   private:
+    typedef struct {
+      uint8_t *buf=NULL;           // DMA-capable buffer holding complete start, pixel, and end frames
+      size_t size=0;               // allocated size (in bytes) of buf
+      spi_transaction_t trans={};
+      volatile boolean inUse=false;    // true from when frame is queued until its SPI transaction has been retrieved as complete
+    } txBuffer_t;
+
     uint32_t dataMask;
     uint32_t clockMask;
     volatile uint32_t *dataSetReg;
     volatile uint32_t *dataClearReg;
     volatile uint32_t *clockSetReg;
     volatile uint32_t *clockClearReg;
+
+    uint8_t dataPin;
+    uint8_t clockPin;
+    spi_host_device_t spiHost;
+    spi_device_interface_config_t devcfg = {};
+    spi_device_handle_t spi=NULL;  // SPI device (NULL if using bit-banged GPIO instead of hardware SPI)
+    size_t maxBytes=DOT_SPI_MAX_BYTES;   // maximum size (in bytes) of a single SPI transfer on spiHost (taken from host if it was already initialized)
+    txBuffer_t txBuffer[2];        // double-buffered frames used in SPI mode
+    int nextBuffer=0;              // index of buffer to use for next call to send()
+
+    void initGPIO(uint8_t dataPin, uint8_t clockPin);                                       // configures pins and registers for bit-banged GPIO (also used as fallback if SPI mode cannot be started)
     void transmit(const Color *c, size_t nPixels, boolean multiColor);                      // transmits Colors to the LED strand; setting multiColor to false repeats Color in c[0] for all nPixels
+    boolean queue(const Color *c, size_t nPixels, boolean multiColor);                      // builds frame in a free txBuffer and queues it for SPI transmission (returns immediately)
+    void release(boolean block);                                                            // marks txBuffers of completed SPI transactions as free; if block is true, waits for all transactions to complete
 
   public:
     Dot(uint8_t dataPin, uint8_t clockPin);                                                 // creates addressable two-wire LED connected to dataPin and clockPin (such as the DotStar SK9822 or APA102)
+    Dot(uint8_t dataPin, uint8_t clockPin, spi_host_device_t host, uint32_t freq=DOT_SPI_FREQ);    // same as above, but drives LEDs from a hardware SPI host using DMA at clock frequency freq (SPI1_HOST selects the default host for the chip)
     void set(const Color *c, size_t nPixels){transmit(c,nPixels,true);}                     // sets colors of nPixels based on array of Colors c
     void set(Color c, size_t nPixels=1){transmit(&c,nPixels,false);}                        // sets color of nPixels to be equal to specific Color c
+
+    boolean send(const Color *c, size_t nPixels){return(queue(c,nPixels,true));}           // same as set(), but in SPI mode transmits in the background and returns immediately; returns false (and does nothing) if two frames are already pending
+    boolean send(Color c, size_t nPixels=1){return(queue(&c,nPixels,false));}              // same as set(), but in SPI mode transmits in the background and returns immediately; returns false (and does nothing) if two frames are already pending
+    boolean isBusy();                                                                       // returns true if any frame queued by send() has not yet been fully transmitted
+    void wait(){release(true);}                                                             // waits until all frames queued by send() have been fully transmitted
+    Dot *setTiming(uint32_t freq);                                                          // changes SPI clock frequency (SPI mode only)
+
+    static size_t frameSize(size_t nPixels){return(4+4*nPixels+4*((nPixels-1)/64+1));}     // returns number of bytes needed for start, pixel, and end frames of nPixels
+    static size_t buildFrame(uint8_t *buf, const Color *c, size_t nPixels, boolean multiColor);    // writes start, pixel, and end frames for nPixels Colors to buf (which must hold frameSize(nPixels) bytes) and returns number of bytes written
     
     static Color RGB(uint8_t r, uint8_t g, uint8_t b, uint8_t driveLevel=31){return(Color().RGB(r,g,b,driveLevel));}  // an alternative method for returning an RGB Color
     static Color HSV(float h, float s, float v, double drivePercent=100){return(Color().HSV(h,s,v,drivePercent));}    // an alternative method for returning an HSV Color
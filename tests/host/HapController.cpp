@@ -0,0 +1,619 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+#include "HapController.h"
+
+#include <mbedtls/bignum.h>
+#include <stdarg.h>
+
+std::function<void()> HapController::pollAccessory=[](){homeSpan.poll();};
+
+uint8_t HapController::ctrlID[hap_controller_IDBYTES];
+uint8_t HapController::ctrlLTPK[32];
+uint8_t HapController::ctrlLTSK[64];
+uint8_t HapController::accID[hap_accessory_IDBYTES];
+uint8_t HapController::accLTPK[32];
+boolean HapController::paired=false;
+
+static const uint8_t TLV_METHOD=0x00, TLV_ID=0x01, TLV_SALT=0x02, TLV_PUBKEY=0x03, TLV_PROOF=0x04, TLV_ENCDATA=0x05, TLV_STATE=0x06, TLV_ERROR=0x07, TLV_SIGNATURE=0x0A;
+
+//////////////////////////////////////
+
+HapController::HapController(uint16_t port){
+
+  if(!ctrlID[0]){                                                  // create this process's controller identity on first use
+    uint8_t uuid[16];
+    randombytes_buf(uuid,16);
+    char buf[hap_controller_IDBYTES+1];
+    snprintf(buf,sizeof(buf),"%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+             uuid[0],uuid[1],uuid[2],uuid[3],uuid[4],uuid[5],uuid[6],uuid[7],uuid[8],uuid[9],uuid[10],uuid[11],uuid[12],uuid[13],uuid[14],uuid[15]);
+    memcpy(ctrlID,buf,hap_controller_IDBYTES);
+    crypto_sign_keypair(ctrlLTPK,ctrlLTSK);
+  }
+
+  client=Host::connect(port);
+}
+
+//////////////////////////////////////
+
+void HapController::fail(const char *fmt, ...){
+
+  if(failed)                  // keep the first reason only
+    return;
+
+  char buf[256];
+  va_list ap;
+  va_start(ap,fmt);
+  vsnprintf(buf,sizeof(buf),fmt,ap);
+  va_end(ap);
+
+  failed=true;
+  failReason=buf;
+}
+
+//////////////////////////////////////
+
+void HapController::tlvAdd(std::vector<uint8_t> &buf, uint8_t tag, const void *val, size_t len){
+
+  const uint8_t *p=(const uint8_t *)val;
+
+  do {                                                             // values longer than 255 bytes are split across consecutive records with the same tag
+    size_t n=len>255?255:len;
+    buf.push_back(tag);
+    buf.push_back(n);
+    buf.insert(buf.end(),p,p+n);
+    p+=n;
+    len-=n;
+  } while(len>0);
+}
+
+//////////////////////////////////////
+
+boolean HapController::tlvParse(const uint8_t *buf, size_t len, tlv_t &tlv){
+
+  tlv.clear();
+  int lastTag=-1;
+  size_t lastLen=0;
+
+  for(size_t i=0;i<len;){
+    if(i+2>len || i+2+buf[i+1]>len)
+      return(false);
+
+    uint8_t tag=buf[i];
+    uint8_t n=buf[i+1];
+    auto &v=tlv[tag];
+
+    if(tag!=lastTag || lastLen!=255)                               // a record only continues the previous one if it has the same tag and the previous one was full
+      v.clear();
+
+    v.insert(v.end(),buf+i+2,buf+i+2+n);
+    lastTag=tag;
+    lastLen=n;
+    i+=2+n;
+  }
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+void HapController::hkdf(uint8_t *out, const uint8_t *in, size_t len, const char *salt, const char *info){
+
+  // HKDF-SHA-512 (RFC 5869) with a 32-byte output, which needs only the first block of the expansion step
+
+  uint8_t prk[crypto_auth_hmacsha512_BYTES];
+  uint8_t okm[crypto_auth_hmacsha512_BYTES];
+  crypto_auth_hmacsha512_state st;
+
+  crypto_auth_hmacsha512_init(&st,(const uint8_t *)salt,strlen(salt));
+  crypto_auth_hmacsha512_update(&st,in,len);
+  crypto_auth_hmacsha512_final(&st,prk);
+
+  uint8_t one=1;
+  crypto_auth_hmacsha512_init(&st,prk,sizeof(prk));
+  crypto_auth_hmacsha512_update(&st,(const uint8_t *)info,strlen(info));
+  crypto_auth_hmacsha512_update(&st,&one,1);
+  crypto_auth_hmacsha512_final(&st,okm);
+
+  memcpy(out,okm,32);
+}
+
+//////////////////////////////////////
+
+boolean HapController::pairTransact(const char *url, const std::vector<uint8_t> &req, tlv_t &rsp, uint8_t state){
+
+  Message msg=transact("POST",url,"application/pairing+tlv8",std::string(req.begin(),req.end()),30000);
+
+  if(msg.status!=200){
+    fail("%s state %d: HTTP status %d",url,state,msg.status);
+    return(false);
+  }
+
+  if(!tlvParse((const uint8_t *)msg.body.data(),msg.body.size(),rsp)){
+    fail("%s state %d: malformed TLV response",url,state);
+    return(false);
+  }
+
+  if(rsp.count(TLV_ERROR)){
+    fail("%s state %d: accessory returned error %d",url,state,rsp[TLV_ERROR].empty()?-1:rsp[TLV_ERROR][0]);
+    return(false);
+  }
+
+  if(rsp[TLV_STATE].size()!=1 || rsp[TLV_STATE][0]!=state){
+    fail("%s: expected state %d",url,state);
+    return(false);
+  }
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+static void sha512(uint8_t *out, const std::vector<uint8_t> &in){
+  crypto_hash_sha512(out,in.data(),in.size());
+}
+
+static std::vector<uint8_t> mpiBytes(const mbedtls_mpi *x, size_t pad=0){          // pad=0 writes the minimum number of bytes
+  std::vector<uint8_t> v(pad?pad:mbedtls_mpi_size(x));
+  mbedtls_mpi_write_binary(x,v.data(),v.size());
+  return(v);
+}
+
+boolean HapController::pairSetup(const char *setupCode){
+
+  std::vector<uint8_t> req;
+  tlv_t rsp;
+
+  // M1 -> M2: start SRP and receive accessory's salt and public key B
+
+  tlvAdd(req,TLV_STATE,1);
+  tlvAdd(req,TLV_METHOD,0);
+  if(!pairTransact("/pair-setup",req,rsp,2))
+    return(false);
+
+  std::vector<uint8_t> salt=rsp[TLV_SALT];
+  std::vector<uint8_t> Bbytes=rsp[TLV_PUBKEY];
+  if(salt.size()!=16 || Bbytes.size()!=384){
+    fail("pair-setup M2: bad salt or public key length");
+    return(false);
+  }
+
+  // SRP-6a client computations (SHA-512, 3072-bit group)
+
+  mbedtls_mpi N, g, k, a, A, B, u, x, t1, t2, S;
+  for(auto *m : {&N,&g,&k,&a,&A,&B,&u,&x,&t1,&t2,&S})
+    mbedtls_mpi_init(m);
+
+  mbedtls_mpi_read_string(&N,16,SRP6A::N3072);
+  mbedtls_mpi_lset(&g,SRP6A::g3072);
+  mbedtls_mpi_read_binary(&B,Bbytes.data(),Bbytes.size());
+
+  uint8_t h[64];
+  std::vector<uint8_t> buf;
+
+  buf=mpiBytes(&N,384);                                            // k = H(N | PAD(g))
+  {auto pg=mpiBytes(&g,384); buf.insert(buf.end(),pg.begin(),pg.end());}
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&k,h,64);
+
+  uint8_t aRand[32];                                               // A = g^a %N
+  randombytes_buf(aRand,32);
+  mbedtls_mpi_read_binary(&a,aRand,32);
+  mbedtls_mpi_exp_mod(&A,&g,&a,&N,NULL);
+
+  buf=mpiBytes(&A,384);                                            // u = H(PAD(A) | PAD(B))
+  {auto pb=mpiBytes(&B,384); buf.insert(buf.end(),pb.begin(),pb.end());}
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&u,h,64);
+
+  char icp[32];                                                    // x = H(s | H(I | ":" | P)) where P has the form XXX-XX-XXX
+  snprintf(icp,sizeof(icp),"%s:%.3s-%.2s-%.3s",SRP6A::I,setupCode,setupCode+3,setupCode+5);
+  buf.assign(icp,icp+strlen(icp));
+  sha512(h,buf);
+  buf=salt;
+  buf.insert(buf.end(),h,h+64);
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&x,h,64);
+
+  mbedtls_mpi_exp_mod(&t1,&g,&x,&N,NULL);                          // S = (B - k*g^x)^(a + u*x) %N
+  mbedtls_mpi_mul_mpi(&t2,&k,&t1);
+  mbedtls_mpi_sub_mpi(&t1,&B,&t2);
+  mbedtls_mpi_mod_mpi(&t1,&t1,&N);
+  mbedtls_mpi_mul_mpi(&t2,&u,&x);
+  mbedtls_mpi_add_mpi(&t2,&t2,&a);
+  mbedtls_mpi_exp_mod(&S,&t1,&t2,&N,NULL);
+
+  uint8_t K[64];                                                   // K = H(PAD(S))
+  sha512(K,mpiBytes(&S,384));
+
+  uint8_t hN[64], hg[64], hI[64], M1[64], M2[64];                  // M1 = H(H(N) xor H(g) | H(I) | s | A | B | K)
+  sha512(hN,mpiBytes(&N,384));
+  crypto_hash_sha512(hg,&SRP6A::g3072,1);
+  crypto_hash_sha512(hI,(const uint8_t *)SRP6A::I,strlen(SRP6A::I));
+  buf.clear();
+  for(int i=0;i<64;i++)
+    buf.push_back(hN[i]^hg[i]);
+  buf.insert(buf.end(),hI,hI+64);
+  buf.insert(buf.end(),salt.begin(),salt.end());
+  {auto v=mpiBytes(&A); buf.insert(buf.end(),v.begin(),v.end());}
+  {auto v=mpiBytes(&B); buf.insert(buf.end(),v.begin(),v.end());}
+  buf.insert(buf.end(),K,K+64);
+  sha512(M1,buf);
+
+  buf=mpiBytes(&A,384);                                            // M2 = H(PAD(A) | M1 | K)
+  buf.insert(buf.end(),M1,M1+64);
+  buf.insert(buf.end(),K,K+64);
+  sha512(M2,buf);
+
+  std::vector<uint8_t> Abytes=mpiBytes(&A,384);
+
+  for(auto *m : {&N,&g,&k,&a,&A,&B,&u,&x,&t1,&t2,&S})
+    mbedtls_mpi_free(m);
+
+  // M3 -> M4: send A and proof M1, and verify accessory's proof M2
+
+  req.clear();
+  tlvAdd(req,TLV_STATE,3);
+  tlvAdd(req,TLV_PUBKEY,Abytes.data(),Abytes.size());
+  tlvAdd(req,TLV_PROOF,M1,64);
+  if(!pairTransact("/pair-setup",req,rsp,4))
+    return(false);
+
+  if(rsp[TLV_PROOF].size()!=64 || memcmp(rsp[TLV_PROOF].data(),M2,64)){
+    fail("pair-setup M4: accessory proof does not match");
+    return(false);
+  }
+
+  // M5 -> M6: exchange long-term public keys
+
+  uint8_t sessionKey[32], iosX[32], accX[32];
+  hkdf(sessionKey,K,64,"Pair-Setup-Encrypt-Salt","Pair-Setup-Encrypt-Info");
+  hkdf(iosX,K,64,"Pair-Setup-Controller-Sign-Salt","Pair-Setup-Controller-Sign-Info");
+  hkdf(accX,K,64,"Pair-Setup-Accessory-Sign-Salt","Pair-Setup-Accessory-Sign-Info");
+
+  buf.assign(iosX,iosX+32);
+  buf.insert(buf.end(),ctrlID,ctrlID+hap_controller_IDBYTES);
+  buf.insert(buf.end(),ctrlLTPK,ctrlLTPK+32);
+  uint8_t sig[64];
+  crypto_sign_detached(sig,NULL,buf.data(),buf.size(),ctrlLTSK);
+
+  std::vector<uint8_t> sub;
+  tlvAdd(sub,TLV_ID,ctrlID,hap_controller_IDBYTES);
+  tlvAdd(sub,TLV_PUBKEY,ctrlLTPK,32);
+  tlvAdd(sub,TLV_SIGNATURE,sig,64);
+
+  std::vector<uint8_t> enc(sub.size()+crypto_aead_chacha20poly1305_IETF_ABYTES);
+  crypto_aead_chacha20poly1305_ietf_encrypt(enc.data(),NULL,sub.data(),sub.size(),NULL,0,NULL,(const uint8_t *)"\x00\x00\x00\x00PS-Msg05",sessionKey);
+
+  req.clear();
+  tlvAdd(req,TLV_STATE,5);
+  tlvAdd(req,TLV_ENCDATA,enc.data(),enc.size());
+  if(!pairTransact("/pair-setup",req,rsp,6))
+    return(false);
+
+  enc=rsp[TLV_ENCDATA];
+  if(enc.size()<crypto_aead_chacha20poly1305_IETF_ABYTES){
+    fail("pair-setup M6: missing encrypted data");
+    return(false);
+  }
+
+  sub.resize(enc.size()-crypto_aead_chacha20poly1305_IETF_ABYTES);
+  if(crypto_aead_chacha20poly1305_ietf_decrypt(sub.data(),NULL,NULL,enc.data(),enc.size(),NULL,0,(const uint8_t *)"\x00\x00\x00\x00PS-Msg06",sessionKey)){
+    fail("pair-setup M6: decryption failed");
+    return(false);
+  }
+
+  tlv_t subTLV;
+  if(!tlvParse(sub.data(),sub.size(),subTLV) || subTLV[TLV_ID].size()!=hap_accessory_IDBYTES || subTLV[TLV_PUBKEY].size()!=32 || subTLV[TLV_SIGNATURE].size()!=64){
+    fail("pair-setup M6: malformed sub-TLV");
+    return(false);
+  }
+
+  buf.assign(accX,accX+32);
+  buf.insert(buf.end(),subTLV[TLV_ID].begin(),subTLV[TLV_ID].end());
+  buf.insert(buf.end(),subTLV[TLV_PUBKEY].begin(),subTLV[TLV_PUBKEY].end());
+  if(crypto_sign_verify_detached(subTLV[TLV_SIGNATURE].data(),buf.data(),buf.size(),subTLV[TLV_PUBKEY].data())){
+    fail("pair-setup M6: accessory signature does not verify");
+    return(false);
+  }
+
+  memcpy(accID,subTLV[TLV_ID].data(),hap_accessory_IDBYTES);
+  memcpy(accLTPK,subTLV[TLV_PUBKEY].data(),32);
+  paired=true;
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+boolean HapController::pairVerify(){
+
+  if(!paired){
+    fail("pair-verify: controller has not completed pair-setup");
+    return(false);
+  }
+
+  std::vector<uint8_t> req, buf;
+  tlv_t rsp;
+
+  // M1 -> M2: exchange Curve25519 keys and verify accessory's signature
+
+  uint8_t curvePK[32], curveSK[32], shared[32], sessionKey[32];
+  crypto_box_keypair(curvePK,curveSK);
+
+  tlvAdd(req,TLV_STATE,1);
+  tlvAdd(req,TLV_PUBKEY,curvePK,32);
+  if(!pairTransact("/pair-verify",req,rsp,2))
+    return(false);
+
+  std::vector<uint8_t> accCurvePK=rsp[TLV_PUBKEY];
+  std::vector<uint8_t> enc=rsp[TLV_ENCDATA];
+  if(accCurvePK.size()!=32 || enc.size()<crypto_aead_chacha20poly1305_IETF_ABYTES){
+    fail("pair-verify M2: bad public key or encrypted data");
+    return(false);
+  }
+
+  if(crypto_scalarmult_curve25519(shared,curveSK,accCurvePK.data())){
+    fail("pair-verify M2: invalid accessory public key");
+    return(false);
+  }
+
+  hkdf(sessionKey,shared,32,"Pair-Verify-Encrypt-Salt","Pair-Verify-Encrypt-Info");
+
+  std::vector<uint8_t> sub(enc.size()-crypto_aead_chacha20poly1305_IETF_ABYTES);
+  if(crypto_aead_chacha20poly1305_ietf_decrypt(sub.data(),NULL,NULL,enc.data(),enc.size(),NULL,0,(const uint8_t *)"\x00\x00\x00\x00PV-Msg02",sessionKey)){
+    fail("pair-verify M2: decryption failed");
+    return(false);
+  }
+
+  tlv_t subTLV;
+  if(!tlvParse(sub.data(),sub.size(),subTLV) || subTLV[TLV_ID].size()!=hap_accessory_IDBYTES || subTLV[TLV_SIGNATURE].size()!=64 || memcmp(subTLV[TLV_ID].data(),accID,hap_accessory_IDBYTES)){
+    fail("pair-verify M2: malformed sub-TLV or unknown accessory");
+    return(false);
+  }
+
+  buf=accCurvePK;
+  buf.insert(buf.end(),accID,accID+hap_accessory_IDBYTES);
+  buf.insert(buf.end(),curvePK,curvePK+32);
+  if(crypto_sign_verify_detached(subTLV[TLV_SIGNATURE].data(),buf.data(),buf.size(),accLTPK)){
+    fail("pair-verify M2: accessory signature does not verify");
+    return(false);
+  }
+
+  // M3 -> M4: prove this controller's identity
+
+  buf.assign(curvePK,curvePK+32);
+  buf.insert(buf.end(),ctrlID,ctrlID+hap_controller_IDBYTES);
+  buf.insert(buf.end(),accCurvePK.begin(),accCurvePK.end());
+  uint8_t sig[64];
+  crypto_sign_detached(sig,NULL,buf.data(),buf.size(),ctrlLTSK);
+
+  sub.clear();
+  tlvAdd(sub,TLV_ID,ctrlID,hap_controller_IDBYTES);
+  tlvAdd(sub,TLV_SIGNATURE,sig,64);
+  enc.resize(sub.size()+crypto_aead_chacha20poly1305_IETF_ABYTES);
+  crypto_aead_chacha20poly1305_ietf_encrypt(enc.data(),NULL,sub.data(),sub.size(),NULL,0,NULL,(const uint8_t *)"\x00\x00\x00\x00PV-Msg03",sessionKey);
+
+  req.clear();
+  tlvAdd(req,TLV_STATE,3);
+  tlvAdd(req,TLV_ENCDATA,enc.data(),enc.size());
+  if(!pairTransact("/pair-verify",req,rsp,4))
+    return(false);
+
+  hkdf(c2aKey,shared,32,"Control-Salt","Control-Write-Encryption-Key");
+  hkdf(a2cKey,shared,32,"Control-Salt","Control-Read-Encryption-Key");
+  c2aCount=0;
+  a2cCount=0;
+  verified=true;
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+void HapController::send(const char *method, const char *url, const char *contentType, const std::string &body){
+
+  std::string msg=std::string(method)+" "+url+" HTTP/1.1\r\nHost: homespan.local\r\n";
+  if(contentType)
+    msg+=std::string("Content-Type: ")+contentType+"\r\n";
+  if(!body.empty() || contentType)
+    msg+="Content-Length: "+std::to_string(body.size())+"\r\n";
+  msg+="\r\n"+body;
+
+  if(!verified){
+    txBuf.insert(txBuf.end(),msg.begin(),msg.end());
+    return;
+  }
+
+  for(size_t i=0;i<msg.size();i+=1024){                            // encrypted frames carry at most 1024 bytes of plaintext
+    uint16_t n=std::min<size_t>(1024,msg.size()-i);
+    uint8_t aad[2]={(uint8_t)(n&0xFF),(uint8_t)(n>>8)};
+    uint8_t nonce[12]={0};
+    for(int j=0;j<8;j++)
+      nonce[4+j]=c2aCount>>(8*j);
+    c2aCount++;
+
+    size_t base=txBuf.size();
+    txBuf.resize(base+2+n+crypto_aead_chacha20poly1305_IETF_ABYTES);
+    memcpy(txBuf.data()+base,aad,2);
+    crypto_aead_chacha20poly1305_ietf_encrypt(txBuf.data()+base+2,NULL,(const uint8_t *)msg.data()+i,n,aad,2,NULL,nonce,c2aKey);
+  }
+}
+
+//////////////////////////////////////
+
+boolean HapController::pump(){
+
+  if(txBuf.empty())
+    return(false);
+
+  size_t n=txBuf.size();
+
+  if(maxWrite){                                                    // xorshift32 - deterministic for a given seed
+    rngState^=rngState<<13;
+    rngState^=rngState>>17;
+    rngState^=rngState<<5;
+    n=std::min<size_t>(n,1+rngState%maxWrite);
+  }
+
+  size_t written=client.write(txBuf.data(),n);
+  if(written!=n)
+    fail("write failed after %u of %u bytes",(unsigned)written,(unsigned)n);
+  txBuf.erase(txBuf.begin(),txBuf.begin()+n);
+
+  return(!txBuf.empty());
+}
+
+//////////////////////////////////////
+
+boolean HapController::decryptFrames(){
+
+  while(rxWire.size()>=2){
+    uint16_t n=rxWire[0]|(rxWire[1]<<8);
+    if(n>1024){
+      fail("received frame with illegal length %u",n);
+      return(false);
+    }
+    if(rxWire.size()<2+n+crypto_aead_chacha20poly1305_IETF_ABYTES)
+      break;
+
+    uint8_t nonce[12]={0};
+    for(int j=0;j<8;j++)
+      nonce[4+j]=a2cCount>>(8*j);
+    a2cCount++;
+
+    size_t base=rxPlain.size();
+    rxPlain.resize(base+n);
+    if(crypto_aead_chacha20poly1305_ietf_decrypt((uint8_t *)rxPlain.data()+base,NULL,NULL,rxWire.data()+2,n+crypto_aead_chacha20poly1305_IETF_ABYTES,rxWire.data(),2,nonce,a2cKey)){
+      fail("decryption of frame #%llu failed",(unsigned long long)(a2cCount-1));
+      return(false);
+    }
+    rxWire.erase(rxWire.begin(),rxWire.begin()+2+n+crypto_aead_chacha20poly1305_IETF_ABYTES);
+  }
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+void HapController::parseMessages(){
+
+  while(true){
+    size_t hEnd=rxPlain.find("\r\n\r\n");
+    if(hEnd==std::string::npos)
+      return;
+
+    Message msg;
+    std::string header=rxPlain.substr(0,hEnd);
+
+    if(!header.compare(0,9,"HTTP/1.1 "))
+      msg.event=false;
+    else if(!header.compare(0,10,"EVENT/1.0 "))
+      msg.event=true;
+    else {
+      fail("unrecognized message start: %.40s",header.c_str());
+      rxPlain.clear();
+      return;
+    }
+
+    msg.status=atoi(header.c_str()+(msg.event?10:9));
+
+    size_t len=0;
+    size_t cl=header.find("Content-Length: ");
+    if(cl!=std::string::npos)
+      len=strtoul(header.c_str()+cl+16,NULL,10);
+
+    if(rxPlain.size()<hEnd+4+len)
+      return;
+
+    msg.body=rxPlain.substr(hEnd+4,len);
+    rxPlain.erase(0,hEnd+4+len);
+    msg.wireBytes=rxWireCount-rxWire.size();
+    rxWireCount=rxWire.size();
+    msg.time=esp_timer_get_time();
+    inbox.push_back(std::move(msg));
+  }
+}
+
+//////////////////////////////////////
+
+boolean HapController::receive(Message &msg){
+
+  if(inbox.empty() && !failed){
+    int n=client.available();
+    if(n>0){
+      uint8_t buf[2048];
+      while((n=client.read(buf,sizeof(buf)))>0){
+        rxWireCount+=n;
+        if(verified)
+          rxWire.insert(rxWire.end(),buf,buf+n);
+        else
+          rxPlain.append((const char *)buf,n);
+      }
+      if(!verified || decryptFrames())
+        parseMessages();
+    }
+  }
+
+  if(inbox.empty())
+    return(false);
+
+  msg=std::move(inbox.front());
+  inbox.pop_front();
+  return(true);
+}
+
+//////////////////////////////////////
+
+HapController::Message HapController::transact(const char *method, const char *url, const char *contentType, const std::string &body, uint32_t timeoutMs){
+
+  send(method,url,contentType,body);
+
+  Message msg;
+  uint32_t alarm=millis()+timeoutMs;
+
+  while(!failed && millis()<alarm){
+    pump();
+    pollAccessory();
+    while(receive(msg)){
+      if(!msg.event)
+        return(msg);
+      events.push_back(std::move(msg));
+    }
+    if(!connected()){
+      fail("%s %s: connection closed by accessory",method,url);
+      break;
+    }
+  }
+
+  if(!failed)
+    fail("%s %s: no response after %u ms",method,url,timeoutMs);
+
+  msg=Message();
+  msg.status=-1;
+  return(msg);
+}
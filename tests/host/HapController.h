@@ -0,0 +1,122 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Minimal HomeKit controller for driving HomeSpan on the host over a loopback connection.  Implements pair-setup (SRP-6a),
+// pair-verify, and the encrypted session framing independently of HomeSpan's own TLV8, SRP, and HKDF code, so a regression
+// in any of those (or in HAPClient's receive/framing logic) shows up as a failed handshake, a decrypt error, or a bad message.
+
+#pragma once
+
+#include <HomeSpan.h>
+#include <HostStubs.h>
+#include <sodium.h>
+#include <HAP.h>
+#include <SRP.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+
+class HapController {
+
+  public:
+
+  struct Message {
+    boolean event=false;                  // true if an EVENT/1.0 notification, false if an HTTP/1.1 response
+    int status=0;                         // HTTP status code (-1 if the request timed out or the connection failed)
+    std::string body;                     // message body
+    size_t wireBytes=0;                   // number of (encrypted) bytes received for this message
+    int64_t time=0;                       // esp_timer_get_time() when the message was fully received
+  };
+
+  typedef std::map<uint8_t,std::vector<uint8_t>> tlv_t;
+
+  static std::function<void()> pollAccessory;     // called repeatedly by blocking operations to give HomeSpan a chance to run (default=homeSpan.poll())
+
+  private:
+
+  static uint8_t ctrlID[hap_controller_IDBYTES];  // this controller's pairing ID, LTPK, and LTSK (shared by all instances)
+  static uint8_t ctrlLTPK[32];
+  static uint8_t ctrlLTSK[64];
+  static uint8_t accID[hap_accessory_IDBYTES];    // accessory's pairing ID and LTPK, learned during pair-setup
+  static uint8_t accLTPK[32];
+  static boolean paired;
+
+  NetworkClient client;
+  boolean verified=false;
+  uint8_t c2aKey[32], a2cKey[32];
+  uint64_t c2aCount=0, a2cCount=0;
+
+  std::vector<uint8_t> txBuf;                     // bytes (already encrypted if verified) waiting to be written
+  std::vector<uint8_t> rxWire;                    // raw bytes read but not yet decrypted
+  std::string rxPlain;                            // decrypted bytes not yet parsed into a Message
+  size_t rxWireCount=0;                           // number of raw bytes read since the last Message was completed
+  std::deque<Message> inbox;
+
+  size_t maxWrite=0;                              // if non-zero, write at most a random 1..maxWrite bytes each time pump() is called
+  uint32_t rngState=1;
+
+  boolean failed=false;
+  std::string failReason;
+
+  void fail(const char *fmt, ...);
+  boolean decryptFrames();
+  void parseMessages();
+  boolean pairTransact(const char *url, const std::vector<uint8_t> &req, tlv_t &rsp, uint8_t state);
+
+  public:
+
+  HapController(uint16_t port=80);
+  ~HapController(){client.stop();}
+  HapController(const HapController &)=delete;
+  HapController &operator=(const HapController &)=delete;
+
+  static void tlvAdd(std::vector<uint8_t> &buf, uint8_t tag, const void *val, size_t len);
+  static void tlvAdd(std::vector<uint8_t> &buf, uint8_t tag, uint8_t val){tlvAdd(buf,tag,&val,1);}
+  static boolean tlvParse(const uint8_t *buf, size_t len, tlv_t &tlv);
+  static void hkdf(uint8_t *out, const uint8_t *in, size_t len, const char *salt, const char *info);
+
+  boolean pairSetup(const char *setupCode=DEFAULT_SETUP_CODE);     // performs pair-setup on this connection (only needs to be done once per process)
+  boolean pairVerify();                                           // performs pair-verify, after which all traffic on this connection is encrypted
+  static boolean isPaired(){return(paired);}
+
+  void setFragmentation(size_t maxBytes, uint32_t seed=1){maxWrite=maxBytes;rngState=seed?seed:1;}
+
+  void send(const char *method, const char *url, const char *contentType=NULL, const std::string &body="");
+  boolean pump();                                 // writes pending request bytes (subject to fragmentation) - returns true if bytes remain to be written
+  boolean receive(Message &msg);                  // reads and decodes any available data - returns true (and pops msg) if a complete message is ready
+  Message transact(const char *method, const char *url, const char *contentType=NULL, const std::string &body="", uint32_t timeoutMs=10000);
+
+  std::deque<Message> events;                     // EVENT messages that arrived while transact() was waiting for a response
+
+  void close(){client.stop();}
+  boolean connected(){return(client.connected());}
+  boolean hasFailed(){return(failed);}
+  const char *error(){return(failReason.c_str());}
+};
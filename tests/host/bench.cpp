@@ -0,0 +1,380 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Host benchmark of HomeSpan's HAP request handling for a Bridge of 2-150 Accessories (the Bridge itself plus 1-149 dimmable LightBulbs)
+//
+//   homespan_bench [iterations]       (default=200 requests of each type per bridge size)
+//
+// A controller pairs with HomeSpan over a loopback connection and, for each bridge size, times GET /accessories, GET /characteristics
+// (all values), PUT /characteristics (all On values), and EVENT (all Brightness values changed with setVal() and delivered to a second,
+// subscribed, session).  Reports requests/second (end-to-end, including the controller's own crypto), the time spent in homeSpan.poll(),
+// the encrypted size of each response, and the number of heap allocations HomeSpan made per request (counted only within homeSpan.poll()).
+//
+// With 1 (the Bridge alone), 10, and 150 Accessories, also runs HomeSpan's 'b' serial command, which compares Span::find() using the
+// aid/iid index against the linear scan of every Accessory, Service, and Characteristic it replaced.
+//
+// For each bridge size, every value, minValue, maxValue, and minStep in the GET /accessories response is also re-formatted into hapOut
+// two ways: with an Arduino String per value, as SpanCharacteristic::uvPrint() did before values were written straight to hapOut (before),
+// and with the stack-buffer conversions printfValue() now uses (after), reporting heap allocations and time per response for each.
+// Note that an Arduino-ESP32 String holds up to 14 characters without allocating (the host's std::string-based String holds 15), so
+// before only allocated for longer string values.
+//
+// Finally, with 150 Accessories, repeats GET /accessories and GET /characteristics for a range of staging buffer sizes (see
+// homeSpan.setTxBufferSize()), reporting the number of encrypted HAP frames packed into each write to the loopback socket and the
+// time spent in homeSpan.poll() per KB of response.  The smallest size holds a single frame, so each frame needs its own write.
+
+#include "HapController.h"
+
+struct BenchLight : Service::LightBulb {
+
+  SpanCharacteristic *power;
+  SpanCharacteristic *level;
+
+  BenchLight() : Service::LightBulb(){
+    power=new Characteristic::On();
+    level=new Characteristic::Brightness(50);
+  }
+};
+
+static std::vector<BenchLight *> lights;
+static uint64_t pollAllocs=0;
+static int64_t pollTime=0;
+
+//////////////////////////////////////
+
+static void addLight(){
+
+  char name[16];
+  snprintf(name,sizeof(name),"Light-%u",(unsigned)lights.size()+1);
+
+  new SpanAccessory();
+    new Service::AccessoryInformation();
+      new Characteristic::Identify();
+      new Characteristic::Name(name);
+    lights.push_back(new BenchLight());
+}
+
+//////////////////////////////////////
+
+struct Result {
+  double reqPerSec;
+  double pollUsec;
+  size_t bytes;
+  double allocs;
+};
+
+static Result measure(int iterations, std::function<size_t()> request){
+
+  pollAllocs=0;
+  pollTime=0;
+  size_t bytes=0;
+
+  int64_t t0=esp_timer_get_time();
+  for(int i=0;i<iterations;i++)
+    bytes=request();
+  int64_t elapsed=esp_timer_get_time()-t0;
+
+  return(Result{iterations*1.0e6/elapsed, (double)pollTime/iterations, bytes, (double)pollAllocs/iterations});
+}
+
+//////////////////////////////////////
+
+static void benchLookups(){
+
+  Host::setQuiet(false);                                           // 'b' reports through Serial at log level 0
+  homeSpan.setLogLevel(0);
+  homeSpan.processSerialCommand("b");
+  homeSpan.setLogLevel(-1);
+  fflush(stdout);
+  Host::setQuiet(true);
+}
+
+//////////////////////////////////////
+
+struct ValueField {
+  boolean isString;
+  boolean isFloat;
+  std::string text;                                                // contents of string, or the number as written
+};
+
+static std::vector<ValueField> valueFields(const std::string &body){      // extracts every value, minValue, maxValue, and minStep
+
+  std::vector<ValueField> fields;
+
+  for(const char *key : {"\"value\":", "\"minValue\":", "\"maxValue\":", "\"minStep\":"}){
+    for(size_t p=0;(p=body.find(key,p))!=std::string::npos;){
+      p+=strlen(key);
+      if(body[p]=='"'){
+        size_t q=p+1;
+        while(q<body.size() && body[q]!='"')
+          q+=(body[q]=='\\')?2:1;
+        fields.push_back({true,false,body.substr(p+1,q-p-1)});
+      } else {
+        size_t q=body.find_first_not_of("-+.0123456789eE",p);
+        std::string num=body.substr(p,q-p);
+        if(!num.empty())
+          fields.push_back({false,num.find_first_of(".eE")!=std::string::npos,num});
+      }
+    }
+  }
+
+  return(fields);
+}
+
+//////////////////////////////////////
+
+struct FormatResult {
+  double allocs;
+  double usec;
+};
+
+static FormatResult measureFormat(int iterations, const std::vector<ValueField> &fields, boolean useString){
+
+  hapOut.beginCapture();                                           // allocate capture chunks before counting
+  for(auto const &f : fields)
+    hapOut << f.text.c_str();
+  hapOut.endCapture();
+  hapOut.clearCapture();
+
+  uint64_t n0=Host::allocCount();
+  int64_t t0=esp_timer_get_time();
+
+  for(int i=0;i<iterations;i++){
+    hapOut.beginCapture();
+    for(auto const &f : fields){
+      if(useString){                                               // Arduino String per value (uvPrint() before printfValue())
+        if(f.isString){
+          hapOut << (String("\"") + String(f.text.c_str()) + String("\"")).c_str();
+        } else if(f.isFloat){
+          char c[64];
+          sprintf(c,"%g",atof(f.text.c_str()));
+          hapOut << String(c).c_str();
+        } else {
+          hapOut << String(atol(f.text.c_str())).c_str();
+        }
+      } else {                                                     // stack buffer written directly to hapOut (printfValue())
+        if(f.isString){
+          hapOut << "\"" << f.text.c_str() << "\"";
+        } else {
+          char c[32];
+          size_t n=f.isFloat?Utils::floatToChar(atof(f.text.c_str()),c):Utils::intToChar(atol(f.text.c_str()),c);
+          hapOut.write(c,n);
+        }
+      }
+    }
+    hapOut.endCapture();
+    hapOut.clearCapture();
+  }
+
+  return(FormatResult{(double)(Host::allocCount()-n0)/iterations, (double)(esp_timer_get_time()-t0)/iterations});
+}
+
+//////////////////////////////////////
+
+static void check(boolean ok, HapController &ctl, const char *what){
+
+  if(ok && !ctl.hasFailed())
+    return;
+
+  fprintf(stderr,"FAILED: %s (%s)\n",what,ctl.hasFailed()?ctl.error():"unexpected response");
+  exit(1);
+}
+
+//////////////////////////////////////
+
+int main(int argc, char *argv[]){
+
+  int iterations=argc>1?atoi(argv[1]):200;
+  if(iterations<1)
+    iterations=1;
+
+  Host::setQuiet(true);
+  Host::setSkipDelays(true);
+  init();
+
+  homeSpan.setLogLevel(-1);
+  homeSpan.begin(Category::Bridges,"HomeSpan Bench");
+
+  new SpanAccessory();
+    new Service::AccessoryInformation();
+      new Characteristic::Identify();
+
+  HapController::pollAccessory=[](){
+    uint64_t n=Host::allocCount();
+    int64_t t=esp_timer_get_time();
+    homeSpan.poll();
+    pollTime+=esp_timer_get_time()-t;
+    pollAllocs+=Host::allocCount()-n;
+  };
+
+  HapController::pollAccessory();                                  // initialize HomeSpan
+
+  benchLookups();
+
+  addLight();
+  homeSpan.updateDatabase();
+
+  {
+    HapController setup;
+    check(setup.pairSetup(),setup,"pair-setup");
+  }
+
+  HapController ctl;
+  HapController sub;
+  check(ctl.pairVerify(),ctl,"pair-verify (requests)");
+  check(sub.pairVerify(),sub,"pair-verify (events)");
+
+  std::vector<std::string> formatResults;
+
+  printf("\n%-6s %-6s  %-20s %10s %10s %10s %10s\n","Accs","Chars","Request","req/sec","poll usec","Bytes","Allocs/req");
+
+  for(int nAcc : {2, 10, 25, 50, 100, 150}){                       // total number of Accessories, including the Bridge (HAP allows at most 150)
+
+    while((int)lights.size()<nAcc-1)
+      addLight();
+    homeSpan.updateDatabase();
+
+    if(nAcc==10 || nAcc==150)
+      benchLookups();
+
+    std::string ids, putOn, putEv;
+    for(auto light : lights){
+      char buf[96];
+      snprintf(buf,sizeof(buf),"%s%u.%u,%u.%u",ids.empty()?"":",",light->getAID(),light->power->getIID(),light->getAID(),light->level->getIID());
+      ids+=buf;
+      snprintf(buf,sizeof(buf),"%s{\"aid\":%u,\"iid\":%u,\"value\":%%d}",putOn.empty()?"":",",light->getAID(),light->power->getIID());
+      putOn+=buf;
+      snprintf(buf,sizeof(buf),"%s{\"aid\":%u,\"iid\":%u,\"ev\":true}",putEv.empty()?"":",",light->getAID(),light->level->getIID());
+      putEv+=buf;
+    }
+
+    std::string getURL="/characteristics?id="+ids;
+    std::string putBody[2];
+    for(int v=0;v<2;v++){
+      std::string s=putOn;
+      for(size_t p;(p=s.find("%d"))!=std::string::npos;)
+        s.replace(p,2,std::to_string(v));
+      putBody[v]="{\"characteristics\":["+s+"]}";
+    }
+
+    check(sub.transact("PUT","/characteristics","application/hap+json","{\"characteristics\":["+putEv+"]}").status==204,sub,"subscribe to Brightness events");
+
+    int nChars=1+4*lights.size();                                  // Identify on the Bridge, plus Identify, Name, On, and Brightness on each Light
+
+    std::vector<std::pair<const char *,Result>> results;
+
+    results.push_back({"GET /accessories",measure(iterations,[&](){
+      auto rsp=ctl.transact("GET","/accessories");
+      check(rsp.status==200,ctl,"GET /accessories");
+      return(rsp.wireBytes);
+    })});
+
+    results.push_back({"GET /characteristics",measure(iterations,[&](){
+      auto rsp=ctl.transact("GET",getURL.c_str());
+      check(rsp.status==200,ctl,"GET /characteristics");
+      return(rsp.wireBytes);
+    })});
+
+    int putCount=0;
+    results.push_back({"PUT /characteristics",measure(iterations,[&](){
+      auto rsp=ctl.transact("PUT","/characteristics","application/hap+json",putBody[putCount++%2]);
+      check(rsp.status==204,ctl,"PUT /characteristics");
+      return(rsp.wireBytes);
+    })});
+
+    int eventCount=0;
+    results.push_back({"EVENT",measure(iterations,[&](){
+      int val=(eventCount++%2)?30:70;
+      for(auto light : lights)
+        light->level->setVal(val);
+
+      size_t bytes=0;
+      int nValues=0;
+      uint32_t alarm=millis()+10000;
+      HapController::Message msg;
+
+      while(nValues<(int)lights.size()){                           // HomeSpan may split notifications across several EVENT messages
+        check(millis()<alarm,sub,"EVENT not received");
+        HapController::pollAccessory();
+        while(sub.receive(msg)){
+          check(msg.event,sub,"unexpected response on event session");
+          bytes+=msg.wireBytes;
+          for(size_t p=0;(p=msg.body.find("\"aid\"",p))!=std::string::npos;p++)
+            nValues++;
+        }
+        check(!sub.hasFailed(),sub,"EVENT");
+      }
+      return(bytes);
+    })});
+
+    for(auto &r : results)
+      printf("%-6d %-6d  %-20s %10.0f %10.1f %10zu %10.1f\n",nAcc,nChars,r.first,r.second.reqPerSec,r.second.pollUsec,r.second.bytes,r.second.allocs);
+    printf("\n");
+
+    auto fields=valueFields(ctl.transact("GET","/accessories").body);
+    FormatResult before=measureFormat(iterations,fields,true);
+    FormatResult after=measureFormat(iterations,fields,false);
+    char line[128];
+    snprintf(line,sizeof(line),"%-6d %-6zu  %12.1f %12.1f %12.1f %12.1f",nAcc,fields.size(),before.allocs,before.usec,after.allocs,after.usec);
+    formatResults.push_back(line);
+
+    if(nAcc<150)
+      continue;
+
+    printf("%-8s  %-20s %10s %10s %10s %12s %10s\n","TxBuffer","Request","Bytes","Frames","Writes","Frames/write","usec/KB");
+
+    for(size_t txSize : {1042, DEFAULT_TX_BUFFER_SIZE, 16384, 65536}){       // 1042 bytes is the minimum (one full encrypted frame)
+      homeSpan.setTxBufferSize(txSize);
+
+      for(const char *url : {"/accessories", getURL.c_str()}){
+        uint32_t frames=hapOut.getFrameCount();
+        uint32_t writes=hapOut.getWriteCount();
+
+        Result r=measure(iterations,[&](){
+          auto rsp=ctl.transact("GET",url);
+          check(rsp.status==200,ctl,"GET");
+          return(rsp.wireBytes);
+        });
+
+        double nFrames=(double)(hapOut.getFrameCount()-frames)/iterations;
+        double nWrites=(double)(hapOut.getWriteCount()-writes)/iterations;
+        printf("%-8zu  GET %-16.16s %10zu %10.1f %10.1f %12.1f %10.2f\n",txSize,url,r.bytes,nFrames,nWrites,nWrites?nFrames/nWrites:0.0,r.pollUsec*1024/r.bytes);
+      }
+    }
+
+    homeSpan.setTxBufferSize(DEFAULT_TX_BUFFER_SIZE);
+    printf("\n");
+  }
+
+  printf("Value formatting for GET /accessories (per response)\n\n");
+  printf("%-6s %-6s  %12s %12s %12s %12s\n","Accs","Values","Allocs (bef)","usec (bef)","Allocs (aft)","usec (aft)");
+  for(auto const &line : formatResults)
+    printf("%s\n",line.c_str());
+  printf("\n");
+
+  return(0);
+}
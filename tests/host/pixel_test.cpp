@@ -0,0 +1,624 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Host tests of the symbol streams and SPI frames produced by Pixel, PixelGroup, and Dot, and of the PixelFrame color kernels
+//
+//   pixel_test                       runs all tests
+//   pixel_test --bench [frames]      times each PixelFrame color kernel on a 1024-pixel frame and reports pixels per second (default=10000)
+//
+// The RMT stand-in runs each Pixel encoder to completion, offering it a configurable number of free symbols on each call, and captures
+// the resulting symbol stream.  These are compared against a reference encoder that converts each color byte to symbols one bit at a time,
+// as Pixel did before its symbols were taken from a pre-computed table.
+//
+// Color::HSV8() and the PixelFrame fill, add, blend, crossfade, and fade kernels are compared against floating-point references.
+
+#include <HomeSpan.h>
+#include <HostStubs.h>
+#include <src/extras/Pixel.h>
+
+#include <random>
+#include <map>
+#include <functional>
+
+static int nChecks=0;
+static int nFailures=0;
+
+#define CHECK(cond, ...) do{ nChecks++; if(!(cond)){ nFailures++; fprintf(stderr,"FAILED (%s:%d): ",__FILE__,__LINE__); fprintf(stderr,__VA_ARGS__); fprintf(stderr,"\n"); } }while(0)
+
+static std::mt19937 rng(1);
+
+//////////////////////////////////////
+// Reference bit-loop encoder for Pixel
+
+struct PixelTiming {
+  float high0=0.32, low0=0.88, high1=0.64, low1=0.56;
+  uint32_t lowReset=80;
+};
+
+static rmt_symbol_word_t symbol(float high, float low){
+
+  rmt_symbol_word_t s;
+  s.level0=1;
+  s.duration0=high*80+0.5;
+  s.level1=0;
+  s.duration1=low*80+0.5;
+  return(s);
+}
+
+static Host::rmtFrame_t referencePixel(const Pixel::Color *c, size_t nPixels, boolean multiColor, const char *pixelType, const PixelTiming &t, uint8_t brightness=255, float gamma=1.0){
+
+  static const char valid[]="RGBWC01234-";
+  std::vector<int> order;
+  for(const char *p=pixelType;*p;p++)
+    order.push_back((strchr(valid,toupper(*p))-valid)%5);
+
+  rmt_symbol_word_t bit0=symbol(t.high0,t.low0);
+  rmt_symbol_word_t bit1=symbol(t.high1,t.low1);
+
+  Host::rmtFrame_t frame;
+  for(size_t n=0;n<nPixels;n++){
+    const Pixel::Color &color=c[multiColor?n:0];
+    for(int k : order){
+      uint8_t val=color.col[k];
+      if(gamma!=1.0)
+        val=pow(val/255.0,gamma)*255.0+0.5;
+      val=(val*brightness+127)/255;
+      for(int j=7;j>=0;j--)
+        frame.push_back((val&(1<<j))?bit1:bit0);
+    }
+  }
+
+  return(frame);
+}
+
+//////////////////////////////////////
+
+static void checkPixelFrame(const Host::rmtFrame_t &frame, const Host::rmtFrame_t &ref, uint32_t lowReset, const char *label){
+
+  CHECK(frame.size()>ref.size(),"%s: %zu symbols, expected %zu data symbols plus reset",label,frame.size(),ref.size());
+  if(frame.size()<=ref.size())
+    return;
+
+  size_t mismatch=ref.size();
+  for(size_t i=0;i<ref.size() && mismatch==ref.size();i++)
+    if(frame[i].val!=ref[i].val)
+      mismatch=i;
+  CHECK(mismatch==ref.size(),"%s: symbol %zu is 0x%08X, expected 0x%08X",label,mismatch,frame[mismatch].val,ref[mismatch].val);
+
+  uint32_t resetTicks=0;                                          // remaining symbols must hold the line low for at least lowReset usec
+  boolean allLow=true, nonZero=true;
+  for(size_t i=ref.size();i<frame.size();i++){
+    allLow&=(frame[i].level0==0 && frame[i].level1==0);
+    nonZero&=(frame[i].duration0>0 && frame[i].duration1>0);
+    resetTicks+=frame[i].duration0+frame[i].duration1;
+  }
+  CHECK(allLow && nonZero,"%s: reset symbols must be low with non-zero durations",label);
+  CHECK(resetTicks>=lowReset*80,"%s: reset gap of %u ticks is shorter than %u",label,resetTicks,lowReset*80);
+}
+
+//////////////////////////////////////
+
+static std::vector<Pixel::Color> randomColors(size_t n){
+
+  std::vector<Pixel::Color> colors(n);
+  for(auto &c : colors)
+    c.RGB(rng(),rng(),rng(),rng(),rng());
+  return(colors);
+}
+
+//////////////////////////////////////
+
+struct TestPixel {
+  const char *type;
+  int pin;
+  Pixel *pixel;
+};
+
+static std::vector<TestPixel> testPixels;
+
+static void testPixelEncoder(){
+
+  for(auto const &type : {"GRB","RGBW","RGBWC","W0C"}){
+    int pin=12+testPixels.size();
+    testPixels.push_back({type,pin,new Pixel(pin,type)});
+    CHECK(*testPixels.back().pixel,"Pixel(%d,\"%s\") was not created",pin,type);
+  }
+
+  PixelTiming timings[2];
+  timings[1].high0=0.40; timings[1].low0=0.85; timings[1].high1=0.80; timings[1].low1=0.45; timings[1].lowReset=1000;    // reset gap needing more than one symbol
+
+  struct {uint8_t level; float gamma;} levels[]={{255,1.0},{128,1.0},{200,2.2},{0,1.0}};
+
+  for(auto &tp : testPixels){
+    for(auto const &t : timings){
+      tp.pixel->setTiming(t.high0,t.low0,t.high1,t.low1,t.lowReset);
+
+      for(auto const &lv : levels){
+        tp.pixel->setBrightness(lv.level,lv.gamma);
+
+        for(size_t chunk : {8, 12, 24, 64, 4096}){
+          Host::setRmtChunk(chunk);
+
+          for(size_t nPixels : {1, 3, 64, 301}){
+            std::vector<Pixel::Color> colors=randomColors(nPixels);
+            char label[128];
+
+            for(int mode=0;mode<4;mode++){                        // set() multi-color, set() single-color, send() multi-color, send() single-color
+              boolean multi=!(mode&1);
+              Host::rmtClear();
+
+              if(mode<2)
+                multi?tp.pixel->set(colors.data(),nPixels):tp.pixel->set(colors[0],nPixels);
+              else {
+                boolean ok=multi?tp.pixel->send(colors.data(),nPixels):tp.pixel->send(colors[0],nPixels);
+                CHECK(ok,"send() to Pixel(%d) was refused",tp.pin);
+                tp.pixel->wait();
+                CHECK(!tp.pixel->isBusy(),"Pixel(%d) still busy after wait()",tp.pin);
+              }
+
+              snprintf(label,sizeof(label),"Pixel(%d,\"%s\") %s %s of %zu, brightness=%d gamma=%.1f reset=%u chunk=%zu",
+                       tp.pin,tp.type,mode<2?"set()":"send()",multi?"multi-color":"single-color",nPixels,lv.level,lv.gamma,t.lowReset,chunk);
+
+              auto &frames=Host::rmtFrames(tp.pin);
+              CHECK(frames.size()==1,"%s: %zu frames transmitted, expected 1",label,frames.size());
+              if(frames.size()==1)
+                checkPixelFrame(frames[0],referencePixel(colors.data(),nPixels,multi,tp.type,t,lv.level,lv.gamma),t.lowReset,label);
+            }
+          }
+        }
+      }
+    }
+
+    tp.pixel->setTiming(0.32,0.88,0.64,0.56,80)->setBrightness(255);
+  }
+
+  Host::setRmtChunk(0);
+}
+
+//////////////////////////////////////
+
+static void testPixelAllocFailure(){
+
+  int inUse=Host::rmtChannelsInUse();
+
+  Host::failInternalAlloc(true);                                  // symbol table cannot be allocated
+  Pixel *p=new Pixel(20,"GRB");
+  Host::failInternalAlloc(false);
+
+  CHECK(!*p,"Pixel created without a symbol table");
+  CHECK(Host::rmtChannelsInUse()==inUse,"RMT channel not released after symbol table allocation failed (%d in use, expected %d)",Host::rmtChannelsInUse(),inUse);
+  CHECK(p->getPin()==-1,"failed Pixel reports pin %d",p->getPin());
+
+  Host::rmtClear();
+  p->set(Pixel::RGB(1,2,3),4);                                    // must be harmless
+  p->setBrightness(100);
+  CHECK(p->send(Pixel::RGB(1,2,3),4),"send() to failed Pixel should be ignored");
+  CHECK(Host::rmtFrames(20).empty(),"failed Pixel transmitted symbols");
+
+  Pixel *q=new Pixel(20,"GRB");                                   // channel can now be re-used
+  CHECK(*q,"Pixel could not re-use released RMT channel");
+  CHECK(Host::rmtChannelsInUse()==inUse+1,"expected %d RMT channels in use, found %d",inUse+1,Host::rmtChannelsInUse());
+}
+
+//////////////////////////////////////
+
+static std::map<Pixel *, int> doneCount;
+
+static void countDone(Pixel *pixel, void *arg){
+  doneCount[pixel]++;
+  (*(int *)arg)++;
+}
+
+static void testPixelGroup(){
+
+  PixelGroup group;
+  for(auto &tp : testPixels)
+    group.add(tp.pixel);
+  CHECK(group.size()==testPixels.size(),"PixelGroup has %zu pixels, expected %zu",group.size(),testPixels.size());
+
+  int totalDone=0;
+  for(auto &tp : testPixels)
+    tp.pixel->setDoneCallback(countDone,&totalDone);
+
+  PixelTiming t;
+  size_t nPixels[]={5, 17, 1, 40};
+  std::vector<Pixel::Color> frameA[4], frameB[4], frameC[4];
+  const Pixel::Color *colorsA[4], *colorsB[4], *colorsC[4];
+  for(int i=0;i<4;i++){
+    frameA[i]=randomColors(nPixels[i]);
+    frameB[i]=randomColors(nPixels[i]);
+    frameC[i]=randomColors(nPixels[i]);
+    colorsA[i]=frameA[i].data();
+    colorsB[i]=frameB[i].data();
+    colorsC[i]=frameC[i].data();
+  }
+
+  Host::rmtClear();
+  doneCount.clear();
+
+  CHECK(!group.isBusy(),"idle PixelGroup reports busy");
+  CHECK(group.send(colorsA,nPixels),"first PixelGroup send() was refused");
+  CHECK(group.send(colorsB,nPixels),"second PixelGroup send() was refused");
+  CHECK(group.isBusy(),"PixelGroup not busy with two frames pending");
+  CHECK(!group.send(colorsC,nPixels),"third PixelGroup send() accepted with two frames already pending");
+  CHECK(totalDone==0,"done callback called %d times before wait()",totalDone);
+
+  group.wait();
+  CHECK(!group.isBusy(),"PixelGroup still busy after wait()");
+  CHECK(totalDone==8,"done callback called %d times, expected 8",totalDone);
+
+  for(int i=0;i<4;i++){
+    auto &tp=testPixels[i];
+    char label[64];
+    auto &frames=Host::rmtFrames(tp.pin);
+    CHECK(doneCount[tp.pixel]==2,"Pixel(%d) done callback called %d times, expected 2",tp.pin,doneCount[tp.pixel]);
+    CHECK(frames.size()==2,"PixelGroup send() transmitted %zu frames on pin %d, expected 2",frames.size(),tp.pin);
+    if(frames.size()!=2)
+      continue;
+    snprintf(label,sizeof(label),"PixelGroup Pixel(%d,\"%s\") frame 1",tp.pin,tp.type);
+    checkPixelFrame(frames[0],referencePixel(colorsA[i],nPixels[i],true,tp.type,t),t.lowReset,label);
+    snprintf(label,sizeof(label),"PixelGroup Pixel(%d,\"%s\") frame 2",tp.pin,tp.type);
+    checkPixelFrame(frames[1],referencePixel(colorsB[i],nPixels[i],true,tp.type,t),t.lowReset,label);
+  }
+
+  Host::rmtClear();                                               // set() waits for completion of every pixel
+  totalDone=0;
+  group.set(colorsC,nPixels);
+  CHECK(!group.isBusy(),"PixelGroup busy after set()");
+  CHECK(totalDone==4,"done callback called %d times after set(), expected 4",totalDone);
+
+  for(int i=0;i<4;i++){
+    auto &tp=testPixels[i];
+    char label[64];
+    auto &frames=Host::rmtFrames(tp.pin);
+    CHECK(frames.size()==1,"PixelGroup set() transmitted %zu frames on pin %d, expected 1",frames.size(),tp.pin);
+    snprintf(label,sizeof(label),"PixelGroup set() Pixel(%d,\"%s\")",tp.pin,tp.type);
+    if(frames.size()==1)
+      checkPixelFrame(frames[0],referencePixel(colorsC[i],nPixels[i],true,tp.type,t),t.lowReset,label);
+  }
+
+  for(auto &tp : testPixels)
+    tp.pixel->setDoneCallback(NULL);
+}
+
+//////////////////////////////////////
+// Reference frame for Dot (APA102/SK9822)
+
+static std::vector<uint8_t> referenceDot(const Dot::Color *c, size_t nPixels, boolean multiColor){
+
+  std::vector<uint8_t> frame(4,0x00);                             // start frame
+
+  for(size_t n=0;n<nPixels;n++){
+    const Dot::Color &color=c[multiColor?n:0];
+    frame.push_back(0xE0|color.drive);                            // flags must always be 111
+    frame.push_back(color.blue);
+    frame.push_back(color.green);
+    frame.push_back(color.red);
+  }
+
+  for(size_t n=0;n<(nPixels+63)/64;n++)                           // one 32-bit end frame (a blank pixel) for every 64 pixels
+    frame.insert(frame.end(),{0xE0,0x00,0x00,0x00});
+
+  return(frame);
+}
+
+//////////////////////////////////////
+
+static std::vector<Dot::Color> randomDotColors(size_t n){
+
+  std::vector<Dot::Color> colors(n);
+  for(auto &c : colors)
+    c.RGB(rng(),rng(),rng(),rng()%32);
+  return(colors);
+}
+
+//////////////////////////////////////
+
+static void testDotFrame(){
+
+  uint8_t guard=0xA5;
+  CHECK(Dot::buildFrame(&guard,NULL,0,true)==0 && guard==0xA5,"Dot::buildFrame() wrote an empty frame");
+
+  for(size_t nPixels : {1, 2, 63, 64, 65, 128, 129, 1000}){
+    std::vector<Dot::Color> colors=randomDotColors(nPixels);
+
+    for(boolean multi : {true, false}){
+      std::vector<uint8_t> ref=referenceDot(colors.data(),nPixels,multi);
+      std::vector<uint8_t> buf(ref.size()+8,0xA5);
+      size_t n=Dot::buildFrame(buf.data(),colors.data(),nPixels,multi);
+
+      CHECK(Dot::frameSize(nPixels)==ref.size(),"Dot::frameSize(%zu)=%zu, expected %zu",nPixels,Dot::frameSize(nPixels),ref.size());
+      CHECK(n==ref.size(),"Dot::buildFrame() of %zu pixels returned %zu bytes, expected %zu",nPixels,n,ref.size());
+      CHECK(std::equal(ref.begin(),ref.end(),buf.begin()),"Dot::buildFrame() of %zu %s pixels does not match reference frame",nPixels,multi?"multi-color":"single-color");
+      CHECK(buf[ref.size()]==0xA5,"Dot::buildFrame() of %zu pixels wrote past end of frame",nPixels);
+    }
+  }
+}
+
+//////////////////////////////////////
+
+static void testDotSPI(){
+
+  Host::spiReset();
+
+  Dot dot(5,18,SPI2_HOST);                                        // Dot initializes host with its own transfer limit
+  auto &frames=Host::spiFrames(SPI2_HOST);
+
+  std::vector<Dot::Color> colors=randomDotColors(300);
+  CHECK(dot.send(colors.data(),300),"Dot send() was refused");
+  CHECK(dot.send(colors[7],20),"Dot send() was refused");
+  dot.wait();
+  CHECK(!dot.isBusy(),"Dot still busy after wait()");
+  dot.set(colors.data()+1,65);
+
+  CHECK(frames.size()==3,"Dot transmitted %zu SPI frames, expected 3",frames.size());
+  if(frames.size()==3){
+    CHECK(frames[0]==referenceDot(colors.data(),300,true),"Dot send() of 300 multi-color pixels does not match reference frame");
+    CHECK(frames[1]==referenceDot(&colors[7],20,false),"Dot send() of 20 single-color pixels does not match reference frame");
+    CHECK(frames[2]==referenceDot(colors.data()+1,65,true),"Dot set() of 65 multi-color pixels does not match reference frame");
+  }
+
+  size_t maxPixels=1;                                             // largest strand whose frame fits in DOT_SPI_MAX_BYTES
+  while(Dot::frameSize(maxPixels+1)<=DOT_SPI_MAX_BYTES)
+    maxPixels++;
+
+  colors=randomDotColors(maxPixels+1);
+  CHECK(!dot.send(colors.data(),maxPixels+1),"Dot send() of %zu-byte frame accepted by host limited to %d bytes",Dot::frameSize(maxPixels+1),DOT_SPI_MAX_BYTES);
+  CHECK(frames.size()==3,"oversized Dot frame was transmitted");
+  CHECK(Host::spiOversized(SPI2_HOST)==0,"oversized Dot frame was queued on SPI host");
+
+  CHECK(dot.send(colors.data(),maxPixels),"Dot send() of largest frame was refused after oversized frame");      // refusal must not leave a buffer marked in use
+  CHECK(dot.send(colors.data()+1,maxPixels),"Dot send() was refused after oversized frame");
+  dot.wait();
+  CHECK(frames.size()==5,"Dot transmitted %zu SPI frames, expected 5",frames.size());
+  if(frames.size()==5){
+    CHECK(frames[3]==referenceDot(colors.data(),maxPixels,true),"Dot send() of %zu pixels does not match reference frame",maxPixels);
+    CHECK(frames[4]==referenceDot(colors.data()+1,maxPixels,true),"Dot send() of %zu pixels does not match reference frame",maxPixels);
+  }
+}
+
+//////////////////////////////////////
+
+static void testDotSharedSPI(){
+
+  Host::spiReset();
+
+  WS2801_LED ws(23,19,SPI2_HOST);                                 // WS2801 initializes host with the default (single DMA descriptor) transfer limit
+  Dot dot(23,19,SPI2_HOST);                                       // same pins - shares host and must respect its smaller transfer limit
+  auto &frames=Host::spiFrames(SPI2_HOST);
+
+  size_t maxBytes=spi_bus_get_attr(SPI2_HOST)->max_transfer_sz;
+  CHECK(maxBytes<DOT_SPI_MAX_BYTES,"WS2801 host transfer limit of %zu bytes is not smaller than Dot's own limit",maxBytes);
+
+  size_t maxPixels=1;
+  while(Dot::frameSize(maxPixels+1)<=maxBytes)
+    maxPixels++;
+
+  std::vector<Dot::Color> colors=randomDotColors(maxPixels+1);
+  WS2801_LED::Color wsColors[3];
+  wsColors[0].RGB(1,2,3);
+  wsColors[1].RGB(4,5,6);
+  wsColors[2].RGB(7,8,9);
+
+  ws.set(wsColors,3);
+  CHECK(dot.send(colors.data(),maxPixels),"Dot send() of %zu-byte frame refused by shared host limited to %zu bytes",Dot::frameSize(maxPixels),maxBytes);
+  dot.wait();
+  CHECK(!dot.send(colors.data(),maxPixels+1),"Dot send() of %zu-byte frame accepted by shared host limited to %zu bytes",Dot::frameSize(maxPixels+1),maxBytes);
+  CHECK(Host::spiOversized(SPI2_HOST)==0,"Dot queued a frame larger than shared host's transfer limit");
+  ws.set(wsColors+1,2);
+
+  CHECK(frames.size()==3,"shared host transmitted %zu SPI frames, expected 3",frames.size());
+  if(frames.size()==3){
+    CHECK(frames[0]==std::vector<uint8_t>({1,2,3,4,5,6,7,8,9}),"WS2801 frame on shared host is incorrect");
+    CHECK(frames[1]==referenceDot(colors.data(),maxPixels,true),"Dot frame on shared host does not match reference frame");
+    CHECK(frames[2]==std::vector<uint8_t>({4,5,6,7,8,9}),"WS2801 frame on shared host is incorrect");
+  }
+
+  Dot other(25,26,SPI2_HOST);                                     // different pins - host can't be shared, so Dot falls back to bit-banged GPIO
+  CHECK(other.send(colors.data(),maxPixels+1),"bit-banged Dot send() was refused");
+  other.set(colors[0],10);
+  CHECK(!other.isBusy(),"bit-banged Dot reports busy");
+  CHECK(frames.size()==3,"Dot on pins (25,26) transmitted on SPI host initialized on pins (23,19)");
+  CHECK(spi_bus_get_attr(SPI2_HOST)->bus_cfg.mosi_io_num==23 && spi_bus_get_attr(SPI2_HOST)->bus_cfg.sclk_io_num==19,"SPI host pins changed by Dot on other pins");
+
+  Host::spiReset();
+}
+
+//////////////////////////////////////
+
+//////////////////////////////////////
+// Reference color kernels for PixelFrame (floating point, rounded to nearest)
+
+static Pixel::Color referenceHSV8(uint8_t h, uint8_t s, uint8_t v, uint8_t w, uint8_t c){
+
+  float r,g,b;
+  LedPin::HSVtoRGB((h/43+((h%43)*6)/256.0)*60.0,s/255.0,v/255.0,&r,&g,&b);      // HSV8 divides the color wheel into 6 regions of 43 hues
+  return(Pixel::Color().RGB(r*255+0.5,g*255+0.5,b*255+0.5,w,c));
+}
+
+static uint8_t mix(uint8_t a, uint8_t b, double amount){          // amount=[0,1] ranges from all of a to all of b
+  return(lround(a+(b-a)*amount));
+}
+
+static int maxDiff(const Pixel::Color *a, const Pixel::Color *b, size_t nPixels){
+
+  int diff=0;
+  for(size_t i=0;i<nPixels;i++)
+    for(int j=0;j<5;j++)
+      diff=std::max(diff,abs(a[i].col[j]-b[i].col[j]));
+  return(diff);
+}
+
+//////////////////////////////////////
+
+static void testColorKernels(){
+
+  int diff=0;                                                     // Color::HSV8() against floating-point HSV
+  for(int h=0;h<256;h++){
+    for(int s=0;s<256;s+=15){
+      for(int v=0;v<256;v+=15){
+        Pixel::Color c=Pixel::Color().HSV8(h,s,v,h^s,v^s);
+        Pixel::Color ref=referenceHSV8(h,s,v,h^s,v^s);
+        diff=std::max(diff,maxDiff(&c,&ref,1));
+        CHECK(c==Pixel::HSV8(h,s,v,h^s,v^s),"Pixel::HSV8(%d,%d,%d) does not match Color::HSV8()",h,s,v);
+      }
+    }
+  }
+  CHECK(diff<=3,"Color::HSV8() differs from floating-point HSV by up to %d",diff);
+  CHECK(Pixel::HSV8(0,255,255)==Pixel::RGB(255,0,0),"Color::HSV8() of pure red is incorrect");
+  CHECK(Pixel::HSV8(100,0,0,7,9)==Pixel::RGB(0,0,0,7,9),"Color::HSV8() with v=0 is not black");
+
+  const size_t nPixels=301;
+  PixelFrame frame(testPixels[0].pixel,nPixels);
+  CHECK(frame.size()==nPixels && frame.getColors(),"PixelFrame of %zu pixels was not created",nPixels);
+  if(!frame.getColors())
+    return;
+
+  std::vector<Pixel::Color> src=randomColors(nPixels), dst=randomColors(nPixels), ref(nPixels);
+
+  frame.fill(src[5]);                                             // fill() and fillRainbow()
+  for(size_t i=0;i<nPixels;i++)
+    ref[i]=src[5];
+  CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)==0,"fill() does not match reference");
+
+  frame.fillRainbow(200,7,180,90);
+  for(size_t i=0;i<nPixels;i++)
+    ref[i].HSV8(200+i*7,180,90);
+  CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)==0,"fillRainbow() does not match Color::HSV8()");
+
+  for(size_t nColors : {1, 2, 3, 4, 16}){                         // fillPalette() - palette index [0,255] spans all nColors, wrapping back to the first
+    std::vector<Pixel::Color> palette=randomColors(nColors);
+    for(uint8_t delta : {1, 3, 64}){
+      frame.fillPalette(palette.data(),nColors,250,delta);
+      for(size_t i=0;i<nPixels;i++){
+        uint8_t index=250+i*delta;
+        double pos=index*nColors/256.0;
+        const Pixel::Color &a=palette[(size_t)pos];
+        const Pixel::Color &b=palette[((size_t)pos+1)%nColors];
+        for(int j=0;j<5;j++)
+          ref[i].col[j]=mix(a.col[j],b.col[j],pos-(size_t)pos);
+      }
+      CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)<=1,"fillPalette() of %zu colors with delta=%d differs from reference by %d",nColors,delta,maxDiff(frame.getColors(),ref.data(),nPixels));
+    }
+    frame.fillPalette(palette.data(),nColors,0,256/nColors);      // every pixel lands exactly on a palette entry
+    for(size_t i=0;i<nPixels;i++)
+      ref[i]=palette[i%nColors];
+    CHECK(nColors==3 || maxDiff(frame.getColors(),ref.data(),nPixels)==0,"fillPalette() of %zu colors does not reproduce palette entries",nColors);
+  }
+
+  std::copy(dst.begin(),dst.end(),frame.getColors());             // add() saturates at 255
+  frame.add(src.data());
+  for(size_t i=0;i<nPixels;i++)
+    for(int j=0;j<5;j++)
+      ref[i].col[j]=std::min(255,dst[i].col[j]+src[i].col[j]);
+  CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)==0,"add() does not match saturating reference");
+
+  for(int amount : {0, 1, 64, 127, 128, 200, 254, 255}){          // blend(), crossfade(), and fade() - amount=0 and amount=255 must be exact
+
+    int tolerance=(amount==0 || amount==255)?0:1;
+
+    std::copy(dst.begin(),dst.end(),frame.getColors());
+    frame.blend(src.data(),amount);
+    for(size_t i=0;i<nPixels;i++)
+      for(int j=0;j<5;j++)
+        ref[i].col[j]=mix(dst[i].col[j],src[i].col[j],amount/255.0);
+    CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)<=tolerance,"blend() with amount=%d differs from reference by %d",amount,maxDiff(frame.getColors(),ref.data(),nPixels));
+
+    frame.fill(Pixel::RGB(1,2,3));
+    frame.crossfade(dst.data(),src.data(),amount);
+    CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)<=tolerance,"crossfade() with amount=%d differs from reference by %d",amount,maxDiff(frame.getColors(),ref.data(),nPixels));
+
+    std::copy(dst.begin(),dst.end(),frame.getColors());           // "from" may be the frame buffer itself
+    frame.crossfade(frame.getColors(),src.data(),amount);
+    CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)<=tolerance,"in-place crossfade() with amount=%d differs from reference by %d",amount,maxDiff(frame.getColors(),ref.data(),nPixels));
+
+    std::copy(dst.begin(),dst.end(),frame.getColors());
+    frame.fade(amount);
+    for(size_t i=0;i<nPixels;i++)
+      for(int j=0;j<5;j++)
+        ref[i].col[j]=mix(dst[i].col[j],0,amount/255.0);
+    CHECK(maxDiff(frame.getColors(),ref.data(),nPixels)<=tolerance,"fade() with amount=%d differs from reference by %d",amount,maxDiff(frame.getColors(),ref.data(),nPixels));
+  }
+}
+
+//////////////////////////////////////
+// Benchmark of PixelFrame color kernels (pixels per second)
+
+static void bench(int frames){
+
+  const size_t nPixels=1024;
+  PixelFrame frame(NULL,nPixels);
+  std::vector<Pixel::Color> src=randomColors(nPixels), dst=randomColors(nPixels);
+  std::vector<Pixel::Color> palette=randomColors(16);
+  Pixel::Color *c=frame.getColors();
+  uint32_t sum=0;
+
+  auto measure=[&](const char *name, std::function<void(int)> kernel){
+    std::copy(dst.begin(),dst.end(),c);
+    int64_t t0=esp_timer_get_time();
+    for(int n=0;n<frames;n++)
+      kernel(n);
+    double elapsed=(esp_timer_get_time()-t0)/1.0e6;
+    sum+=c[nPixels/2].col[0];                                     // keep results live
+    printf("%-34s %14.1f\n",name,elapsed>0?frames*nPixels/elapsed/1.0e6:0.0);
+  };
+
+  printf("\nPixelFrame color kernels, %zu-pixel frame, %d frames\n\n",nPixels,frames);
+  printf("%-34s %14s\n","Kernel","Mpixels/sec");
+
+  measure("Color::HSV() per pixel (float)",[&](int n){for(size_t i=0;i<nPixels;i++) c[i].HSV((n+i)%360,100,100);});
+  measure("fillRainbow() (Color::HSV8)",[&](int n){frame.fillRainbow(n,1);});
+  measure("fillPalette() (16 colors)",[&](int n){frame.fillPalette(palette.data(),16,n,1);});
+  measure("Color += per pixel (no saturation)",[&](int n){for(size_t i=0;i<nPixels;i++) c[i]+=src[i];});
+  measure("add()",[&](int n){frame.add(src.data());});
+  measure("blend()",[&](int n){frame.blend(src.data(),n);});
+  measure("crossfade()",[&](int n){frame.crossfade(dst.data(),src.data(),n);});
+  measure("fade()",[&](int n){frame.fade(1);});
+
+  printf("\n(checksum %u)\n",sum);
+}
+
+int main(int argc, char *argv[]){
+
+  Host::setQuiet(true);
+
+  if(argc>1 && !strcmp(argv[1],"--bench")){
+    bench(argc>2?atoi(argv[2]):10000);
+    return(0);
+  }
+
+  testPixelEncoder();
+  testPixelGroup();
+  testColorKernels();
+  testPixelAllocFailure();
+  testDotFrame();
+  testDotSPI();
+  testDotSharedSPI();
+
+  printf("%d checks, %d failures\n",nChecks,nFailures);
+  return(nFailures?1:0);
+}
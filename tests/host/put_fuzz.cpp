@@ -0,0 +1,845 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Differential fuzz test of PUT /characteristics against the parser HomeSpan used before the single-pass SpanJSON tokenizer
+//
+//   put_fuzz [iterations] [seed]      replays the corpus of Home App PUT bodies below, then runs the differential test on randomly generated and
+//                                     randomly damaged bodies (default=5000, 1)
+//
+// Each body is sent to HomeSpan by a verified HapController session, and is also run through a copy of the old parser (escapeJSON() followed
+// by the sscanf() extraction of Span::updateCharacteristics(), and the sscanf() conversions of SpanCharacteristic::loadUpdate()) applied to a
+// model of the same database.  For the corpus and for generated bodies, the two must agree on whether the body parses, on the HTTP status
+// (204 or 207), on the aid, iid, and status of each characteristic in a 207 response, and on every resulting value.  Damaged bodies (bytes
+// deleted, inserted, replaced, or truncated) must never stop HomeSpan from responding in order, and are held to the same checks whenever both
+// parsers accept them.  The counts of damaged bodies only one parser accepted are reported, since the old parser accepted much that is not JSON.
+//
+// Three intentional differences are applied to the old parser's results rather than skipped: string values have their JSON escape sequences
+// resolved (the old parser stored STRING values still escaped, and only stripped backslashes from DATA and TLV8 values), an empty numeric
+// value is rejected with InvalidValue (the old parser took sscanf()'s EOF as success and left the value unchanged), and an aid or iid that is
+// not a number is taken as 0 (the old parser left it unchanged, which only matters if an object repeats "aid" or "iid").  Damaged bodies containing
+// backslashes, control characters, non-ASCII bytes, or "pid" are only checked for liveness, since the old parser's escape handling mis-reads quotes
+// following "\\", it reserved bytes 0xF5-0xFB for its own use, and it took "pid": anywhere in the text (even after the closing brace) as a timed write.
+
+#include "HapController.h"
+
+#include <random>
+#include <cmath>
+
+CUSTOM_SERV(FuzzService, F0000000-0000-1000-8000-0026BB765291);
+CUSTOM_CHAR(FuzzUint8, F0000001-0000-1000-8000-0026BB765291, PR+PW+EV, UINT8, 0, 0, 255, true);
+CUSTOM_CHAR(FuzzUint16, F0000002-0000-1000-8000-0026BB765291, PR+PW+EV, UINT16, 0, 0, 65535, true);
+CUSTOM_CHAR(FuzzUint64, F0000003-0000-1000-8000-0026BB765291, PR+PW+EV, UINT64, 0, 0, 0xFFFFFFFFFFFFFFFF, true);
+CUSTOM_CHAR_DATA(FuzzData, F0000004-0000-1000-8000-0026BB765291, PR+PW+EV);
+CUSTOM_CHAR_TLV8(FuzzTLV, F0000005-0000-1000-8000-0026BB765291, PR+PW+EV);
+
+union MVal {                              // same layout as SpanCharacteristic::UVal, so partial writes (e.g. to UINT8) behave the same way
+  boolean BOOL;
+  uint8_t UINT8;
+  uint16_t UINT16;
+  uint32_t UINT32;
+  uint64_t UINT64;
+  int32_t INT;
+  double FLOAT;
+};
+
+struct MChar {                            // model of one Characteristic
+  const char *name;                       // name used by $name placeholders in the corpus
+  SpanCharacteristic *chr;
+  int svc;                                // index of enclosing Service
+  FORMAT format;
+  uint8_t perms;
+  MVal value, newValue;
+  std::string sValue, sNewValue;          // value and newValue of string-based formats
+};
+
+static std::vector<MChar> model;
+static int nServices=0;
+static SpanCharacteristic *sentinel;      // read-only Characteristic read with GET after every PUT
+
+struct Result {                           // outcome of one PUT body
+  boolean parsed=false;                   // false if the body failed to parse (HomeSpan sends no response)
+  int http=0;                             // 204 or 207
+  std::vector<std::array<int64_t,3>> status;      // aid, iid, and status of each characteristic (207 only)
+};
+
+//////////////////////////////////////
+
+static void fail(const char *what, const std::string &body){
+
+  fprintf(stderr,"FAILED: %s\nBody (%zu bytes): ",what,body.size());
+  for(unsigned char c : body)
+    fprintf(stderr,c>=0x20 && c<0x7F ? "%c" : "\\x%02X",c);
+  fprintf(stderr,"\n");
+  abort();
+}
+
+//////////////////////////////////////
+
+namespace Old {                           // the parser HomeSpan used before SpanJSON, reproduced from Span::updateCharacteristics() and SpanCharacteristic::loadUpdate()
+
+static constexpr char delims[]="\"{[:,]}";
+static const uint8_t DELIM=0xF5;
+static const uint8_t END_DELIM=DELIM+strlen(delims)-1;
+
+struct Buf {
+  uint32_t aid=0;
+  uint32_t iid=0;
+  boolean wr=false;
+  char *val=NULL;
+  char *ev=NULL;
+};
+
+static char *escapeJSON(char *jObj){
+ 
+  boolean quoting=false;
+  const char *p;
+  
+  for(int i=0,k=0;;i++){
+    
+    if(jObj[i]=='\0'){
+      jObj[k]='\0';
+      break;
+    }
+
+    if(!quoting){
+      if(strchr(" \t\n\r",jObj[i]))
+        continue;
+    if(jObj[i]=='"')
+      quoting=true;
+    } else {
+      if(jObj[i]=='"' && i>0 && jObj[i-1]!='\\')
+        quoting=false;
+      else if((p=strchr(delims,jObj[i])))
+        jObj[i]=DELIM+p-delims;
+    }
+          
+    jObj[k++]=jObj[i];
+  }    
+
+  return(jObj);
+}
+
+static char *unEscapeJSON(char *jObj){
+
+  for(int i=0;;i++){
+    
+    if(jObj[i]=='\0')
+      break;
+
+    if((uint8_t)jObj[i]>=DELIM && (uint8_t)jObj[i]<=END_DELIM)
+      jObj[i]=delims[(uint8_t)jObj[i]-DELIM];
+  }
+    
+  return(jObj);
+}
+
+static char *strstr_r(const char *haystack, const char *needle){
+  char *s=(char *)strstr(haystack,needle);
+  if(s)
+    s+=strlen(needle);
+  return(s);  
+}
+
+static int scan(char *s, const char *fmt, char *dest, int *end){   // the old parser called sscanf(s,fmt,s,&end) on its own input - reading from a copy gives the same result without the overlap
+  std::string copy(s);
+  return(sscanf(copy.c_str(),fmt,dest,end));
+}
+
+static boolean parse(char *buf, std::vector<Buf> &pVec, boolean &twFail){
+
+  char *jObj=escapeJSON(buf);
+  int end=0;
+
+  twFail=strstr_r(jObj,"\"pid\":");       // no timed writes are prepared by this test, so any pid fails
+
+  jObj=strstr_r(jObj,"\"characteristics\":");
+
+  if(!jObj || !scan(jObj,"[%[^]]]%n",jObj,&end) || !end)
+    return(false);
+
+  for(;;){                // loop over objects in characteristics array
+    int okay=0;
+    end=0;
+    if(!scan(jObj,"{%[^}]}%n",jObj,&end) || end==0)
+      return(false);
+
+    Buf sBuf;
+    
+    for(;;){              // loop over all name-value pairs in the object 
+      end=0;
+      char *name=jObj;
+      if(scan(name,"\"%[^\"]\"%n",name,&end)!=1  || end==0)
+        return(false);
+      char *value=name+end;
+      if(scan(value,":%[^,]%n",value,&end)!=1)
+        return(false);
+
+      if(*value=='\"'){
+        value++;
+        end--;
+        if(value[end-2]=='\"'){
+          value[end-2]='\0';
+          unEscapeJSON(value);
+        }          
+      }
+      
+      unsigned long n;
+      if(!strcmp(name,"aid")){
+        sBuf.aid=sscanf(value,"%lu",&n)==1?n:0;
+        okay|=1;
+      } else 
+      if(!strcmp(name,"iid")){
+        sBuf.iid=sscanf(value,"%lu",&n)==1?n:0;
+        okay|=2;
+      } else 
+      if(!strcmp(name,"value")){
+        sBuf.val=value;
+        okay|=4;
+      } else 
+      if(!strcmp(name,"ev")){
+        sBuf.ev=value;
+        okay|=8;
+      } else 
+      if(!strcmp(name,"r")){
+        sBuf.wr=(!strcmp(value,"1") || !strcmp(value,"true"));
+      } else {
+        return(false);
+      }
+      
+      jObj=value+end;
+      if(*jObj++=='\0')
+        break;
+    }
+
+    if(okay==7 || okay==11  || okay==15){
+      if(!sBuf.val)
+        sBuf.wr=false;
+      pVec.push_back(sBuf);
+    } else {
+      return(false);
+    }
+    
+    if(*++jObj=='\0')
+      break;
+    else if(*jObj++!=',')
+      return(false);
+  }
+
+  return(true);
+}
+
+static StatusCode loadUpdate(MChar &c, const char *val, const char *ev){
+
+  if(ev){
+    boolean evFlag;
+    
+    if(!strcmp(ev,"0") || !strcmp(ev,"false"))
+      evFlag=false;
+    else if(!strcmp(ev,"1") || !strcmp(ev,"true"))
+      evFlag=true;
+    else
+      return(StatusCode::InvalidValue);
+    
+    if(evFlag && !(c.perms&EV))
+      return(StatusCode::NotifyNotAllowed);
+  }
+
+  if(!val)
+    return(StatusCode::OK);
+  
+  if(!(c.perms&PW))
+    return(StatusCode::ReadOnly);
+
+  MVal &nv=c.newValue;
+
+  switch(c.format){                       // sscanf() returning EOF (empty val) is taken as failure here - see above
+    
+    case BOOL:
+      if(!strcmp(val,"0") || !strcmp(val,"false"))
+        nv.BOOL=false;
+      else if(!strcmp(val,"1") || !strcmp(val,"true"))
+        nv.BOOL=true;
+      else
+        return(StatusCode::InvalidValue);
+      break;
+
+    case INT: {
+      long n;
+      if(!strcmp(val,"false"))
+        nv.INT=0;
+      else if(!strcmp(val,"true"))
+        nv.INT=1;
+      else if(sscanf(val,"%ld",&n)<1)
+        return(StatusCode::InvalidValue);
+      else
+        nv.INT=n;
+    }
+    break;
+
+    case UINT8:
+      if(!strcmp(val,"false"))
+        nv.UINT8=0;
+      else if(!strcmp(val,"true"))
+        nv.UINT8=1;
+      else if(sscanf(val,"%hhu",&nv.UINT8)<1)
+        return(StatusCode::InvalidValue);
+      break;
+            
+    case UINT16:
+      if(!strcmp(val,"false"))
+        nv.UINT16=0;
+      else if(!strcmp(val,"true"))
+        nv.UINT16=1;
+      else if(sscanf(val,"%hu",&nv.UINT16)<1)
+        return(StatusCode::InvalidValue);
+      break;
+      
+    case UINT32: {
+      unsigned long n;
+      if(!strcmp(val,"false"))
+        nv.UINT32=0;
+      else if(!strcmp(val,"true"))
+        nv.UINT32=1;
+      else if(sscanf(val,"%lu",&n)<1)
+        return(StatusCode::InvalidValue);
+      else
+        nv.UINT32=n;
+    }
+    break;
+      
+    case UINT64: {
+      unsigned long long n;
+      if(!strcmp(val,"false"))
+        nv.UINT64=0;
+      else if(!strcmp(val,"true"))
+        nv.UINT64=1;
+      else if(sscanf(val,"%llu",&n)<1)
+        return(StatusCode::InvalidValue);
+      else
+        nv.UINT64=n;
+    }
+    break;
+
+    case FLOAT:
+      if(sscanf(val,"%lg",&nv.FLOAT)<1)
+        return(StatusCode::InvalidValue);
+      break;
+
+    case STRING:
+    case DATA:
+    case TLV_ENC: {
+      std::string s(strlen(val)+1,'\0');                           // escape sequences are resolved, as SpanJSON does
+      s.resize(SpanJSON::unescape(s.data(),val,strlen(val)));
+      c.sNewValue=s;
+    }
+    break;
+
+    default:
+    break;
+  }
+
+  return(StatusCode::TBD);
+}
+
+} // namespace Old
+
+//////////////////////////////////////
+
+static Result predict(const std::string &body){
+
+  Result r;
+  std::vector<char> buf(body.begin(),body.end());
+  buf.resize(body.size()+64,'\0');                                 // the old parser can read a little past the end of its text on damaged input
+
+  std::vector<Old::Buf> pVec;
+  boolean twFail;
+  if(!(r.parsed=Old::parse(buf.data(),pVec,twFail)))
+    return(r);
+
+  for(auto &m : model){                                            // newValue equals value between requests
+    m.newValue=m.value;
+    m.sNewValue=m.sValue;
+  }
+
+  std::vector<MChar *> chr(pVec.size(),NULL);
+  std::vector<StatusCode> status(pVec.size());
+
+  for(size_t i=0;i<pVec.size();i++){                               // PASS 1
+    if(twFail){
+      status[i]=StatusCode::InvalidValue;
+      continue;
+    }
+    for(auto &m : model)
+      if(m.chr->getAID()==pVec[i].aid && m.chr->getIID()==pVec[i].iid)
+        chr[i]=&m;
+    status[i]=chr[i]?Old::loadUpdate(*chr[i],pVec[i].val,pVec[i].ev):StatusCode::UnknownResource;
+  }
+
+  for(size_t i=0;i<pVec.size();i++){                               // PASS 2 (every Service's update() returns true)
+    if(status[i]!=StatusCode::TBD)
+      continue;
+    for(size_t j=i;j<pVec.size();j++){
+      if(chr[j] && chr[j]->svc==chr[i]->svc){
+        status[j]=StatusCode::OK;
+        chr[j]->value=chr[j]->newValue;
+        chr[j]->sValue=chr[j]->sNewValue;
+      }
+    }
+  }
+
+  boolean multiCast=false;
+  for(size_t i=0;i<pVec.size();i++)
+    multiCast|=(status[i]!=StatusCode::OK || pVec[i].wr);
+
+  r.http=multiCast?207:204;
+  if(multiCast)
+    for(size_t i=0;i<pVec.size();i++)
+      r.status.push_back({pVec[i].aid,pVec[i].iid,(int)status[i]});
+
+  return(r);
+}
+
+//////////////////////////////////////
+
+static HapController::Message nextResponse(HapController &ctl){
+
+  HapController::Message msg;
+  uint32_t alarm=millis()+10000;
+
+  while(!ctl.hasFailed() && ctl.connected() && millis()<alarm){
+    ctl.pump();
+    HapController::pollAccessory();
+    while(ctl.receive(msg))
+      if(!msg.event)
+        return(msg);
+  }
+
+  msg.status=-1;
+  return(msg);
+}
+
+//////////////////////////////////////
+
+static Result send(HapController &ctl, const std::string &body){
+
+  char url[48];
+  snprintf(url,sizeof(url),"/characteristics?id=%u.%u",(unsigned)sentinel->getAID(),(unsigned)sentinel->getIID());
+
+  ctl.send("PUT","/characteristics","application/hap+json",body);   // a body that fails to parse gets no response, so a GET follows every PUT
+  ctl.send("GET",url);
+
+  Result r;
+  HapController::Message msg=nextResponse(ctl);
+
+  if(msg.status!=200){
+    r.parsed=true;
+    r.http=msg.status;
+    if(r.http!=204 && r.http!=207)
+      fail((std::string("unexpected response to PUT: ")+std::to_string(msg.status)+" "+ctl.error()).c_str(),body);
+    for(size_t p=0;(p=msg.body.find("{\"aid\":",p))!=std::string::npos;p++){
+      long long aid, iid, status;
+      if(sscanf(msg.body.c_str()+p,"{\"aid\":%lld,\"iid\":%lld,\"status\":%lld",&aid,&iid,&status)!=3)
+        fail(("malformed 207 response: "+msg.body).c_str(),body);
+      r.status.push_back({aid,iid,status});
+    }
+    msg=nextResponse(ctl);
+  }
+
+  if(msg.status!=200)
+    fail((std::string("no response to GET following PUT: ")+std::to_string(msg.status)+" "+ctl.error()).c_str(),body);
+
+  ctl.events.clear();
+  return(r);
+}
+
+//////////////////////////////////////
+
+static void syncModel(){                                                // sets model values from HomeSpan
+
+  for(auto &m : model){
+    switch(m.format){
+      case BOOL: m.value.BOOL=m.chr->getVal<boolean>(); break;
+      case UINT8: m.value.UINT8=m.chr->getVal<uint8_t>(); break;
+      case UINT16: m.value.UINT16=m.chr->getVal<uint16_t>(); break;
+      case UINT32: m.value.UINT32=m.chr->getVal<uint32_t>(); break;
+      case UINT64: m.value.UINT64=m.chr->getVal<uint64_t>(); break;
+      case INT: m.value.INT=m.chr->getVal<int32_t>(); break;
+      case FLOAT: m.value.FLOAT=m.chr->getVal<double>(); break;
+      default: m.sValue=m.chr->getString()?m.chr->getString():""; break;
+    }
+  }
+}
+
+//////////////////////////////////////
+
+static void checkValues(const std::string &body){
+
+  char msg[160];
+
+  for(auto &m : model){
+    boolean same;
+    switch(m.format){
+      case BOOL: same=(m.value.BOOL==m.chr->getVal<boolean>()); break;
+      case UINT8: same=(m.value.UINT8==m.chr->getVal<uint8_t>()); break;
+      case UINT16: same=(m.value.UINT16==m.chr->getVal<uint16_t>()); break;
+      case UINT32: same=(m.value.UINT32==m.chr->getVal<uint32_t>()); break;
+      case UINT64: same=(m.value.UINT64==m.chr->getVal<uint64_t>()); break;
+      case INT: same=(m.value.INT==m.chr->getVal<int32_t>()); break;
+      case FLOAT: same=(m.value.FLOAT==m.chr->getVal<double>() || (std::isnan(m.value.FLOAT) && std::isnan(m.chr->getVal<double>()))); break;
+      default: same=(m.sValue==(m.chr->getString()?m.chr->getString():"")); break;
+    }
+    if(!same){
+      snprintf(msg,sizeof(msg),"value of %s (aid=%u iid=%u) does not match the old parser",m.name,(unsigned)m.chr->getAID(),(unsigned)m.chr->getIID());
+      fail(msg,body);
+    }
+  }
+}
+
+//////////////////////////////////////
+
+static void compare(const Result &expected, const Result &actual, const std::string &body){
+
+  char msg[160];
+
+  if(expected.parsed!=actual.parsed){
+    snprintf(msg,sizeof(msg),"body %s by HomeSpan, but %s by the old parser",actual.parsed?"accepted":"rejected",expected.parsed?"accepted":"rejected");
+    fail(msg,body);
+  }
+
+  if(expected.http!=actual.http){
+    snprintf(msg,sizeof(msg),"HTTP status %d, expected %d",actual.http,expected.http);
+    fail(msg,body);
+  }
+
+  if(expected.status!=actual.status){
+    std::string s="207 statuses (aid,iid,status):";
+    for(auto &v : actual.status)
+      s+=" ("+std::to_string(v[0])+","+std::to_string(v[1])+","+std::to_string(v[2])+")";
+    s+=", expected:";
+    for(auto &v : expected.status)
+      s+=" ("+std::to_string(v[0])+","+std::to_string(v[1])+","+std::to_string(v[2])+")";
+    fail(s.c_str(),body);
+  }
+
+  checkValues(body);
+}
+
+//////////////////////////////////////
+
+static std::string expand(const char *text){                       // replaces each $name with "aid":A,"iid":I of the named Characteristic
+
+  std::string s;
+
+  while(*text){
+    if(*text!='$'){
+      s+=*text++;
+      continue;
+    }
+    const char *p=++text;
+    while(isalnum(*text))
+      text++;
+    std::string name(p,text-p);
+    auto it=std::find_if(model.begin(),model.end(),[&name](const MChar &m){return(name==m.name);});
+    if(it==model.end()){
+      fprintf(stderr,"Unknown characteristic '%s' in corpus\n",name.c_str());
+      exit(1);
+    }
+    s+="\"aid\":"+std::to_string(it->chr->getAID())+",\"iid\":"+std::to_string(it->chr->getIID());
+  }
+
+  return(s);
+}
+
+//////////////////////////////////////
+
+static const char *corpus[]={                                      // PUT bodies as sent by the Home App, plus requests HomeSpan must reject or report errors for
+  "{\"characteristics\":[{$on,\"value\":1}]}",
+  "{\"characteristics\":[{$on,\"value\":0}]}",
+  "{\"characteristics\":[{$on,\"value\":true}]}",
+  "{\"characteristics\":[{$on,\"value\":false}]}",
+  "{\"characteristics\":[{$level,\"value\":75}]}",
+  "{\"characteristics\":[{$on,\"value\":1},{$level,\"value\":30}]}",
+  "{\"characteristics\":[{$hue,\"value\":212.00001525878906},{$sat,\"value\":37}]}",
+  "{\"characteristics\":[{$hue,\"value\":0},{$sat,\"value\":100},{$level,\"value\":100}]}",
+  "{\"characteristics\":[{$temp,\"value\":153}]}",
+  "{\"characteristics\":[{$on,\"ev\":true},{$level,\"ev\":true},{$hue,\"ev\":true},{$sat,\"ev\":true},{$temp,\"ev\":true}]}",
+  "{\"characteristics\":[{$on,\"ev\":false},{$level,\"ev\":false}]}",
+  "{\"characteristics\":[{$on2,\"ev\":true},{$level2,\"ev\":true}]}",
+  "{\"characteristics\":[{$identify,\"value\":true}]}",
+  "{\"characteristics\":[{$cname,\"value\":\"Kitchen Light\"}]}",
+  "{\"characteristics\":[{$cname,\"value\":\"K\xC3\xBC" "che\"}]}",
+  "{\"characteristics\":[{$cname,\"value\":\"Caf\\u00e9 \\ud83d\\ude00\"}]}",
+  "{\"characteristics\":[{$cname,\"value\":\"Lamp \\\"A\\\"\\/B, {1} [2]: 3\"}]}",
+  "{\"characteristics\":[{$u8,\"value\":2},{$u16,\"value\":1024},{$u64,\"value\":18446744073709551615}]}",
+  "{\"characteristics\":[{$data,\"value\":\"AQIDBA==\",\"r\":true}]}",
+  "{\"characteristics\":[{$tlv,\"value\":\"AQEA\\/w==\",\"r\":true}]}",
+  "{\"characteristics\":[{$level2,\"value\":10,\"r\":true}]}",
+  "{\"characteristics\":[{$on2,\"value\":1}],\"pid\":4614012946733473085}",
+  "{\"pid\":4614012946733473085,\"characteristics\":[{$on2,\"value\":0}]}",
+  "{\"characteristics\":[{\"aid\":1,\"iid\":999,\"value\":1}]}",
+  "{\"characteristics\":[{\"aid\":99,\"iid\":9,\"ev\":true}]}",
+  "{\"characteristics\":[{$on,\"value\":1},{\"aid\":99,\"iid\":9,\"value\":1}]}",
+  "{\"characteristics\":[{$name,\"value\":\"Renamed\"}]}",
+  "{\"characteristics\":[{$name,\"ev\":true}]}",
+  "{\"characteristics\":[{$identify,\"ev\":true}]}",
+  "{\"characteristics\":[{$level,\"value\":\"abc\"}]}",
+  "{\"characteristics\":[{$level,\"value\":null}]}",
+  "{\"characteristics\":[{$level,\"value\":\"\"}]}",
+  "{\"characteristics\":[{$level,\"value\":\"40\"}]}",
+  "{\"characteristics\":[{$level,\"value\":55},{$level,\"value\":\"bad\"}]}",
+  "{\"characteristics\":[{$hue,\"value\":\"x\"},{$sat,\"value\":12.5}]}",
+  "{\"characteristics\":[{$on,\"value\":2}]}",
+  "{\"characteristics\":[{$on,\"ev\":2}]}",
+  "{\"characteristics\":[{$u8,\"value\":300},{$u16,\"value\":-1}]}",
+  "{ \"characteristics\" : [ { $level , \"value\" : 64 } , { $on , \"value\" : 1 } ] }",
+  "{\"characteristics\":[{$on,\"value\":1}],\"other\":{\"a\":[1,2,{\"b\":\"]\"}]}}",
+  "{\"characteristics\":[]}",
+  "{\"characteristics\":[{}]}",
+  "{\"characteristics\":[{$on}]}",
+  "{\"characteristics\":[{\"aid\":1,\"value\":1}]}",
+  "{\"characteristics\":[{$on,\"value\":1,\"extra\":1}]}",
+  "{\"characteristics\":[{$on,\"value\":1}",
+  "{\"characteristics\":[{$on,\"value\":1},]}",
+  "{\"characteristics\":[{$on,\"value\":}]}",
+  "{\"characteristics\":{$on,\"value\":1}}",
+  "{\"chars\":[{$on,\"value\":1}]}",
+  "x",
+  NULL
+};
+
+//////////////////////////////////////
+
+static std::string token(std::mt19937 &rng, FORMAT format){       // a value token suited (mostly) to format
+
+  static const char *ints[]={"0","1","42","-7","255","256","300","65535","65536","4294967295","4294967296","18446744073709551615","007","+5",
+                             "12abc","1.9","-0","true","false","null","abc","\"17\"","\"\""," \" 9\"","1e3"};
+  static const char *floats[]={"0","21.5","-3.25","212.00001525878906","1e3","-0.5","nan","inf","\"37.5\"","true","false","1","0","abc",
+                               "null",".5","5.","\"\"","-1e-3"};
+  static const char *bools[]={"0","1","true","false","\"true\"","\"1\"","2","null","-1","yes"};
+  static const char *strings[]={"\"Kitchen Light\"","\"K\xC3\xBC" "che\"","\"a,b}c]d:e{f[g\"","\"Say \\\"hi\\\"\"","\"A\\/B\"","\"Caf\\u00e9\"",
+                                "\"tab\\there\"","\"\\ud83d\\ude00\"","\"\"","\"12\"","42","true","null","\"AQIDBA==\"","\"AQEA\"","\"x\\\\y\""};
+
+  if(rng()%5==0)                                                   // sometimes a token meant for another format
+    format=(FORMAT)(rng()%10);
+
+  switch(format){
+    case BOOL: return(bools[rng()%std::size(bools)]);
+    case FLOAT: return(floats[rng()%std::size(floats)]);
+    case STRING: case DATA: case TLV_ENC: break;
+    default: return(ints[rng()%std::size(ints)]);
+  }
+
+  if(rng()%3)
+    return(strings[rng()%std::size(strings)]);
+
+  std::string s="\"";                                              // random printable string, with no escapes
+  for(int n=rng()%24;n>0;n--){
+    char c=' '+rng()%95;
+    if(c!='"' && c!='\\')
+      s+=c;
+  }
+  return(s+"\"");
+}
+
+//////////////////////////////////////
+
+static std::string generate(std::mt19937 &rng){
+
+  static const char *evs[]={"true","false","1","0","\"true\"","2","null"};
+
+  boolean ws=rng()%5==0;                                           // sometimes add whitespace between tokens
+  const char *colon=ws?": ":":";
+  const char *comma=ws?", ":",";
+
+  auto prop=[&](const char *name, const std::string &val){return("\""+std::string(name)+"\""+colon+val);};
+
+  std::string objs;
+  for(int n=1+rng()%4;n>0;n--){
+    std::vector<std::string> props;
+    MChar &m=model[rng()%model.size()];
+
+    props.push_back(prop("aid",std::to_string(rng()%10?m.chr->getAID():rng()%4)));
+    props.push_back(prop("iid",std::to_string(rng()%10?m.chr->getIID():rng()%40)));
+
+    int what=rng()%10;
+    if(what<7)
+      props.push_back(prop("value",token(rng,m.format)));
+    if(what>=5)
+      props.push_back(prop("ev",evs[rng()%std::size(evs)]));
+    if(rng()%6==0)
+      props.push_back(prop("r",rng()%2?"true":"false"));
+
+    switch(rng()%40){                                              // occasional malformed objects
+      case 0: props.erase(props.begin()+rng()%2); break;            // missing aid or iid
+      case 1: props.push_back(prop("extra","1")); break;            // unexpected property
+      case 2: props.push_back(prop("value",token(rng,m.format))); break;   // duplicate value (the last one is used)
+    }
+
+    std::shuffle(props.begin(),props.end(),rng);
+
+    std::string obj="{";
+    for(size_t i=0;i<props.size();i++)
+      obj+=(i?comma:"")+props[i];
+    objs+=(objs.empty()?"":comma)+obj+"}";
+  }
+
+  std::string chars=prop("characteristics","["+objs+"]");
+
+  switch(rng()%12){
+    case 0: return("{"+chars+comma+prop("pid",std::to_string(rng()))+"}");
+    case 1: return("{"+prop("pid",std::to_string(rng()))+comma+chars+"}");
+    case 2: return("{"+prop("meta","{\"a\":[1,\"]}\",{}]}")+comma+chars+"}");
+    default: return("{"+chars+"}");
+  }
+}
+
+//////////////////////////////////////
+
+static std::string damage(std::string s, std::mt19937 &rng){
+
+  static const char bytes[]="{}[]:,\"\\ 0123456789aeflnrstu-.";
+
+  for(int n=1+rng()%3;n>0;n--){
+    size_t pos=s.empty()?0:rng()%s.size();
+    char c=rng()%8?bytes[rng()%(sizeof(bytes)-1)]:(char)(1+rng()%255);
+    switch(rng()%5){
+      case 0: if(!s.empty()) s.erase(pos,1); break;
+      case 1: s.insert(s.begin()+pos,c); break;
+      case 2: if(!s.empty()) s[pos]=c; break;
+      case 3: s.resize(pos); break;
+      case 4: if(!s.empty()) s.insert(pos,s.substr(pos,1+rng()%std::min<size_t>(16,s.size()-pos))); break;
+    }
+  }
+
+  return(s.empty()?"{":s);                                         // HAPClient closes the connection on a PUT with no content
+}
+
+//////////////////////////////////////
+
+int main(int argc, char *argv[]){
+
+  int iterations=argc>1?atoi(argv[1]):5000;
+  uint32_t seed=argc>2?atoi(argv[2]):1;
+  std::mt19937 rng(seed);
+
+  Host::setQuiet(true);
+  Host::setSkipDelays(true);
+  init();
+
+  homeSpan.setLogLevel(-1);
+  homeSpan.begin(Category::Bridges,"HomeSpan Fuzz");
+
+  auto add=[](const char *name, SpanCharacteristic *chr, FORMAT format, uint8_t perms){
+    model.push_back({name,chr,nServices,format,perms});
+    return(chr);
+  };
+
+  new SpanAccessory();
+    new Service::AccessoryInformation(); nServices++;
+      add("identify",new Characteristic::Identify(),BOOL,PW);
+      sentinel=add("name",new Characteristic::Name("Fuzz Bridge"),STRING,PR);
+    new Service::LightBulb(); nServices++;
+      add("on",new Characteristic::On(),BOOL,PR+PW+EV);
+      add("level",new Characteristic::Brightness(50),INT,PR+PW+EV);
+      add("hue",new Characteristic::Hue(120),FLOAT,PR+PW+EV);
+      add("sat",new Characteristic::Saturation(50),FLOAT,PR+PW+EV);
+      add("temp",new Characteristic::ColorTemperature(200),UINT32,PR+PW+EV);
+      add("cname",new Characteristic::ConfiguredName("Light"),STRING,PR+PW+EV);
+    new Service::FuzzService(); nServices++;
+      add("u8",new Characteristic::FuzzUint8(),UINT8,PR+PW+EV);
+      add("u16",new Characteristic::FuzzUint16(),UINT16,PR+PW+EV);
+      add("u64",new Characteristic::FuzzUint64(),UINT64,PR+PW+EV);
+      add("data",new Characteristic::FuzzData(),DATA,PR+PW+EV);
+      add("tlv",new Characteristic::FuzzTLV(),TLV_ENC,PR+PW+EV);
+
+  new SpanAccessory();
+    new Service::AccessoryInformation(); nServices++;
+      add("identify2",new Characteristic::Identify(),BOOL,PW);
+    new Service::LightBulb(); nServices++;
+      add("on2",new Characteristic::On(),BOOL,PR+PW+EV);
+      add("level2",new Characteristic::Brightness(50),INT,PR+PW+EV);
+
+  HapController::pollAccessory();                                  // initialize HomeSpan
+
+  {
+    HapController setup;
+    if(!setup.pairSetup()){
+      fprintf(stderr,"FAILED: pair-setup: %s\n",setup.error());
+      return(1);
+    }
+  }
+
+  HapController ctl;
+  if(!ctl.pairVerify()){
+    fprintf(stderr,"FAILED: pair-verify: %s\n",ctl.error());
+    return(1);
+  }
+
+  syncModel();
+
+  int nCorpus=0;
+  for(const char **c=corpus;*c;c++,nCorpus++){
+    std::string body=expand(*c);
+    Result expected=predict(body);
+    compare(expected,send(ctl,body),body);
+  }
+
+  int nGenerated=0, nDamaged=0, nBoth=0, nOldOnly=0, nNewOnly=0;
+  size_t totalBytes=0;
+
+  for(int i=0;i<iterations;i++){
+    boolean damaged=rng()%2;
+    std::string body=generate(rng);
+    if(damaged)
+      body=damage(body,rng);
+    totalBytes+=body.size();
+
+    Result expected=predict(body);
+    Result actual=send(ctl,body);
+
+    if(!damaged){
+      nGenerated++;
+      compare(expected,actual,body);
+      continue;
+    }
+
+    nDamaged++;
+    nBoth+=(expected.parsed && actual.parsed);
+    nOldOnly+=(expected.parsed && !actual.parsed);
+    nNewOnly+=(!expected.parsed && actual.parsed);
+
+    if(expected.parsed && actual.parsed && body.find("\"pid\"")==std::string::npos && std::none_of(body.begin(),body.end(),[](char c){return(c=='\\' || c<0x20);}))
+      compare(expected,actual,body);
+    else
+      syncModel();                                                      // HomeSpan is the reference for the next body
+  }
+
+  printf("%d corpus and %d generated bodies parsed identically to the old parser, and %d damaged bodies (%zu bytes in all) left HomeSpan responding\n",
+         nCorpus,nGenerated,nDamaged,totalBytes);
+  printf("Damaged bodies accepted by both parsers: %d, only by the old parser: %d, only by HomeSpan: %d\n",nBoth,nOldOnly,nNewOnly);
+  return(0);
+}
@@ -0,0 +1,466 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Host simulator of multiple HomeKit controllers driving a Bridge of dimmable LightBulbs
+//
+//   homespan_sim [--sessions N] [--requests N] [--lights N] [--pipeline N] [--frag BYTES] [--setval PCT] [--seed N]
+//                [--mix get=W,put=W,ev=W,timed=W,acc=W]
+//
+// Each session pair-verifies with HomeSpan and then issues a random mix of GET /characteristics, PUT /characteristics, ev=1/ev=0
+// subscription changes, timed writes (PUT /prepare followed by PUT /characteristics with the same pid), and GET /accessories, keeping
+// up to --pipeline requests outstanding.  If --frag is non-zero, each session writes its (encrypted) requests in random pieces of
+// 1..BYTES bytes spread across successive polls, which exercises HAPClient's incremental frame reassembly.  Between polls, the "sketch"
+// changes the Brightness of a random Light with setVal() (with probability --setval percent).
+//
+// Reports p50/p99/max latency for each request type, overall throughput, and per-session EVENT lag (from setVal() to the EVENT being
+// received).  Exits with an error on any failed handshake, decrypt or framing error, unexpected status, lost EVENT, or if the values
+// read back at the end do not match the sketch.
+
+#include "HapController.h"
+
+#include <random>
+
+struct SimLight : Service::LightBulb {
+
+  SpanCharacteristic *power;
+  SpanCharacteristic *level;
+
+  SimLight() : Service::LightBulb(){
+    power=new Characteristic::On();
+    level=new Characteristic::Brightness(50);
+  }
+};
+
+enum OpType {OP_GET, OP_PUT, OP_EV, OP_TIMED, OP_ACC, OP_TIMED_PUT, N_OPS};
+static const char *opNames[N_OPS]={"GET /characteristics","PUT /characteristics","PUT ev","PUT /prepare","GET /accessories","PUT timed-write"};
+
+struct Request {
+  OpType op;
+  int64_t sent;
+  int light;                              // Light affected (PUT, EV, TIMED)
+  int val;                                // value written (PUT, TIMED), or subscription requested (EV)
+  uint64_t pid;                           // pid (TIMED)
+};
+
+enum SubState {UNSUBSCRIBED, SUBSCRIBED, CHANGING};
+
+struct Session {
+  HapController *ctl;
+  std::deque<Request> inflight;           // requests sent and awaiting a response (HomeSpan responds in order)
+  int remaining;                          // number of requests still to be issued
+  std::vector<SubState> sub;              // subscription state for each Light's Brightness
+  std::map<int,int64_t> pendingEv;        // Light -> time of earliest Brightness change not yet delivered to this session
+  std::vector<int64_t> lags;              // EVENT lag (usec) of each Brightness change delivered
+  uint32_t nEvents=0;                     // number of EVENT messages received
+};
+
+static std::vector<SimLight *> lights;
+static std::map<uint32_t,int> aidIndex;   // aid -> Light index
+static std::vector<int64_t> latency[N_OPS];
+static std::mt19937 rng;
+
+static int rnd(int n){return(std::uniform_int_distribution<int>(0,n-1)(rng));}
+
+//////////////////////////////////////
+
+static void fatal(const char *fmt, ...){
+
+  va_list ap;
+  va_start(ap,fmt);
+  fprintf(stderr,"FAILED: ");
+  vfprintf(stderr,fmt,ap);
+  fprintf(stderr,"\n");
+  va_end(ap);
+  exit(1);
+}
+
+//////////////////////////////////////
+
+static int64_t percentile(std::vector<int64_t> &v, double p){
+
+  if(v.empty())
+    return(0);
+  std::sort(v.begin(),v.end());
+  return(v[std::min(v.size()-1,(size_t)(p*v.size()))]);
+}
+
+//////////////////////////////////////
+
+static void issue(Session &s, OpType op){
+
+  Request r={op,esp_timer_get_time(),rnd(lights.size()),0,0};
+  SimLight *light=lights[r.light];
+  char buf[160];
+
+  switch(op){
+
+    case OP_GET: {
+      std::string url="/characteristics?id=";
+      int n=1+rnd(std::min<int>(lights.size(),8));
+      for(int i=0;i<n;i++){
+        SimLight *l=lights[rnd(lights.size())];
+        snprintf(buf,sizeof(buf),"%s%u.%u,%u.%u",i?",":"",l->getAID(),l->power->getIID(),l->getAID(),l->level->getIID());
+        url+=buf;
+      }
+      s.ctl->send("GET",url.c_str());
+      break;
+    }
+
+    case OP_PUT:
+      r.val=rnd(2);
+      snprintf(buf,sizeof(buf),"{\"characteristics\":[{\"aid\":%u,\"iid\":%u,\"value\":%d}]}",light->getAID(),light->power->getIID(),r.val);
+      s.ctl->send("PUT","/characteristics","application/hap+json",buf);
+      break;
+
+    case OP_EV:
+      if(s.sub[r.light]==CHANGING)        // one subscription change at a time per Light - read its values instead
+        return(issue(s,OP_GET));
+      r.val=(s.sub[r.light]==UNSUBSCRIBED);
+      s.sub[r.light]=CHANGING;
+      s.pendingEv.erase(r.light);
+      snprintf(buf,sizeof(buf),"{\"characteristics\":[{\"aid\":%u,\"iid\":%u,\"ev\":%s}]}",light->getAID(),light->level->getIID(),r.val?"true":"false");
+      s.ctl->send("PUT","/characteristics","application/hap+json",buf);
+      break;
+
+    case OP_TIMED:
+      r.pid=((uint64_t)rng()<<20)|(rnd(1<<20)+1);
+      snprintf(buf,sizeof(buf),"{\"ttl\":5000,\"pid\":%llu}",(unsigned long long)r.pid);
+      s.ctl->send("PUT","/prepare","application/hap+json",buf);
+      break;
+
+    case OP_TIMED_PUT:
+      break;
+
+    case OP_ACC:
+      s.ctl->send("GET","/accessories");
+      break;
+
+    default:
+      break;
+  }
+
+  s.inflight.push_back(r);
+}
+
+//////////////////////////////////////
+
+static void handleResponse(Session &s, int n, HapController::Message &msg){
+
+  if(s.inflight.empty())
+    fatal("session %d: response with no request outstanding",n);
+
+  Request r=s.inflight.front();
+  s.inflight.pop_front();
+  latency[r.op].push_back(msg.time-r.sent);
+
+  switch(r.op){
+
+    case OP_GET:
+      if(msg.status!=200 || msg.body.find("\"characteristics\":[")==std::string::npos)
+        fatal("session %d: %s returned %d",n,opNames[r.op],msg.status);
+      break;
+
+    case OP_ACC:
+      if(msg.status!=200 || std::count(msg.body.begin(),msg.body.end(),'{')<(int)lights.size())
+        fatal("session %d: %s returned %d",n,opNames[r.op],msg.status);
+      break;
+
+    case OP_PUT:
+    case OP_TIMED_PUT:
+      if(msg.status!=204)
+        fatal("session %d: %s returned %d: %s",n,opNames[r.op],msg.status,msg.body.c_str());
+      break;
+
+    case OP_EV:
+      if(msg.status!=204)
+        fatal("session %d: %s returned %d: %s",n,opNames[r.op],msg.status,msg.body.c_str());
+      s.sub[r.light]=r.val?SUBSCRIBED:UNSUBSCRIBED;
+      break;
+
+    case OP_TIMED: {
+      if(msg.status!=200 || msg.body!="{\"status\":0}")
+        fatal("session %d: %s returned %d: %s",n,opNames[r.op],msg.status,msg.body.c_str());
+
+      SimLight *light=lights[r.light];
+      char buf[160];
+      snprintf(buf,sizeof(buf),"{\"characteristics\":[{\"aid\":%u,\"iid\":%u,\"value\":%d}],\"pid\":%llu}",light->getAID(),light->power->getIID(),rnd(2),(unsigned long long)r.pid);
+      s.ctl->send("PUT","/characteristics","application/hap+json",buf);
+      s.inflight.push_back({OP_TIMED_PUT,esp_timer_get_time(),r.light,0,0});
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+//////////////////////////////////////
+
+static boolean parseValues(const std::string &body, std::map<std::pair<uint32_t,uint32_t>,std::string> &values){
+
+  values.clear();
+
+  for(size_t p=0;(p=body.find('{',p+1))!=std::string::npos;){     // each entry has the form {"iid":I,"value":V,"aid":A} in some order
+    size_t end=body.find('}',p);
+    if(end==std::string::npos)
+      return(false);
+
+    std::string item=body.substr(p,end-p);
+    size_t a=item.find("\"aid\":"), i=item.find("\"iid\":"), v=item.find("\"value\":");
+    if(a==std::string::npos || i==std::string::npos)
+      return(false);
+
+    std::string val;
+    if(v!=std::string::npos)
+      val=item.substr(v+8,item.find_first_of(",}",v+8)-(v+8));
+    values[{strtoul(item.c_str()+a+6,NULL,10),strtoul(item.c_str()+i+6,NULL,10)}]=val;
+  }
+
+  return(true);
+}
+
+//////////////////////////////////////
+
+static void handleEvent(Session &s, int n, HapController::Message &msg){
+
+  std::map<std::pair<uint32_t,uint32_t>,std::string> values;
+
+  s.nEvents++;
+
+  if(msg.status!=200 || !parseValues(msg.body,values))
+    fatal("session %d: malformed EVENT (status %d): %s",n,msg.status,msg.body.c_str());
+
+  for(auto const &v : values){
+    uint32_t aid=v.first.first;
+    if(!aidIndex.count(aid))
+      fatal("session %d: EVENT for unknown aid %u",n,aid);
+
+    int l=aidIndex[aid];
+    if(v.first.second!=lights[l]->level->getIID())                 // only Brightness subscriptions are tracked
+      continue;
+
+    if(s.sub[l]==UNSUBSCRIBED)
+      fatal("session %d: EVENT for aid %u after unsubscribing",n,aid);
+
+    auto it=s.pendingEv.find(l);
+    if(it!=s.pendingEv.end()){
+      s.lags.push_back(msg.time-it->second);
+      s.pendingEv.erase(it);
+    }
+  }
+}
+
+//////////////////////////////////////
+
+int main(int argc, char *argv[]){
+
+  int nSessions=8, nRequests=500, nLights=20, pipeline=2, frag=0, setvalPct=20, seed=1;
+  int weights[N_OPS]={40,25,10,10,5,0};
+
+  for(int i=1;i<argc;i++){
+    const char *arg=argv[i];
+    const char *val=(i+1<argc)?argv[++i]:"";
+    if(!strcmp(arg,"--sessions")) nSessions=atoi(val);
+    else if(!strcmp(arg,"--requests")) nRequests=atoi(val);
+    else if(!strcmp(arg,"--lights")) nLights=atoi(val);
+    else if(!strcmp(arg,"--pipeline")) pipeline=atoi(val);
+    else if(!strcmp(arg,"--frag")) frag=atoi(val);
+    else if(!strcmp(arg,"--setval")) setvalPct=atoi(val);
+    else if(!strcmp(arg,"--seed")) seed=atoi(val);
+    else if(!strcmp(arg,"--mix")){
+      char name[16];
+      int w, n;
+      for(const char *p=val;sscanf(p,"%15[a-z]=%d%n",name,&w,&n)==2;p+=n+(p[n]==',')){
+        const char *names[]={"get","put","ev","timed","acc"};
+        int k=std::find_if(names,names+5,[&](const char *x){return(!strcmp(x,name));})-names;
+        if(k==5)
+          fatal("unknown --mix entry '%s'",name);
+        weights[k]=w;
+      }
+    }
+    else fatal("unknown option '%s'",arg);
+  }
+
+  nSessions=std::clamp(nSessions,1,32);                            // HomeSpan has 32 subscription slots
+  nLights=std::clamp(nLights,1,149);
+  pipeline=std::max(pipeline,1);
+  rng.seed(seed);
+
+  Host::setQuiet(true);
+  Host::setSkipDelays(true);
+  init();
+
+  homeSpan.setLogLevel(-1);
+  homeSpan.begin(Category::Bridges,"HomeSpan Sim");
+
+  new SpanAccessory();
+    new Service::AccessoryInformation();
+      new Characteristic::Identify();
+
+  for(int i=0;i<nLights;i++){
+    new SpanAccessory();
+      new Service::AccessoryInformation();
+        new Characteristic::Identify();
+      lights.push_back(new SimLight());
+    aidIndex[lights.back()->getAID()]=i;
+  }
+
+  homeSpan.poll();
+
+  {
+    HapController setup;
+    if(!setup.pairSetup())
+      fatal("pair-setup: %s",setup.error());
+  }
+
+  std::vector<Session> sessions(nSessions);
+  for(int n=0;n<nSessions;n++){
+    sessions[n].ctl=new HapController();
+    if(!sessions[n].ctl->pairVerify())
+      fatal("session %d: pair-verify: %s",n,sessions[n].ctl->error());
+    sessions[n].ctl->setFragmentation(frag,seed*97+n);
+    sessions[n].remaining=nRequests;
+    sessions[n].sub.assign(nLights,UNSUBSCRIBED);
+  }
+
+  int totalWeight=0;
+  for(int w : weights)
+    totalWeight+=w;
+  if(totalWeight<=0)
+    fatal("--mix weights must not all be zero");
+
+  int64_t t0=esp_timer_get_time();
+  int64_t deadline=t0+120*1000000LL;
+  uint64_t nSetVal=0;
+  boolean active=true;
+  HapController::Message msg;
+
+  while(active){
+
+    if(esp_timer_get_time()>deadline)
+      fatal("simulation did not complete within 120 seconds");
+
+    active=false;
+
+    for(auto &s : sessions){
+      while(s.remaining>0 && (int)s.inflight.size()<pipeline){
+        int pick=rnd(totalWeight), op=0;
+        while(pick>=weights[op])
+          pick-=weights[op++];
+        issue(s,(OpType)op);
+        s.remaining--;
+      }
+      s.ctl->pump();
+      active|=(s.remaining>0 || !s.inflight.empty());
+    }
+
+    if(rnd(100)<setvalPct){                                        // sketch changes a Brightness value between polls
+      int l=rnd(nLights);
+      SimLight *light=lights[l];
+      light->level->setVal((light->level->getVal()+1+rnd(99))%101);
+      nSetVal++;
+      int64_t now=esp_timer_get_time();
+      for(auto &s : sessions)
+        if(s.sub[l]==SUBSCRIBED && !s.pendingEv.count(l))
+          s.pendingEv[l]=now;
+    }
+
+    homeSpan.poll();
+
+    for(int n=0;n<nSessions;n++){
+      Session &s=sessions[n];
+      while(s.ctl->receive(msg)){
+        if(msg.event)
+          handleEvent(s,n,msg);
+        else
+          handleResponse(s,n,msg);
+      }
+      if(s.ctl->hasFailed())
+        fatal("session %d: %s",n,s.ctl->error());
+      if(!s.ctl->connected())
+        fatal("session %d: connection closed by accessory",n);
+    }
+  }
+
+  int64_t elapsed=esp_timer_get_time()-t0;
+
+  for(int i=0;i<10;i++){                                           // allow any final EVENTs to be delivered
+    homeSpan.poll();
+    for(int n=0;n<nSessions;n++)
+      while(sessions[n].ctl->receive(msg))
+        if(msg.event)
+          handleEvent(sessions[n],n,msg);
+  }
+
+  for(int n=0;n<nSessions;n++)
+    if(!sessions[n].pendingEv.empty())
+      fatal("session %d: %d Brightness change(s) never delivered as EVENTs",n,(int)sessions[n].pendingEv.size());
+
+  std::string url="/characteristics?id=";                          // read back all values and check they match the sketch
+  for(auto light : lights)
+    url+=std::to_string(light->getAID())+"."+std::to_string(light->power->getIID())+","+std::to_string(light->getAID())+"."+std::to_string(light->level->getIID())+",";
+  url.pop_back();
+
+  sessions[0].ctl->setFragmentation(0);
+  HapController::Message rsp=sessions[0].ctl->transact("GET",url.c_str());
+  std::map<std::pair<uint32_t,uint32_t>,std::string> values;
+  if(rsp.status!=200 || !parseValues(rsp.body,values))
+    fatal("final read-back returned %d: %s",rsp.status,rsp.body.c_str());
+
+  for(auto light : lights){
+    std::string on=values[{light->getAID(),light->power->getIID()}];
+    std::string level=values[{light->getAID(),light->level->getIID()}];
+    if(on!=std::to_string(light->power->getVal()) && on!=(light->power->getVal()?"true":"false"))
+      fatal("read-back of aid %u On=%s does not match sketch",light->getAID(),on.c_str());
+    if(level!=std::to_string(light->level->getVal()))
+      fatal("read-back of aid %u Brightness=%s does not match sketch",light->getAID(),level.c_str());
+  }
+
+  uint64_t total=0;
+  for(auto &v : latency)
+    total+=v.size();
+
+  printf("\n%d sessions, %d Lights, pipeline=%d, frag=%d, seed=%d: %llu requests and %llu setVal() updates in %.2f sec (%.0f req/sec)\n\n",
+         nSessions,nLights,pipeline,frag,seed,(unsigned long long)total,(unsigned long long)nSetVal,elapsed/1.0e6,total*1.0e6/elapsed);
+
+  printf("%-22s %8s %10s %10s %10s\n","Request","Count","p50 usec","p99 usec","max usec");
+  for(int i=0;i<N_OPS;i++)
+    if(!latency[i].empty())
+      printf("%-22s %8zu %10lld %10lld %10lld\n",opNames[i],latency[i].size(),(long long)percentile(latency[i],0.5),(long long)percentile(latency[i],0.99),(long long)percentile(latency[i],1.0));
+
+  printf("\n%-8s %8s %10s %10s %10s %10s\n","Session","EVENTs","Changes","p50 lag","p99 lag","max lag");
+  for(int n=0;n<nSessions;n++){
+    Session &s=sessions[n];
+    printf("%-8d %8u %10zu %10lld %10lld %10lld\n",n,s.nEvents,s.lags.size(),(long long)percentile(s.lags,0.5),(long long)percentile(s.lags,0.99),(long long)percentile(s.lags,1.0));
+  }
+  printf("\n");
+
+  for(auto &s : sessions)
+    delete s.ctl;
+
+  return(0);
+}
@@ -0,0 +1,358 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Host benchmark of the accessory's SRP-6A computations during pair-setup, step by step
+//
+//   srp_bench [iterations]       (default=20 pairings)
+//
+// A simulated controller runs the client side of SRP-6A against SRP6A exactly as HAPClient uses it, and the accessory's share of each
+// step is timed separately:
+//
+//   initGroup     loading N and g, and computing k and _rr (first SRP6A only - later instances re-use them)
+//   setup code    createVerifyCode() (only when the setup code is set, not once per pairing)
+//   M1 -> M2      createPublicKey(), i.e. B = k*v + g^b %N
+//   M3 -> M4      createSessionKey(), verifyClientProof(), and createAccProof(), i.e. S = (A*v^u)^b %N plus hashing
+//
+// Every pairing must succeed (the accessory verifies the client's proof M1, and the client verifies the accessory's proof M2).
+//
+// g^b is then timed on its own three ways: with mbedtls_mpi_exp_mod() (what createPublicKey() uses), and with constant-time Lim-Lee
+// fixed-base combs of 4 and 8 rows (a table of 16 or 256 pre-computed powers of g, scanned in full for every look-up).  The combs are built
+// from the same public MbedTLS multiply and reduce calls the ESP32 would have to use.  Each result must match mbedtls_mpi_exp_mod().
+
+#include <SRP.h>
+#include <HostStubs.h>
+#include <sodium.h>
+
+#include <vector>
+
+//////////////////////////////////////
+
+static void check(boolean ok, const char *what){
+
+  if(ok)
+    return;
+
+  fprintf(stderr,"FAILED: %s\n",what);
+  exit(1);
+}
+
+static void sha512(uint8_t *out, const std::vector<uint8_t> &in){
+  crypto_hash_sha512(out,in.data(),in.size());
+}
+
+static std::vector<uint8_t> mpiBytes(const mbedtls_mpi *x, size_t pad=0){          // pad=0 writes the minimum number of bytes
+  std::vector<uint8_t> v(pad?pad:mbedtls_mpi_size(x));
+  mbedtls_mpi_write_binary(x,v.data(),v.size());
+  return(v);
+}
+
+//////////////////////////////////////
+
+struct Client {                                                    // client side of SRP-6A (as in HapController::pairSetup())
+
+  uint8_t A[384];
+  uint8_t M1[64];
+  uint8_t M2[64];
+
+  void create(const char *setupCode, const uint8_t *salt, const uint8_t *B);
+};
+
+void Client::create(const char *setupCode, const uint8_t *salt, const uint8_t *Bbytes){
+
+  mbedtls_mpi N, g, k, a, mA, B, u, x, t1, t2, S;
+  for(auto *m : {&N,&g,&k,&a,&mA,&B,&u,&x,&t1,&t2,&S})
+    mbedtls_mpi_init(m);
+
+  mbedtls_mpi_read_string(&N,16,SRP6A::N3072);
+  mbedtls_mpi_lset(&g,SRP6A::g3072);
+  mbedtls_mpi_read_binary(&B,Bbytes,384);
+
+  uint8_t h[64];
+  std::vector<uint8_t> buf;
+
+  buf=mpiBytes(&N,384);                                            // k = H(N | PAD(g))
+  {auto pg=mpiBytes(&g,384); buf.insert(buf.end(),pg.begin(),pg.end());}
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&k,h,64);
+
+  uint8_t aRand[32];                                               // A = g^a %N
+  randombytes_buf(aRand,32);
+  mbedtls_mpi_read_binary(&a,aRand,32);
+  mbedtls_mpi_exp_mod(&mA,&g,&a,&N,NULL);
+
+  buf=mpiBytes(&mA,384);                                           // u = H(PAD(A) | PAD(B))
+  {auto pb=mpiBytes(&B,384); buf.insert(buf.end(),pb.begin(),pb.end());}
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&u,h,64);
+
+  char icp[32];                                                    // x = H(s | H(I | ":" | P))
+  snprintf(icp,sizeof(icp),"%s:%.3s-%.2s-%.3s",SRP6A::I,setupCode,setupCode+3,setupCode+5);
+  buf.assign(icp,icp+strlen(icp));
+  sha512(h,buf);
+  buf.assign(salt,salt+16);
+  buf.insert(buf.end(),h,h+64);
+  sha512(h,buf);
+  mbedtls_mpi_read_binary(&x,h,64);
+
+  mbedtls_mpi_exp_mod(&t1,&g,&x,&N,NULL);                          // S = (B - k*g^x)^(a + u*x) %N
+  mbedtls_mpi_mul_mpi(&t2,&k,&t1);
+  mbedtls_mpi_sub_mpi(&t1,&B,&t2);
+  mbedtls_mpi_mod_mpi(&t1,&t1,&N);
+  mbedtls_mpi_mul_mpi(&t2,&u,&x);
+  mbedtls_mpi_add_mpi(&t2,&t2,&a);
+  mbedtls_mpi_exp_mod(&S,&t1,&t2,&N,NULL);
+
+  uint8_t K[64];                                                   // K = H(PAD(S))
+  sha512(K,mpiBytes(&S,384));
+
+  uint8_t hN[64], hg[64], hI[64];                                  // M1 = H(H(N) xor H(g) | H(I) | s | A | B | K)
+  sha512(hN,mpiBytes(&N,384));
+  crypto_hash_sha512(hg,&SRP6A::g3072,1);
+  crypto_hash_sha512(hI,(const uint8_t *)SRP6A::I,strlen(SRP6A::I));
+  buf.clear();
+  for(int i=0;i<64;i++)
+    buf.push_back(hN[i]^hg[i]);
+  buf.insert(buf.end(),hI,hI+64);
+  buf.insert(buf.end(),salt,salt+16);
+  {auto v=mpiBytes(&mA); buf.insert(buf.end(),v.begin(),v.end());}
+  {auto v=mpiBytes(&B); buf.insert(buf.end(),v.begin(),v.end());}
+  buf.insert(buf.end(),K,K+64);
+  sha512(M1,buf);
+
+  buf=mpiBytes(&mA,384);                                           // M2 = H(PAD(A) | M1 | K)
+  buf.insert(buf.end(),M1,M1+64);
+  buf.insert(buf.end(),K,K+64);
+  sha512(M2,buf);
+
+  mbedtls_mpi_write_binary(&mA,A,384);
+
+  for(auto *m : {&N,&g,&k,&a,&mA,&B,&u,&x,&t1,&t2,&S})
+    mbedtls_mpi_free(m);
+}
+
+//////////////////////////////////////
+
+struct Comb {                                                      // constant-time Lim-Lee fixed-base comb for g^E %N, with E up to 256 bits
+
+  static const int E_BITS=256;
+
+  int rows;                                                        // number of rows (h) - table holds 2^h entries
+  int cols;                                                        // number of columns (E_BITS/h) - one squaring and one multiplication per column
+  std::vector<mbedtls_mpi> table;                                  // table[j] = PRODUCT over rows r with bit r of j set of g^(2^(r*cols)) %N
+
+  Comb(int rows);
+  ~Comb();
+  void exp(mbedtls_mpi *X, const mbedtls_mpi *E);
+  size_t bytes(){return(table.size()*384);}
+};
+
+Comb::Comb(int rows) : rows(rows), cols(E_BITS/rows), table(1<<rows) {
+
+  mbedtls_mpi P, T;
+  mbedtls_mpi_init(&P);
+  mbedtls_mpi_init(&T);
+
+  for(auto &t : table)
+    mbedtls_mpi_init(&t);
+
+  mbedtls_mpi_lset(&table[0],1);
+  mbedtls_mpi_copy(&P,&SRP6A::g);                                  // P = g^(2^(r*cols)) for the current row r
+
+  for(int r=0;r<rows;r++){
+    for(int j=0;j<(1<<r);j++){                                     // entries with highest bit r are the entries below 2^r times P
+      mbedtls_mpi_mul_mpi(&T,&table[j],&P);
+      mbedtls_mpi_mod_mpi(&table[j|(1<<r)],&T,&SRP6A::N);
+    }
+    for(int i=0;i<cols;i++){
+      mbedtls_mpi_mul_mpi(&T,&P,&P);
+      mbedtls_mpi_mod_mpi(&P,&T,&SRP6A::N);
+    }
+  }
+
+  for(auto &t : table)                                             // grow every entry to the same size so look-ups do not depend on the entry
+    mbedtls_mpi_grow(&t,mbedtls_mpi_size(&SRP6A::N)/sizeof(mbedtls_mpi_uint));
+
+  mbedtls_mpi_free(&P);
+  mbedtls_mpi_free(&T);
+}
+
+Comb::~Comb(){
+  for(auto &t : table)
+    mbedtls_mpi_free(&t);
+}
+
+void Comb::exp(mbedtls_mpi *X, const mbedtls_mpi *E){
+
+  mbedtls_mpi Q, T;
+  mbedtls_mpi_init(&Q);
+  mbedtls_mpi_init(&T);
+  mbedtls_mpi_grow(&T,mbedtls_mpi_size(&SRP6A::N)/sizeof(mbedtls_mpi_uint));
+
+  mbedtls_mpi_lset(X,1);
+
+  for(int c=cols-1;c>=0;c--){
+
+    mbedtls_mpi_mul_mpi(&Q,X,X);                                   // X = X^2
+    mbedtls_mpi_mod_mpi(X,&Q,&SRP6A::N);
+
+    unsigned int idx=0;                                            // column c of E, one bit from each row
+    for(int r=0;r<rows;r++)
+      idx|=mbedtls_mpi_get_bit(E,r*cols+c)<<r;
+
+    for(unsigned int j=0;j<table.size();j++)                       // read every entry, keeping only table[idx]
+      mbedtls_mpi_safe_cond_assign(&T,&table[j],j==idx);
+
+    mbedtls_mpi_mul_mpi(&Q,X,&T);                                  // X = X*T (always performed, since table[0]=1)
+    mbedtls_mpi_mod_mpi(X,&Q,&SRP6A::N);
+  }
+
+  mbedtls_mpi_free(&Q);
+  mbedtls_mpi_free(&T);
+}
+
+//////////////////////////////////////
+
+static double usecSince(int64_t t0){
+  return((double)(esp_timer_get_time()-t0));
+}
+
+int main(int argc, char *argv[]){
+
+  int iterations=argc>1?atoi(argv[1]):20;
+  if(iterations<1)
+    iterations=1;
+
+  Host::setQuiet(true);
+
+  const char *setupCode="46637726";
+
+  int64_t t0=esp_timer_get_time();
+  SRP6A::initGroup();
+  double initFirst=usecSince(t0);
+
+  t0=esp_timer_get_time();
+  for(int i=0;i<iterations;i++)
+    SRP6A::initGroup();
+  double initCached=usecSince(t0)/iterations;
+
+  Verification vData;
+  double tVerify=0, tM2=0, tM4=0, tClient=0;
+
+  for(int i=0;i<iterations;i++){
+
+    SRP6A *srp=new SRP6A;
+    uint8_t B[384];
+    uint8_t accProof[64];
+    Client client;
+
+    t0=esp_timer_get_time();
+    srp->createVerifyCode(setupCode,&vData);
+    tVerify+=usecSince(t0);
+
+    t0=esp_timer_get_time();
+    srp->createPublicKey(&vData,B);
+    tM2+=usecSince(t0);
+
+    t0=esp_timer_get_time();
+    client.create(setupCode,vData.salt,B);
+    tClient+=usecSince(t0);
+
+    t0=esp_timer_get_time();
+    srp->createSessionKey(client.A,384);
+    int verified=srp->verifyClientProof(client.M1);
+    srp->createAccProof(accProof);
+    tM4+=usecSince(t0);
+
+    check(verified,"accessory did not verify client proof M1");
+    check(!memcmp(accProof,client.M2,64),"client did not verify accessory proof M2");
+
+    delete srp;
+  }
+
+  printf("\nSRP-6A pair-setup computations (accessory side, usec per pairing, %d pairings)\n\n",iterations);
+  printf("%-40s %12.0f\n","initGroup (first SRP6A)",initFirst);
+  printf("%-40s %12.2f\n","initGroup (later SRP6A)",initCached);
+  printf("%-40s %12.0f\n","createVerifyCode (setup code only)",tVerify/iterations);
+  printf("%-40s %12.0f\n","M1 -> M2 (createPublicKey)",tM2/iterations);
+  printf("%-40s %12.0f\n","M3 -> M4 (session key and proofs)",tM4/iterations);
+  printf("%-40s %12.0f\n","(client side, for reference)",tClient/iterations);
+
+  // g^b on its own
+
+  mbedtls_mpi b, X, Y;
+  mbedtls_mpi_init(&b);
+  mbedtls_mpi_init(&X);
+  mbedtls_mpi_init(&Y);
+
+  std::vector<std::vector<uint8_t>> keys(iterations,std::vector<uint8_t>(32));
+  for(auto &k : keys)
+    randombytes_buf(k.data(),32);
+  keys[0].assign(32,0xFF);                                         // include the extremes
+  if(iterations>1)
+    keys[1].assign(32,0x00);
+
+  double tExp=0;
+  for(auto &k : keys){
+    mbedtls_mpi_read_binary(&b,k.data(),32);
+    t0=esp_timer_get_time();
+    mbedtls_mpi_exp_mod(&X,&SRP6A::g,&b,&SRP6A::N,&SRP6A::_rr);
+    tExp+=usecSince(t0);
+  }
+
+  printf("\ng^b %%N with a 256-bit b (usec each)\n\n");
+  printf("%-40s %12s %12s %12s\n","Method","Table bytes","Build usec","usec");
+  printf("%-40s %12d %12d %12.0f\n","mbedtls_mpi_exp_mod",0,0,tExp/iterations);
+
+  for(int rows : {4,8}){
+
+    t0=esp_timer_get_time();
+    Comb comb(rows);
+    double tBuild=usecSince(t0);
+
+    double tComb=0;
+    for(auto &k : keys){
+      mbedtls_mpi_read_binary(&b,k.data(),32);
+      t0=esp_timer_get_time();
+      comb.exp(&Y,&b);
+      tComb+=usecSince(t0);
+      mbedtls_mpi_exp_mod(&X,&SRP6A::g,&b,&SRP6A::N,&SRP6A::_rr);
+      check(!mbedtls_mpi_cmp_mpi(&X,&Y),"comb result does not match mbedtls_mpi_exp_mod()");
+    }
+
+    char name[48];
+    snprintf(name,sizeof(name),"Lim-Lee comb, %d rows (constant-time)",rows);
+    printf("%-40s %12zu %12.0f %12.0f\n",name,comb.bytes(),tBuild,tComb/iterations);
+  }
+
+  printf("\n");
+
+  mbedtls_mpi_free(&b);
+  mbedtls_mpi_free(&X);
+  mbedtls_mpi_free(&Y);
+
+  return(0);
+}
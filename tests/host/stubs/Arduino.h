@@ -0,0 +1,253 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Thin stand-in for the Arduino-ESP32 core, providing just enough of its API for HomeSpan to compile and run on a Linux host.
+// Serial writes to stdout, millis()/micros() use the host's monotonic clock, and FreeRTOS tasks and queues map onto std::thread.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <string>
+#include <functional>
+#include <algorithm>
+
+#include "HostSystem.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define PULLUP          0x04
+#define INPUT_PULLUP    0x05
+#define PULLDOWN        0x08
+#define INPUT_PULLDOWN  0x09
+#define OPEN_DRAIN      0x10
+#define OUTPUT_OPEN_DRAIN 0x13
+#define ANALOG          0xC0
+
+#define PI          3.1415926535897932384626433832795
+#define HALF_PI     1.5707963267948966192313216916398
+#define TWO_PI      6.283185307179586476925286766559
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+uint16_t touchRead(uint8_t pin);
+
+extern "C" void init();                           // defined by HomeSpan; called by the Arduino core just before setup(), and by tests on the host
+
+void configTzTime(const char *tz, const char *server1, const char *server2=NULL, const char *server3=NULL);
+bool getLocalTime(struct tm *info, uint32_t ms=5000);
+
+long random(long max);
+long random(long min, long max);
+
+/////////////////////////////////////////////////
+
+class String {
+
+  std::string s;
+
+  public:
+
+  String(){}
+  String(const char *c){if(c) s=c;}
+  String(const std::string &str) : s(str){}
+  String(char c) : s(1,c){}
+  String(unsigned char v, unsigned char base=10) : String((unsigned long)v,base){}
+  String(int v, unsigned char base=10) : String((long)v,base){}
+  String(unsigned int v, unsigned char base=10) : String((unsigned long)v,base){}
+  String(long v, unsigned char base=10);
+  String(unsigned long v, unsigned char base=10);
+  String(long long v, unsigned char base=10);
+  String(unsigned long long v, unsigned char base=10);
+  String(float v, unsigned int decimalPlaces=2) : String((double)v,decimalPlaces){}
+  String(double v, unsigned int decimalPlaces=2);
+
+  const char *c_str() const {return(s.c_str());}
+  unsigned int length() const {return(s.length());}
+  bool isEmpty() const {return(s.empty());}
+  bool reserve(unsigned int n){s.reserve(n);return(true);}
+  char charAt(unsigned int i) const {return(i<s.length()?s[i]:0);}
+  char operator[](unsigned int i) const {return(charAt(i));}
+  char &operator[](unsigned int i){return(s[i]);}
+
+  String &operator=(const char *c){s=c?c:"";return(*this);}
+  String &operator+=(const String &x){s+=x.s;return(*this);}
+  String &operator+=(const char *c){if(c) s+=c;return(*this);}
+  String &operator+=(char c){s+=c;return(*this);}
+  template <typename T> String &operator+=(T v){s+=String(v).s;return(*this);}
+  bool concat(const String &x){s+=x.s;return(true);}
+  template <typename T> bool concat(T v){s+=String(v).s;return(true);}
+
+  friend String operator+(const String &a, const String &b){return(String(a.s+b.s));}
+  friend String operator+(const String &a, const char *b){return(String(a.s+(b?b:"")));}
+  friend String operator+(const char *a, const String &b){return(String(std::string(a?a:"")+b.s));}
+  template <typename T> friend String operator+(const String &a, T v){return(a+String(v));}
+
+  bool operator==(const String &x) const {return(s==x.s);}
+  bool operator==(const char *c) const {return(s==(c?c:""));}
+  bool operator!=(const String &x) const {return(s!=x.s);}
+  bool operator!=(const char *c) const {return(s!=(c?c:""));}
+  bool operator<(const String &x) const {return(s<x.s);}
+  bool equals(const String &x) const {return(s==x.s);}
+  bool equalsIgnoreCase(const String &x) const {return(!strcasecmp(s.c_str(),x.s.c_str()));}
+  bool startsWith(const String &x) const {return(s.rfind(x.s,0)==0);}
+  bool endsWith(const String &x) const {return(s.length()>=x.s.length() && !s.compare(s.length()-x.s.length(),x.s.length(),x.s));}
+
+  int indexOf(char c, unsigned int from=0) const {size_t n=s.find(c,from);return(n==std::string::npos?-1:(int)n);}
+  int indexOf(const String &x, unsigned int from=0) const {size_t n=s.find(x.s,from);return(n==std::string::npos?-1:(int)n);}
+  int lastIndexOf(char c) const {size_t n=s.rfind(c);return(n==std::string::npos?-1:(int)n);}
+  String substring(unsigned int from) const {return(from<s.length()?String(s.substr(from)):String());}
+  String substring(unsigned int from, unsigned int to) const {return(from<to && from<s.length()?String(s.substr(from,to-from)):String());}
+  void replace(const String &a, const String &b);
+  void trim();
+  void toUpperCase(){for(auto &c : s) c=toupper(c);}
+  void toLowerCase(){for(auto &c : s) c=tolower(c);}
+  long toInt() const {return(atol(s.c_str()));}
+  float toFloat() const {return(atof(s.c_str()));}
+  double toDouble() const {return(atof(s.c_str()));}
+};
+
+/////////////////////////////////////////////////
+
+enum IPType {IPv4, IPv6};
+
+class IPAddress {
+
+  uint8_t addr[16]={0};
+  IPType type=IPv4;
+
+  public:
+
+  IPAddress(){}
+  IPAddress(IPType t) : type(t){}
+  IPAddress(IPType t, const uint8_t *a, uint8_t zone=0) : type(t){memcpy(addr,a,t==IPv6?16:4);}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d){addr[0]=a;addr[1]=b;addr[2]=c;addr[3]=d;}
+  IPAddress(uint32_t v){memcpy(addr,&v,4);}
+
+  operator uint32_t() const {uint32_t v;memcpy(&v,addr,4);return(v);}
+  uint8_t operator[](int i) const {return(addr[i]);}
+  bool operator==(const IPAddress &x) const {return(type==x.type && !memcmp(addr,x.addr,16));}
+  String toString(bool includeZone=false) const;
+};
+
+/////////////////////////////////////////////////
+
+class Print {
+
+  public:
+
+  virtual ~Print(){}
+  virtual size_t write(uint8_t c)=0;
+  virtual size_t write(const uint8_t *buf, size_t n){size_t k=0;while(n--) k+=write(*buf++);return(k);}
+  size_t write(const char *c){return(c?write((const uint8_t *)c,strlen(c)):0);}
+
+  size_t printf(const char *fmt, ...) __attribute__((format(printf,2,3)));
+  size_t print(const char *c){return(write(c));}
+  size_t print(const String &s){return(write(s.c_str()));}
+  size_t print(char c){return(write((uint8_t)c));}
+  size_t print(int v, int base=DEC){return(print(String((long)v,base)));}
+  size_t print(unsigned int v, int base=DEC){return(print(String((unsigned long)v,base)));}
+  size_t print(long v, int base=DEC){return(print(String(v,base)));}
+  size_t print(unsigned long v, int base=DEC){return(print(String(v,base)));}
+  size_t print(double v, int digits=2){return(print(String(v,digits)));}
+  template <typename T> size_t println(T v){return(print(v)+print("\r\n"));}
+  size_t println(){return(print("\r\n"));}
+  virtual void flush(){}
+};
+
+class Stream : public Print {
+
+  public:
+
+  virtual int available()=0;
+  virtual int read()=0;
+  virtual int peek(){return(-1);}
+  void setTimeout(unsigned long){}
+};
+
+class HardwareSerial : public Stream {
+
+  public:
+
+  void begin(unsigned long baud, ...){}
+  void end(){}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int available() override {return(0);}          // no serial input on the host - serial commands are invoked directly with homeSpan.processSerialCommand()
+  int read() override {return(-1);}
+  void flush() override {fflush(stdout);}
+  operator bool() const {return(true);}
+};
+
+extern HardwareSerial Serial;
+
+/////////////////////////////////////////////////
+
+class EspClass {
+
+  public:
+
+  const char *getChipModel(){return("HOST");}
+  uint8_t getChipRevision(){return(0);}
+  uint8_t getChipCores(){return(CONFIG_FREERTOS_NUMBER_OF_CORES);}
+  uint32_t getFlashChipSize(){return(4*1024*1024);}
+  uint32_t getFreeHeap(){return(heap_caps_get_free_size(MALLOC_CAP_DEFAULT));}
+  uint32_t getSketchSize(){return(0);}
+  uint32_t getFreeSketchSpace(){return(0);}
+  void restart() __attribute__((noreturn));
+};
+
+extern EspClass ESP;
@@ -0,0 +1,64 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// OTA updates are never started on the host
+
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH   0
+#define U_SPIFFS  100
+
+typedef enum {OTA_AUTH_ERROR, OTA_BEGIN_ERROR, OTA_CONNECT_ERROR, OTA_RECEIVE_ERROR, OTA_END_ERROR} ota_error_t;
+
+class UpdateClass {
+
+  public:
+
+  void abort(){}
+};
+
+extern UpdateClass Update;
+
+class ArduinoOTAClass {
+
+  public:
+
+  ArduinoOTAClass &setHostname(const char *){return(*this);}
+  ArduinoOTAClass &setPasswordHash(const char *){return(*this);}
+  ArduinoOTAClass &onStart(std::function<void()>){return(*this);}
+  ArduinoOTAClass &onEnd(std::function<void()>){return(*this);}
+  ArduinoOTAClass &onProgress(std::function<void(unsigned int, unsigned int)>){return(*this);}
+  ArduinoOTAClass &onError(std::function<void(ota_error_t)>){return(*this);}
+  void begin(){}
+  void handle(){}
+  int getCommand(){return(U_FLASH);}
+};
+
+extern ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,872 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Implementations of the host stand-ins declared in the headers of this directory
+
+#include "HostStubs.h"
+
+#include <ETH.h>
+#include <ESPmDNS.h>
+#include <ArduinoOTA.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <esp_ota_ops.h>
+#include <esp_flash.h>
+#include <esp_now.h>
+#include <esp_task_wdt.h>
+#include <driver/ledc.h>
+#include <soc/rmt_struct.h>
+#include <soc/gpio_struct.h>
+#include <esp_private/spi_common_internal.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+
+/////////////////////////////////////////////////
+// Heap allocation counting (interposes the C library allocator for the whole process)
+
+static std::atomic<uint64_t> nAllocs{0};
+static std::atomic<uint64_t> nAllocBytes{0};
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size){
+  nAllocs.fetch_add(1,std::memory_order_relaxed);
+  nAllocBytes.fetch_add(size,std::memory_order_relaxed);
+  return(__libc_malloc(size));
+}
+
+void *calloc(size_t n, size_t size){
+  nAllocs.fetch_add(1,std::memory_order_relaxed);
+  nAllocBytes.fetch_add(n*size,std::memory_order_relaxed);
+  return(__libc_calloc(n,size));
+}
+
+void *realloc(void *ptr, size_t size){
+  nAllocs.fetch_add(1,std::memory_order_relaxed);
+  nAllocBytes.fetch_add(size,std::memory_order_relaxed);
+  return(__libc_realloc(ptr,size));
+}
+
+void free(void *ptr){
+  __libc_free(ptr);
+}
+
+}
+
+uint64_t Host::allocCount(){return(nAllocs.load(std::memory_order_relaxed));}
+uint64_t Host::allocBytes(){return(nAllocBytes.load(std::memory_order_relaxed));}
+
+static std::atomic<bool> internalAllocFails{false};
+
+void Host::failInternalAlloc(bool fail){internalAllocFails=fail;}
+
+void *heap_caps_malloc(size_t size, uint32_t caps){
+  if(internalAllocFails && (caps&MALLOC_CAP_INTERNAL))
+    return(NULL);
+  return(malloc(size));
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps){
+  if(internalAllocFails && (caps&MALLOC_CAP_INTERNAL))
+    return(NULL);
+  return(calloc(n,size));
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps){
+  if(internalAllocFails && (caps&MALLOC_CAP_INTERNAL))
+    return(NULL);
+  return(realloc(ptr,size));
+}
+
+void heap_caps_free(void *ptr){free(ptr);}
+
+size_t heap_caps_get_free_size(uint32_t caps){return(256*1024);}                 // reports a comfortably-sized internal heap, so HomeSpan never issues low-memory warnings
+size_t heap_caps_get_largest_free_block(uint32_t caps){return(128*1024);}
+size_t heap_caps_get_minimum_free_size(uint32_t caps){return(256*1024);}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps){
+  memset(info,0,sizeof(multi_heap_info_t));
+  info->total_free_bytes=heap_caps_get_free_size(caps);
+  info->largest_free_block=heap_caps_get_largest_free_block(caps);
+  info->minimum_free_bytes=heap_caps_get_minimum_free_size(caps);
+}
+
+/////////////////////////////////////////////////
+// Time, errors, and reset
+
+static const auto startTime=std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time(){
+  return(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-startTime).count());
+}
+
+unsigned long millis(){return(esp_timer_get_time()/1000);}
+unsigned long micros(){return(esp_timer_get_time());}
+static std::atomic<bool> skipDelays{false};
+
+void delay(uint32_t ms){
+  if(skipDelays)
+    std::this_thread::yield();
+  else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void Host::setSkipDelays(bool skip){skipDelays=skip;}
+void delayMicroseconds(uint32_t us){std::this_thread::sleep_for(std::chrono::microseconds(us));}
+void yield(){std::this_thread::yield();}
+
+const char *esp_err_to_name(esp_err_t err){return(err==ESP_OK?"ESP_OK":"ESP_FAIL");}
+
+esp_reset_reason_t esp_reset_reason(){return(ESP_RST_POWERON);}
+
+void esp_restart(){
+  fflush(stdout);
+  fprintf(stderr,"*** esp_restart() called - exiting\n");
+  exit(0);
+}
+
+void EspClass::restart(){esp_restart();}
+
+void configTzTime(const char *tz, const char *server1, const char *server2, const char *server3){}
+bool getLocalTime(struct tm *info, uint32_t ms){return(false);}
+
+/////////////////////////////////////////////////
+// GPIO (inputs always read HIGH, so pushbuttons are never pressed)
+
+void pinMode(uint8_t pin, uint8_t mode){}
+void digitalWrite(uint8_t pin, uint8_t val){}
+int digitalRead(uint8_t pin){return(HIGH);}
+uint16_t analogRead(uint8_t pin){return(0);}
+uint16_t touchRead(uint8_t pin){return(0);}
+esp_err_t gpio_config(const gpio_config_t *config){return(ESP_OK);}
+
+long random(long max){return(max>0?rand()%max:0);}
+long random(long min, long max){return(max>min?min+rand()%(max-min):min);}
+
+gpio_dev_t GPIO;
+rmt_dev_t RMT;
+
+/////////////////////////////////////////////////
+// String, IPAddress, Print, and Serial
+
+static String toBase(unsigned long long v, unsigned char base, bool negative){
+  char buf[72];
+  char *p=buf+sizeof(buf)-1;
+  *p='\0';
+  if(base<2 || base>36)
+    base=10;
+  do {
+    int d=v%base;
+    *--p=d<10?'0'+d:'a'+d-10;
+    v/=base;
+  } while(v);
+  if(negative)
+    *--p='-';
+  return(String(p));
+}
+
+String::String(long v, unsigned char base) : String(base==10 && v<0?toBase(-(unsigned long long)v,base,true):toBase((unsigned long)v,base,false)){}
+String::String(unsigned long v, unsigned char base) : String(toBase(v,base,false)){}
+String::String(long long v, unsigned char base) : String(base==10 && v<0?toBase(-(unsigned long long)v,base,true):toBase((unsigned long long)v,base,false)){}
+String::String(unsigned long long v, unsigned char base) : String(toBase(v,base,false)){}
+
+String::String(double v, unsigned int decimalPlaces){
+  char buf[64];
+  snprintf(buf,sizeof(buf),"%.*f",decimalPlaces,v);
+  s=buf;
+}
+
+void String::replace(const String &a, const String &b){
+  if(a.s.empty())
+    return;
+  size_t pos=0;
+  while((pos=s.find(a.s,pos))!=std::string::npos){
+    s.replace(pos,a.s.length(),b.s);
+    pos+=b.s.length();
+  }
+}
+
+void String::trim(){
+  size_t start=s.find_first_not_of(" \t\r\n");
+  size_t end=s.find_last_not_of(" \t\r\n");
+  s=(start==std::string::npos)?"":s.substr(start,end-start+1);
+}
+
+String IPAddress::toString(bool includeZone) const {
+  char buf[48];
+  if(type==IPv4)
+    sprintf(buf,"%d.%d.%d.%d",addr[0],addr[1],addr[2],addr[3]);
+  else
+    sprintf(buf,"%x:%x:%x:%x:%x:%x:%x:%x",addr[0]<<8|addr[1],addr[2]<<8|addr[3],addr[4]<<8|addr[5],addr[6]<<8|addr[7],
+                                          addr[8]<<8|addr[9],addr[10]<<8|addr[11],addr[12]<<8|addr[13],addr[14]<<8|addr[15]);
+  return(String(buf));
+}
+
+size_t Print::printf(const char *fmt, ...){
+  char sBuf[256];
+  va_list args;
+  va_start(args,fmt);
+  int n=vsnprintf(sBuf,sizeof(sBuf),fmt,args);
+  va_end(args);
+  if(n<0)
+    return(0);
+  if(n<(int)sizeof(sBuf))
+    return(write((const uint8_t *)sBuf,n));
+  char *buf=(char *)malloc(n+1);
+  va_start(args,fmt);
+  vsnprintf(buf,n+1,fmt,args);
+  va_end(args);
+  size_t k=write((const uint8_t *)buf,n);
+  free(buf);
+  return(k);
+}
+
+static std::atomic<bool> serialQuiet{false};
+
+void Host::setQuiet(bool quiet){serialQuiet=quiet;}
+
+size_t HardwareSerial::write(uint8_t c){return(write(&c,1));}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n){
+  if(!serialQuiet)
+    fwrite(buf,1,n,stdout);
+  return(n);
+}
+
+HardwareSerial Serial;
+EspClass ESP;
+
+/////////////////////////////////////////////////
+// FreeRTOS tasks and queues
+
+struct HostTask {
+  std::string name;
+  UBaseType_t priority;
+  BaseType_t core;
+};
+
+static HostTask loopTask{"loopTask",1,1};
+static HostTask idleTask[CONFIG_FREERTOS_NUMBER_OF_CORES]={{"IDLE0",0,0},{"IDLE1",0,1}};
+static thread_local HostTask *currentTask=&loopTask;
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core){
+  HostTask *task=new HostTask{name,priority,core==tskNO_AFFINITY?0:core};
+  if(handle)
+    *handle=task;
+  std::thread([fn,arg,task](){currentTask=task;fn(arg);}).detach();
+  return(pdPASS);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core){
+  return(xTaskCreateUniversal(fn,name,stackSize,arg,priority,handle,core));
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle){
+  return(xTaskCreateUniversal(fn,name,stackSize,arg,priority,handle,tskNO_AFFINITY));
+}
+
+void vTaskDelete(TaskHandle_t task){
+  if(task==NULL || task==currentTask)             // a task can only delete itself on the host
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks){delay(ticks*portTICK_PERIOD_MS);}
+TaskHandle_t xTaskGetCurrentTaskHandle(){return(currentTask);}
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core){return(idleTask+core);}
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task){return((task?task:currentTask)->priority);}
+BaseType_t xTaskGetCoreID(TaskHandle_t task){return((task?task:currentTask)->core);}
+BaseType_t xPortGetCoreID(){return(currentTask->core);}
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task){return(4096);}
+char *pcTaskGetName(TaskHandle_t task){return((char *)(task?task:currentTask)->name.c_str());}
+
+struct HostQueue {
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+};
+
+template <typename P> static bool waitFor(HostQueue *q, std::unique_lock<std::mutex> &lock, TickType_t wait, P ready){
+  if(wait==portMAX_DELAY){
+    q->cv.wait(lock,ready);
+    return(true);
+  }
+  return(q->cv.wait_for(lock,std::chrono::milliseconds(wait*portTICK_PERIOD_MS),ready));
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize){
+  HostQueue *q=new HostQueue;
+  q->length=length;
+  q->itemSize=itemSize;
+  return(q);
+}
+
+void vQueueDelete(QueueHandle_t q){delete q;}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait){
+  std::unique_lock<std::mutex> lock(q->m);
+  if(!waitFor(q,lock,wait,[q]{return(q->items.size()<q->length);}))
+    return(pdFAIL);
+  q->items.emplace_back((const uint8_t *)item,(const uint8_t *)item+q->itemSize);
+  q->cv.notify_all();
+  return(pdPASS);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item){
+  std::unique_lock<std::mutex> lock(q->m);
+  q->items.clear();
+  q->items.emplace_back((const uint8_t *)item,(const uint8_t *)item+q->itemSize);
+  q->cv.notify_all();
+  return(pdPASS);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait){
+  std::unique_lock<std::mutex> lock(q->m);
+  if(!waitFor(q,lock,wait,[q]{return(!q->items.empty());}))
+    return(pdFALSE);
+  memcpy(item,q->items.front().data(),q->itemSize);
+  q->items.pop_front();
+  q->cv.notify_all();
+  return(pdTRUE);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait){
+  std::unique_lock<std::mutex> lock(q->m);
+  if(!waitFor(q,lock,wait,[q]{return(!q->items.empty());}))
+    return(pdFALSE);
+  memcpy(item,q->items.front().data(),q->itemSize);
+  return(pdTRUE);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q){
+  std::unique_lock<std::mutex> lock(q->m);
+  return(q->items.size());
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q){
+  std::unique_lock<std::mutex> lock(q->m);
+  return(q->length-q->items.size());
+}
+
+/////////////////////////////////////////////////
+// Loopback network connections
+
+struct HostSocket {
+  std::mutex m;
+  std::deque<uint8_t> rx[2];                      // bytes waiting to be read by each side (0=accessory, 1=controller)
+  bool open[2]={true,true};
+  int fd;
+};
+
+static std::mutex serverMutex;
+static std::map<uint16_t,std::deque<std::shared_ptr<HostSocket>>> pendingClients;
+static int nextFD=LWIP_SOCKET_OFFSET;
+
+NetworkClient Host::connect(uint16_t port){
+  auto sock=std::make_shared<HostSocket>();
+  std::lock_guard<std::mutex> lock(serverMutex);
+  sock->fd=nextFD++;
+  pendingClients[port].push_back(sock);
+  return(NetworkClient(sock,1));
+}
+
+bool NetworkServer::hasClient(){
+  std::lock_guard<std::mutex> lock(serverMutex);
+  return(!pendingClients[port].empty());
+}
+
+NetworkClient NetworkServer::accept(){
+  std::lock_guard<std::mutex> lock(serverMutex);
+  auto &q=pendingClients[port];
+  if(q.empty())
+    return(NetworkClient());
+  auto sock=q.front();
+  q.pop_front();
+  return(NetworkClient(sock,0));
+}
+
+int NetworkClient::available(){
+  if(!sock)
+    return(0);
+  std::lock_guard<std::mutex> lock(sock->m);
+  return(sock->rx[side].size());
+}
+
+int NetworkClient::read(){
+  uint8_t c;
+  return(read(&c,1)==1?c:-1);
+}
+
+int NetworkClient::read(uint8_t *buf, size_t n){
+  if(!sock)
+    return(-1);
+  std::lock_guard<std::mutex> lock(sock->m);
+  auto &q=sock->rx[side];
+  if(q.empty())
+    return(-1);
+  if(n>q.size())
+    n=q.size();
+  std::copy(q.begin(),q.begin()+n,buf);
+  q.erase(q.begin(),q.begin()+n);
+  return(n);
+}
+
+size_t NetworkClient::write(const uint8_t *buf, size_t n){
+  if(!sock)
+    return(0);
+  std::lock_guard<std::mutex> lock(sock->m);
+  if(!sock->open[0] || !sock->open[1])            // peer has closed connection
+    return(0);
+  sock->rx[!side].insert(sock->rx[!side].end(),buf,buf+n);
+  return(n);
+}
+
+uint8_t NetworkClient::connected(){
+  if(!sock)
+    return(0);
+  std::lock_guard<std::mutex> lock(sock->m);
+  return(sock->open[side] && (sock->open[!side] || !sock->rx[side].empty()));       // as with TCP, data already received can still be read after the peer closes
+}
+
+void NetworkClient::stop(){
+  if(!sock)
+    return;
+  std::lock_guard<std::mutex> lock(sock->m);
+  sock->open[side]=false;
+  sock->rx[side].clear();
+}
+
+int NetworkClient::fd() const {return(sock?sock->fd:-1);}
+IPAddress NetworkClient::remoteIP() const {return(IPAddress(127,0,0,1));}
+
+/////////////////////////////////////////////////
+// Network interfaces (never connected)
+
+NetworkManager Network;
+WiFiClass WiFi;
+ETHClass ETH;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+UpdateClass Update;
+
+int esp_netif_get_all_ip6(esp_netif_t *netif, esp_ip6_addr_t *ip6){return(0);}
+esp_ip6_addr_type_t esp_netif_ip6_get_addr_type(esp_ip6_addr_t *ip6){return(ESP_IP6_ADDR_IS_UNKNOWN);}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf){memset(conf,0,sizeof(wifi_config_t));return(ESP_OK);}
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf){return(ESP_OK);}
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second){*primary=1;*second=WIFI_SECOND_CHAN_NONE;return(ESP_OK);}
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second){return(ESP_OK);}
+
+esp_err_t mdns_service_txt_item_set(const char *service, const char *proto, const char *key, const char *value){return(ESP_OK);}
+
+esp_err_t esp_now_init(){return(ESP_OK);}
+esp_err_t esp_now_set_pmk(const uint8_t *pmk){return(ESP_OK);}
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb){return(ESP_OK);}
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb){return(ESP_OK);}
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer){return(ESP_OK);}
+bool esp_now_is_peer_exist(const uint8_t *peer_addr){return(false);}
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len){return(ESP_FAIL);}
+
+/////////////////////////////////////////////////
+// Non-volatile storage
+
+typedef std::map<std::string,std::vector<uint8_t>> nvsNamespace_t;
+
+static std::mutex nvsMutex;
+
+static std::vector<std::pair<std::string,nvsNamespace_t>> &nvsData(){     // constructed on first use, since Span() opens NVS during static initialization
+  static std::vector<std::pair<std::string,nvsNamespace_t>> data;
+  return(data);
+}
+
+static nvsNamespace_t *nvsSpace(nvs_handle_t handle){
+  return(handle>0 && handle<=nvsData().size()?&nvsData()[handle-1].second:NULL);
+}
+
+esp_err_t nvs_flash_init(){return(ESP_OK);}
+
+esp_err_t nvs_flash_erase(){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  for(auto &ns : nvsData())
+    ns.second.clear();
+  return(ESP_OK);
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  auto &data=nvsData();
+  for(size_t i=0;i<data.size();i++){
+    if(data[i].first==name){
+      *handle=i+1;
+      return(ESP_OK);
+    }
+  }
+  data.emplace_back(name,nvsNamespace_t());
+  *handle=data.size();
+  return(ESP_OK);
+}
+
+void nvs_close(nvs_handle_t handle){}
+esp_err_t nvs_commit(nvs_handle_t handle){return(ESP_OK);}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvsNamespace_t *ns=nvsSpace(handle);
+  if(!ns)
+    return(ESP_ERR_INVALID_ARG);
+  ns->clear();
+  return(ESP_OK);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvsNamespace_t *ns=nvsSpace(handle);
+  if(!ns)
+    return(ESP_ERR_INVALID_ARG);
+  return(ns->erase(key)?ESP_OK:ESP_ERR_NVS_NOT_FOUND);
+}
+
+esp_err_t nvs_get_stats(const char *part, nvs_stats_t *stats){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  size_t used=0;
+  for(auto &ns : nvsData())
+    used+=ns.second.size();
+  stats->namespace_count=nvsData().size();
+  stats->total_entries=630;
+  stats->used_entries=used;
+  stats->free_entries=stats->total_entries-used;
+  stats->available_entries=stats->free_entries;
+  return(ESP_OK);
+}
+
+static esp_err_t nvsGet(nvs_handle_t handle, const char *key, void *value, size_t *length){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvsNamespace_t *ns=nvsSpace(handle);
+  if(!ns)
+    return(ESP_ERR_INVALID_ARG);
+  auto it=ns->find(key);
+  if(it==ns->end())
+    return(ESP_ERR_NVS_NOT_FOUND);
+  if(!value){                                     // caller is asking only for length
+    *length=it->second.size();
+    return(ESP_OK);
+  }
+  if(*length<it->second.size())
+    return(ESP_ERR_NVS_INVALID_LENGTH);
+  memcpy(value,it->second.data(),it->second.size());
+  *length=it->second.size();
+  return(ESP_OK);
+}
+
+static esp_err_t nvsSet(nvs_handle_t handle, const char *key, const void *value, size_t length){
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvsNamespace_t *ns=nvsSpace(handle);
+  if(!ns)
+    return(ESP_ERR_INVALID_ARG);
+  (*ns)[key].assign((const uint8_t *)value,(const uint8_t *)value+length);
+  return(ESP_OK);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length){return(nvsGet(handle,key,value,length));}
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length){return(nvsSet(handle,key,value,length));}
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *length){return(nvsGet(handle,key,value,length));}
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value){return(nvsSet(handle,key,value,strlen(value)+1));}
+
+#define NVS_INT(suffix,type) \
+  esp_err_t nvs_get_##suffix(nvs_handle_t handle, const char *key, type *value){size_t len=sizeof(type);return(nvsGet(handle,key,value,&len));} \
+  esp_err_t nvs_set_##suffix(nvs_handle_t handle, const char *key, type value){return(nvsSet(handle,key,&value,sizeof(type)));}
+
+NVS_INT(u8,uint8_t)
+NVS_INT(i8,int8_t)
+NVS_INT(u16,uint16_t)
+NVS_INT(i16,int16_t)
+NVS_INT(u32,uint32_t)
+NVS_INT(i32,int32_t)
+NVS_INT(u64,uint64_t)
+NVS_INT(i64,int64_t)
+
+/////////////////////////////////////////////////
+// Partitions, OTA, and watchdog
+
+static esp_partition_t factoryPartition={NULL,ESP_PARTITION_TYPE_APP,0x00,0x10000,0x300000,"factory"};
+
+const esp_partition_t *esp_ota_get_running_partition(){return(&factoryPartition);}
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start){return(NULL);}
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *state){return(ESP_ERR_NOT_SUPPORTED);}
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(){return(ESP_OK);}
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(){esp_restart();}
+extern "C" bool __attribute__((weak)) verifyRollbackLater(){return(false);}      // Arduino-ESP32 default (a test may include SpanRollback.h to override)
+
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label){return(NULL);}
+const esp_partition_t *esp_partition_get(esp_partition_iterator_t it){return(NULL);}
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t it){return(NULL);}
+void esp_partition_iterator_release(esp_partition_iterator_t it){}
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size){return(ESP_ERR_INVALID_ARG);}
+esp_err_t esp_flash_get_physical_size(esp_flash_t *chip, uint32_t *flash_size){*flash_size=4*1024*1024;return(ESP_OK);}
+
+esp_err_t esp_task_wdt_status(TaskHandle_t task){return(ESP_ERR_NOT_FOUND);}
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config){return(ESP_OK);}
+esp_err_t esp_task_wdt_add_user(const char *name, esp_task_wdt_user_handle_t *handle){*handle=(esp_task_wdt_user_handle_t)name;return(ESP_OK);}
+esp_err_t esp_task_wdt_delete_user(esp_task_wdt_user_handle_t handle){return(ESP_OK);}
+esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t handle){return(ESP_OK);}
+
+/////////////////////////////////////////////////
+// LEDC (no-op)
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config){return(ESP_OK);}
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config){return(ESP_OK);}
+esp_err_t ledc_fade_func_install(int intr_alloc_flags){return(ESP_OK);}
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg){return(ESP_OK);}
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel){return(0);}
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode){return(ESP_OK);}
+
+/////////////////////////////////////////////////
+// RMT transmit channels (encoders run to completion inside rmt_transmit(); completion callbacks fire from rmt_tx_wait_all_done())
+
+struct rmt_channel_t {
+  int channel;                                    // must be first, since Pixel reads channel number from the start of the handle, as on the chip
+  int gpio;
+  bool enabled=false;
+  rmt_tx_event_callbacks_t cbs={};
+  void *user=NULL;
+  std::deque<size_t> pending;                     // number of symbols in each transmission whose completion has not yet been reported
+};
+
+struct rmt_encoder_t {
+  rmt_simple_encoder_config_t config;
+};
+
+static rmt_channel_t *rmtChannels[SOC_RMT_TX_CANDIDATES_PER_GROUP];
+static std::map<int,std::vector<Host::rmtFrame_t>> rmtCaptured;
+static size_t rmtChunk=SOC_RMT_MEM_WORDS_PER_CHANNEL;
+
+const std::vector<Host::rmtFrame_t> &Host::rmtFrames(int pin){return(rmtCaptured[pin]);}
+void Host::rmtClear(){rmtCaptured.clear();}
+void Host::setRmtChunk(size_t symbols){rmtChunk=symbols?symbols:SOC_RMT_MEM_WORDS_PER_CHANNEL;}
+
+int Host::rmtChannelsInUse(){
+  int n=0;
+  for(auto chan : rmtChannels)
+    n+=(chan!=NULL);
+  return(n);
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan){
+  for(int i=0;i<SOC_RMT_TX_CANDIDATES_PER_GROUP;i++){
+    if(!rmtChannels[i]){
+      rmtChannels[i]=new rmt_channel_t;
+      rmtChannels[i]->channel=i;
+      rmtChannels[i]->gpio=config->gpio_num;
+      *ret_chan=rmtChannels[i];
+      return(ESP_OK);
+    }
+  }
+  return(ESP_ERR_NOT_FOUND);
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t chan){
+  if(!chan || chan->enabled)                      // as on the chip, a channel must be disabled before it is deleted
+    return(ESP_ERR_INVALID_STATE);
+  rmtChannels[chan->channel]=NULL;
+  delete chan;
+  return(ESP_OK);
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t chan){chan->enabled=true;return(ESP_OK);}
+esp_err_t rmt_disable(rmt_channel_handle_t chan){chan->enabled=false;return(ESP_OK);}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t chan, const rmt_tx_event_callbacks_t *cbs, void *user_data){
+  if(chan->enabled)
+    return(ESP_ERR_INVALID_STATE);
+  chan->cbs=*cbs;
+  chan->user=user_data;
+  return(ESP_OK);
+}
+
+esp_err_t rmt_new_simple_encoder(const rmt_simple_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder){
+  *ret_encoder=new rmt_encoder_t{*config};
+  return(ESP_OK);
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder){
+  delete encoder;
+  return(ESP_OK);
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t chan, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes, const rmt_transmit_config_t *config){
+
+  if(!chan->enabled)
+    return(ESP_ERR_INVALID_STATE);
+
+  Host::rmtFrame_t frame;
+  std::vector<rmt_symbol_word_t> block(rmtChunk);
+  bool done=false;
+
+  while(!done){
+    size_t n=encoder->config.callback(payload,payload_bytes,frame.size(),block.size(),block.data(),&done,encoder->config.arg);
+    if(n>block.size()){
+      fprintf(stderr,"*** RMT encoder wrote %zu symbols into a block of %zu\n",n,block.size());
+      abort();
+    }
+    if(n==0 && !done){                            // encoder could not make progress even with a full block of free space
+      fprintf(stderr,"*** RMT encoder stalled after %zu symbols\n",frame.size());
+      abort();
+    }
+    frame.insert(frame.end(),block.begin(),block.begin()+n);
+  }
+
+  chan->pending.push_back(frame.size());
+  rmtCaptured[chan->gpio].push_back(std::move(frame));
+  return(ESP_OK);
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t chan, int timeout_ms){
+  while(!chan->pending.empty()){
+    rmt_tx_done_event_data_t edata={chan->pending.front()};
+    chan->pending.pop_front();
+    if(chan->cbs.on_trans_done)
+      chan->cbs.on_trans_done(chan,&edata,chan->user);
+  }
+  return(ESP_OK);
+}
+
+/////////////////////////////////////////////////
+// SPI master (transactions complete as soon as they are queued)
+
+#define DMA_DESCRIPTOR_BUFFER_MAX_SIZE  4092
+
+struct HostSpiBus {
+  bool initialized=false;
+  spi_bus_attr_t attr={};
+  int nDevices=0;
+  int nOversized=0;
+  std::vector<Host::spiFrame_t> frames;
+};
+
+struct spi_device_t {
+  spi_host_device_t host;
+  spi_device_interface_config_t config;
+  std::deque<spi_transaction_t *> completed;      // queued transactions not yet retrieved with spi_device_get_trans_result()
+};
+
+static HostSpiBus spiBus[SPI_HOST_MAX];
+
+const std::vector<Host::spiFrame_t> &Host::spiFrames(spi_host_device_t host){return(spiBus[host].frames);}
+int Host::spiOversized(spi_host_device_t host){return(spiBus[host].nOversized);}
+
+void Host::spiReset(){
+  for(auto &bus : spiBus)
+    bus=HostSpiBus();
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config, spi_common_dma_t dma_chan){
+  if(host==SPI1_HOST || host>=SPI_HOST_MAX)
+    return(ESP_ERR_INVALID_ARG);
+  if(spiBus[host].initialized)
+    return(ESP_ERR_INVALID_STATE);
+  spiBus[host].initialized=true;
+  spiBus[host].attr.bus_cfg=*bus_config;
+  int nDesc=(bus_config->max_transfer_sz+DMA_DESCRIPTOR_BUFFER_MAX_SIZE-1)/DMA_DESCRIPTOR_BUFFER_MAX_SIZE;     // transfer limit is rounded up to a whole number of DMA descriptors, as on the chip
+  spiBus[host].attr.max_transfer_sz=(nDesc?nDesc:1)*DMA_DESCRIPTOR_BUFFER_MAX_SIZE;
+  return(ESP_OK);
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host){
+  if(spiBus[host].nDevices)
+    return(ESP_ERR_INVALID_STATE);
+  spiBus[host].initialized=false;
+  return(ESP_OK);
+}
+
+const spi_bus_attr_t *spi_bus_get_attr(spi_host_device_t host){
+  return(host<SPI_HOST_MAX && spiBus[host].initialized?&spiBus[host].attr:NULL);
+}
+
+esp_err_t spicommon_bus_initialize_io(spi_host_device_t host, const spi_bus_config_t *bus_config, uint32_t flags, uint32_t *flags_o){return(ESP_OK);}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle){
+  if(host>=SPI_HOST_MAX || !spiBus[host].initialized)
+    return(ESP_ERR_INVALID_STATE);
+  if(spiBus[host].nDevices==3)                    // SPI2 and SPI3 each support three devices on the ESP32
+    return(ESP_ERR_NOT_FOUND);
+  spiBus[host].nDevices++;
+  *handle=new spi_device_t{host,*dev_config};
+  return(ESP_OK);
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle){
+  if(!handle->completed.empty())
+    return(ESP_ERR_INVALID_STATE);
+  spiBus[handle->host].nDevices--;
+  delete handle;
+  return(ESP_OK);
+}
+
+static esp_err_t spiRecord(spi_device_handle_t handle, spi_transaction_t *trans){
+  HostSpiBus &bus=spiBus[handle->host];
+  if(trans->length>(size_t)bus.attr.max_transfer_sz*8){
+    bus.nOversized++;
+    return(ESP_ERR_INVALID_ARG);
+  }
+  const uint8_t *p=(const uint8_t *)trans->tx_buffer;
+  bus.frames.emplace_back(p,p+(trans->length+7)/8);
+  return(ESP_OK);
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t ticks_to_wait){
+  if(handle->completed.size()>=(size_t)handle->config.queue_size)      // on the chip this would block until a slot frees up; on the host no slot ever frees up by itself
+    return(ESP_ERR_TIMEOUT);
+  esp_err_t status=spiRecord(handle,trans);
+  if(status==ESP_OK)
+    handle->completed.push_back(trans);
+  return(status);
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans, TickType_t ticks_to_wait){
+  if(handle->completed.empty())
+    return(ESP_ERR_TIMEOUT);
+  *trans=handle->completed.front();
+  handle->completed.pop_front();
+  return(ESP_OK);
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans){return(spiRecord(handle,trans));}
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait){return(ESP_OK);}
+void spi_device_release_bus(spi_device_handle_t dev){}
@@ -0,0 +1,62 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Test-facing interface to the host stand-ins: opening loopback connections to HomeSpan, counting heap allocations,
+// and inspecting the symbol streams and SPI transactions captured from Pixel, Dot, and WS2801_LED devices
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <driver/rmt_tx.h>
+#include <driver/spi_master.h>
+#include <vector>
+
+namespace Host {
+
+  NetworkClient connect(uint16_t port=80);                  // opens a loopback connection to a NetworkServer on port and returns the controller's end of it
+  void setQuiet(bool quiet);                                // suppresses (or restores) output written to Serial
+  void setSkipDelays(bool skip);                            // if true, delay() and vTaskDelay() just yield, so a benchmark does not count the tick poll() gives up on every call
+
+  uint64_t allocCount();                                    // total number of calls to malloc(), calloc(), and realloc() made by the process so far
+  uint64_t allocBytes();                                    // total number of bytes requested by those calls
+
+  void failInternalAlloc(bool fail);                        // if true, heap_caps_malloc() fails for any request with MALLOC_CAP_INTERNAL
+
+  typedef std::vector<rmt_symbol_word_t> rmtFrame_t;
+
+  const std::vector<rmtFrame_t> &rmtFrames(int pin);         // symbol streams transmitted so far on the RMT channel attached to pin, one per call to rmt_transmit()
+  void rmtClear();                                          // discards all captured symbol streams
+  void setRmtChunk(size_t symbols);                         // sets the number of free symbols offered to an encoder on each call (default=SOC_RMT_MEM_WORDS_PER_CHANNEL)
+  int rmtChannelsInUse();                                   // number of RMT channels allocated and not yet deleted
+
+  typedef std::vector<uint8_t> spiFrame_t;
+
+  const std::vector<spiFrame_t> &spiFrames(spi_host_device_t host);     // data of each transaction queued so far on host
+  int spiOversized(spi_host_device_t host);                 // number of transactions rejected so far by host for exceeding its maximum transfer size
+  void spiReset();                                          // frees all SPI buses and discards captured transactions
+}
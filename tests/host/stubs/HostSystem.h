@@ -0,0 +1,196 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Thin stand-ins for the ESP-IDF and FreeRTOS system APIs used by HomeSpan (heap, timer, tasks, queues, logging, GPIO, and chip configuration)
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/////////////////////////////////////////////////
+// Chip configuration (host behaves as a dual-core ESP32)
+
+#define CONFIG_FREERTOS_NUMBER_OF_CORES   2
+#define portNUM_PROCESSORS                2
+#define CONFIG_LWIP_MAX_SOCKETS           16
+#define CONFIG_LWIP_IPV6_NUM_ADDRESSES    3
+#define CONFIG_ESP_TASK_WDT_TIMEOUT_S     5
+#define LWIP_SOCKET_OFFSET                0
+#define ARDUINO_BOARD                     "HOST"
+#define ARDUINO_VARIANT                   "host"
+
+#define ESP_IDF_VERSION_VAL(major,minor,patch)  ((major<<16)|(minor<<8)|(patch))
+#define ESP_IDF_VERSION_MAJOR             5             // Arduino-ESP32 3.3.0 is built on ESP-IDF 5.5.0
+#define ESP_IDF_VERSION_MINOR             5
+#define ESP_IDF_VERSION_PATCH             0
+#define ESP_IDF_VERSION                   ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR,ESP_IDF_VERSION_MINOR,ESP_IDF_VERSION_PATCH)
+
+#define SOC_RMT_MEM_WORDS_PER_CHANNEL     64
+#define SOC_RMT_TX_CANDIDATES_PER_GROUP   8
+#define SOC_RMT_SUPPORT_REF_TICK          1
+#define SOC_LEDC_SUPPORT_APB_CLOCK        1
+#define SOC_TOUCH_SENSOR_SUPPORTED        0
+#define SOC_TOUCH_SENSOR_NUM              0
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+/////////////////////////////////////////////////
+// Errors and logging
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NO_MEM        0x101
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND     0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT       0x107
+
+const char *esp_err_to_name(esp_err_t err);
+
+#define ESP_LOGE(tag,format,...) fprintf(stderr,"E (%s) " format "\n",tag __VA_OPT__(,) __VA_ARGS__)
+#define ESP_LOGW(tag,format,...) fprintf(stderr,"W (%s) " format "\n",tag __VA_OPT__(,) __VA_ARGS__)
+#define ESP_LOGI(tag,format,...) do{}while(0)
+#define ESP_LOGD(tag,format,...) do{}while(0)
+#define ESP_LOGV(tag,format,...) do{}while(0)
+#define log_e(format,...) ESP_LOGE("log",format __VA_OPT__(,) __VA_ARGS__)
+#define log_w(format,...) ESP_LOGW("log",format __VA_OPT__(,) __VA_ARGS__)
+#define log_i(format,...) do{}while(0)
+#define log_d(format,...) do{}while(0)
+#define log_v(format,...) do{}while(0)
+
+/////////////////////////////////////////////////
+// Timer, reset, and heap
+
+int64_t esp_timer_get_time();
+
+typedef enum {ESP_RST_UNKNOWN, ESP_RST_POWERON, ESP_RST_EXT, ESP_RST_SW, ESP_RST_PANIC, ESP_RST_INT_WDT, ESP_RST_TASK_WDT, ESP_RST_WDT,
+              ESP_RST_DEEPSLEEP, ESP_RST_BROWNOUT, ESP_RST_SDIO, ESP_RST_USB, ESP_RST_JTAG, ESP_RST_EFUSE, ESP_RST_PWR_GLITCH, ESP_RST_CPU_LOCKUP} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason();
+void esp_restart() __attribute__((noreturn));
+
+#define MALLOC_CAP_EXEC       (1<<0)
+#define MALLOC_CAP_32BIT      (1<<1)
+#define MALLOC_CAP_8BIT       (1<<2)
+#define MALLOC_CAP_DMA        (1<<3)
+#define MALLOC_CAP_SPIRAM     (1<<10)
+#define MALLOC_CAP_INTERNAL   (1<<11)
+#define MALLOC_CAP_DEFAULT    (1<<12)
+
+typedef struct {
+  size_t total_free_bytes;
+  size_t total_allocated_bytes;
+  size_t largest_free_block;
+  size_t minimum_free_bytes;
+  size_t allocated_blocks;
+  size_t free_blocks;
+  size_t total_blocks;
+} multi_heap_info_t;
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps);
+
+/////////////////////////////////////////////////
+// FreeRTOS (tasks run as detached std::threads; queues are mutex-protected ring buffers)
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdFAIL              0
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+#define tskNO_AFFINITY      0x7FFFFFFF
+#define configMAX_PRIORITIES 25
+
+struct HostTask;
+struct HostQueue;
+typedef HostTask *TaskHandle_t;
+typedef HostQueue *QueueHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackSize, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xTaskGetCoreID(TaskHandle_t task);
+BaseType_t xPortGetCoreID();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+char *pcTaskGetName(TaskHandle_t task);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+
+/////////////////////////////////////////////////
+// GPIO
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC                   -1
+#define GPIO_IS_VALID_GPIO(pin)       ((pin)>=0 && (pin)<40)
+#define GPIO_IS_VALID_OUTPUT_GPIO(pin) ((pin)>=0 && (pin)<34)
+
+typedef enum {GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE} gpio_pullup_t;
+typedef enum {GPIO_PULLDOWN_DISABLE, GPIO_PULLDOWN_ENABLE} gpio_pulldown_t;
+typedef enum {GPIO_MODE_DISABLE=0, GPIO_MODE_INPUT=1, GPIO_MODE_OUTPUT=2} gpio_mode_t;
+typedef enum {GPIO_INTR_DISABLE} gpio_int_type_t;
+
+typedef struct {
+  uint64_t pin_bit_mask;
+  gpio_mode_t mode;
+  gpio_pullup_t pull_up_en;
+  gpio_pulldown_t pull_down_en;
+  gpio_int_type_t intr_type;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *config);
@@ -0,0 +1,190 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Thin stand-ins for the Arduino-ESP32 networking classes.  The radio is never started, and NetworkClient/NetworkServer are in-memory
+// loopback connections: a test opens a connection with Host::connect() and HomeSpan accepts it on its next poll, exactly as for a TCP client.
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+/////////////////////////////////////////////////
+// Loopback connections
+
+struct HostSocket;
+
+class NetworkClient : public Stream {
+
+  std::shared_ptr<HostSocket> sock;
+  int side=0;                             // which end of the connection this client is (0=accessory, 1=controller)
+
+  public:
+
+  NetworkClient(){}
+  NetworkClient(int fd){}                 // allows "client=0" to close out a client, as with the Arduino-ESP32 core
+  NetworkClient(std::shared_ptr<HostSocket> s, int side) : sock(s), side(side){}
+
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t n);
+  size_t write(uint8_t c) override {return(write(&c,1));}
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  uint8_t connected();
+  void stop();
+  int fd() const;
+  IPAddress remoteIP() const;
+  void setNoDelay(bool){}
+  operator bool() const {return(sock!=nullptr);}
+};
+
+class NetworkServer {
+
+  uint16_t port;
+
+  public:
+
+  NetworkServer(uint16_t port=80) : port(port){}
+  void begin(){}
+  void end(){}
+  bool hasClient();
+  NetworkClient accept();
+  NetworkClient available(){return(accept());}
+};
+
+/////////////////////////////////////////////////
+// Network events
+
+typedef enum {
+  ARDUINO_EVENT_NONE, ARDUINO_EVENT_ETH_START, ARDUINO_EVENT_ETH_CONNECTED, ARDUINO_EVENT_ETH_DISCONNECTED, ARDUINO_EVENT_ETH_GOT_IP, ARDUINO_EVENT_ETH_GOT_IP6,
+  ARDUINO_EVENT_WIFI_SCAN_DONE, ARDUINO_EVENT_WIFI_STA_CONNECTED, ARDUINO_EVENT_WIFI_STA_DISCONNECTED, ARDUINO_EVENT_WIFI_STA_GOT_IP, ARDUINO_EVENT_WIFI_STA_GOT_IP6,
+  ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef struct {uint32_t addr[4]; uint8_t zone;} esp_ip6_addr_t;
+typedef enum {ESP_IP6_ADDR_IS_UNKNOWN, ESP_IP6_ADDR_IS_GLOBAL, ESP_IP6_ADDR_IS_LINK_LOCAL, ESP_IP6_ADDR_IS_SITE_LOCAL, ESP_IP6_ADDR_IS_UNIQUE_LOCAL} esp_ip6_addr_type_t;
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef union {
+  struct {struct {esp_ip6_addr_t ip;} ip6_info;} got_ip6;
+} arduino_event_info_t;
+
+typedef struct {
+  arduino_event_id_t event_id;
+  arduino_event_info_t event_info;
+} arduino_event_t;
+
+int esp_netif_get_all_ip6(esp_netif_t *netif, esp_ip6_addr_t *ip6);
+esp_ip6_addr_type_t esp_netif_ip6_get_addr_type(esp_ip6_addr_t *ip6);
+
+class NetworkInterface {
+
+  public:
+
+  esp_netif_t *netif(){return(NULL);}
+  IPAddress localIP(){return(IPAddress());}
+  IPAddress gatewayIP(){return(IPAddress());}
+  String macAddress(){return("00:00:00:00:00:00");}
+};
+
+class NetworkManager {
+
+  public:
+
+  void onEvent(void (*cb)(arduino_event_t *), arduino_event_id_t event=ARDUINO_EVENT_MAX){}
+  void onEvent(void (*cb)(arduino_event_id_t), arduino_event_id_t event=ARDUINO_EVENT_MAX){}
+  String macAddress(){return("00:00:00:00:00:00");}
+  const char *eventName(arduino_event_id_t){return("");}
+};
+
+extern NetworkManager Network;
+
+/////////////////////////////////////////////////
+// WiFi
+
+typedef enum {WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA} wifi_mode_t;
+typedef enum {WIFI_IF_STA, WIFI_IF_AP} wifi_interface_t;
+typedef enum {WIFI_FAST_SCAN, WIFI_ALL_CHANNEL_SCAN} wifi_scan_method_t;
+typedef enum {WIFI_CONNECT_AP_BY_SIGNAL, WIFI_CONNECT_AP_BY_SECURITY} wifi_sort_method_t;
+typedef enum {WIFI_SECOND_CHAN_NONE, WIFI_SECOND_CHAN_ABOVE, WIFI_SECOND_CHAN_BELOW} wifi_second_chan_t;
+typedef enum {WIFI_AUTH_OPEN, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK, WIFI_AUTH_WPA2_ENTERPRISE,
+              WIFI_AUTH_WPA3_PSK, WIFI_AUTH_WPA2_WPA3_PSK, WIFI_AUTH_WAPI_PSK} wifi_auth_mode_t;
+typedef enum {WL_IDLE_STATUS=0, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_DISCONNECTED} wl_status_t;
+
+typedef union {
+  struct {uint8_t ssid[32]; uint8_t password[64]; uint8_t ssid_hidden;} ap;
+  struct {uint8_t ssid[32]; uint8_t password[64];} sta;
+} wifi_config_t;
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+
+class STAClass : public NetworkInterface {};
+
+class WiFiSTAClass {
+
+  public:
+
+  STAClass STA;
+
+  IPAddress localIP(){return(STA.localIP());}
+  IPAddress gatewayIP(){return(STA.gatewayIP());}
+  String macAddress(){return(STA.macAddress());}
+};
+
+class WiFiClass : public WiFiSTAClass {
+
+  wifi_mode_t wifiMode=WIFI_OFF;
+
+  public:
+
+  bool mode(wifi_mode_t m){wifiMode=m;return(true);}
+  wifi_mode_t getMode(){return(wifiMode);}
+  bool setAutoReconnect(bool){return(true);}
+  void persistent(bool){}
+  void setScanMethod(wifi_scan_method_t){}
+  void setSortMethod(wifi_sort_method_t){}
+  wl_status_t begin(const char *ssid, const char *pwd=NULL){return(WL_DISCONNECTED);}
+  bool disconnect(bool wifiOff=false){return(true);}
+  wl_status_t status(){return(WL_DISCONNECTED);}
+  int16_t scanNetworks(bool async=false, bool hidden=false, bool passive=false, uint32_t msPerChannel=300, uint8_t channel=0, const char *ssid=NULL, const uint8_t *bssid=NULL){return(0);}
+  int16_t scanComplete(){return(0);}
+  void scanDelete(){}
+  String SSID(uint8_t i=0){return("");}
+  String BSSIDstr(int i=-1){return("00:00:00:00:00:00");}
+  int32_t RSSI(int i=-1){return(0);}
+  wifi_auth_mode_t encryptionType(uint8_t i){return(WIFI_AUTH_OPEN);}
+  int getBand(){return(1);}
+  bool softAP(const char *ssid, const char *pwd=NULL){return(true);}
+  bool softAPdisconnect(bool wifiOff=false){return(true);}
+  String softAPmacAddress(){return("00:00:00:00:00:00");}
+};
+
+extern WiFiClass WiFi;
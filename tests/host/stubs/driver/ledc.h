@@ -0,0 +1,53 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// LEDC is a no-op on the host (PwmPin is built only because Pixel and Dot use LedPin::HSVtoRGB)
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum {LEDC_LOW_SPEED_MODE, LEDC_SPEED_MODE_MAX} ledc_mode_t;
+typedef enum {LEDC_CHANNEL_0, LEDC_CHANNEL_MAX=8} ledc_channel_t;
+typedef enum {LEDC_TIMER_0, LEDC_TIMER_MAX=4} ledc_timer_t;
+typedef enum {LEDC_TIMER_1_BIT=1, LEDC_TIMER_BIT_MAX=21} ledc_timer_bit_t;
+typedef enum {LEDC_AUTO_CLK, LEDC_USE_APB_CLK} ledc_clk_cfg_t;
+typedef enum {LEDC_INTR_DISABLE, LEDC_INTR_FADE_END} ledc_intr_type_t;
+typedef enum {LEDC_FADE_NO_WAIT, LEDC_FADE_WAIT_DONE} ledc_fade_mode_t;
+
+typedef struct {int gpio_num; ledc_mode_t speed_mode; ledc_channel_t channel; ledc_intr_type_t intr_type; ledc_timer_t timer_sel; uint32_t duty; int hpoint; struct {unsigned int output_invert: 1;} flags;} ledc_channel_config_t;
+typedef struct {ledc_mode_t speed_mode; ledc_timer_bit_t duty_resolution; ledc_timer_t timer_num; uint32_t freq_hz; ledc_clk_cfg_t clk_cfg; bool deconfigure;} ledc_timer_config_t;
+typedef struct {int event; uint32_t speed_mode; uint32_t channel; uint32_t duty;} ledc_cb_param_t;
+typedef bool (*ledc_cb_t)(const ledc_cb_param_t *param, void *arg);
+typedef struct {ledc_cb_t fade_cb;} ledc_cbs_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config);
+esp_err_t ledc_fade_func_install(int intr_alloc_flags);
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg);
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode);
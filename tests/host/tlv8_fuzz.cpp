@@ -0,0 +1,321 @@
+/*********************************************************************************
+ *  MIT License
+ *
+ *  Copyright (c) 2020-2024 Gregg E. Berman
+ *
+ *  https://github.com/HomeSpan/HomeSpan
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ ********************************************************************************/
+
+// Differential fuzz test and benchmark of TLV8 unpacking
+//
+//   tlv8_fuzz [iterations] [seed]      runs the differential test on randomly generated (and randomly damaged) TLV8 buffers (default=20000, 1)
+//   tlv8_fuzz --bench [iterations]     times unpack(), unpackView(), and incremental unpacking of typical pair-setup and pair-verify messages
+//
+// Each buffer is unpacked four ways: unpack() and unpackView() on the whole buffer (the single-pass unpackAll() paths), the incremental
+// unpacker fed one byte at a time, and the incremental unpacker fed random-sized chunks.  All four must produce the same records and the same
+// return value, the records must match an independent reference parser, and re-packing the result must reproduce the canonical encoding.
+//
+// Building with -DTLV8_LIBFUZZER (and Clang's -fsanitize=fuzzer) instead provides LLVMFuzzerTestOneInput() for coverage-guided fuzzing.
+
+#include <TLV8.h>
+#include <HAPConstants.h>
+#include <HostStubs.h>
+
+#include <vector>
+#include <random>
+
+typedef std::vector<std::pair<uint8_t,std::vector<uint8_t>>> records_t;
+
+//////////////////////////////////////
+
+static void fail(const char *what, const std::vector<uint8_t> &buf){
+
+  fprintf(stderr,"FAILED: %s\nInput (%zu bytes):",what,buf.size());
+  for(size_t i=0;i<buf.size();i++)
+    fprintf(stderr,"%s%02X",i%32?" ":"\n  ",buf[i]);
+  fprintf(stderr,"\n");
+  abort();
+}
+
+//////////////////////////////////////
+
+static int reference(const std::vector<uint8_t> &buf, records_t &rec){
+
+  // independent parser: consecutive records with the same tag are coalesced, and an incomplete final record is kept as far as it was received
+  // returns 0 if buf ends on a record boundary, else the incremental unpacker's phase (1=waiting for length, 2=waiting for value bytes)
+
+  rec.clear();
+  size_t i=0;
+
+  while(i<buf.size()){
+    uint8_t tag=buf[i++];
+    if(rec.empty() || rec.back().first!=tag)
+      rec.push_back({tag,{}});
+    if(i==buf.size())
+      return(1);
+    size_t len=buf[i++];
+    size_t n=std::min(len,buf.size()-i);
+    rec.back().second.insert(rec.back().second.end(),buf.begin()+i,buf.begin()+i+n);
+    i+=n;
+    if(n<len)
+      return(2);
+  }
+
+  return(0);
+}
+
+//////////////////////////////////////
+
+static void compare(const TLV8 &tlv, const records_t &rec, const char *path, const std::vector<uint8_t> &buf){
+
+  char msg[128];
+
+  if(tlv.size()!=rec.size()){
+    snprintf(msg,sizeof(msg),"%s: %zu records, expected %zu",path,tlv.size(),rec.size());
+    fail(msg,buf);
+  }
+
+  auto it=tlv.begin();
+  for(size_t i=0;i<rec.size();i++,it++){
+    if(it->getTag()!=rec[i].first || it->getLen()!=rec[i].second.size() || (it->getLen() && memcmp(it->get(),rec[i].second.data(),it->getLen()))){
+      snprintf(msg,sizeof(msg),"%s: record %zu (tag=%d, len=%zu) does not match expected (tag=%d, len=%zu)",path,i,it->getTag(),it->getLen(),rec[i].first,rec[i].second.size());
+      fail(msg,buf);
+    }
+  }
+}
+
+//////////////////////////////////////
+
+static std::vector<uint8_t> canonical(const records_t &rec){
+
+  std::vector<uint8_t> out;                                        // records longer than 255 bytes are split into 255-byte fragments
+  for(auto const &r : rec){
+    size_t len=r.second.size(), off=0;
+    do {
+      size_t n=std::min<size_t>(len-off,255);
+      out.push_back(r.first);
+      out.push_back(n);
+      out.insert(out.end(),r.second.begin()+off,r.second.begin()+off+n);
+      off+=n;
+    } while(off<len);
+  }
+  return(out);
+}
+
+//////////////////////////////////////
+
+static void checkInput(const uint8_t *data, size_t size, uint32_t chunkSeed){
+
+  std::vector<uint8_t> buf(data,data+size);
+  records_t rec;
+  int expected=size?reference(buf,rec):-1;
+
+  std::vector<uint8_t> work=buf;                                   // unpack() must not modify its input
+  TLV8 tlvA;
+  int rA=tlvA.unpack(work.data(),work.size());
+  if(work!=buf)
+    fail("unpack() modified its input",buf);
+
+  std::vector<uint8_t> viewBuf=buf;                                // unpackView() records may point into viewBuf, which outlives tlvB
+  TLV8 tlvB;
+  int rB=tlvB.unpackView(viewBuf.data(),viewBuf.size());
+
+  TLV8 tlvC;                                                       // incremental, one byte at a time (the first byte alone is never a complete record)
+  int rC=-1;
+  for(size_t i=0;i<size;i++)
+    rC=tlvC.unpack(work.data()+i,1);
+
+  TLV8 tlvD;                                                       // incremental, random chunks
+  std::mt19937 rng(chunkSeed);
+  int rD=-1;
+  for(size_t i=0;i<size;){
+    size_t n=1+rng()%std::min<size_t>(size-i,300);
+    rD=tlvD.unpack(work.data()+i,n);
+    i+=n;
+  }
+
+  char msg[128];
+  if(rA!=expected || rB!=expected || rC!=expected || rD!=expected){
+    snprintf(msg,sizeof(msg),"return values unpack=%d unpackView=%d bytewise=%d chunked=%d, expected %d",rA,rB,rC,rD,expected);
+    fail(msg,buf);
+  }
+
+  compare(tlvA,rec,"unpack()",buf);
+  compare(tlvB,rec,"unpackView()",buf);
+  compare(tlvC,rec,"bytewise unpack()",buf);
+  compare(tlvD,rec,"chunked unpack()",buf);
+
+  TLV8 tlvE(std::move(tlvA));                                      // moved records (including arena views) must survive the move
+  compare(tlvE,rec,"moved unpack()",buf);
+
+  if(expected==0){                                                 // complete input must re-pack to its canonical encoding
+    std::vector<uint8_t> packed(tlvE.pack_size());
+    tlvE.pack(packed.data());
+    if(packed!=canonical(rec))
+      fail("re-packed records do not match canonical encoding",buf);
+
+    std::vector<uint8_t> viewPacked(tlvB.pack_size());
+    tlvB.pack(viewPacked.data());
+    if(viewPacked!=packed)
+      fail("re-packed unpackView() records do not match unpack()",buf);
+  }
+}
+
+//////////////////////////////////////
+
+#ifdef TLV8_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+  checkInput(data,size,size);
+  return(0);
+}
+
+#else
+
+static std::vector<uint8_t> generate(std::mt19937 &rng){
+
+  static const uint8_t tags[]={kTLVType_State,kTLVType_PublicKey,kTLVType_EncryptedData,kTLVType_Signature,kTLVType_Separator};
+
+  std::vector<uint8_t> buf;
+  int nRecords=rng()%8;
+
+  for(int r=0;r<nRecords;r++){
+    uint8_t tag=rng()%4 ? tags[rng()%5] : rng()%256;               // mostly a small set of tags, so adjacent records often share a tag
+
+    size_t len;
+    switch(rng()%6){
+      case 0: len=0; break;
+      case 1: len=255; break;
+      case 2: len=255*(1+rng()%3)+rng()%3; break;                  // just over a fragment boundary
+      case 3: len=256+rng()%1000; break;
+      default: len=rng()%64; break;
+    }
+
+    size_t off=0;
+    do {                                                           // encode as a series of fragments, which are usually (but not always) 255 bytes
+      size_t n=std::min<size_t>(len-off,rng()%8?255:rng()%256);
+      buf.push_back(tag);
+      buf.push_back(n);
+      for(size_t i=0;i<n;i++)
+        buf.push_back(rng());
+      off+=n;
+    } while(off<len);
+  }
+
+  switch(rng()%8){                                                 // damage some buffers
+    case 0:
+      if(!buf.empty())
+        buf.resize(rng()%buf.size());                              // truncate
+      break;
+    case 1:
+      if(buf.size()>1)
+        buf[1+rng()%(buf.size()-1)]=rng();                          // corrupt a (probable) length byte
+      break;
+    case 2:
+      buf.resize(rng()%64);                                        // random garbage
+      for(auto &b : buf)
+        b=rng();
+      break;
+  }
+
+  return(buf);
+}
+
+//////////////////////////////////////
+
+static void bench(int iterations){
+
+  std::vector<uint8_t> pk(384), proof(64), curve(32), enc(154);
+  for(size_t i=0;i<pk.size();i++) pk[i]=i*7;
+
+  struct Msg {const char *name; std::vector<uint8_t> buf;};
+  std::vector<Msg> msgs(3);
+
+  TLV8 t;                                                          // pair-setup M3: State, PublicKey (384 bytes, so fragmented), Proof
+  t.add(kTLVType_State,3);
+  t.add(kTLVType_PublicKey,pk.size(),pk.data());
+  t.add(kTLVType_Proof,proof.size(),proof.data());
+  msgs[0]={"pair-setup M3",std::vector<uint8_t>(t.pack_size())};
+  t.pack(msgs[0].buf.data());
+
+  t.wipe();                                                        // pair-verify M1: State, PublicKey (32 bytes)
+  t.add(kTLVType_State,1);
+  t.add(kTLVType_PublicKey,curve.size(),curve.data());
+  msgs[1]={"pair-verify M1",std::vector<uint8_t>(t.pack_size())};
+  t.pack(msgs[1].buf.data());
+
+  t.wipe();                                                        // pair-verify M3: State, EncryptedData
+  t.add(kTLVType_State,3);
+  t.add(kTLVType_EncryptedData,enc.size(),enc.data());
+  msgs[2]={"pair-verify M3",std::vector<uint8_t>(t.pack_size())};
+  t.pack(msgs[2].buf.data());
+
+  printf("\n%-16s %6s  %-22s %10s %10s\n","Message","Bytes","Method","nsec/op","allocs/op");
+
+  for(auto &m : msgs){
+    for(int method=0;method<3;method++){
+      uint64_t a0=Host::allocCount();
+      int64_t t0=esp_timer_get_time();
+      for(int i=0;i<iterations;i++){
+        TLV8 tlv;
+        if(method==0)
+          tlv.unpack(m.buf.data(),m.buf.size());
+        else if(method==1)
+          tlv.unpackView(m.buf.data(),m.buf.size());
+        else {
+          tlv.unpack(m.buf.data(),1);                              // a first chunk that is not a complete record forces the incremental path
+          tlv.unpack(m.buf.data()+1,m.buf.size()-1);
+        }
+      }
+      int64_t dt=esp_timer_get_time()-t0;
+      const char *names[]={"unpack()","unpackView()","incremental unpack()"};
+      printf("%-16s %6zu  %-22s %10.0f %10.1f\n",m.name,m.buf.size(),names[method],dt*1000.0/iterations,(double)(Host::allocCount()-a0)/iterations);
+    }
+  }
+  printf("\n");
+}
+
+//////////////////////////////////////
+
+int main(int argc, char *argv[]){
+
+  if(argc>1 && !strcmp(argv[1],"--bench")){
+    bench(argc>2?atoi(argv[2]):100000);
+    return(0);
+  }
+
+  int iterations=argc>1?atoi(argv[1]):20000;
+  uint32_t seed=argc>2?atoi(argv[2]):1;
+  std::mt19937 rng(seed);
+
+  size_t totalBytes=0;
+  for(int i=0;i<iterations;i++){
+    std::vector<uint8_t> buf=generate(rng);
+    totalBytes+=buf.size();
+    checkInput(buf.data(),buf.size(),rng());
+  }
+
+  printf("%d buffers (%zu bytes) unpacked identically by unpack(), unpackView(), and incremental unpack()\n",iterations,totalBytes);
+  return(0);
+}
+
+#endif